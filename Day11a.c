@@ -23,42 +23,151 @@
 //microchips. Which pair or which microchips doesn't matter -- there's no
 //difference between them! Dealing with two choices is much easier than dealing
 //with six.
+//
+//We'll search for the answer with a breadth-first search, like the maze on Day
+//13. Each "room" is a state of the facility (where the elevator and every
+//component are), and each step is one elevator trip. The key to making this
+//fast is that the pairs are interchangeable: a state with the strontium pair on
+//floor 1 and the plutonium pair on floor 2 is no different from the other way
+//around. If we always list the pairs in sorted order, those states become the
+//same state, and the search only has to look at one of them.
 
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
 
 
-//Instead of mucking about with text parsing, let's enter the input state
-//manually so we can concentrate on the task at hand. My input has fives types
-//of power -- strontium (S), plutonium (P), thulium (T), ruthenium (R), and
-//curium (C). There's also the elevator (E), which starts on floor 1. The
-//starting location of each generator and microchip is:
+//My input has five types of power -- strontium (S), plutonium (P), thulium (T),
+//ruthenium (R), and curium (C). There's also the elevator (E), which starts on
+//floor 1. The starting location of each generator and microchip is:
 //
 //               
 //    Floor 4    .   .   .   .   .   .   .   .   .   .   . 
 //    Floor 3    .   .   .   .   .   .   TM  .   .   .   .
 //    Floor 2    .   .   .   .   .   TG  .   RG  RM  CG  CM
 //    Floor 1    E   SG  SM  PG  PM  .   .   .   .   .   .
+//
+//I was going to enter this by hand, but reading the input file isn't much work,
+//and it lets us try other layouts. All we care about for each type of power is
+//which floor its microchip is on and which floor its generator is on.
+#define LINE_LENGTH  512
+#define NAME_LENGTH  32
+#define NUM_FLOORS   4
+#define MAX_PAIRS    15
+#define MAX_MOVES    1024
+#define EMPTY_KEY    UINT64_MAX
+
+typedef struct
+{
+	int elevator;
+	int numPairs;
+	int chip[MAX_PAIRS];
+	int generator[MAX_PAIRS];
+} sState;
+
+//A set of states we've already visited, stored in a hash table. Each slot holds
+//a packed state (see Pack_State()), or EMPTY_KEY if it's unused.
+typedef struct
+{
+	uint64_t *keys;
+	size_t numKeys, capacity;
+} sStateSet;
+
+//The threaded search shares its visited set between threads. Rather than one
+//lock for the whole set, which would keep the threads waiting on each other,
+//we split it into shards, each with its own lock. A state's hash picks its
+//shard, so two threads only wait for each other if they happen to add states
+//to the same shard at the same time.
+#define SHARD_BITS  6
+#define NUM_SHARDS  (1 << SHARD_BITS)
+
+typedef struct
+{
+	sStateSet shards[NUM_SHARDS];
+	pthread_mutex_t locks[NUM_SHARDS];
+} sSharedStateSet;
+
+//One direction of the threaded search: the states it has visited, and the
+//ones that are exactly depth steps away
+typedef struct
+{
+	sSharedStateSet visited;
+	uint64_t *frontier;
+	size_t numFrontier;
+	int depth;
+} sSearchSide;
+
+//Don't bother with threads for small frontiers
+#define MIN_THREADED_FRONTIER  1024
+
+//Arguments for one search thread. Each thread collects the new states it finds
+//in its own list, so the threads don't have to share the next frontier.
+typedef struct
+{
+	sSearchSide *side;
+	const sSearchSide *other;
+	int numPairs, numThreads, thread;
+	uint64_t *found;
+	size_t numFound, capacity;
+	bool met;
+} sSearchWorker;
+
 
+bool Read_Facility(FILE *inFile, sState *start);
+uint64_t Pack_State(const sState *state);
+void Unpack_State(uint64_t key, int numPairs, sState *state);
+bool Is_Safe(const sState *state);
+int Expand_State(uint64_t key, int numPairs, uint64_t *moves);
+int Find_Fewest_Steps(const sState *start);
+int Find_Fewest_Steps_Threaded(const sState *start, bool bidirectional);
+void Init_State_Set(sStateSet *set);
+bool Add_To_State_Set(sStateSet *set, uint64_t key);
+bool Is_In_State_Set(const sStateSet *set, uint64_t key);
+void Delete_State_Set(sStateSet *set);
+void Init_Shared_State_Set(sSharedStateSet *set);
+bool Add_To_Shared_State_Set(sSharedStateSet *set, uint64_t key);
+bool Is_In_Shared_State_Set(const sSharedStateSet *set, uint64_t key);
+void Delete_Shared_State_Set(sSharedStateSet *set);
+void *Safe_Malloc(size_t size);
 
 
+//The helper functions are:
+//
+//    Read_Facility()      Parse the input file
+//    Pack_State()         Squeeze a state into a single 64-bit number
+//    Unpack_State()       Undo Pack_State()
+//    Is_Safe()            Check that no microchips get fried
+//    Expand_State()       Find every state one elevator trip away
+//    Find_Fewest_Steps()  Breadth-first search to the top floor
+//    Find_Fewest_Steps_Threaded()  The same search spread across several
+//                                  threads, optionally from both ends
 int main(int argc, char **argv)
 {
-	//When allocating space for strings, always leave room for the terminating
-	//null character!
-	char line[LINE_LENGTH+1];
-	char *next;
 	FILE *inFile;
-	long s1, s2, s3;
-	int numTriangles = 0;
+	sState start;
+	const char *method;
+	int steps;
 	
-	//The usual command line argument check and input file opening
-	if (argc != 2)
+	//The usual command line argument check and input file opening. There's
+	//also an optional argument to pick the search method (see below), which is
+	//handy for checking the methods against each other.
+	if (argc != 2 && argc != 3)
 	{
-		fprintf(stderr, "Usage:\n\tDay11 <input filename>\n\n");
+		fprintf(stderr, "Usage:\n\tDay11 <input filename> "
+		                               "[serial|parallel|bidirectional]\n\n");
+		return EXIT_FAILURE;
+	}
+	method = (argc == 3) ? argv[2] : "bidirectional";
+	if (strcmp(method, "serial") != 0 && strcmp(method, "parallel") != 0 &&
+	                                      strcmp(method, "bidirectional") != 0)
+	{
+		fprintf(stderr, "Unknown search method: %s\n\n", method);
 		return EXIT_FAILURE;
 	}
 
@@ -68,43 +177,677 @@ int main(int argc, char **argv)
 		fprintf(stderr, "Error opening file: %s\n\n", strerror(errno));
 		return EXIT_FAILURE;
 	}
+	
+	//Read the starting layout, and close the file as soon as we're done with it
+	if (!Read_Facility(inFile, &start))
+	{
+		fclose(inFile);
+		return EXIT_FAILURE;
+	}
+	fclose(inFile);
+	
+	//Search for the answer. The serial search is the simplest. The parallel
+	//search splits each step of the search between threads. The bidirectional
+	//search does the same, but also searches backward from the top floor, and
+	//stops when the two searches meet in the middle.
+	if (strcmp(method, "serial") == 0)
+		steps = Find_Fewest_Steps(&start);
+	else
+		steps = Find_Fewest_Steps_Threaded(&start,
+		                            strcmp(method, "bidirectional") == 0);
+	if (steps < 0)
+		printf("There's no way to get everything to the top floor\n");
+	else
+		printf("Minimum number of steps: %d\n", steps);
+	
+	return EXIT_SUCCESS;
+}
 
-	//Read the file one line at a time. fgets() automatically stops after a
-	//newline, but we won't rely on that behavior here. Note that the length
-	//passed to fgets() includes the terminating null character.
+
+//Read the facility layout. Each line is one floor, starting with the first. We
+//split the line into words, and any word that starts with "generator" or
+//"microchip" tells us about the word before it: "strontium generator" or
+//"strontium-compatible microchip". Types of power are numbered in the order we
+//first see them.
+bool Read_Facility(FILE *inFile, sState *start)
+{
+	char line[LINE_LENGTH+1];
+	char names[MAX_PAIRS][NAME_LENGTH+1];
+	bool hasChip[MAX_PAIRS], hasGenerator[MAX_PAIRS];
+	char *word, *previous, *dash;
+	int floor, p;
+	
+	start->elevator = 0;
+	start->numPairs = 0;
+	floor = 0;
 	while (fgets(line, LINE_LENGTH+1, inFile) != NULL)
 	{
-		//We could use strtok() and atoi() like on Day 1, but since we're only
-		//dealing with numbers we can use strtol() instead. strtol() takes in a
-		//pointer to a string, a reference to a pointer, and a number base.
-		//Unlike in C++, there's no special syntax for refernces -- we just
-		//pass in a pointer to a variable. In this case, that's a pointer to
-		//a pointer. strtol() returns the converted number and modifies the
-		//referenced pointer to point to the remaining part of the string. The
-		//string is not modified. To get the next number, we pass in the
-		//modified pointer. strtol() returns 0 on failure. If 0 were a valid
-		//value, we could check errno instead.
-		s1 = strtol(line, &next, 10);
-		s2 = strtol(next, &next, 10);
-		s3 = strtol(next, &next, 10);
-		if (s1 == 0 || s2 == 0 || s3 == 0)
+		if (floor >= NUM_FLOORS)
 		{
-			fprintf(stderr, "Error parsing numbers: %s\n\n", strerror(errno));
-			fprintf(stderr, "Line: %s\n", line);
-			fclose(inFile);
-			return EXIT_FAILURE;
+			fprintf(stderr, "Error: Too many floors!\n");
+			return false;
 		}
 		
-		//Check for a possible triangle and increment the count if necessary
-		if (s1 + s2 > s3 && s2 + s3 > s1 && s3 + s1 > s2)
-			numTriangles++;
+		previous = NULL;
+		for (word = strtok(line, " ,.\n"); word != NULL;
+		                                         word = strtok(NULL, " ,.\n"))
+		{
+			if (previous != NULL && (strncmp(word, "generator", 9) == 0 ||
+			                         strncmp(word, "microchip", 9) == 0))
+			{
+				//Chop off the "-compatible"
+				dash = strchr(previous, '-');
+				if (dash != NULL)
+					*dash = '\0';
+				
+				//Look up the name, adding it if it's new
+				for (p = 0; p < start->numPairs; p++)
+				{
+					if (strcmp(names[p], previous) == 0)
+						break;
+				}
+				if (p == start->numPairs)
+				{
+					if (p == MAX_PAIRS)
+					{
+						fprintf(stderr, "Error: Too many types of power (max "
+						                                "%d)!\n", MAX_PAIRS);
+						return false;
+					}
+					strncpy(names[p], previous, NAME_LENGTH);
+					names[p][NAME_LENGTH] = '\0';
+					hasChip[p] = hasGenerator[p] = false;
+					start->numPairs++;
+				}
+				
+				if (word[0] == 'g')
+				{
+					start->generator[p] = floor;
+					hasGenerator[p] = true;
+				} else
+				{
+					start->chip[p] = floor;
+					hasChip[p] = true;
+				}
+			}
+			previous = word;
+		}
+		floor++;
 	}
 	
-	//Close the file as soon as we're done with it
-	fclose(inFile);
+	//Every microchip needs a generator and vice versa
+	for (p = 0; p < start->numPairs; p++)
+	{
+		if (!hasChip[p] || !hasGenerator[p])
+		{
+			fprintf(stderr, "Error: Missing microchip or generator for %s!\n",
+			                                                        names[p]);
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+
+//Pack a state into a 64-bit number. Each pair takes 4 bits: 2 for the floor
+//of the microchip and 2 for the floor of the generator. The elevator goes in
+//the top bits. Before packing, we sort the pairs, so that states that only
+//differ by which pair is which pack to the same number. There are only 16
+//kinds of pair, so rather than a general sort, we count how many of each
+//kind there are and write them out in order.
+uint64_t Pack_State(const sState *state)
+{
+	int count[NUM_FLOORS * NUM_FLOORS] = {0};
+	uint64_t key;
+	int p, kind, shift;
 	
-	//Print the number of triangles
-	printf("Number of possible triangles: %d\n", numTriangles);
+	for (p = 0; p < state->numPairs; p++)
+	{
+		count[state->chip[p] * NUM_FLOORS + state->generator[p]]++;
+	}
 	
-	return EXIT_SUCCESS;
+	key = (uint64_t)state->elevator << 60;
+	shift = 0;
+	for (kind = 0; kind < NUM_FLOORS * NUM_FLOORS; kind++)
+	{
+		for (p = 0; p < count[kind]; p++)
+		{
+			key |= (uint64_t)kind << shift;
+			shift += 4;
+		}
+	}
+	
+	return key;
+}
+
+
+//Unpack a state packed by Pack_State()
+void Unpack_State(uint64_t key, int numPairs, sState *state)
+{
+	int p, kind;
+	
+	state->elevator = key >> 60;
+	state->numPairs = numPairs;
+	for (p = 0; p < numPairs; p++)
+	{
+		kind = (key >> (4 * p)) & 0xF;
+		state->chip[p] = kind / NUM_FLOORS;
+		state->generator[p] = kind % NUM_FLOORS;
+	}
+}
+
+
+//A microchip gets fried if it's on a floor with any generator, unless its own
+//generator is there to protect it. We mark the floors that have generators
+//as bits in a number, then check each unprotected microchip.
+bool Is_Safe(const sState *state)
+{
+	int p, generatorFloors;
+	
+	generatorFloors = 0;
+	for (p = 0; p < state->numPairs; p++)
+	{
+		generatorFloors |= 1 << state->generator[p];
+	}
+	
+	for (p = 0; p < state->numPairs; p++)
+	{
+		if (state->chip[p] != state->generator[p] &&
+		                            (generatorFloors & (1 << state->chip[p])))
+			return false;
+	}
+	
+	return true;
+}
+
+
+//Find every safe state one elevator trip away. The elevator takes one or two
+//of the components on its floor up or down a floor. We number the components
+//so that component 2p is pair p's microchip and 2p+1 is its generator, which
+//lets us loop over the choices easily. Returns the number of states found.
+//Some of them will be repeats (that's what the visited set is for).
+int Expand_State(uint64_t key, int numPairs, uint64_t *moves)
+{
+	sState state, next;
+	int items[2 * MAX_PAIRS];
+	int numItems, numMoves, i, j, direction, floor;
+	
+	Unpack_State(key, numPairs, &state);
+	
+	//List the components on the elevator's floor
+	numItems = 0;
+	for (i = 0; i < numPairs; i++)
+	{
+		if (state.chip[i] == state.elevator)
+			items[numItems++] = 2 * i;
+		if (state.generator[i] == state.elevator)
+			items[numItems++] = 2 * i + 1;
+	}
+	
+	numMoves = 0;
+	for (direction = -1; direction <= 1; direction += 2)
+	{
+		floor = state.elevator + direction;
+		if (floor < 0 || floor >= NUM_FLOORS)
+			continue;
+		
+		//When j == i, the elevator only carries one component
+		for (i = 0; i < numItems; i++)
+		{
+			for (j = i; j < numItems; j++)
+			{
+				next = state;
+				next.elevator = floor;
+				if (items[i] % 2 == 0)
+					next.chip[items[i] / 2] = floor;
+				else
+					next.generator[items[i] / 2] = floor;
+				if (items[j] % 2 == 0)
+					next.chip[items[j] / 2] = floor;
+				else
+					next.generator[items[j] / 2] = floor;
+				
+				if (Is_Safe(&next))
+					moves[numMoves++] = Pack_State(&next);
+			}
+		}
+	}
+	
+	return numMoves;
+}
+
+
+//Breadth-first search from the starting state to the state with everything on
+//the top floor. Rather than a queue, we keep two lists: the states that are
+//a certain number of steps away (the frontier), and the ones a step further.
+//Once we've gone through the whole frontier, the next list becomes the new
+//frontier. Returns -1 if the top floor can't be reached.
+int Find_Fewest_Steps(const sState *start)
+{
+	sStateSet visited;
+	sState goal;
+	uint64_t *frontier, *next, *temp;
+	uint64_t moves[MAX_MOVES];
+	uint64_t goalKey;
+	size_t numFrontier, numNext, capacity, i;
+	int steps, numMoves, m, p;
+	
+	goal.elevator = NUM_FLOORS - 1;
+	goal.numPairs = start->numPairs;
+	for (p = 0; p < start->numPairs; p++)
+	{
+		goal.chip[p] = goal.generator[p] = NUM_FLOORS - 1;
+	}
+	goalKey = Pack_State(&goal);
+	
+	Init_State_Set(&visited);
+	capacity = 1024;
+	frontier = Safe_Malloc(capacity * sizeof(uint64_t));
+	next = Safe_Malloc(capacity * sizeof(uint64_t));
+	frontier[0] = Pack_State(start);
+	numFrontier = 1;
+	Add_To_State_Set(&visited, frontier[0]);
+	
+	for (steps = 0; numFrontier > 0; steps++)
+	{
+		numNext = 0;
+		for (i = 0; i < numFrontier; i++)
+		{
+			if (frontier[i] == goalKey)
+			{
+				free(frontier);
+				free(next);
+				Delete_State_Set(&visited);
+				return steps;
+			}
+			
+			numMoves = Expand_State(frontier[i], start->numPairs, moves);
+			for (m = 0; m < numMoves; m++)
+			{
+				if (!Add_To_State_Set(&visited, moves[m]))
+					continue;
+				
+				//Make both lists bigger if we run out of room. They swap
+				//places every step, so they need to stay the same size.
+				if (numNext == capacity)
+				{
+					capacity *= 2;
+					frontier = realloc(frontier, capacity * sizeof(uint64_t));
+					next = realloc(next, capacity * sizeof(uint64_t));
+					if (frontier == NULL || next == NULL)
+					{
+						fprintf(stderr, "Error allocating memory: %s\n",
+						                                       strerror(errno));
+						exit(EXIT_FAILURE);
+					}
+				}
+				next[numNext++] = moves[m];
+			}
+		}
+		
+		temp = frontier;
+		frontier = next;
+		next = temp;
+		numFrontier = numNext;
+	}
+	
+	free(frontier);
+	free(next);
+	Delete_State_Set(&visited);
+	
+	return -1;
+}
+
+
+//Thread function for the threaded search. The frontier is divided into
+//contiguous blocks, one per thread. Each thread expands the states in its
+//block, adds the new ones to the shared visited set, and keeps the ones it
+//added in its own list. If a new state has already been visited by the other
+//side of the search, the two sides have met.
+static void *Search_Worker(void *arg)
+{
+	sSearchWorker *worker = arg;
+	sSearchSide *side = worker->side;
+	uint64_t moves[MAX_MOVES];
+	size_t first, end, blockSize, i;
+	int numMoves, m;
+	
+	blockSize = (side->numFrontier + worker->numThreads - 1) /
+	                                                        worker->numThreads;
+	first = blockSize * worker->thread;
+	end = first + blockSize;
+	if (end > side->numFrontier)
+		end = side->numFrontier;
+	
+	for (i = first; i < end; i++)
+	{
+		numMoves = Expand_State(side->frontier[i], worker->numPairs, moves);
+		for (m = 0; m < numMoves; m++)
+		{
+			if (!Add_To_Shared_State_Set(&side->visited, moves[m]))
+				continue;
+			if (Is_In_Shared_State_Set(&worker->other->visited, moves[m]))
+				worker->met = true;
+			
+			if (worker->numFound == worker->capacity)
+			{
+				worker->capacity = (worker->capacity == 0) ? 1024 :
+				                                         2 * worker->capacity;
+				worker->found = realloc(worker->found,
+				                          worker->capacity * sizeof(uint64_t));
+				if (worker->found == NULL)
+				{
+					fprintf(stderr, "Error allocating memory: %s\n",
+					                                           strerror(errno));
+					exit(EXIT_FAILURE);
+				}
+			}
+			worker->found[worker->numFound++] = moves[m];
+		}
+	}
+	
+	return NULL;
+}
+
+
+//Move one side of the threaded search a step further. Once every thread is
+//done, we join their lists together to make the new frontier. Returns true if
+//this side met the other side.
+static bool Expand_Level(sSearchSide *side, const sSearchSide *other,
+                         int numPairs)
+{
+	sSearchWorker *workers;
+	pthread_t *threads;
+	size_t numNext;
+	int numThreads, t;
+	bool met;
+	
+	numThreads = 1;
+	if (side->numFrontier >= MIN_THREADED_FRONTIER)
+		numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (numThreads < 1)
+		numThreads = 1;
+	
+	workers = Safe_Malloc(numThreads * sizeof(sSearchWorker));
+	threads = Safe_Malloc(numThreads * sizeof(pthread_t));
+	for (t = 0; t < numThreads; t++)
+	{
+		workers[t] = (sSearchWorker){side, other, numPairs, numThreads, t,
+		                                                   NULL, 0, 0, false};
+		
+		//Thread 0 is the current thread
+		if (t > 0 && pthread_create(&threads[t], NULL, Search_Worker,
+		                                                      &workers[t]) != 0)
+		{
+			fprintf(stderr, "Error creating thread\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	Search_Worker(&workers[0]);
+	for (t = 1; t < numThreads; t++)
+	{
+		pthread_join(threads[t], NULL);
+	}
+	
+	//Join the lists into the new frontier
+	numNext = 0;
+	for (t = 0; t < numThreads; t++)
+	{
+		numNext += workers[t].numFound;
+	}
+	free(side->frontier);
+	side->frontier = Safe_Malloc((numNext + 1) * sizeof(uint64_t));
+	side->numFrontier = 0;
+	met = false;
+	for (t = 0; t < numThreads; t++)
+	{
+		memcpy(&side->frontier[side->numFrontier], workers[t].found,
+		                            workers[t].numFound * sizeof(uint64_t));
+		side->numFrontier += workers[t].numFound;
+		met = met || workers[t].met;
+		free(workers[t].found);
+	}
+	side->depth++;
+	
+	free(threads);
+	free(workers);
+	
+	return met;
+}
+
+
+//The threaded search. Like the serial search, it goes one step at a time, but
+//each step is split between threads (see Search_Worker()). We keep the searches
+//going forward from the start and backward from the goal as two "sides". Every
+//elevator trip can be undone by the opposite trip, so searching backward works
+//just like searching forward.
+//
+//For a one-way search, the backward side never moves, so the only state it has
+//visited is the goal, and meeting it means we've reached the goal. For a
+//bidirectional search, we always move the side with the smaller frontier, so
+//the two searches meet in the middle having looked at far fewer states than a
+//one-way search would. The first time the sides meet, the answer is the sum of
+//their depths. (If there were a shorter path, its middle state would have been
+//visited by both sides a step earlier, and we'd have stopped then.)
+int Find_Fewest_Steps_Threaded(const sState *start, bool bidirectional)
+{
+	sSearchSide sides[2];
+	sState goal;
+	int p, s, steps;
+	
+	goal.elevator = NUM_FLOORS - 1;
+	goal.numPairs = start->numPairs;
+	for (p = 0; p < start->numPairs; p++)
+	{
+		goal.chip[p] = goal.generator[p] = NUM_FLOORS - 1;
+	}
+	
+	for (s = 0; s < 2; s++)
+	{
+		Init_Shared_State_Set(&sides[s].visited);
+		sides[s].frontier = Safe_Malloc(sizeof(uint64_t));
+		sides[s].frontier[0] = Pack_State((s == 0) ? start : &goal);
+		sides[s].numFrontier = 1;
+		sides[s].depth = 0;
+		Add_To_Shared_State_Set(&sides[s].visited, sides[s].frontier[0]);
+	}
+	
+	if (sides[0].frontier[0] == sides[1].frontier[0])
+		steps = 0;
+	else
+	{
+		while (true)
+		{
+			s = (bidirectional &&
+			            sides[1].numFrontier < sides[0].numFrontier) ? 1 : 0;
+			
+			//If either side runs out of states, the start and the goal aren't
+			//connected
+			if (sides[s].numFrontier == 0)
+			{
+				steps = -1;
+				break;
+			}
+			if (Expand_Level(&sides[s], &sides[1 - s], start->numPairs))
+			{
+				steps = sides[0].depth + sides[1].depth;
+				break;
+			}
+		}
+	}
+	
+	for (s = 0; s < 2; s++)
+	{
+		Delete_Shared_State_Set(&sides[s].visited);
+		free(sides[s].frontier);
+	}
+	
+	return steps;
+}
+
+
+//Create an empty state set
+void Init_State_Set(sStateSet *set)
+{
+	size_t i;
+	
+	set->numKeys = 0;
+	set->capacity = 1024;
+	set->keys = Safe_Malloc(set->capacity * sizeof(uint64_t));
+	for (i = 0; i < set->capacity; i++)
+	{
+		set->keys[i] = EMPTY_KEY;
+	}
+}
+
+
+//Find the slot where a key is, or where it would go. This is an open addressing
+//hash table: every key lives in the table itself, and if its slot is taken, we
+//try the next one, and so on. The hash is the same multiply-and-shift one the
+//Day 24 branch and bound search uses.
+static size_t Find_Slot(const sStateSet *set, uint64_t key)
+{
+	size_t slot;
+	int bits;
+	
+	//The capacity is a power of two, so count its bits to know how many of the
+	//top bits of the hash to use
+	for (bits = 0; ((size_t)1 << bits) < set->capacity; bits++) {;}
+	slot = (key * UINT64_C(0x9E3779B97F4A7C15)) >> (64 - bits);
+	while (set->keys[slot] != EMPTY_KEY && set->keys[slot] != key)
+	{
+		slot = (slot + 1) & (set->capacity - 1);
+	}
+	
+	return slot;
+}
+
+
+//Add a state to the set. Returns false if it was already there. We keep the
+//table at most half full so the runs of taken slots stay short, doubling it
+//when it gets too full.
+bool Add_To_State_Set(sStateSet *set, uint64_t key)
+{
+	uint64_t *oldKeys;
+	size_t oldCapacity, slot, i;
+	
+	if (2 * (set->numKeys + 1) > set->capacity)
+	{
+		oldKeys = set->keys;
+		oldCapacity = set->capacity;
+		set->capacity *= 2;
+		set->keys = Safe_Malloc(set->capacity * sizeof(uint64_t));
+		for (i = 0; i < set->capacity; i++)
+		{
+			set->keys[i] = EMPTY_KEY;
+		}
+		set->numKeys = 0;
+		for (i = 0; i < oldCapacity; i++)
+		{
+			if (oldKeys[i] != EMPTY_KEY)
+				Add_To_State_Set(set, oldKeys[i]);
+		}
+		free(oldKeys);
+	}
+	
+	slot = Find_Slot(set, key);
+	if (set->keys[slot] == key)
+		return false;
+	
+	set->keys[slot] = key;
+	set->numKeys++;
+	
+	return true;
+}
+
+
+//Check whether a state is in the set
+bool Is_In_State_Set(const sStateSet *set, uint64_t key)
+{
+	return set->keys[Find_Slot(set, key)] == key;
+}
+
+
+//Free the memory used by a state set
+void Delete_State_Set(sStateSet *set)
+{
+	free(set->keys);
+	set->keys = NULL;
+	set->numKeys = set->capacity = 0;
+}
+
+
+//Create an empty shared state set
+void Init_Shared_State_Set(sSharedStateSet *set)
+{
+	int i;
+	
+	for (i = 0; i < NUM_SHARDS; i++)
+	{
+		Init_State_Set(&set->shards[i]);
+		pthread_mutex_init(&set->locks[i], NULL);
+	}
+}
+
+
+//Pick a state's shard. We use a different multiplier than Find_Slot(), so the
+//states within a shard are still spread across its slots.
+static int Shard_Of(uint64_t key)
+{
+	return (key * UINT64_C(0xC2B2AE3D27D4EB4F)) >> (64 - SHARD_BITS);
+}
+
+
+//Add a state to a shared set, holding its shard's lock while we do. Returns
+//false if it was already there.
+bool Add_To_Shared_State_Set(sSharedStateSet *set, uint64_t key)
+{
+	int shard;
+	bool added;
+	
+	shard = Shard_Of(key);
+	pthread_mutex_lock(&set->locks[shard]);
+	added = Add_To_State_Set(&set->shards[shard], key);
+	pthread_mutex_unlock(&set->locks[shard]);
+	
+	return added;
+}
+
+
+//Check whether a state is in a shared set. There's no lock here, so this is
+//only safe while nobody is adding to the set. The threaded search only looks
+//up states on the side that isn't moving, so that's always the case.
+bool Is_In_Shared_State_Set(const sSharedStateSet *set, uint64_t key)
+{
+	return Is_In_State_Set(&set->shards[Shard_Of(key)], key);
+}
+
+
+//Free the memory used by a shared state set
+void Delete_Shared_State_Set(sSharedStateSet *set)
+{
+	int i;
+	
+	for (i = 0; i < NUM_SHARDS; i++)
+	{
+		Delete_State_Set(&set->shards[i]);
+		pthread_mutex_destroy(&set->locks[i]);
+	}
+}
+
+
+//Helper function for error-checking malloc()
+void *Safe_Malloc(size_t size)
+{
+	void *retVal;
+	
+	retVal = malloc(size);
+	if (retVal == NULL)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	
+	return retVal;
 }
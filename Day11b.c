@@ -0,0 +1,762 @@
+//Day11b.c
+//
+//Question 2: Upon entering the isolated containment area, we find some extra
+//parts on the first floor that weren't listed on the record outside: an
+//elerium generator and microchip, and a dilithium generator and microchip. What
+//is the minimum number of steps required to bring all of the components,
+//including the four new ones, to the fourth floor?
+//
+//To solve this puzzle, we just add two more pairs to the first floor. The
+//number of states grows quickly with every pair we add, but since the pairs
+//are interchangeable, the sorted states keep the search small enough.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+
+//The facility is stored the same way as in part A
+#define LINE_LENGTH  512
+#define NAME_LENGTH  32
+#define NUM_FLOORS   4
+#define MAX_PAIRS    15
+#define MAX_MOVES    1024
+#define EMPTY_KEY    UINT64_MAX
+
+typedef struct
+{
+	int elevator;
+	int numPairs;
+	int chip[MAX_PAIRS];
+	int generator[MAX_PAIRS];
+} sState;
+
+//No change to the visited sets or the threaded search
+typedef struct
+{
+	uint64_t *keys;
+	size_t numKeys, capacity;
+} sStateSet;
+
+#define SHARD_BITS  6
+#define NUM_SHARDS  (1 << SHARD_BITS)
+
+typedef struct
+{
+	sStateSet shards[NUM_SHARDS];
+	pthread_mutex_t locks[NUM_SHARDS];
+} sSharedStateSet;
+
+typedef struct
+{
+	sSharedStateSet visited;
+	uint64_t *frontier;
+	size_t numFrontier;
+	int depth;
+} sSearchSide;
+
+#define MIN_THREADED_FRONTIER  1024
+
+typedef struct
+{
+	sSearchSide *side;
+	const sSearchSide *other;
+	int numPairs, numThreads, thread;
+	uint64_t *found;
+	size_t numFound, capacity;
+	bool met;
+} sSearchWorker;
+
+
+bool Read_Facility(FILE *inFile, sState *start);
+uint64_t Pack_State(const sState *state);
+void Unpack_State(uint64_t key, int numPairs, sState *state);
+bool Is_Safe(const sState *state);
+int Expand_State(uint64_t key, int numPairs, uint64_t *moves);
+int Find_Fewest_Steps(const sState *start);
+int Find_Fewest_Steps_Threaded(const sState *start, bool bidirectional);
+void Init_State_Set(sStateSet *set);
+bool Add_To_State_Set(sStateSet *set, uint64_t key);
+bool Is_In_State_Set(const sStateSet *set, uint64_t key);
+void Delete_State_Set(sStateSet *set);
+void Init_Shared_State_Set(sSharedStateSet *set);
+bool Add_To_Shared_State_Set(sSharedStateSet *set, uint64_t key);
+bool Is_In_Shared_State_Set(const sSharedStateSet *set, uint64_t key);
+void Delete_Shared_State_Set(sSharedStateSet *set);
+void *Safe_Malloc(size_t size);
+
+
+int main(int argc, char **argv)
+{
+	FILE *inFile;
+	sState start;
+	const char *method;
+	int steps, p;
+	
+	//The usual command line argument check and input file opening, with the
+	//same optional search method as part A
+	if (argc != 2 && argc != 3)
+	{
+		fprintf(stderr, "Usage:\n\tDay11 <input filename> "
+		                               "[serial|parallel|bidirectional]\n\n");
+		return EXIT_FAILURE;
+	}
+	method = (argc == 3) ? argv[2] : "bidirectional";
+	if (strcmp(method, "serial") != 0 && strcmp(method, "parallel") != 0 &&
+	                                      strcmp(method, "bidirectional") != 0)
+	{
+		fprintf(stderr, "Unknown search method: %s\n\n", method);
+		return EXIT_FAILURE;
+	}
+
+	inFile = fopen(argv[1], "r");
+	if (inFile == NULL)
+	{
+		fprintf(stderr, "Error opening file: %s\n\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+	
+	//Read the starting layout, and close the file as soon as we're done with it
+	if (!Read_Facility(inFile, &start))
+	{
+		fclose(inFile);
+		return EXIT_FAILURE;
+	}
+	fclose(inFile);
+	
+	//Add the elerium and dilithium pairs to the first floor
+	if (start.numPairs + 2 > MAX_PAIRS)
+	{
+		fprintf(stderr, "Error: Too many types of power (max %d)!\n",
+		                                                           MAX_PAIRS);
+		return EXIT_FAILURE;
+	}
+	for (p = 0; p < 2; p++)
+	{
+		start.chip[start.numPairs] = 0;
+		start.generator[start.numPairs] = 0;
+		start.numPairs++;
+	}
+	
+	//Search for the answer
+	if (strcmp(method, "serial") == 0)
+		steps = Find_Fewest_Steps(&start);
+	else
+		steps = Find_Fewest_Steps_Threaded(&start,
+		                            strcmp(method, "bidirectional") == 0);
+	if (steps < 0)
+		printf("There's no way to get everything to the top floor\n");
+	else
+		printf("Minimum number of steps: %d\n", steps);
+	
+	return EXIT_SUCCESS;
+}
+
+
+//No change to the parser
+bool Read_Facility(FILE *inFile, sState *start)
+{
+	char line[LINE_LENGTH+1];
+	char names[MAX_PAIRS][NAME_LENGTH+1];
+	bool hasChip[MAX_PAIRS], hasGenerator[MAX_PAIRS];
+	char *word, *previous, *dash;
+	int floor, p;
+	
+	start->elevator = 0;
+	start->numPairs = 0;
+	floor = 0;
+	while (fgets(line, LINE_LENGTH+1, inFile) != NULL)
+	{
+		if (floor >= NUM_FLOORS)
+		{
+			fprintf(stderr, "Error: Too many floors!\n");
+			return false;
+		}
+		
+		previous = NULL;
+		for (word = strtok(line, " ,.\n"); word != NULL;
+		                                         word = strtok(NULL, " ,.\n"))
+		{
+			if (previous != NULL && (strncmp(word, "generator", 9) == 0 ||
+			                         strncmp(word, "microchip", 9) == 0))
+			{
+				//Chop off the "-compatible"
+				dash = strchr(previous, '-');
+				if (dash != NULL)
+					*dash = '\0';
+				
+				//Look up the name, adding it if it's new
+				for (p = 0; p < start->numPairs; p++)
+				{
+					if (strcmp(names[p], previous) == 0)
+						break;
+				}
+				if (p == start->numPairs)
+				{
+					if (p == MAX_PAIRS)
+					{
+						fprintf(stderr, "Error: Too many types of power (max "
+						                                "%d)!\n", MAX_PAIRS);
+						return false;
+					}
+					strncpy(names[p], previous, NAME_LENGTH);
+					names[p][NAME_LENGTH] = '\0';
+					hasChip[p] = hasGenerator[p] = false;
+					start->numPairs++;
+				}
+				
+				if (word[0] == 'g')
+				{
+					start->generator[p] = floor;
+					hasGenerator[p] = true;
+				} else
+				{
+					start->chip[p] = floor;
+					hasChip[p] = true;
+				}
+			}
+			previous = word;
+		}
+		floor++;
+	}
+	
+	//Every microchip needs a generator and vice versa
+	for (p = 0; p < start->numPairs; p++)
+	{
+		if (!hasChip[p] || !hasGenerator[p])
+		{
+			fprintf(stderr, "Error: Missing microchip or generator for %s!\n",
+			                                                        names[p]);
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+
+//The state packing and the safety check are the same as in part A
+uint64_t Pack_State(const sState *state)
+{
+	int count[NUM_FLOORS * NUM_FLOORS] = {0};
+	uint64_t key;
+	int p, kind, shift;
+	
+	for (p = 0; p < state->numPairs; p++)
+	{
+		count[state->chip[p] * NUM_FLOORS + state->generator[p]]++;
+	}
+	
+	key = (uint64_t)state->elevator << 60;
+	shift = 0;
+	for (kind = 0; kind < NUM_FLOORS * NUM_FLOORS; kind++)
+	{
+		for (p = 0; p < count[kind]; p++)
+		{
+			key |= (uint64_t)kind << shift;
+			shift += 4;
+		}
+	}
+	
+	return key;
+}
+
+
+//No change
+void Unpack_State(uint64_t key, int numPairs, sState *state)
+{
+	int p, kind;
+	
+	state->elevator = key >> 60;
+	state->numPairs = numPairs;
+	for (p = 0; p < numPairs; p++)
+	{
+		kind = (key >> (4 * p)) & 0xF;
+		state->chip[p] = kind / NUM_FLOORS;
+		state->generator[p] = kind % NUM_FLOORS;
+	}
+}
+
+
+//No change
+bool Is_Safe(const sState *state)
+{
+	int p, generatorFloors;
+	
+	generatorFloors = 0;
+	for (p = 0; p < state->numPairs; p++)
+	{
+		generatorFloors |= 1 << state->generator[p];
+	}
+	
+	for (p = 0; p < state->numPairs; p++)
+	{
+		if (state->chip[p] != state->generator[p] &&
+		                            (generatorFloors & (1 << state->chip[p])))
+			return false;
+	}
+	
+	return true;
+}
+
+
+//The searches are the same as in part A
+int Expand_State(uint64_t key, int numPairs, uint64_t *moves)
+{
+	sState state, next;
+	int items[2 * MAX_PAIRS];
+	int numItems, numMoves, i, j, direction, floor;
+	
+	Unpack_State(key, numPairs, &state);
+	
+	//List the components on the elevator's floor
+	numItems = 0;
+	for (i = 0; i < numPairs; i++)
+	{
+		if (state.chip[i] == state.elevator)
+			items[numItems++] = 2 * i;
+		if (state.generator[i] == state.elevator)
+			items[numItems++] = 2 * i + 1;
+	}
+	
+	numMoves = 0;
+	for (direction = -1; direction <= 1; direction += 2)
+	{
+		floor = state.elevator + direction;
+		if (floor < 0 || floor >= NUM_FLOORS)
+			continue;
+		
+		//When j == i, the elevator only carries one component
+		for (i = 0; i < numItems; i++)
+		{
+			for (j = i; j < numItems; j++)
+			{
+				next = state;
+				next.elevator = floor;
+				if (items[i] % 2 == 0)
+					next.chip[items[i] / 2] = floor;
+				else
+					next.generator[items[i] / 2] = floor;
+				if (items[j] % 2 == 0)
+					next.chip[items[j] / 2] = floor;
+				else
+					next.generator[items[j] / 2] = floor;
+				
+				if (Is_Safe(&next))
+					moves[numMoves++] = Pack_State(&next);
+			}
+		}
+	}
+	
+	return numMoves;
+}
+
+
+//No change
+int Find_Fewest_Steps(const sState *start)
+{
+	sStateSet visited;
+	sState goal;
+	uint64_t *frontier, *next, *temp;
+	uint64_t moves[MAX_MOVES];
+	uint64_t goalKey;
+	size_t numFrontier, numNext, capacity, i;
+	int steps, numMoves, m, p;
+	
+	goal.elevator = NUM_FLOORS - 1;
+	goal.numPairs = start->numPairs;
+	for (p = 0; p < start->numPairs; p++)
+	{
+		goal.chip[p] = goal.generator[p] = NUM_FLOORS - 1;
+	}
+	goalKey = Pack_State(&goal);
+	
+	Init_State_Set(&visited);
+	capacity = 1024;
+	frontier = Safe_Malloc(capacity * sizeof(uint64_t));
+	next = Safe_Malloc(capacity * sizeof(uint64_t));
+	frontier[0] = Pack_State(start);
+	numFrontier = 1;
+	Add_To_State_Set(&visited, frontier[0]);
+	
+	for (steps = 0; numFrontier > 0; steps++)
+	{
+		numNext = 0;
+		for (i = 0; i < numFrontier; i++)
+		{
+			if (frontier[i] == goalKey)
+			{
+				free(frontier);
+				free(next);
+				Delete_State_Set(&visited);
+				return steps;
+			}
+			
+			numMoves = Expand_State(frontier[i], start->numPairs, moves);
+			for (m = 0; m < numMoves; m++)
+			{
+				if (!Add_To_State_Set(&visited, moves[m]))
+					continue;
+				
+				//Make both lists bigger if we run out of room. They swap
+				//places every step, so they need to stay the same size.
+				if (numNext == capacity)
+				{
+					capacity *= 2;
+					frontier = realloc(frontier, capacity * sizeof(uint64_t));
+					next = realloc(next, capacity * sizeof(uint64_t));
+					if (frontier == NULL || next == NULL)
+					{
+						fprintf(stderr, "Error allocating memory: %s\n",
+						                                       strerror(errno));
+						exit(EXIT_FAILURE);
+					}
+				}
+				next[numNext++] = moves[m];
+			}
+		}
+		
+		temp = frontier;
+		frontier = next;
+		next = temp;
+		numFrontier = numNext;
+	}
+	
+	free(frontier);
+	free(next);
+	Delete_State_Set(&visited);
+	
+	return -1;
+}
+
+
+//No change
+static void *Search_Worker(void *arg)
+{
+	sSearchWorker *worker = arg;
+	sSearchSide *side = worker->side;
+	uint64_t moves[MAX_MOVES];
+	size_t first, end, blockSize, i;
+	int numMoves, m;
+	
+	blockSize = (side->numFrontier + worker->numThreads - 1) /
+	                                                        worker->numThreads;
+	first = blockSize * worker->thread;
+	end = first + blockSize;
+	if (end > side->numFrontier)
+		end = side->numFrontier;
+	
+	for (i = first; i < end; i++)
+	{
+		numMoves = Expand_State(side->frontier[i], worker->numPairs, moves);
+		for (m = 0; m < numMoves; m++)
+		{
+			if (!Add_To_Shared_State_Set(&side->visited, moves[m]))
+				continue;
+			if (Is_In_Shared_State_Set(&worker->other->visited, moves[m]))
+				worker->met = true;
+			
+			if (worker->numFound == worker->capacity)
+			{
+				worker->capacity = (worker->capacity == 0) ? 1024 :
+				                                         2 * worker->capacity;
+				worker->found = realloc(worker->found,
+				                          worker->capacity * sizeof(uint64_t));
+				if (worker->found == NULL)
+				{
+					fprintf(stderr, "Error allocating memory: %s\n",
+					                                           strerror(errno));
+					exit(EXIT_FAILURE);
+				}
+			}
+			worker->found[worker->numFound++] = moves[m];
+		}
+	}
+	
+	return NULL;
+}
+
+
+//No change
+static bool Expand_Level(sSearchSide *side, const sSearchSide *other,
+                         int numPairs)
+{
+	sSearchWorker *workers;
+	pthread_t *threads;
+	size_t numNext;
+	int numThreads, t;
+	bool met;
+	
+	numThreads = 1;
+	if (side->numFrontier >= MIN_THREADED_FRONTIER)
+		numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (numThreads < 1)
+		numThreads = 1;
+	
+	workers = Safe_Malloc(numThreads * sizeof(sSearchWorker));
+	threads = Safe_Malloc(numThreads * sizeof(pthread_t));
+	for (t = 0; t < numThreads; t++)
+	{
+		workers[t] = (sSearchWorker){side, other, numPairs, numThreads, t,
+		                                                   NULL, 0, 0, false};
+		
+		//Thread 0 is the current thread
+		if (t > 0 && pthread_create(&threads[t], NULL, Search_Worker,
+		                                                      &workers[t]) != 0)
+		{
+			fprintf(stderr, "Error creating thread\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	Search_Worker(&workers[0]);
+	for (t = 1; t < numThreads; t++)
+	{
+		pthread_join(threads[t], NULL);
+	}
+	
+	//Join the lists into the new frontier
+	numNext = 0;
+	for (t = 0; t < numThreads; t++)
+	{
+		numNext += workers[t].numFound;
+	}
+	free(side->frontier);
+	side->frontier = Safe_Malloc((numNext + 1) * sizeof(uint64_t));
+	side->numFrontier = 0;
+	met = false;
+	for (t = 0; t < numThreads; t++)
+	{
+		memcpy(&side->frontier[side->numFrontier], workers[t].found,
+		                            workers[t].numFound * sizeof(uint64_t));
+		side->numFrontier += workers[t].numFound;
+		met = met || workers[t].met;
+		free(workers[t].found);
+	}
+	side->depth++;
+	
+	free(threads);
+	free(workers);
+	
+	return met;
+}
+
+
+//No change
+int Find_Fewest_Steps_Threaded(const sState *start, bool bidirectional)
+{
+	sSearchSide sides[2];
+	sState goal;
+	int p, s, steps;
+	
+	goal.elevator = NUM_FLOORS - 1;
+	goal.numPairs = start->numPairs;
+	for (p = 0; p < start->numPairs; p++)
+	{
+		goal.chip[p] = goal.generator[p] = NUM_FLOORS - 1;
+	}
+	
+	for (s = 0; s < 2; s++)
+	{
+		Init_Shared_State_Set(&sides[s].visited);
+		sides[s].frontier = Safe_Malloc(sizeof(uint64_t));
+		sides[s].frontier[0] = Pack_State((s == 0) ? start : &goal);
+		sides[s].numFrontier = 1;
+		sides[s].depth = 0;
+		Add_To_Shared_State_Set(&sides[s].visited, sides[s].frontier[0]);
+	}
+	
+	if (sides[0].frontier[0] == sides[1].frontier[0])
+		steps = 0;
+	else
+	{
+		while (true)
+		{
+			s = (bidirectional &&
+			            sides[1].numFrontier < sides[0].numFrontier) ? 1 : 0;
+			
+			//If either side runs out of states, the start and the goal aren't
+			//connected
+			if (sides[s].numFrontier == 0)
+			{
+				steps = -1;
+				break;
+			}
+			if (Expand_Level(&sides[s], &sides[1 - s], start->numPairs))
+			{
+				steps = sides[0].depth + sides[1].depth;
+				break;
+			}
+		}
+	}
+	
+	for (s = 0; s < 2; s++)
+	{
+		Delete_Shared_State_Set(&sides[s].visited);
+		free(sides[s].frontier);
+	}
+	
+	return steps;
+}
+
+
+//The state set functions are the same as in part A
+void Init_State_Set(sStateSet *set)
+{
+	size_t i;
+	
+	set->numKeys = 0;
+	set->capacity = 1024;
+	set->keys = Safe_Malloc(set->capacity * sizeof(uint64_t));
+	for (i = 0; i < set->capacity; i++)
+	{
+		set->keys[i] = EMPTY_KEY;
+	}
+}
+
+
+//No change
+static size_t Find_Slot(const sStateSet *set, uint64_t key)
+{
+	size_t slot;
+	int bits;
+	
+	//The capacity is a power of two, so count its bits to know how many of the
+	//top bits of the hash to use
+	for (bits = 0; ((size_t)1 << bits) < set->capacity; bits++) {;}
+	slot = (key * UINT64_C(0x9E3779B97F4A7C15)) >> (64 - bits);
+	while (set->keys[slot] != EMPTY_KEY && set->keys[slot] != key)
+	{
+		slot = (slot + 1) & (set->capacity - 1);
+	}
+	
+	return slot;
+}
+
+
+//No change
+bool Add_To_State_Set(sStateSet *set, uint64_t key)
+{
+	uint64_t *oldKeys;
+	size_t oldCapacity, slot, i;
+	
+	if (2 * (set->numKeys + 1) > set->capacity)
+	{
+		oldKeys = set->keys;
+		oldCapacity = set->capacity;
+		set->capacity *= 2;
+		set->keys = Safe_Malloc(set->capacity * sizeof(uint64_t));
+		for (i = 0; i < set->capacity; i++)
+		{
+			set->keys[i] = EMPTY_KEY;
+		}
+		set->numKeys = 0;
+		for (i = 0; i < oldCapacity; i++)
+		{
+			if (oldKeys[i] != EMPTY_KEY)
+				Add_To_State_Set(set, oldKeys[i]);
+		}
+		free(oldKeys);
+	}
+	
+	slot = Find_Slot(set, key);
+	if (set->keys[slot] == key)
+		return false;
+	
+	set->keys[slot] = key;
+	set->numKeys++;
+	
+	return true;
+}
+
+
+//No change
+bool Is_In_State_Set(const sStateSet *set, uint64_t key)
+{
+	return set->keys[Find_Slot(set, key)] == key;
+}
+
+
+//No change
+void Delete_State_Set(sStateSet *set)
+{
+	free(set->keys);
+	set->keys = NULL;
+	set->numKeys = set->capacity = 0;
+}
+
+
+//The shared state set functions are the same as in part A
+void Init_Shared_State_Set(sSharedStateSet *set)
+{
+	int i;
+	
+	for (i = 0; i < NUM_SHARDS; i++)
+	{
+		Init_State_Set(&set->shards[i]);
+		pthread_mutex_init(&set->locks[i], NULL);
+	}
+}
+
+
+//No change
+static int Shard_Of(uint64_t key)
+{
+	return (key * UINT64_C(0xC2B2AE3D27D4EB4F)) >> (64 - SHARD_BITS);
+}
+
+
+//No change
+bool Add_To_Shared_State_Set(sSharedStateSet *set, uint64_t key)
+{
+	int shard;
+	bool added;
+	
+	shard = Shard_Of(key);
+	pthread_mutex_lock(&set->locks[shard]);
+	added = Add_To_State_Set(&set->shards[shard], key);
+	pthread_mutex_unlock(&set->locks[shard]);
+	
+	return added;
+}
+
+
+//No change
+bool Is_In_Shared_State_Set(const sSharedStateSet *set, uint64_t key)
+{
+	return Is_In_State_Set(&set->shards[Shard_Of(key)], key);
+}
+
+
+//No change
+void Delete_Shared_State_Set(sSharedStateSet *set)
+{
+	int i;
+	
+	for (i = 0; i < NUM_SHARDS; i++)
+	{
+		Delete_State_Set(&set->shards[i]);
+		pthread_mutex_destroy(&set->locks[i]);
+	}
+}
+
+
+//Helper function for error-checking malloc()
+void *Safe_Malloc(size_t size)
+{
+	void *retVal;
+	
+	retVal = malloc(size);
+	if (retVal == NULL)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	
+	return retVal;
+}
@@ -38,94 +38,124 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
 
 
 //For brevity, we'll call each location a "room". For each room, we need to keep
 //track of whether the room is a wall or an open space, and how far it is from
 //the starting node. We could use the distance to indicate whether a node has
-//been visited, but for simplicity let's add another boolean flag.
+//been visited, but for simplicity let's add another flag.
+//
+//Rather than a boolean flag, we'll use a generation stamp. Each search gets a
+//new generation number, and a room's isOpen and distance values only count if
+//its stamp matches the current generation. Otherwise they're left over from an
+//earlier search (possibly with a different seed!) and the room hasn't been
+//looked at yet. This means we don't have to initialize every room before each
+//search -- we only work out whether a room is open when the search actually
+//reaches it. That saves a lot of time in batch mode, where most searches only
+//touch a small corner of the maze.
 typedef struct
 {
-	bool isOpen, visited;
+	bool isOpen;
+	uint32_t stamp;
 	unsigned long distance;
 } sRoom;
 
 //The shortest path algorithm requires us to add rooms to a queue as we find
-//them. To facilitate this, we'll store queued coordinates in a linked list. I'm
-//using longs for everything due to the potentially infinite (read: large)
-//nature of the maze.
-typedef struct sCoord
+//them. I'm using longs for everything due to the potentially infinite (read:
+//large) nature of the maze.
+typedef struct
 {
 	unsigned long x, y;
-	struct sCoord *next;
 } sCoord;
 
 //The queue also has some information of its own. There isn't an easy way to
 //make an abstract container in C, so this queue is custom-built to store
 //coordinates. Maybe we'll try making an abstract queue another day.
+//
+//A breadth-first search adds each room to the queue at most once, so the queue
+//can never hold more coordinates than there are rooms in the maze. That means
+//we can allocate one array up front and use it as a circular buffer instead of
+//calling malloc() and free() for every single room. This matters when we run
+//thousands of searches in batch mode (see below).
 typedef struct
 {
-	unsigned long numElements;
-	sCoord *first, *last;
+	unsigned long numElements, capacity, head, tail;
+	sCoord *elements;
 } sQueue;
 
-//Initialize the coordinate queue
-void Init_Queue(sQueue *queue)
+//The maze itself, along with its size. Bundling these together makes it easy
+//to hand a whole maze to a search function or a worker thread.
+typedef struct
+{
+	sRoom **rooms;
+	unsigned long xSize, ySize;
+	uint32_t generation;
+} sMaze;
+
+//Initialize the coordinate queue with enough room for the given number of
+//coordinates
+void Init_Queue(sQueue *queue, unsigned long capacity)
 {
 	queue->numElements = 0;
-	queue->first = NULL;
-	queue->last = NULL;
+	queue->capacity = capacity;
+	queue->head = 0;
+	queue->tail = 0;
+	queue->elements = malloc(capacity * sizeof(sCoord));
+	if (queue->elements == NULL)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+}
+
+//Empty the queue without freeing its memory so it can be reused
+void Clear_Queue(sQueue *queue)
+{
+	queue->numElements = 0;
+	queue->head = 0;
+	queue->tail = 0;
 }
 
 //Add a coordinate to the queue
 void Enqueue(sQueue *queue, unsigned long x, unsigned long y)
 {
-	sCoord *new;
-	
-	//Create the new coordinate node for the linked list
-	new = malloc(sizeof(sCoord));
-	if (new == NULL)
+	//Running out of space means the capacity was set too small, which is a bug
+	//rather than something we can recover from.
+	if (queue->numElements == queue->capacity)
 	{
-		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		fprintf(stderr, "Error: Queue overrun!\n");
 		exit(EXIT_FAILURE);
 	}
-	new->x = x;
-	new->y = y;
-	new->next = NULL;
-	
-	//Add the node to the tail of the list. If the list is empty, we need to
-	//update the queue pointers to cover the new list.
-	if (queue->numElements > 0)
-		queue->last->next = new;
-	else
-		queue->first = new;
-	queue->last = new;
+	
+	//Add the coordinates at the tail and wrap the index around if necessary
+	queue->elements[queue->tail] = (sCoord){x, y};
+	queue->tail++;
+	if (queue->tail == queue->capacity)
+		queue->tail = 0;
 	queue->numElements++;
 }
 
 //Remove and return the next coordinates from the queue
 sCoord Dequeue(sQueue *queue)
 {
-	sCoord *oldest;
 	sCoord retVal;
 	
-	//In an infinite maze, we should never run out of nodes, so trying to get a
-	//node from an empty list is a showstopping error.
+	//Trying to get a node from an empty queue is a showstopping error. The
+	//search functions check for this before calling us.
 	if (queue->numElements == 0)
 	{
 		fprintf(stderr, "Error: Queue underrun!\n");
 		exit(EXIT_FAILURE);
 	}
 	
-	//Copy the oldest node
-	oldest = queue->first;
-	retVal = *oldest;
-
-	//Delete the oldest node from the linked list. We can only update the queue
-	//pointers if there are still other nodes left in the list.
-	if (queue->numElements > 1)
-		queue->first = oldest->next;
-	free(oldest);
+	//Copy the oldest coordinates and advance the head index
+	retVal = queue->elements[queue->head];
+	queue->head++;
+	if (queue->head == queue->capacity)
+		queue->head = 0;
 	queue->numElements--;
 	
 	return retVal;
@@ -134,15 +164,10 @@ sCoord Dequeue(sQueue *queue)
 //Free all the memory used by the queue
 void Delete_Queue(sQueue *queue)
 {
-	sCoord *next;
-	
-	while (queue->numElements > 0)
-	{
-		next = queue->first->next;
-		free(queue->first);
-		queue->first = next;
-		queue->numElements--;
-	}
+	free(queue->elements);
+	queue->elements = NULL;
+	queue->numElements = 0;
+	queue->capacity = 0;
 }
 
 
@@ -153,27 +178,47 @@ void Delete_Queue(sQueue *queue)
 #define STARTX           1
 #define STARTY           1
 
+//Distance reported when the target can't be reached inside the maze subset
+#define UNREACHABLE      ULONG_MAX
+
 
 bool Location_Is_Open(unsigned long x, unsigned long y, unsigned long seed);
+void Create_Maze(sMaze *maze, unsigned long xSize, unsigned long ySize);
+void Delete_Maze(sMaze *maze);
+void Start_Search(sMaze *maze);
+bool Visit_Room(sMaze *maze, sQueue *queue, unsigned long x, unsigned long y,
+                unsigned long distance, unsigned long seed);
+unsigned long Find_Distance(sMaze *maze, sQueue *queue, unsigned long seed,
+                            unsigned long targetX, unsigned long targetY);
+int Run_Batch(const char *fileName, long numThreads);
 
 
 int main(int argc, char **argv)
 {
-	//We might need the ability to resize both dimensions of the (known) maze,
-	//so we can't use a normal 2D array with one fixed dimension. Instead, we'll
-	//use a 1D array of pointers to 1D arrays, which lets us use the 2D array
-	//syntax and doesn't require a single block of memory. The downside is that
-	//we have to do a lot more initialization and reallocation to handle this.
-	sRoom **maze;
+	sMaze maze;
 	sQueue queue;
-	sCoord temp;
-	unsigned long input, targetX, targetY, x, y, xSize, ySize;
+	unsigned long input, targetX, targetY, distance;
+	long numThreads;
+	
+	//Batch mode takes a file of queries instead of a single seed and target.
+	//The thread count is optional; by default we use one thread per CPU.
+	if ((argc == 3 || argc == 4) && strcmp(argv[1], "-b") == 0)
+	{
+		numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (argc == 4)
+			numThreads = strtol(argv[3], NULL, 10);
+		if (numThreads < 1)
+			numThreads = 1;
+		
+		return Run_Batch(argv[2], numThreads);
+	}
 	
 	//No input file this time. We'll take the target coordinates as parameters
 	//along with the seed to facilitate use of the test input.
 	if (argc != 4)
 	{
 		fprintf(stderr, "Usage:\n\tDay13 <input seed> <target x> <target y>\n");
+		fprintf(stderr, "\tDay13 -b <query file> [threads]\n");
 		return EXIT_FAILURE;
 	}
 
@@ -189,111 +234,199 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 	
-	//First, let's initialize a reasonable number of rooms. This means we need
-	//to allocate memory for the array of pointers to the columns (x dimension)
-	//and the rooms in each column (y dimension).
-	xSize = STARTING_SIZE;
-	ySize = STARTING_SIZE;
-	maze = malloc(xSize * sizeof(sRoom *));
-	if (maze == NULL)
+	//We might need the ability to resize both dimensions of the (known) maze,
+	//so we can't use a normal 2D array with one fixed dimension. Instead, we'll
+	//use a 1D array of pointers to 1D arrays, which lets us use the 2D array
+	//syntax and doesn't require a single block of memory. The downside is that
+	//we have to do a lot more initialization and reallocation to handle this.
+	//The queue gets one slot for every room in the maze.
+	Create_Maze(&maze, STARTING_SIZE, STARTING_SIZE);
+	Init_Queue(&queue, maze.xSize * maze.ySize);
+	
+	//The maze only covers the starting subset, so a target outside of it can't
+	//be found.
+	if (targetX >= maze.xSize || targetY >= maze.ySize)
 	{
-		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		fprintf(stderr, "Error: Target is outside the %lux%lu maze!\n",
+		                                                maze.xSize, maze.ySize);
 		return EXIT_FAILURE;
 	}
+	
+	//Run the search
+	distance = Find_Distance(&maze, &queue, input, targetX, targetY);
+	if (distance == UNREACHABLE)
+	{
+		fprintf(stderr, "Error: (%lu,%lu) is unreachable!\n", targetX, targetY);
+		return EXIT_FAILURE;
+	}
+	
+	//Print the shortest distance to the target
+	printf("Shortest distance to (%lu,%lu): %lu\n", targetX, targetY, distance);
+	
+	//Delete the queue and free the maze's memory
+	Delete_Queue(&queue);
+	Delete_Maze(&maze);
+	
+	return EXIT_SUCCESS;
+}
+
+
+//Allocate memory for a maze of the given size. This means we need to allocate
+//memory for the array of pointers to the columns (x dimension) and the rooms in
+//each column (y dimension). The rooms themselves are initialized by the search,
+//so all we need to do here is clear the generation stamps.
+void Create_Maze(sMaze *maze, unsigned long xSize, unsigned long ySize)
+{
+	unsigned long x, y;
+	
+	maze->xSize = xSize;
+	maze->ySize = ySize;
+	maze->rooms = malloc(xSize * sizeof(sRoom *));
+	if (maze->rooms == NULL)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
 	for (x = 0; x < xSize; x++)
 	{
-		maze[x] = malloc(ySize * sizeof(sRoom));
-		if (maze[x] == NULL)
+		maze->rooms[x] = malloc(ySize * sizeof(sRoom));
+		if (maze->rooms[x] == NULL)
 		{
 			fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
-			return EXIT_FAILURE;
+			exit(EXIT_FAILURE);
+		}
+		for (y = 0; y < ySize; y++)
+		{
+			maze->rooms[x][y].stamp = 0;
 		}
 	}
+	maze->generation = 0;
+}
+
+
+//Free the memory used by a maze
+void Delete_Maze(sMaze *maze)
+{
+	unsigned long x;
 	
-	//Now we can initialize the rooms. At this point, we can determine whether
-	//every room is a wall or an open space. The only known distance is for the
-	//starting location (1,1), which has distance 0.
-	for (x = 0; x < xSize; x++)
+	for (x = 0; x < maze->xSize; x++)
 	{
-		for (y = 0; y < ySize; y++)
+		free(maze->rooms[x]);
+	}
+	free(maze->rooms);
+	maze->rooms = NULL;
+}
+
+
+//Start a new search by moving on to the next generation. The rooms only need to
+//be cleared when the generation counter wraps around to zero, since otherwise
+//rooms stamped four billion searches ago would look like they'd been visited.
+void Start_Search(sMaze *maze)
+{
+	unsigned long x, y;
+	
+	maze->generation++;
+	if (maze->generation == 0)
+	{
+		for (x = 0; x < maze->xSize; x++)
 		{
-			maze[x][y].isOpen = Location_Is_Open(x, y, input);
-			maze[x][y].visited = false;
-			maze[x][y].distance = ULONG_MAX;
+			for (y = 0; y < maze->ySize; y++)
+			{
+				maze->rooms[x][y].stamp = 0;
+			}
 		}
+		maze->generation = 1;
 	}
-	maze[STARTX][STARTY].distance = 0;
-	maze[STARTX][STARTY].visited = true;
+}
+
+
+//Look at a room next to the one the search is on. If the room hasn't been
+//looked at yet in this search, we stamp it and figure out whether it's open.
+//Open rooms get their distance and are added to the queue. Returns true if the
+//room was added.
+bool Visit_Room(sMaze *maze, sQueue *queue, unsigned long x, unsigned long y,
+                unsigned long distance, unsigned long seed)
+{
+	sRoom *room;
+	
+	room = &maze->rooms[x][y];
+	if (room->stamp == maze->generation)
+		return false;
+	
+	//Stamping the room prevents it from being added to the queue multiple
+	//times. We stamp walls too, so we only have to compute each room once.
+	room->stamp = maze->generation;
+	room->isOpen = Location_Is_Open(x, y, seed);
+	if (!room->isOpen)
+		return false;
+	
+	room->distance = distance;
+	Enqueue(queue, x, y);
+	return true;
+}
+
+
+//Find the shortest distance from the starting location to the target. The maze
+//and queue are reused from search to search, so nothing is allocated here.
+//Returns UNREACHABLE if the target can't be reached inside the maze.
+unsigned long Find_Distance(sMaze *maze, sQueue *queue, unsigned long seed,
+                            unsigned long targetX, unsigned long targetY)
+{
+	sRoom **rooms, *target;
+	sCoord temp;
+	unsigned long x, y, distance;
 	
-	//Initialize the queue and add the starting location as the first element
-	Init_Queue(&queue);
-	Enqueue(&queue, STARTX, STARTY);
+	rooms = maze->rooms;
+	target = &rooms[targetX][targetY];
+	
+	//Start a new generation and empty the queue. The starting location (1,1)
+	//is the only room we know about, and it has distance 0. We're standing in
+	//it, so it counts as open even if the formula says it's a wall. That's
+	//why it doesn't go through Visit_Room().
+	Start_Search(maze);
+	Clear_Queue(queue);
+	rooms[STARTX][STARTY].stamp = maze->generation;
+	rooms[STARTX][STARTY].isOpen = true;
+	rooms[STARTX][STARTY].distance = 0;
+	Enqueue(queue, STARTX, STARTY);
 	
 	//Finally, we can explore the maze. This specific situation (breadth-first
 	//search on an unweighted graph) guarantees that the first time we encounter
 	//a room will be along a shortest path, so we don't have to worry about
 	//finding every path to the target -- once we encounter the target room, we
-	//can terminate immediately.
-	while (maze[targetX][targetY].distance == ULONG_MAX)
+	//can terminate immediately. If we run out of rooms first, the target is
+	//walled off from the start (at least within our subset of the maze).
+	while (queue->numElements > 0 &&
+	               (target->stamp != maze->generation || !target->isOpen))
 	{
 		//Get the next node from the queue
-		temp = Dequeue(&queue);
+		temp = Dequeue(queue);
 		x = temp.x;
 		y = temp.y;
 		
 		//Add unvisited, open, adjacent rooms to the queue. This is the breadth-
-		//first part of the search. The maze generation algorithm does not
-		//guarantee that the maze is bounded by walls, so we have to make sure
-		//not to go off the edges of the array. These compound conditionals are
-		//safe because C's short-circuiting behavior guarantees that invalid
-		//indices are never evaluated.
-		if (x > 0 && maze[x-1][y].isOpen && !maze[x-1][y].visited)
-		{
-			//Mark the new room as visited to prevent it from being added to the
-			//queue multiple times.
-			maze[x-1][y].visited = true;
-
-			//The new room is one step away from the current, so its distance is
-			//one plus the current distance. Again, this search guarantees that
-			//the first time we encounter the room will be on a shortest path.
-			maze[x-1][y].distance = maze[x][y].distance + 1;
-			Enqueue(&queue, x-1, y);
-			
-		}
-		if (y > 0 && maze[x][y-1].isOpen && !maze[x][y-1].visited)
-		{
-			//Same logic as above
-			maze[x][y-1].visited = true;
-			maze[x][y-1].distance = maze[x][y].distance + 1;
-			Enqueue(&queue, x, y-1);
-		}
-		if (x < xSize && maze[x+1][y].isOpen && !maze[x+1][y].visited)
-		{
-			maze[x+1][y].visited = true;
-			maze[x+1][y].distance = maze[x][y].distance + 1;
-			Enqueue(&queue, x+1, y);
-		}
-		if (y < ySize && maze[x][y+1].isOpen && !maze[x][y+1].visited)
-		{
-			maze[x][y+1].visited = true;
-			maze[x][y+1].distance = maze[x][y].distance + 1;
-			Enqueue(&queue, x, y+1);
-		}
+		//first part of the search. The new rooms are one step away from the
+		//current, so their distance is one plus the current distance. Again,
+		//this search guarantees that the first time we encounter a room will be
+		//on a shortest path.
+		//
+		//The maze generation algorithm does not guarantee that the maze is
+		//bounded by walls, so we have to make sure not to go off the edges of
+		//the array before looking at a neighbor.
+		distance = rooms[x][y].distance + 1;
+		if (x > 0)
+			Visit_Room(maze, queue, x-1, y, distance, seed);
+		if (y > 0)
+			Visit_Room(maze, queue, x, y-1, distance, seed);
+		if (x + 1 < maze->xSize)
+			Visit_Room(maze, queue, x+1, y, distance, seed);
+		if (y + 1 < maze->ySize)
+			Visit_Room(maze, queue, x, y+1, distance, seed);
 	}
 	
-	//Print the shortest distance to the target
-	printf("Shortest distance to (%lu,%lu): %lu\n", targetX, targetY,
-	                                           maze[targetX][targetY].distance);
-	
-	//Delete the queue and free the maze's memory
-	Delete_Queue(&queue);
-	for (x = 0; x < STARTING_SIZE; x++)
-	{
-		free(maze[x]);
-	}
-	free(maze);
-	
-	return EXIT_SUCCESS;
+	if (target->stamp != maze->generation || !target->isOpen)
+		return UNREACHABLE;
+	return target->distance;
 }
 
 
@@ -327,3 +460,207 @@ bool Location_Is_Open(unsigned long x, unsigned long y, unsigned long seed)
 	//wall.
 	return (temp % 2 == 0);
 }
+
+
+//Batch mode
+//
+//When regression-testing the solver, we want to try lots of different seeds and
+//targets. Starting a new process for each one spends more time on process
+//startup and memory allocation than on the actual search, so batch mode reads a
+//file of queries, one per line:
+//
+//    <input seed> <target x> <target y>
+//
+//and hands them out to a pool of worker threads. Each worker allocates a maze
+//and a queue once and reuses them for every query it handles, so the searches
+//themselves never call malloc(). The workers finish in whatever order they
+//like, but the main thread prints the results in the same order as the queries
+//in the file, printing each one as soon as it and everything before it is done.
+
+//One query and its result. The done flag is protected by the batch mutex.
+typedef struct
+{
+	unsigned long seed, targetX, targetY;
+	unsigned long distance;
+	bool done;
+} sQuery;
+
+//Information shared by all of the threads. The workers claim queries by
+//incrementing nextQuery, and signal resultReady whenever they finish one.
+typedef struct
+{
+	sQuery *queries;
+	unsigned long numQueries, nextQuery;
+	pthread_mutex_t lock;
+	pthread_cond_t resultReady;
+} sBatch;
+
+
+//Worker thread function. pthreads requires the function to take and return a
+//void pointer, so we pass in the batch structure that way.
+static void *Batch_Worker(void *arg)
+{
+	sBatch *batch = arg;
+	sQuery *query;
+	sMaze maze;
+	sQueue queue;
+	unsigned long q, distance;
+	
+	//These are the only allocations the worker makes
+	Create_Maze(&maze, STARTING_SIZE, STARTING_SIZE);
+	Init_Queue(&queue, maze.xSize * maze.ySize);
+	
+	while (true)
+	{
+		//Claim the next query
+		pthread_mutex_lock(&batch->lock);
+		q = batch->nextQuery++;
+		pthread_mutex_unlock(&batch->lock);
+		if (q >= batch->numQueries)
+			break;
+		
+		//The query itself doesn't change, so we can read it without locking.
+		//Targets outside the maze are reported as unreachable.
+		query = &batch->queries[q];
+		if (query->targetX < maze.xSize && query->targetY < maze.ySize)
+			distance = Find_Distance(&maze, &queue, query->seed,
+			                                    query->targetX, query->targetY);
+		else
+			distance = UNREACHABLE;
+		
+		//Publish the result and wake up the main thread
+		pthread_mutex_lock(&batch->lock);
+		query->distance = distance;
+		query->done = true;
+		pthread_cond_signal(&batch->resultReady);
+		pthread_mutex_unlock(&batch->lock);
+	}
+	
+	Delete_Queue(&queue);
+	Delete_Maze(&maze);
+	
+	return NULL;
+}
+
+
+//Read the query file, run the queries on numThreads threads, and print the
+//results in input order.
+int Run_Batch(const char *fileName, long numThreads)
+{
+	FILE *inFile;
+	sBatch batch;
+	sQuery *query;
+	pthread_t *threads;
+	char line[256];
+	unsigned long capacity, lineNum, q;
+	long t;
+	
+	inFile = fopen(fileName, "r");
+	if (inFile == NULL)
+	{
+		fprintf(stderr, "Error opening file: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+	
+	//We don't know how many queries there are, so we'll grow the array as we
+	//go. Doubling the size each time keeps the number of realloc() calls low.
+	capacity = 64;
+	batch.numQueries = 0;
+	batch.queries = malloc(capacity * sizeof(sQuery));
+	if (batch.queries == NULL)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+	
+	lineNum = 0;
+	while (fgets(line, sizeof(line), inFile) != NULL)
+	{
+		lineNum++;
+		
+		//Skip blank lines
+		if (strspn(line, " \t\r\n") == strlen(line))
+			continue;
+		
+		if (batch.numQueries == capacity)
+		{
+			capacity *= 2;
+			query = realloc(batch.queries, capacity * sizeof(sQuery));
+			if (query == NULL)
+			{
+				fprintf(stderr, "Error allocating memory: %s\n",
+				                                               strerror(errno));
+				return EXIT_FAILURE;
+			}
+			batch.queries = query;
+		}
+		
+		query = &batch.queries[batch.numQueries];
+		if (sscanf(line, "%lu %lu %lu", &query->seed, &query->targetX,
+		                                                  &query->targetY) != 3)
+		{
+			fprintf(stderr, "Error parsing line %lu of %s\n", lineNum,
+			                                                          fileName);
+			return EXIT_FAILURE;
+		}
+		query->done = false;
+		batch.numQueries++;
+	}
+	fclose(inFile);
+	
+	//There's no point in starting more threads than there are queries
+	if ((unsigned long)numThreads > batch.numQueries)
+		numThreads = batch.numQueries;
+	
+	//Start the workers
+	batch.nextQuery = 0;
+	pthread_mutex_init(&batch.lock, NULL);
+	pthread_cond_init(&batch.resultReady, NULL);
+	threads = malloc(numThreads * sizeof(pthread_t));
+	if (threads == NULL && numThreads > 0)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+	for (t = 0; t < numThreads; t++)
+	{
+		if (pthread_create(&threads[t], NULL, Batch_Worker, &batch) != 0)
+		{
+			fprintf(stderr, "Error creating thread\n");
+			return EXIT_FAILURE;
+		}
+	}
+	
+	//Print the results in order. If the next result isn't ready yet, we wait
+	//for a worker to signal that it finished something and check again.
+	for (q = 0; q < batch.numQueries; q++)
+	{
+		query = &batch.queries[q];
+		
+		pthread_mutex_lock(&batch.lock);
+		while (!query->done)
+		{
+			pthread_cond_wait(&batch.resultReady, &batch.lock);
+		}
+		pthread_mutex_unlock(&batch.lock);
+		
+		if (query->distance == UNREACHABLE)
+			printf("%lu (%lu,%lu): unreachable\n", query->seed,
+			                                    query->targetX, query->targetY);
+		else
+			printf("%lu (%lu,%lu): %lu\n", query->seed, query->targetX,
+			                                   query->targetY, query->distance);
+	}
+	
+	//Clean up
+	for (t = 0; t < numThreads; t++)
+	{
+		pthread_join(threads[t], NULL);
+	}
+	pthread_cond_destroy(&batch.resultReady);
+	pthread_mutex_destroy(&batch.lock);
+	free(threads);
+	free(batch.queries);
+	
+	return EXIT_SUCCESS;
+}
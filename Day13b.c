@@ -15,60 +15,76 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
 
 
 //No change to the room definition
 typedef struct
 {
-	bool isOpen, visited;
+	bool isOpen;
+	uint32_t stamp;
 	unsigned long distance;
 } sRoom;
 
-//No change to the queue system
-typedef struct sCoord
+//No change to the queue system or the maze structure
+typedef struct
 {
 	unsigned long x, y;
-	struct sCoord *next;
 } sCoord;
 
 typedef struct
 {
-	unsigned long numElements;
-	sCoord *first, *last;
+	unsigned long numElements, capacity, head, tail;
+	sCoord *elements;
 } sQueue;
 
-void Init_Queue(sQueue *queue)
+typedef struct
+{
+	sRoom **rooms;
+	unsigned long xSize, ySize;
+	uint32_t generation;
+} sMaze;
+
+void Init_Queue(sQueue *queue, unsigned long capacity)
 {
 	queue->numElements = 0;
-	queue->first = NULL;
-	queue->last = NULL;
+	queue->capacity = capacity;
+	queue->head = 0;
+	queue->tail = 0;
+	queue->elements = malloc(capacity * sizeof(sCoord));
+	if (queue->elements == NULL)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+}
+
+void Clear_Queue(sQueue *queue)
+{
+	queue->numElements = 0;
+	queue->head = 0;
+	queue->tail = 0;
 }
 
 void Enqueue(sQueue *queue, unsigned long x, unsigned long y)
 {
-	sCoord *new;
-	
-	new = malloc(sizeof(sCoord));
-	if (new == NULL)
+	if (queue->numElements == queue->capacity)
 	{
-		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		fprintf(stderr, "Error: Queue overrun!\n");
 		exit(EXIT_FAILURE);
 	}
-	new->x = x;
-	new->y = y;
-	new->next = NULL;
-	
-	if (queue->numElements > 0)
-		queue->last->next = new;
-	else
-		queue->first = new;
-	queue->last = new;
+	
+	queue->elements[queue->tail] = (sCoord){x, y};
+	queue->tail++;
+	if (queue->tail == queue->capacity)
+		queue->tail = 0;
 	queue->numElements++;
 }
 
 sCoord Dequeue(sQueue *queue)
 {
-	sCoord *oldest;
 	sCoord retVal;
 	
 	if (queue->numElements == 0)
@@ -77,12 +93,10 @@ sCoord Dequeue(sQueue *queue)
 		exit(EXIT_FAILURE);
 	}
 	
-	oldest = queue->first;
-	retVal = *oldest;
-
-	if (queue->numElements > 1)
-		queue->first = oldest->next;
-	free(oldest);
+	retVal = queue->elements[queue->head];
+	queue->head++;
+	if (queue->head == queue->capacity)
+		queue->head = 0;
 	queue->numElements--;
 	
 	return retVal;
@@ -90,15 +104,10 @@ sCoord Dequeue(sQueue *queue)
 
 void Delete_Queue(sQueue *queue)
 {
-	sCoord *next;
-	
-	while (queue->numElements > 0)
-	{
-		next = queue->first->next;
-		free(queue->first);
-		queue->first = next;
-		queue->numElements--;
-	}
+	free(queue->elements);
+	queue->elements = NULL;
+	queue->numElements = 0;
+	queue->capacity = 0;
 }
 
 
@@ -109,22 +118,46 @@ void Delete_Queue(sQueue *queue)
 #define STARTX           1
 #define STARTY           1
 
+//Distance of rooms we haven't reached
+#define UNREACHABLE      ULONG_MAX
+
 
 bool Location_Is_Open(unsigned long x, unsigned long y, unsigned long seed);
+void Create_Maze(sMaze *maze, unsigned long xSize, unsigned long ySize);
+void Delete_Maze(sMaze *maze);
+void Start_Search(sMaze *maze);
+bool Visit_Room(sMaze *maze, sQueue *queue, unsigned long x, unsigned long y,
+                unsigned long distance, unsigned long seed);
+unsigned long Count_Rooms(sMaze *maze, sQueue *queue, unsigned long seed,
+                          unsigned long maxSteps);
+int Run_Batch(const char *fileName, long numThreads);
 
 
 int main(int argc, char **argv)
 {
 	//We don't have a target anymore
-	sRoom **maze;
+	sMaze maze;
 	sQueue queue;
-	sCoord temp;
-	unsigned long input, x, y, xSize, ySize, maxSteps, roomCount;
+	unsigned long input, maxSteps, roomCount;
+	long numThreads;
+	
+	//Batch mode works the same way as in part A
+	if ((argc == 3 || argc == 4) && strcmp(argv[1], "-b") == 0)
+	{
+		numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (argc == 4)
+			numThreads = strtol(argv[3], NULL, 10);
+		if (numThreads < 1)
+			numThreads = 1;
+		
+		return Run_Batch(argv[2], numThreads);
+	}
 	
 	//Our input will be the maximum number of steps
 	if (argc != 3)
 	{
 		fprintf(stderr, "Usage:\n\tDay13 <input seed> <max steps>\n");
+		fprintf(stderr, "\tDay13 -b <query file> [threads]\n");
 		return EXIT_FAILURE;
 	}
 
@@ -139,98 +172,151 @@ int main(int argc, char **argv)
 	}
 	
 	//The maze initialization is the same
-	xSize = STARTING_SIZE;
-	ySize = STARTING_SIZE;
-	maze = malloc(xSize * sizeof(sRoom *));
-	if (maze == NULL)
+	Create_Maze(&maze, STARTING_SIZE, STARTING_SIZE);
+	Init_Queue(&queue, maze.xSize * maze.ySize);
+	
+	//Explore the maze and count the rooms within range
+	roomCount = Count_Rooms(&maze, &queue, input, maxSteps);
+	
+	//Print the room count
+	printf("Number of rooms within %lu steps: %lu\n", maxSteps, roomCount);
+
+	//Delete the queue and free the maze's memory
+	Delete_Queue(&queue);
+	Delete_Maze(&maze);
+	
+	return EXIT_SUCCESS;
+}
+
+
+//No change to the maze allocation or generation functions
+void Create_Maze(sMaze *maze, unsigned long xSize, unsigned long ySize)
+{
+	unsigned long x, y;
+	
+	maze->xSize = xSize;
+	maze->ySize = ySize;
+	maze->rooms = malloc(xSize * sizeof(sRoom *));
+	if (maze->rooms == NULL)
 	{
 		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
-		return EXIT_FAILURE;
+		exit(EXIT_FAILURE);
 	}
 	for (x = 0; x < xSize; x++)
 	{
-		maze[x] = malloc(ySize * sizeof(sRoom));
-		if (maze[x] == NULL)
+		maze->rooms[x] = malloc(ySize * sizeof(sRoom));
+		if (maze->rooms[x] == NULL)
 		{
 			fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
-			return EXIT_FAILURE;
+			exit(EXIT_FAILURE);
 		}
-	}
-	
-	for (x = 0; x < xSize; x++)
-	{
 		for (y = 0; y < ySize; y++)
 		{
-			maze[x][y].isOpen = Location_Is_Open(x, y, input);
-			maze[x][y].visited = false;
-			maze[x][y].distance = ULONG_MAX;
+			maze->rooms[x][y].stamp = 0;
 		}
 	}
-	maze[STARTX][STARTY].distance = 0;
-	maze[STARTX][STARTY].visited = true;
-	
-	//We start out the same way
-	Init_Queue(&queue);
-	Enqueue(&queue, STARTX, STARTY);
+	maze->generation = 0;
+}
+
+
+void Delete_Maze(sMaze *maze)
+{
+	unsigned long x;
 	
-	//Now we loop until we run out of rooms. This happens when the queue is
-	//empty at the end of an iteration.
-	while (queue.numElements > 0)
+	for (x = 0; x < maze->xSize; x++)
 	{
-		//Everything else is the same!
-		temp = Dequeue(&queue);
-		x = temp.x;
-		y = temp.y;
-		
-		if (x > 0 && maze[x-1][y].isOpen && !maze[x-1][y].visited)
-		{
-			maze[x-1][y].visited = true;
-			maze[x-1][y].distance = maze[x][y].distance + 1;
-			Enqueue(&queue, x-1, y);
-		}
-		if (y > 0 && maze[x][y-1].isOpen && !maze[x][y-1].visited)
-		{
-			maze[x][y-1].visited = true;
-			maze[x][y-1].distance = maze[x][y].distance + 1;
-			Enqueue(&queue, x, y-1);
-		}
-		if (x < xSize && maze[x+1][y].isOpen && !maze[x+1][y].visited)
-		{
-			maze[x+1][y].visited = true;
-			maze[x+1][y].distance = maze[x][y].distance + 1;
-			Enqueue(&queue, x+1, y);
-		}
-		if (y < ySize && maze[x][y+1].isOpen && !maze[x][y+1].visited)
-		{
-			maze[x][y+1].visited = true;
-			maze[x][y+1].distance = maze[x][y].distance + 1;
-			Enqueue(&queue, x, y+1);
-		}
+		free(maze->rooms[x]);
 	}
+	free(maze->rooms);
+	maze->rooms = NULL;
+}
+
+
+void Start_Search(sMaze *maze)
+{
+	unsigned long x, y;
 	
-	//Now we just count the number of rooms within the specified range
-	roomCount = 0;
-	for (x = 0; x < xSize; x++)
+	maze->generation++;
+	if (maze->generation == 0)
 	{
-		for (y = 0; y < ySize; y++)
+		for (x = 0; x < maze->xSize; x++)
 		{
-			if (maze[x][y].distance <= maxSteps)
-				roomCount++;
+			for (y = 0; y < maze->ySize; y++)
+			{
+				maze->rooms[x][y].stamp = 0;
+			}
 		}
+		maze->generation = 1;
 	}
+}
+
+
+bool Visit_Room(sMaze *maze, sQueue *queue, unsigned long x, unsigned long y,
+                unsigned long distance, unsigned long seed)
+{
+	sRoom *room;
 	
-	//Print the room count
-	printf("Number of rooms within %lu steps: %lu\n", maxSteps, roomCount);
+	room = &maze->rooms[x][y];
+	if (room->stamp == maze->generation)
+		return false;
+	
+	room->stamp = maze->generation;
+	room->isOpen = Location_Is_Open(x, y, seed);
+	if (!room->isOpen)
+		return false;
+	
+	room->distance = distance;
+	Enqueue(queue, x, y);
+	return true;
+}
 
-	//Delete the queue and free the maze's memory
-	Delete_Queue(&queue);
-	for (x = 0; x < STARTING_SIZE; x++)
+
+//Count the rooms that can be reached in at most maxSteps steps. This is the
+//same search as part A, except that we loop until we run out of rooms instead
+//of stopping at a target. Visit_Room() tells us when it finds a new room, so
+//we can count rooms as we go.
+unsigned long Count_Rooms(sMaze *maze, sQueue *queue, unsigned long seed,
+                          unsigned long maxSteps)
+{
+	sRoom **rooms;
+	sCoord temp;
+	unsigned long x, y, distance, roomCount;
+	
+	rooms = maze->rooms;
+	
+	//We start out the same way. The starting room counts too.
+	Start_Search(maze);
+	Clear_Queue(queue);
+	rooms[STARTX][STARTY].stamp = maze->generation;
+	rooms[STARTX][STARTY].isOpen = true;
+	rooms[STARTX][STARTY].distance = 0;
+	Enqueue(queue, STARTX, STARTY);
+	roomCount = 1;
+	
+	//Now we loop until we run out of rooms. Since the search visits rooms in
+	//order of distance, we also know we're done as soon as we pull a room off
+	//the queue that's already maxSteps away -- none of its neighbors can be in
+	//range. That also means we never look at rooms farther out than that.
+	while (queue->numElements > 0)
 	{
-		free(maze[x]);
+		temp = Dequeue(queue);
+		x = temp.x;
+		y = temp.y;
+		if (rooms[x][y].distance >= maxSteps)
+			break;
+		
+		distance = rooms[x][y].distance + 1;
+		if (x > 0)
+			roomCount += Visit_Room(maze, queue, x-1, y, distance, seed);
+		if (y > 0)
+			roomCount += Visit_Room(maze, queue, x, y-1, distance, seed);
+		if (x + 1 < maze->xSize)
+			roomCount += Visit_Room(maze, queue, x+1, y, distance, seed);
+		if (y + 1 < maze->ySize)
+			roomCount += Visit_Room(maze, queue, x, y+1, distance, seed);
 	}
-	free(maze);
 	
-	return EXIT_SUCCESS;
+	return roomCount;
 }
 
 
@@ -264,3 +350,166 @@ bool Location_Is_Open(unsigned long x, unsigned long y, unsigned long seed)
 	//wall.
 	return (temp % 2 == 0);
 }
+
+
+//Batch mode. This is the same as part A, except that each line of the query
+//file has the form:
+//
+//    <input seed> <max steps>
+typedef struct
+{
+	unsigned long seed, maxSteps;
+	unsigned long roomCount;
+	bool done;
+} sQuery;
+
+typedef struct
+{
+	sQuery *queries;
+	unsigned long numQueries, nextQuery;
+	pthread_mutex_t lock;
+	pthread_cond_t resultReady;
+} sBatch;
+
+
+static void *Batch_Worker(void *arg)
+{
+	sBatch *batch = arg;
+	sQuery *query;
+	sMaze maze;
+	sQueue queue;
+	unsigned long q, roomCount;
+	
+	Create_Maze(&maze, STARTING_SIZE, STARTING_SIZE);
+	Init_Queue(&queue, maze.xSize * maze.ySize);
+	
+	while (true)
+	{
+		pthread_mutex_lock(&batch->lock);
+		q = batch->nextQuery++;
+		pthread_mutex_unlock(&batch->lock);
+		if (q >= batch->numQueries)
+			break;
+		
+		query = &batch->queries[q];
+		roomCount = Count_Rooms(&maze, &queue, query->seed, query->maxSteps);
+		
+		pthread_mutex_lock(&batch->lock);
+		query->roomCount = roomCount;
+		query->done = true;
+		pthread_cond_signal(&batch->resultReady);
+		pthread_mutex_unlock(&batch->lock);
+	}
+	
+	Delete_Queue(&queue);
+	Delete_Maze(&maze);
+	
+	return NULL;
+}
+
+
+int Run_Batch(const char *fileName, long numThreads)
+{
+	FILE *inFile;
+	sBatch batch;
+	sQuery *query;
+	pthread_t *threads;
+	char line[256];
+	unsigned long capacity, lineNum, q;
+	long t;
+	
+	inFile = fopen(fileName, "r");
+	if (inFile == NULL)
+	{
+		fprintf(stderr, "Error opening file: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+	
+	capacity = 64;
+	batch.numQueries = 0;
+	batch.queries = malloc(capacity * sizeof(sQuery));
+	if (batch.queries == NULL)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+	
+	lineNum = 0;
+	while (fgets(line, sizeof(line), inFile) != NULL)
+	{
+		lineNum++;
+		if (strspn(line, " \t\r\n") == strlen(line))
+			continue;
+		
+		if (batch.numQueries == capacity)
+		{
+			capacity *= 2;
+			query = realloc(batch.queries, capacity * sizeof(sQuery));
+			if (query == NULL)
+			{
+				fprintf(stderr, "Error allocating memory: %s\n",
+				                                               strerror(errno));
+				return EXIT_FAILURE;
+			}
+			batch.queries = query;
+		}
+		
+		query = &batch.queries[batch.numQueries];
+		if (sscanf(line, "%lu %lu", &query->seed, &query->maxSteps) != 2)
+		{
+			fprintf(stderr, "Error parsing line %lu of %s\n", lineNum,
+			                                                          fileName);
+			return EXIT_FAILURE;
+		}
+		query->done = false;
+		batch.numQueries++;
+	}
+	fclose(inFile);
+	
+	if ((unsigned long)numThreads > batch.numQueries)
+		numThreads = batch.numQueries;
+	
+	batch.nextQuery = 0;
+	pthread_mutex_init(&batch.lock, NULL);
+	pthread_cond_init(&batch.resultReady, NULL);
+	threads = malloc(numThreads * sizeof(pthread_t));
+	if (threads == NULL && numThreads > 0)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+	for (t = 0; t < numThreads; t++)
+	{
+		if (pthread_create(&threads[t], NULL, Batch_Worker, &batch) != 0)
+		{
+			fprintf(stderr, "Error creating thread\n");
+			return EXIT_FAILURE;
+		}
+	}
+	
+	for (q = 0; q < batch.numQueries; q++)
+	{
+		query = &batch.queries[q];
+		
+		pthread_mutex_lock(&batch.lock);
+		while (!query->done)
+		{
+			pthread_cond_wait(&batch.resultReady, &batch.lock);
+		}
+		pthread_mutex_unlock(&batch.lock);
+		
+		printf("%lu %lu: %lu\n", query->seed, query->maxSteps,
+		                                                     query->roomCount);
+	}
+	
+	for (t = 0; t < numThreads; t++)
+	{
+		pthread_join(threads[t], NULL);
+	}
+	pthread_cond_destroy(&batch.resultReady);
+	pthread_mutex_destroy(&batch.lock);
+	free(threads);
+	free(batch.queries);
+	
+	return EXIT_SUCCESS;
+}
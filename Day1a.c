@@ -19,6 +19,10 @@
 //after each comma, and the list is terminated with a newline. The input is
 //guaranteed to be correct, so no error-checking is needed.
 //
+//(Our test walks are much longer than the puzzle input -- some are several
+//gigabytes -- so we're careful not to read the whole input into memory at
+//once.)
+//
 //Question 1: After following the directions, how many blocks are we from the
 //starting point?
 //
@@ -29,6 +33,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//When reading from the standard input, we read this many bytes at a time
+#define CHUNK_SIZE 65536
 
 //I've chosen to represent both the position and direction as vectors in
 //Cartesian coordinates. This will make it easier to compute distances.
@@ -44,21 +57,44 @@ const sVector south = {0, -1};
 const sVector east = {1, 0};
 const sVector west = {-1, 0};
 
+//Everything we know about the walk so far
+typedef struct
+{
+	sVector position;
+	sVector direction;
+	int maxX, maxY, minX, minY;
+} sWalk;
+
+//The tokenizer reads the instructions one character at a time, so it has to
+//remember where it is in the current instruction: the turn ('L' or 'R', or 0
+//if we're between instructions) and the digits of the distance so far. This
+//lets us stop in the middle of an instruction and pick up where we left off
+//with the next chunk of input.
+typedef struct
+{
+	char turn;
+	int distance;
+} sTokenizer;
+
 //Function prototypes. I like putting the main function first so I can get a
 //feel for the whole program before I dive into the supporting functions. The
 //downside is that I need to have explicit prototypes before main().
 sVector Turn_Right(sVector currentDirection);
 sVector Turn_Left(sVector currentDirection);
+bool Read_File(const char *fileName, sTokenizer *tokenizer, sWalk *walk);
+bool Read_Stream(FILE *inFile, sTokenizer *tokenizer, sWalk *walk);
+void Tokenize(sTokenizer *tokenizer, const char *data, size_t length,
+              sWalk *walk);
+void Finish_Tokens(sTokenizer *tokenizer, sWalk *walk);
+void Follow_Instruction(sWalk *walk, char turn, int distance);
 
 
 int main(int argc, char **argv)
 {
-	sVector direction = north;
-	sVector position = {0, 0};
-	FILE *inFile;
-	char *input, *token;
-	size_t inSize;
-	int distance = 0, maxX = 0, maxY = 0, minX = 0, minY = 0;
+	sWalk walk = {{0, 0}, north, 0, 0, 0, 0};
+	sTokenizer tokenizer = {0, 0};
+	bool success;
+	int distance;
 	
 	//We could hard-code the filename, but for this lesson, let's take it as a
 	//command line argument. We'll start by checking for the correct number of
@@ -70,7 +106,8 @@ int main(int argc, char **argv)
 		//error messages. This lets the user redirect the output without
 		//missing any errors. Because we're using a different stream, we
 		//need to use fprintf instead of printf.
-		fprintf(stderr, "Usage:\n\tDay1 <input filename>\n\n");
+		fprintf(stderr, "Usage:\n\tDay1 <input filename>\n\tDay1 - "
+		                                      "(read from standard input)\n\n");
 		
 		//Let's use the stdlib.h constant instead of 1. You never know when
 		//your code might need to run on VMS! :-)
@@ -78,110 +115,200 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 	
-	//Now we need to open the file. This just takes a call to fopen(). Failure
-	//is indicated by a null return value, with an error code stored in errno.
-	inFile = fopen(argv[1], "r");
-	if (inFile == NULL)
+	//Now we need to read the instructions. A filename of "-" is a common
+	//convention for "read from the standard input instead", which lets us pipe
+	//in the output of another program. Either way, the instructions are fed to
+	//the tokenizer, which follows each one as soon as it's complete.
+	if (strcmp(argv[1], "-") == 0)
+		success = Read_Stream(stdin, &tokenizer, &walk);
+	else
+		success = Read_File(argv[1], &tokenizer, &walk);
+	if (!success)
+		return EXIT_FAILURE;
+	
+	//The input might not end with a separator, so the tokenizer could still be
+	//holding on to the last instruction
+	Finish_Tokens(&tokenizer, &walk);
+	
+	//Now we have the coordinates of the final location. Adding the absolute
+	//X and Y values together gives us the taxicab distance from the starting
+	//point.
+	printf("Final location: %d, %d\n", walk.position.x, walk.position.y);
+	distance = abs(walk.position.x) + abs(walk.position.y);
+	printf("Distance from start: %d\n", distance);
+	printf("Max X: %d\tMax Y: %d\n", walk.maxX, walk.maxY);
+	printf("Min X: %d\tMin Y: %d\n", walk.minX, walk.minY);
+	
+	return EXIT_SUCCESS;
+}
+
+
+//Read the instructions from a file. The usual way would be to allocate a buffer
+//as big as the file and read the file into it, but there's a better way on
+//POSIX systems: mmap(). It asks the operating system to map the file into our
+//memory, so that we can read it as if it were one big array. Nothing is
+//actually copied. Instead, the operating system loads pieces of the file as we
+//touch them, straight out of its own file cache. This is great for very big
+//files, since we never need a second copy of the data.
+//
+//mmap() works with the lower-level POSIX file functions, so we use open() and
+//close() instead of fopen() and fclose(). Instead of a FILE pointer, open()
+//gives us a file descriptor, which is just a number, or -1 on failure. To
+//find out how big the file is, we use fstat().
+bool Read_File(const char *fileName, sTokenizer *tokenizer, sWalk *walk)
+{
+	struct stat fileInfo;
+	const char *data;
+	size_t length;
+	int fd;
+	
+	fd = open(fileName, O_RDONLY);
+	if (fd < 0)
 	{
 		//We can use strerror() to convert the errno value to a helpful string!
 		fprintf(stderr, "Error opening file: %s\n\n", strerror(errno));
-		return EXIT_FAILURE;
+		return false;
 	}
 	
-	//Now we need to read the file. We could parse it one character at a time,
-	//but I prefer to read all of the data into memory. This makes it easier
-	//to tokenize later. But first, we need to allocate memory, and that means
-	//we need to know how big the file is. Unfortunately, there's no standard
-	//way to do this. We'll have to settle for POSIX compliance instead.
-	fseek(inFile, 0, SEEK_END);
-	inSize = (size_t)ftell(inFile);
-	rewind(inFile);
-	
-	//With the file size, we can allocate enough memory using malloc(). One
-	//more byte is required to hold the null character that will terminate
-	//the string.
-	input = malloc(inSize + 1);
-	if (input == NULL)
+	if (fstat(fd, &fileInfo) != 0)
 	{
-		//Always check for NULL when calling malloc()!
-		fprintf(stderr, "Error allocating memory: %s\n\n", strerror(errno));
-		return EXIT_FAILURE;
+		fprintf(stderr, "Error reading file: %s\n\n", strerror(errno));
+		close(fd);
+		return false;
 	}
+	length = (size_t)fileInfo.st_size;
 	
-	//Finally, we can read the data from the file using fgets(). There's no
-	//reason to keep the file open any longer, so let's close it now.
-	fgets(input, inSize + 1, inFile);
-	fclose(inFile);
-	
-	//Now the real work begins. We need to parse the instructions in the string
-	//one at a time. This means we have to break up the string and filter out
-	//the separator characters. Our best friend for this task is strtok(), the
-	//string tokenizing function. It looks complicated, but it's actually not
-	//that bad. We feed in our input string and a list of separator characters,
-	//and strtok() returns a pointer to a substring that contains the first
-	//instruction with separator characters removed! Calling strtok() again
-	//(this time with NULL in place of the string pointer) returns the next
-	//token. When the tokens run out, strtok() returns NULL. Note that the
-	//original string is modified, so we can't reuse it later.
-	//
-	//This functionality is similar to the split function in Perl or Python.
-	//Those languages helpfully put the tokens into an array, allocating memory
-	//in the process, all in a single line of code. That's the benefit of high-
-	//level programming! But we're hard-core low-level C programmers, so we
-	//don't need any help. :-)
-	token = strtok(input, " ,\n");
-	while (token != NULL)
+	//mmap() can't map an empty file, but then there's nothing to do anyway.
+	//The mapping is read-only, which is fine, since the tokenizer never
+	//changes the data. (strtok() would have -- it writes a null character at
+	//the end of every token.) madvise() tells the operating system we're going
+	//to read the file from start to finish, so it can load the next pieces
+	//before we get to them.
+	if (length > 0)
 	{
-		//Having chosen a good representation for position and direction and
-		//defined functions for rotation, the actual work is easy!
-	
-		//The first character of the token string is either 'L' or 'R', which
-		//tells us how to rotate. In a real program, we would need an error
-		//handler in case the character is something else.
-		if (token[0] == 'L')
-			direction = Turn_Left(direction);
-		else
-			direction = Turn_Right(direction);
-
-		//The remaining characters are the distance, and need to be converted
-		//to an integer. For this simple case with guaranteed good input, we
-		//can use atoi(). In any other situation, we'd have to use strtol().
-		distance = atoi(token + 1);
-
-		//The change in position is the new direction multiplied by the
-		//distance to walk.
-		position.x += distance * direction.x;
-		position.y += distance * direction.y;
+		data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			fprintf(stderr, "Error mapping file: %s\n\n", strerror(errno));
+			close(fd);
+			return false;
+		}
+		madvise((void *)data, length, MADV_SEQUENTIAL);
 		
-		//Get the extreme X and Y coordinates we see for later use
-		if (position.x > maxX)
-			maxX = position.x;
-		if (position.y > maxY)
-			maxY = position.y;
-		if (position.x < minX)
-			minX = position.x;
-		if (position.y < minY)
-			minY = position.y;
-		
-		//Call strtok() again to get a pointer to the next token. If there are
-		//no more tokens, strtok() returns NULL.
-		token = strtok(NULL, " ,\n");
+		Tokenize(tokenizer, data, length, walk);
+		munmap((void *)data, length);
 	}
 	
-	//Now we have the coordinates of the final location. Adding the absolute
-	//X and Y values together gives us the taxicab distance from the starting
-	//point.
-	printf("Final location: %d, %d\n", position.x, position.y);
-	distance = abs(position.x) + abs(position.y);
-	printf("Distance from start: %d\n", distance);
-	printf("Max X: %d\tMax Y: %d\n", maxX, maxY);
-	printf("Min X: %d\tMin Y: %d\n", minX, minY);
+	//The mapping doesn't need the file to stay open, but we've already unmapped
+	//it anyway
+	close(fd);
 	
-	//Don't forget to free allocated memory! It happens automatically at the
-	//end of the program, but that's no excuse for sloppiness.
-	free(input);
+	return true;
+}
+
+
+//Read the instructions from a stream, like the standard input. We can't map a
+//stream, since it might be coming from another program that hasn't finished
+//writing it yet. Instead, we read it a chunk at a time with fread(), which
+//reads a fixed number of bytes rather than a line. Instructions can be split
+//between chunks, but the tokenizer remembers where it was, so that's fine.
+bool Read_Stream(FILE *inFile, sTokenizer *tokenizer, sWalk *walk)
+{
+	//This buffer is static so it doesn't take up a big chunk of the stack
+	static char chunk[CHUNK_SIZE];
+	size_t length;
 	
-	return EXIT_SUCCESS;
+	while ((length = fread(chunk, 1, CHUNK_SIZE, inFile)) > 0)
+	{
+		Tokenize(tokenizer, chunk, length, walk);
+	}
+	
+	if (ferror(inFile))
+	{
+		fprintf(stderr, "Error reading input: %s\n\n", strerror(errno));
+		return false;
+	}
+	
+	return true;
+}
+
+
+//Split the input into instructions and follow each one. An 'L' or 'R' starts a
+//new instruction, digits add to its distance, and anything else (like a comma,
+//a space, or a newline) ends it. This is a tiny state machine: what we do
+//with each character depends on whether we're in the middle of an
+//instruction.
+void Tokenize(sTokenizer *tokenizer, const char *data, size_t length,
+              sWalk *walk)
+{
+	size_t i;
+	char c;
+	
+	for (i = 0; i < length; i++)
+	{
+		c = data[i];
+		if (c == 'L' || c == 'R')
+		{
+			//If there was no separator, the last instruction ends here
+			Finish_Tokens(tokenizer, walk);
+			tokenizer->turn = c;
+			tokenizer->distance = 0;
+		} else if (c >= '0' && c <= '9')
+		{
+			//Digits outside an instruction are ignored. Otherwise, we build
+			//up the distance one digit at a time, the same way atoi() would,
+			//but checking that it doesn't get too big for an int.
+			if (tokenizer->turn == 0)
+				continue;
+			if (tokenizer->distance > (INT_MAX - (c - '0')) / 10)
+			{
+				fprintf(stderr, "Error: Distance is too large\n\n");
+				exit(EXIT_FAILURE);
+			}
+			tokenizer->distance = tokenizer->distance * 10 + (c - '0');
+		} else
+		{
+			Finish_Tokens(tokenizer, walk);
+		}
+	}
+}
+
+
+//Follow the instruction the tokenizer is working on, if there is one
+void Finish_Tokens(sTokenizer *tokenizer, sWalk *walk)
+{
+	if (tokenizer->turn != 0)
+	{
+		Follow_Instruction(walk, tokenizer->turn, tokenizer->distance);
+		tokenizer->turn = 0;
+		tokenizer->distance = 0;
+	}
+}
+
+
+//Having chosen a good representation for position and direction and defined
+//functions for rotation, the actual work is easy!
+void Follow_Instruction(sWalk *walk, char turn, int distance)
+{
+	if (turn == 'L')
+		walk->direction = Turn_Left(walk->direction);
+	else
+		walk->direction = Turn_Right(walk->direction);
+	
+	//The change in position is the new direction multiplied by the distance
+	//to walk
+	walk->position.x += distance * walk->direction.x;
+	walk->position.y += distance * walk->direction.y;
+	
+	//Get the extreme X and Y coordinates we see for later use
+	if (walk->position.x > walk->maxX)
+		walk->maxX = walk->position.x;
+	if (walk->position.y > walk->maxY)
+		walk->maxY = walk->position.y;
+	if (walk->position.x < walk->minX)
+		walk->minX = walk->position.x;
+	if (walk->position.y < walk->minY)
+		walk->minY = walk->position.y;
 }
 
 
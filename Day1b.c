@@ -4,23 +4,36 @@
 //any intersection we pass through while following the instructions, not just
 //the endpoints.
 //
-//To solve this puzzle, we can create a 2D array of boolean values. Whenever we
-//visit a location, we'll mark it true. When we find a location that's already
-//true, that's the answer. Another method could be to make a list of locations
-//on the fly and compare each new one against the others. Perhaps there's some
-//clever geometric way to solve this without brute force, but I haven't been
-//able to think of one.
+//My first solution used a 2D array of boolean values. Whenever we visited a
+//location, we marked it true, and the first location that was already true was
+//the answer. That works, but the array has to be big enough for the whole
+//walk, and a longer walk could wander right off the edge of it.
+//
+//There's a clever geometric way to solve this after all. Between turns, we walk
+//in a straight line, so the walk is just a list of horizontal and vertical line
+//segments. Visiting a location twice means two of the segments touch. Finding
+//touching segments is a classic problem with a classic solution: sweep a
+//vertical line across the map from left to right, keeping track of which
+//horizontal segments it's crossing. Whenever it hits a vertical segment, we
+//check whether any of those horizontal segments are in its way. The memory we
+//need only depends on the number of instructions, not on how far we walk.
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
-	#include <stdbool.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+	#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+	#define MAX(a, b) (((a) > (b)) ? (a) : (b))
 
-//While answering the previous question, we found that the most extreme X and
-//Y values were between -256 and 256. Thus, a 512x512 grid can hold every
-//location we visit.
-	#define GRID_SIZE 512
+//When reading from the standard input, we read this many bytes at a time
+#define CHUNK_SIZE 65536
 
 //I've chosen to represent both the position and direction as vectors in
 //Cartesian coordinates. This will make it easier to compute distances.
@@ -36,28 +49,92 @@ const sVector south = {0, -1};
 const sVector east = {1, 0};
 const sVector west = {-1, 0};
 
+//A straight stretch of the walk between two turns. The start is the first block
+//we step onto, not the corner we turned at. That way, segments never share
+//their corners, and any two segments that touch mean a location we visited
+//twice.
+	typedef struct
+	{
+		sVector start;
+		sVector end;
+	} sSegment;
+
+//For the sweep, each segment is stored as the coordinate that doesn't change
+//(fixed), and the range of the coordinate that does (low to high)
+	typedef struct
+	{
+		int fixed;
+		int low, high;
+	} sLine;
+
+//An event for the sweep line at a particular X coordinate
+	enum {START_HORIZONTAL, CHECK_VERTICAL, END_HORIZONTAL};
+	typedef struct
+	{
+		int x;
+		int type;
+		int low, high;
+	} sEvent;
+
+//Everything we know about the walk so far. For this part, that includes all of
+//the segments we've walked.
+typedef struct
+{
+	sVector position;
+	sVector direction;
+	int maxX, maxY, minX, minY;
+		sSegment *segments;
+		int numSegments, maxSegments;
+} sWalk;
+
+//The tokenizer reads the instructions one character at a time, so it has to
+//remember where it is in the current instruction: the turn ('L' or 'R', or 0
+//if we're between instructions) and the digits of the distance so far. This
+//lets us stop in the middle of an instruction and pick up where we left off
+//with the next chunk of input.
+typedef struct
+{
+	char turn;
+	int distance;
+} sTokenizer;
+
 //Function prototypes. I like putting the main function first so I can get a
 //feel for the whole program before I dive into the supporting functions. The
 //downside is that I need to have explicit prototypes before main().
 sVector Turn_Right(sVector currentDirection);
 sVector Turn_Left(sVector currentDirection);
+bool Read_File(const char *fileName, sTokenizer *tokenizer, sWalk *walk);
+bool Read_Stream(FILE *inFile, sTokenizer *tokenizer, sWalk *walk);
+void Tokenize(sTokenizer *tokenizer, const char *data, size_t length,
+              sWalk *walk);
+void Finish_Tokens(sTokenizer *tokenizer, sWalk *walk);
+void Follow_Instruction(sWalk *walk, char turn, int distance);
+	bool Find_First_Revisit(const sSegment *segments, int numSegments,
+	                        sVector *revisit);
+	bool Segments_Touch(const sSegment *segments, int numSegments);
 
 
 int main(int argc, char **argv)
 {
-	sVector direction = north;
-	sVector position = {0, 0};
+	sWalk walk = {{0, 0}, north, 0, 0, 0, 0, NULL, 0, 0};
+	sTokenizer tokenizer = {0, 0};
+	bool success;
+	int distance;
 		sVector doubleVisit;
-		bool visited[GRID_SIZE][GRID_SIZE];
 		bool foundFirst = false;
-	FILE *inFile;
-	char *input, *token;
-	size_t inSize;
-	int distance = 0, maxX = 0, maxY = 0, minX = 0, minY = 0;
-		int block;
 
-		memset(visited, false, GRID_SIZE * GRID_SIZE * sizeof(bool));
-		visited[0+256][0+256] = true;
+		//The starting location counts as visited, so it's the first segment,
+		//even though it's only a single point
+		walk.maxSegments = 1024;
+		walk.segments = malloc(walk.maxSegments * sizeof(sSegment));
+		if (walk.segments == NULL)
+		{
+			fprintf(stderr, "Error allocating memory: %s\n\n", strerror(errno));
+			return EXIT_FAILURE;
+		}
+		walk.segments[0].start = walk.position;
+		walk.segments[0].end = walk.position;
+		walk.numSegments = 1;
 	
 	//We could hard-code the filename, but for this lesson, let's take it as a
 	//command line argument. We'll start by checking for the correct number of
@@ -69,7 +146,8 @@ int main(int argc, char **argv)
 		//error messages. This lets the user redirect the output without
 		//missing any errors. Because we're using a different stream, we
 		//need to use fprintf instead of printf.
-		fprintf(stderr, "Usage:\n\tDay1 <input filename>\n\n");
+		fprintf(stderr, "Usage:\n\tDay1 <input filename>\n\tDay1 - "
+		                                      "(read from standard input)\n\n");
 		
 		//Let's use the stdlib.h constant instead of 1. You never know when
 		//your code might need to run on VMS! :-)
@@ -77,132 +155,242 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 	
-	//Now we need to open the file. This just takes a call to fopen(). Failure
-	//is indicated by a null return value, with an error code stored in errno.
-	inFile = fopen(argv[1], "r");
-	if (inFile == NULL)
-	{
-		//We can use strerror() to convert the errno value to a helpful string!
-		fprintf(stderr, "Error opening file: %s\n\n", strerror(errno));
+	//Now we need to read the instructions. A filename of "-" is a common
+	//convention for "read from the standard input instead", which lets us pipe
+	//in the output of another program. Either way, the instructions are fed to
+	//the tokenizer, which follows each one as soon as it's complete.
+	if (strcmp(argv[1], "-") == 0)
+		success = Read_Stream(stdin, &tokenizer, &walk);
+	else
+		success = Read_File(argv[1], &tokenizer, &walk);
+	if (!success)
 		return EXIT_FAILURE;
-	}
 	
-	//Now we need to read the file. We could parse it one character at a time,
-	//but I prefer to read all of the data into memory. This makes it easier
-	//to tokenize later. But first, we need to allocate memory, and that means
-	//we need to know how big the file is. Unfortunately, there's no standard
-	//way to do this. We'll have to settle for POSIX compliance instead.
-	fseek(inFile, 0, SEEK_END);
-	inSize = (size_t)ftell(inFile);
-	rewind(inFile);
-	
-	//With the file size, we can allocate enough memory using malloc(). One
-	//more byte is required to hold the null character that will terminate
-	//the string.
-	input = malloc(inSize + 1);
-	if (input == NULL)
-	{
-		//Always check for NULL when calling malloc()!
-		fprintf(stderr, "Error allocating memory: %s\n\n", strerror(errno));
-		return EXIT_FAILURE;
-	}
+	//The input might not end with a separator, so the tokenizer could still be
+	//holding on to the last instruction
+	Finish_Tokens(&tokenizer, &walk);
 	
-	//Finally, we can read the data from the file using fgets(). There's no
-	//reason to keep the file open any longer, so let's close it now.
-	fgets(input, inSize + 1, inFile);
-	fclose(inFile);
-	
-	//Now the real work begins. We need to parse the instructions in the string
-	//one at a time. This means we have to break up the string and filter out
-	//the separator characters. Our best friend for this task is strtok(), the
-	//string tokenizing function. It looks complicated, but it's actually not
-	//that bad. We feed in our input string and a list of separator characters,
-	//and strtok() returns a pointer to a substring that contains the first
-	//instruction with separator characters removed! Calling strtok() again
-	//(this time with NULL in place of the string pointer) returns the next
-	//token. When the tokens run out, strtok() returns NULL. Note that the
-	//original string is modified, so we can't reuse it later.
-	//
-	//This functionality is similar to the split function in Perl or Python.
-	//Those languages helpfully put the tokens into an array, allocating memory
-	//in the process, all in a single line of code. That's the benefit of high-
-	//level programming! But we're hard-core low-level C programmers, so we
-	//don't need any help. :-)
-	token = strtok(input, " ,\n");
-	while (token != NULL)
-	{
-		//Having chosen a good representation for position and direction and
-		//defined functions for rotation, the actual work is easy!
-	
-		//The first character of the token string is either 'L' or 'R', which
-		//tells us how to rotate. In a real program, we would need an error
-		//handler in case the character is something else.
-		if (token[0] == 'L')
-			direction = Turn_Left(direction);
-		else
-			direction = Turn_Right(direction);
-
-		//The remaining characters are the distance, and need to be converted
-		//to an integer. For this simple case with guaranteed good input, we
-		//can use atoi(). In any other situation, we'd have to use strtol().
-		distance = atoi(token + 1);
-
-		//The change in position is the new direction multiplied by the
-		//distance to walk. To check for double visits, we need to go
-		//one block at a time.
-			for (block = 0; block < distance; block++)
-			{
-				position.x += direction.x;
-				position.y += direction.y;
-			
-				//Check whether we've visited this position before
-				if (visited[position.x+256][position.y+256] && !foundFirst)
-				{
-					doubleVisit.x = position.x;
-					doubleVisit.y = position.y;
-					foundFirst = true;
-				} else
-				{
-					visited[position.x+256][position.y+256] = true;
-				}
-			}
-		
-		//Get the extreme X and Y coordinates we see for later use
-		if (position.x > maxX)
-			maxX = position.x;
-		if (position.y > maxY)
-			maxY = position.y;
-		if (position.x < minX)
-			minX = position.x;
-		if (position.y < minY)
-			minY = position.y;
-		
-		//Call strtok() again to get a pointer to the next token. If there are
-		//no more tokens, strtok() returns NULL.
-		token = strtok(NULL, " ,\n");
-	}
+		//Now we can look for the first location we visited twice
+		foundFirst = Find_First_Revisit(walk.segments, walk.numSegments,
+		                                                       &doubleVisit);
 	
 	//Now we have the coordinates of the final location. Adding the absolute
 	//X and Y values together gives us the taxicab distance from the starting
 	//point.
-	printf("Final location: %d, %d\n", position.x, position.y);
-	distance = abs(position.x) + abs(position.y);
+	printf("Final location: %d, %d\n", walk.position.x, walk.position.y);
+	distance = abs(walk.position.x) + abs(walk.position.y);
 	printf("Distance from start: %d\n", distance);
-	printf("Max X: %d\tMax Y: %d\n", maxX, maxY);
-	printf("Min X: %d\tMin Y: %d\n", minX, minY);
-		printf("First double visitation: %d, %d\n", doubleVisit.x,
-		                                            doubleVisit.y);
-		distance = abs(doubleVisit.x) + abs(doubleVisit.y);
-		printf("Double visitation distance: %d\n", distance);
+	printf("Max X: %d\tMax Y: %d\n", walk.maxX, walk.maxY);
+	printf("Min X: %d\tMin Y: %d\n", walk.minX, walk.minY);
+		if (foundFirst)
+		{
+			printf("First double visitation: %d, %d\n", doubleVisit.x,
+			                                            doubleVisit.y);
+			distance = abs(doubleVisit.x) + abs(doubleVisit.y);
+			printf("Double visitation distance: %d\n", distance);
+		} else
+		{
+			printf("No location was visited twice\n");
+		}
 	
 	//Don't forget to free allocated memory! It happens automatically at the
 	//end of the program, but that's no excuse for sloppiness.
-	free(input);
+		free(walk.segments);
 	
 	return EXIT_SUCCESS;
 }
 
 
+//Read the instructions from a file. The usual way would be to allocate a buffer
+//as big as the file and read the file into it, but there's a better way on
+//POSIX systems: mmap(). It asks the operating system to map the file into our
+//memory, so that we can read it as if it were one big array. Nothing is
+//actually copied. Instead, the operating system loads pieces of the file as we
+//touch them, straight out of its own file cache. This is great for very big
+//files, since we never need a second copy of the data.
+//
+//mmap() works with the lower-level POSIX file functions, so we use open() and
+//close() instead of fopen() and fclose(). Instead of a FILE pointer, open()
+//gives us a file descriptor, which is just a number, or -1 on failure. To
+//find out how big the file is, we use fstat().
+bool Read_File(const char *fileName, sTokenizer *tokenizer, sWalk *walk)
+{
+	struct stat fileInfo;
+	const char *data;
+	size_t length;
+	int fd;
+	
+	fd = open(fileName, O_RDONLY);
+	if (fd < 0)
+	{
+		//We can use strerror() to convert the errno value to a helpful string!
+		fprintf(stderr, "Error opening file: %s\n\n", strerror(errno));
+		return false;
+	}
+	
+	if (fstat(fd, &fileInfo) != 0)
+	{
+		fprintf(stderr, "Error reading file: %s\n\n", strerror(errno));
+		close(fd);
+		return false;
+	}
+	length = (size_t)fileInfo.st_size;
+	
+	//mmap() can't map an empty file, but then there's nothing to do anyway.
+	//The mapping is read-only, which is fine, since the tokenizer never
+	//changes the data. (strtok() would have -- it writes a null character at
+	//the end of every token.) madvise() tells the operating system we're going
+	//to read the file from start to finish, so it can load the next pieces
+	//before we get to them.
+	if (length > 0)
+	{
+		data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			fprintf(stderr, "Error mapping file: %s\n\n", strerror(errno));
+			close(fd);
+			return false;
+		}
+		madvise((void *)data, length, MADV_SEQUENTIAL);
+		
+		Tokenize(tokenizer, data, length, walk);
+		munmap((void *)data, length);
+	}
+	
+	//The mapping doesn't need the file to stay open, but we've already unmapped
+	//it anyway
+	close(fd);
+	
+	return true;
+}
+
+
+//Read the instructions from a stream, like the standard input. We can't map a
+//stream, since it might be coming from another program that hasn't finished
+//writing it yet. Instead, we read it a chunk at a time with fread(), which
+//reads a fixed number of bytes rather than a line. Instructions can be split
+//between chunks, but the tokenizer remembers where it was, so that's fine.
+bool Read_Stream(FILE *inFile, sTokenizer *tokenizer, sWalk *walk)
+{
+	//This buffer is static so it doesn't take up a big chunk of the stack
+	static char chunk[CHUNK_SIZE];
+	size_t length;
+	
+	while ((length = fread(chunk, 1, CHUNK_SIZE, inFile)) > 0)
+	{
+		Tokenize(tokenizer, chunk, length, walk);
+	}
+	
+	if (ferror(inFile))
+	{
+		fprintf(stderr, "Error reading input: %s\n\n", strerror(errno));
+		return false;
+	}
+	
+	return true;
+}
+
+
+//Split the input into instructions and follow each one. An 'L' or 'R' starts a
+//new instruction, digits add to its distance, and anything else (like a comma,
+//a space, or a newline) ends it. This is a tiny state machine: what we do
+//with each character depends on whether we're in the middle of an
+//instruction.
+void Tokenize(sTokenizer *tokenizer, const char *data, size_t length,
+              sWalk *walk)
+{
+	size_t i;
+	char c;
+	
+	for (i = 0; i < length; i++)
+	{
+		c = data[i];
+		if (c == 'L' || c == 'R')
+		{
+			//If there was no separator, the last instruction ends here
+			Finish_Tokens(tokenizer, walk);
+			tokenizer->turn = c;
+			tokenizer->distance = 0;
+		} else if (c >= '0' && c <= '9')
+		{
+			//Digits outside an instruction are ignored. Otherwise, we build
+			//up the distance one digit at a time, the same way atoi() would,
+			//but checking that it doesn't get too big for an int.
+			if (tokenizer->turn == 0)
+				continue;
+			if (tokenizer->distance > (INT_MAX - (c - '0')) / 10)
+			{
+				fprintf(stderr, "Error: Distance is too large\n\n");
+				exit(EXIT_FAILURE);
+			}
+			tokenizer->distance = tokenizer->distance * 10 + (c - '0');
+		} else
+		{
+			Finish_Tokens(tokenizer, walk);
+		}
+	}
+}
+
+
+//Follow the instruction the tokenizer is working on, if there is one
+void Finish_Tokens(sTokenizer *tokenizer, sWalk *walk)
+{
+	if (tokenizer->turn != 0)
+	{
+		Follow_Instruction(walk, tokenizer->turn, tokenizer->distance);
+		tokenizer->turn = 0;
+		tokenizer->distance = 0;
+	}
+}
+
+
+//Having chosen a good representation for position and direction and defined
+//functions for rotation, the actual work is easy!
+void Follow_Instruction(sWalk *walk, char turn, int distance)
+{
+	if (turn == 'L')
+		walk->direction = Turn_Left(walk->direction);
+	else
+		walk->direction = Turn_Right(walk->direction);
+	
+	//The change in position is the new direction multiplied by the distance
+	//to walk. To check for double visits later, we add this stretch of the
+	//walk to the list of segments, making the list bigger if we need to.
+		if (distance == 0)
+			return;
+		if (walk->numSegments == walk->maxSegments)
+		{
+			walk->maxSegments *= 2;
+			walk->segments = realloc(walk->segments,
+			                            walk->maxSegments * sizeof(sSegment));
+			if (walk->segments == NULL)
+			{
+				fprintf(stderr, "Error allocating memory: %s\n\n",
+				                                               strerror(errno));
+				exit(EXIT_FAILURE);
+			}
+		}
+		walk->segments[walk->numSegments].start.x = walk->position.x +
+		                                                    walk->direction.x;
+		walk->segments[walk->numSegments].start.y = walk->position.y +
+		                                                    walk->direction.y;
+	walk->position.x += distance * walk->direction.x;
+	walk->position.y += distance * walk->direction.y;
+		walk->segments[walk->numSegments].end = walk->position;
+		walk->numSegments++;
+	
+	//Get the extreme X and Y coordinates we see for later use
+	if (walk->position.x > walk->maxX)
+		walk->maxX = walk->position.x;
+	if (walk->position.y > walk->maxY)
+		walk->maxY = walk->position.y;
+	if (walk->position.x < walk->minX)
+		walk->minX = walk->position.x;
+	if (walk->position.y < walk->minY)
+		walk->minY = walk->position.y;
+}
+
+
 //90-degree rotation is very simple. A general rotation handler would require
 //matrix multiplication. You can see what this looks like for the 90-degree
 //case here: https://en.wikipedia.org/wiki/Rotation_matrix#Common_rotations
@@ -225,3 +413,263 @@ sVector Turn_Left(sVector currentDirection)
 	
 	return newDirection;
 }
+
+
+//Find the first location we visit twice. Segments_Touch() can tell us whether
+//any segments in a list touch, but not which ones touch first. However, if the
+//first few segments touch, adding more segments won't change that. So we can
+//binary search for the shortest stretch of the walk that touches itself: the
+//last segment in it is the one that brings us back to a location we've
+//already visited. Then we just have to find the first point on that segment
+//that's on one of the earlier ones.
+	bool Find_First_Revisit(const sSegment *segments, int numSegments,
+	                        sVector *revisit)
+	{
+		const sSegment *last;
+		sVector point;
+		int low, high, middle, i, lowX, highX, lowY, highY, steps, bestSteps;
+		
+		if (!Segments_Touch(segments, numSegments))
+			return false;
+		
+		//The first "low" segments don't touch, but the first "high" segments do
+		low = 1;
+		high = numSegments;
+		while (high - low > 1)
+		{
+			middle = low + (high - low) / 2;
+			if (Segments_Touch(segments, middle))
+				high = middle;
+			else
+				low = middle;
+		}
+		
+		//Check the last segment against each of the earlier ones. Where two
+		//segments overlap, the overlap is the box between the larger of their
+		//low ends and the smaller of their high ends. If they cross, the box is
+		//a single point, and if they lie along the same line, it's a stretch of
+		//that line. Either way, the closest point in the box to the start of
+		//the last segment is the first one we reach.
+		last = &segments[high - 1];
+		bestSteps = -1;
+		for (i = 0; i < high - 1; i++)
+		{
+			lowX = MAX(MIN(last->start.x, last->end.x),
+			           MIN(segments[i].start.x, segments[i].end.x));
+			highX = MIN(MAX(last->start.x, last->end.x),
+			            MAX(segments[i].start.x, segments[i].end.x));
+			lowY = MAX(MIN(last->start.y, last->end.y),
+			           MIN(segments[i].start.y, segments[i].end.y));
+			highY = MIN(MAX(last->start.y, last->end.y),
+			            MAX(segments[i].start.y, segments[i].end.y));
+			if (lowX > highX || lowY > highY)
+				continue;
+			
+			point.x = MIN(MAX(last->start.x, lowX), highX);
+			point.y = MIN(MAX(last->start.y, lowY), highY);
+			steps = abs(point.x - last->start.x) + abs(point.y - last->start.y);
+			if (bestSteps < 0 || steps < bestSteps)
+			{
+				bestSteps = steps;
+				*revisit = point;
+			}
+		}
+		
+		return true;
+	}
+
+
+//qsort() comparison function for lines: sort by the fixed coordinate, then by
+//the low end
+	int Compare_Lines(const void *a, const void *b)
+	{
+		const sLine *first = a, *second = b;
+		
+		if (first->fixed != second->fixed)
+			return (first->fixed > second->fixed) ? 1 : -1;
+		return (first->low > second->low) - (first->low < second->low);
+	}
+
+
+//qsort() comparison function for sweep events: sort by X, and at the same X,
+//start horizontal segments before checking vertical ones, and end them after.
+//That way, segments that only touch at their ends still count.
+	int Compare_Events(const void *a, const void *b)
+	{
+		const sEvent *first = a, *second = b;
+		
+		if (first->x != second->x)
+			return (first->x > second->x) ? 1 : -1;
+		return first->type - second->type;
+	}
+
+
+//Find the position of the first value in a sorted array that's at least as big
+//as the given value
+	int Lower_Bound(const int *sorted, int count, int value)
+	{
+		int low, high, middle;
+		
+		low = 0;
+		high = count;
+		while (low < high)
+		{
+			middle = low + (high - low) / 2;
+			if (sorted[middle] < value)
+				low = middle + 1;
+			else
+				high = middle;
+		}
+		
+		return low;
+	}
+
+
+//Check whether any two lines on the same fixed coordinate overlap. Once they're
+//sorted, we only need to remember how far the lines so far have reached.
+	bool Lines_Overlap(sLine *lines, int numLines)
+	{
+		int i, reach;
+		
+		qsort(lines, numLines, sizeof(sLine), Compare_Lines);
+		reach = 0;
+		for (i = 0; i < numLines; i++)
+		{
+			if (i > 0 && lines[i].fixed == lines[i-1].fixed &&
+			                                          lines[i].low <= reach)
+				return true;
+			if (i == 0 || lines[i].fixed != lines[i-1].fixed ||
+			                                          lines[i].high > reach)
+				reach = lines[i].high;
+		}
+		
+		return false;
+	}
+
+
+//Check whether any two of the segments touch. There are three ways they can:
+//
+//1. Two horizontal segments on the same row overlap
+//2. Two vertical segments on the same column overlap
+//3. A horizontal segment crosses (or just touches) a vertical one
+//
+//The first two are easy: sort the segments by row (or column), and check each
+//one against the ones before it on the same row. For the third, we use the
+//sweep line. As the line moves to the right, we keep a count of how many
+//horizontal segments it's crossing on each row. When it reaches a vertical
+//segment, we add up the counts for the rows the vertical segment covers. If
+//the total isn't zero, they touch.
+//
+//Adding up a range of counts one row at a time would be slow, so we keep them
+//in a Fenwick tree (also called a binary indexed tree). Entry i of the tree
+//holds the total for a range of rows ending at row i, whose length is the
+//lowest set bit of i. To add up the first i rows, we add entry i, clear its
+//lowest bit, and repeat. To change a count, we go the other way, adding the
+//lowest set bit each time. Both take one step per bit, so log N steps. We
+//only need rows that actually have a horizontal segment, so we number those
+//rows in order and ignore the rest.
+	bool Segments_Touch(const sSegment *segments, int numSegments)
+	{
+		sLine *horizontal, *vertical;
+		sEvent *events;
+		int *rows, *tree;
+		int numHorizontal, numVertical, numEvents, numRows, i, row, total;
+		bool touch;
+		
+		horizontal = malloc(numSegments * sizeof(sLine));
+		vertical = malloc(numSegments * sizeof(sLine));
+		events = malloc(3 * numSegments * sizeof(sEvent));
+		rows = malloc(numSegments * sizeof(int));
+		tree = malloc((numSegments + 1) * sizeof(int));
+		if (horizontal == NULL || vertical == NULL || events == NULL ||
+		                                          rows == NULL || tree == NULL)
+		{
+			fprintf(stderr, "Error allocating memory: %s\n\n", strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		
+		//Split the segments into horizontal and vertical lines. Single points
+		//count as horizontal.
+		numHorizontal = numVertical = 0;
+		for (i = 0; i < numSegments; i++)
+		{
+			if (segments[i].start.y == segments[i].end.y)
+			{
+				horizontal[numHorizontal].fixed = segments[i].start.y;
+				horizontal[numHorizontal].low = MIN(segments[i].start.x,
+				                                    segments[i].end.x);
+				horizontal[numHorizontal].high = MAX(segments[i].start.x,
+				                                     segments[i].end.x);
+				numHorizontal++;
+			} else
+			{
+				vertical[numVertical].fixed = segments[i].start.x;
+				vertical[numVertical].low = MIN(segments[i].start.y,
+				                                segments[i].end.y);
+				vertical[numVertical].high = MAX(segments[i].start.y,
+				                                 segments[i].end.y);
+				numVertical++;
+			}
+		}
+		
+		//Cases 1 and 2
+		touch = Lines_Overlap(horizontal, numHorizontal) ||
+		                                   Lines_Overlap(vertical, numVertical);
+		
+		//Case 3. First, number the rows. The horizontal lines are sorted by row
+		//now, so we just have to skip the repeats.
+		numRows = 0;
+		for (i = 0; i < numHorizontal && !touch; i++)
+		{
+			if (numRows == 0 || rows[numRows-1] != horizontal[i].fixed)
+				rows[numRows++] = horizontal[i].fixed;
+		}
+		
+		//Make the list of events and sort it
+		numEvents = 0;
+		for (i = 0; i < numHorizontal && !touch; i++)
+		{
+			events[numEvents++] = (sEvent){horizontal[i].low, START_HORIZONTAL,
+			                        horizontal[i].fixed, horizontal[i].fixed};
+			events[numEvents++] = (sEvent){horizontal[i].high, END_HORIZONTAL,
+			                        horizontal[i].fixed, horizontal[i].fixed};
+		}
+		for (i = 0; i < numVertical && !touch; i++)
+		{
+			events[numEvents++] = (sEvent){vertical[i].fixed, CHECK_VERTICAL,
+			                               vertical[i].low, vertical[i].high};
+		}
+		qsort(events, numEvents, sizeof(sEvent), Compare_Events);
+		
+		//Sweep. The tree starts at entry 1, since entry 0 has no lowest bit.
+		memset(tree, 0, (numRows + 1) * sizeof(int));
+		for (i = 0; i < numEvents && !touch; i++)
+		{
+			if (events[i].type == CHECK_VERTICAL)
+			{
+				//The total for rows low through high is the total up to high
+				//minus the total below low
+				total = 0;
+				for (row = Lower_Bound(rows, numRows, events[i].high + 1);
+				                                       row > 0; row &= row - 1)
+					total += tree[row];
+				for (row = Lower_Bound(rows, numRows, events[i].low);
+				                                       row > 0; row &= row - 1)
+					total -= tree[row];
+				touch = (total > 0);
+			} else
+			{
+				for (row = Lower_Bound(rows, numRows, events[i].low) + 1;
+				                             row <= numRows; row += row & -row)
+					tree[row] += (events[i].type == START_HORIZONTAL) ? 1 : -1;
+			}
+		}
+		
+		free(horizontal);
+		free(vertical);
+		free(events);
+		free(rows);
+		free(tree);
+		
+		return touch;
+	}
@@ -21,41 +21,92 @@
 //B (A.used < B.available). The nodes do not have to be adjacent to each other.
 //How many viable pairs of nodes are there?
 //
-//To solve this puzzle, we have to do a pairwise comparison of each node.
+//To solve this puzzle, we have to compare the data on each node with the free
+//space on every other node. Sorting the free space first makes that quick.
 
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
 
 
-//Cluster node attributes. We only need two, but storing all three will make
-//later computations easier.
+//One line of the input file
 typedef struct
 {
+	int x, y;
 	int size;
 	int used;
 	int avail;
 } sNode;
 
+//The whole cluster. Rather than an array of node structures, we keep a
+//separate array (a "plane") for each attribute. This is called a structure of
+//arrays, as opposed to an array of structures. Node (x,y) is at index
+//y * width + x in each plane, so a row of the grid is a run of neighboring
+//numbers in memory. When we only need one attribute, we don't waste time
+//loading the others, and loops over a plane are easy for the compiler to turn
+//into SIMD instructions. The sizes in the puzzle are small, so 16 bits is
+//plenty, and lets the CPU work on 8 or 16 of them at once.
+typedef struct
+{
+	int width, height;
+	uint16_t *size;
+	uint16_t *used;
+	uint16_t *avail;
+} sCluster;
+
+
+void *Safe_Malloc(size_t size);
+sCluster *Read_Cluster(FILE *inFile);
+void Delete_Cluster(sCluster *cluster);
+
+
+//Comparison function for qsort(). qsort() can sort any kind of data, so it
+//passes us pointers to two elements as void pointers, and we have to cast them
+//back to what they really are. We return a negative number if the first
+//element goes first, a positive one if the second does, and 0 if they're equal.
+int Compare_Sizes(const void *a, const void *b)
+{
+	int first, second;
+	
+	first = *(const uint16_t *)a;
+	second = *(const uint16_t *)b;
+	
+	return (first > second) - (first < second);
+}
+
+
+//Count how many values in a sorted array are greater than the given value. We
+//binary search for the first one that's greater: low is always at or before
+//it, and high is always after the last value that isn't.
+long Count_Greater(const uint16_t *sorted, int count, int value)
+{
+	int low, high, middle;
+	
+	low = 0;
+	high = count;
+	while (low < high)
+	{
+		middle = low + (high - low) / 2;
+		if (sorted[middle] > value)
+			high = middle;
+		else
+			low = middle + 1;
+	}
+	
+	return count - low;
+}
+
 
 int main(int argc, char **argv)
 {
-	//C supports two different kinds of 2D arrays. The first (which we've
-	//already used) is a true 2D array that uses a single contiguous block of
-	//memory. These are more convenient and efficient, but the downside is that
-	//the size of one dimension must be known in advance since the compiler has
-	//to know how to compute the memory offsets. A more flexible type uses a 1D
-	//array of pointers to 1D arrays. Each sub-array must be initialized
-	//separately, but the array can be sized at run-time, and each row can even
-	//be a different size! An example of this sort of array is argv, a 1D array
-	//of pointers to command line argument strings. Here, we'll be using the
-	//latter kind of array so we can size the cluster at run-time.
-	sNode **cluster;
+	sCluster *cluster;
 	FILE *inFile;
+	uint16_t *sortedAvail;
 	long viableCount;
-	int clusterWidth, clusterHeight, x1, x2, y1, y2, size, used, avail;
+	int numNodes, n;
 		
 	//The usual command line argument check and input file opening
 	if (argc != 2)
@@ -71,99 +122,154 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 	
-	//Skip the first two lines of the file
-	while (fgetc(inFile) != '\n') {;}
-	while (fgetc(inFile) != '\n') {;}
-	
-	//The last line of the input file contains information for the largest
-	//cluster. We can use fscanf() to read the file directly until we run out
-	//of lines.
-	while (fscanf(inFile,
-	                 "/dev/grid/node-x%d-y%d     %*dT   %*dT    %*dT   %*d%%\n",
-					 &clusterWidth, &clusterHeight) == 2) {;}
-	
-	//The width and height are one more than the max indices
-	clusterWidth++;
-	clusterHeight++;
+	//Read the cluster, and close the file as soon as we're done with it
+	cluster = Read_Cluster(inFile);
+	fclose(inFile);
+
+	//Now we can count the viable pairs. Again, the rules are:
+	//
+	//1. Node A is not empty.
+	//2. Node A and B are not the same node.
+	//3. The data on node A (used) would fit on node B (avail).
+	//
+	//We could just compare each pair of nodes, but that's N^2 comparisons,
+	//which gets slow for big clusters. Instead, we'll sort the available space
+	//of every node. Then for each node A, a binary search tells us how many
+	//nodes have more space available than A uses, in log N steps.
+	numNodes = cluster->width * cluster->height;
+	sortedAvail = Safe_Malloc(numNodes * sizeof(uint16_t));
+	memcpy(sortedAvail, cluster->avail, numNodes * sizeof(uint16_t));
+	qsort(sortedAvail, numNodes, sizeof(uint16_t), Compare_Sizes);
 	
-	//Allocate memory for the array. First we need an array of pointers (one per
-	//X value)...
-	cluster = malloc(clusterWidth * sizeof(sNode *));
-	if (cluster == NULL)
+	viableCount = 0;
+	for (n = 0; n < numNodes; n++)
 	{
-		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
-		return EXIT_FAILURE;
+		//Don't count empty nodes
+		if (cluster->used[n] == 0)
+			continue;
+		
+		viableCount += Count_Greater(sortedAvail, numNodes, cluster->used[n]);
 	}
+	free(sortedAvail);
 	
-	//...then an array of nodes for each Y value.
-	for (x1 = 0; x1 < clusterWidth; x1++)
+	//Those counts include node A itself if its own data would fit in its own
+	//free space, so we have to take those back out. There are no branches
+	//here, just comparisons on neighboring elements of the planes, so the
+	//compiler can do this with SIMD instructions.
+	for (n = 0; n < numNodes; n++)
 	{
-		cluster[x1] = malloc(clusterHeight * sizeof(sNode));
-		if (cluster[x1] == NULL)
-		{
-			fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
-			return EXIT_FAILURE;
-		}
+		viableCount -= (cluster->used[n] != 0) &
+		                            (cluster->used[n] < cluster->avail[n]);
 	}
-			
-	//Now we can read the file again, this time to initialize the nodes. We have
-	//to skip the first two lines again.
-	rewind(inFile);
+	
+	Delete_Cluster(cluster);
+	
+	//Print the count of viable nodes
+	printf("Number of viables node: %ld\n", viableCount);
+	
+	return EXIT_SUCCESS;
+}
+
+
+//Read the cluster from the input file. I used to read the file twice: once to
+//find the size of the cluster from the last line, then again to fill it in.
+//Now we read it just once, keeping the nodes in a list that we make bigger as
+//needed. Once we've seen every node, we know the size of the cluster and can
+//copy the list into the planes.
+sCluster *Read_Cluster(FILE *inFile)
+{
+	sCluster *cluster;
+	sNode *nodes, node;
+	size_t numNodes, capacity, i, n;
+	
+	//Skip the first two lines of the file
 	while (fgetc(inFile) != '\n') {;}
 	while (fgetc(inFile) != '\n') {;}
+	
+	cluster = Safe_Malloc(sizeof(sCluster));
+	cluster->width = cluster->height = 0;
+	numNodes = 0;
+	capacity = 1024;
+	nodes = Safe_Malloc(capacity * sizeof(sNode));
 	while (fscanf(inFile,
 	                    "/dev/grid/node-x%d-y%d     %dT   %dT    %dT   %*d%%\n",
-	                    &x1, &y1, &size, &used, &avail) == 5)
-	{
-		cluster[x1][y1].size = size;
-		cluster[x1][y1].used = used;
-		cluster[x1][y1].avail = avail;
-	}
-
-	//Close the file as soon as we're done with it
-	fclose(inFile);
-
-	//Now we can count the viable pairs. We just have to compare each pair of
-	//nodes. Again, the rules are:
-	//
-	//1. Node A is not empty.
-	//2. Node A and B are not the same node.
-	//3. The data on node A (used) would fit on node B (avail).
-	viableCount = 0;
-	for (x1 = 0; x1 < clusterWidth; x1++)
+	                    &node.x, &node.y, &node.size, &node.used,
+	                    &node.avail) == 5)
 	{
-		for (y1 = 0; y1 < clusterHeight; y1++)
+		if (node.x < 0 || node.y < 0 || node.size < 0 || node.used < 0 ||
+		    node.avail < 0 || node.size > UINT16_MAX ||
+		    node.used > UINT16_MAX || node.avail > UINT16_MAX)
 		{
-			for (x2 = 0; x2 < clusterWidth; x2++)
+			fprintf(stderr, "Error: Node at (%d,%d) is out of range!\n",
+			                                                   node.x, node.y);
+			exit(EXIT_FAILURE);
+		}
+		
+		//realloc() makes the list bigger, keeping what's already in it
+		if (numNodes == capacity)
+		{
+			capacity *= 2;
+			nodes = realloc(nodes, capacity * sizeof(sNode));
+			if (nodes == NULL)
 			{
-				for (y2 = 0; y2 < clusterHeight; y2++)
-				{
-					//Don't compare a node to itself
-					if (x1 == x2 && y1 == y2)
-						continue;
-					
-					//Don't count empty nodes
-					if (cluster[x1][y1].used == 0)
-						continue;
-					
-					//Increment the count if this pair is viable
-					if (cluster[x1][y1].used < cluster[x2][y2].avail)
-						viableCount++;
-				}
+				fprintf(stderr, "Error allocating memory: %s\n",
+				                                               strerror(errno));
+				exit(EXIT_FAILURE);
 			}
 		}
+		nodes[numNodes++] = node;
+		
+		//The width and height are one more than the max indices
+		if (node.x >= cluster->width)
+			cluster->width = node.x + 1;
+		if (node.y >= cluster->height)
+			cluster->height = node.y + 1;
 	}
 	
-	//The other downside of using this kind of array is that we have to free
-	//each sub-array individually.
-	for (x1 = 0; x1 < clusterWidth; x1++)
+	//Allocate the planes. Any node missing from the input is left empty,
+	//with no space at all.
+	n = (size_t)cluster->width * cluster->height;
+	cluster->size = Safe_Malloc(n * sizeof(uint16_t));
+	cluster->used = Safe_Malloc(n * sizeof(uint16_t));
+	cluster->avail = Safe_Malloc(n * sizeof(uint16_t));
+	memset(cluster->size, 0, n * sizeof(uint16_t));
+	memset(cluster->used, 0, n * sizeof(uint16_t));
+	memset(cluster->avail, 0, n * sizeof(uint16_t));
+	
+	for (i = 0; i < numNodes; i++)
 	{
-		free(cluster[x1]);
+		n = (size_t)nodes[i].y * cluster->width + nodes[i].x;
+		cluster->size[n] = nodes[i].size;
+		cluster->used[n] = nodes[i].used;
+		cluster->avail[n] = nodes[i].avail;
 	}
+	free(nodes);
+	
+	return cluster;
+}
+
+
+//Free the planes and the cluster itself
+void Delete_Cluster(sCluster *cluster)
+{
+	free(cluster->size);
+	free(cluster->used);
+	free(cluster->avail);
 	free(cluster);
+}
+
+
+//Helper function for error-checking malloc()
+void *Safe_Malloc(size_t size)
+{
+	void *retVal;
 	
-	//Print the count of viable nodes
-	printf("Number of viables node: %ld\n", viableCount);
+	retVal = malloc(size);
+	if (retVal == NULL)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
 	
-	return EXIT_SUCCESS;
+	return retVal;
 }
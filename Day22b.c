@@ -6,45 +6,154 @@
 //To solve this puzzle, we need to look at the valid pairs and realize that the
 //only valid pairs involve the empty node. Thus, the empty node is the fastest
 //way to move any data (including the goal data) around.
+//
+//I originally just printed a map of the cluster and counted the moves by hand,
+//but that gets old fast. Instead, we'll treat the empty node as a "hole" that
+//slides around a maze like one of those sliding tile puzzles. The nodes that
+//are too full to ever fit into the hole are the walls of the maze. Each move
+//slides the hole one step, and if the hole slides into the goal data, the goal
+//data slides the other way. The state of the puzzle is just the position of the
+//hole and the position of the goal data, so we can search for the fewest moves
+//with A*.
 
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
 
 
-//Cluster node attributes. We only need two, but storing all three will make
-//later computations easier.
+//One line of the input file
 typedef struct
 {
+	int x, y;
 	int size;
 	int used;
 	int avail;
 } sNode;
 
+//The whole cluster, with one plane per attribute (same as part A). Node (x,y)
+//is at index y * width + x, which is also how the searches number the nodes.
+typedef struct
+{
+	int width, height;
+	uint16_t *size;
+	uint16_t *used;
+	uint16_t *avail;
+} sCluster;
+
+
+//Limits on the size of the search. The general search stores the whole cluster
+//for each state, so it's only good for small clusters. The A* search only
+//stores the states it reaches, so it doesn't need a limit, but it does keep a
+//limited number of hole distances around (see Sliding_Estimate()).
+#define MAX_GENERAL_STATES  (1 << 22)
+#define HOLE_CACHE_SIZE     (1 << 25)
+#define UNREACHABLE         -1
+
+
+//An entry in the A* priority queue. The priority is the number of moves made so
+//far plus the estimate of how many are left.
+typedef struct
+{
+	int priority;
+	uint64_t state;
+} sHeapItem;
+
+//A binary heap. The item with the lowest priority is always at the top.
+typedef struct
+{
+	sHeapItem *items;
+	size_t numItems, capacity;
+} sHeap;
+
+//Everything the sliding-hole search needs to know. Nodes are numbered
+//y * width + x, so node 0 is the one we can access. A state is the hole
+//position times the number of nodes plus the goal position.
+typedef struct
+{
+	int width, height, numNodes;
+	const bool *isOpen;
+	
+	//The number of moves the goal data needs to reach node 0, and the number of
+	//moves the hole needs to reach a goal position, ignoring the goal data. The
+	//hole distances are kept for a limited number of goal positions at a time.
+	//Each row of holeDistance holds one goal position's distances, and
+	//cacheGoal says which one (-1 for none). cacheRow goes the other way, from
+	//goal position to row. UINT16_MAX means the hole can't get there.
+	int *goalDistance, *scratch;
+	uint16_t *holeDistance;
+	int *cacheGoal, *cacheRow;
+	int numCacheRows, nextCacheRow;
+	
+	//The fewest moves found so far to reach each state, in a hash table keyed
+	//by state. Storing every possible state would take the number of nodes
+	//squared, which is too much for a big cluster. Empty slots have a state of
+	//UINT64_MAX.
+	uint64_t *stateKey;
+	int *stateCost;
+	size_t tableSize, numStates;
+	sHeap heap;
+} sSlidingPuzzle;
+
+//Everything the general search needs to know. Each state is a copy of the used
+//space on every node plus the position of the goal data.
+typedef struct
+{
+	int width, height, numNodes;
+	const uint16_t *size;
+	
+	//The states we've found so far. States are stored one after another, so
+	//state i's used space starts at used[i * numNodes].
+	uint16_t *used;
+	int *goal, *cost;
+	int numStates;
+	
+	//A hash table of state numbers, so we can tell if we've seen a state
+	//before. -1 means the slot is empty.
+	int *table;
+	size_t tableSize;
+	sHeap heap;
+} sGeneralPuzzle;
+
+
+void *Safe_Malloc(size_t size);
+sCluster *Read_Cluster(FILE *inFile);
+void Delete_Cluster(sCluster *cluster);
+void Print_Map(const sCluster *cluster);
+bool Is_Sliding_Puzzle(const sCluster *cluster, bool *isOpen, int *hole);
+void Find_Distances(const bool *isOpen, int width, int height, int start,
+                    int *distance);
+int Solve_Sliding_Puzzle(const bool *isOpen, int width, int height, int hole,
+                         int goal);
+int Solve_General_Puzzle(const sCluster *cluster, int goal);
+void Heap_Push(sHeap *heap, int priority, uint64_t state);
+sHeapItem Heap_Pop(sHeap *heap);
 
+
+//The helper functions are:
+//
+//    Print_Map()             Print a map of the cluster, for checking by hand
+//    Is_Sliding_Puzzle()     Check that the cluster can be solved by sliding
+//                            a single hole around
+//    Solve_Sliding_Puzzle()  Find the fewest moves with an A* search
+//    Solve_General_Puzzle()  Find the fewest moves by tracking the used space
+//                            on every node (small clusters only)
 int main(int argc, char **argv)
 {
-	//C supports two different kinds of 2D arrays. The first (which we've
-	//already used) is a true 2D array that uses a single contiguous block of
-	//memory. These are more convenient and efficient, but the downside is that
-	//the size of one dimension must be known in advance since the compiler has
-	//to know how to compute the memory offsets. A more flexible type uses a 1D
-	//array of pointers to 1D arrays. Each sub-array must be initialized
-	//separately, but the array can be sized at run-time, and each row can even
-	//be a different size! An example of this sort of array is argv, a 1D array
-	//of pointers to command line argument strings. Here, we'll be using the
-	//latter kind of array so we can size the cluster at run-time.
-	sNode **cluster;
+	sCluster *cluster;
 	FILE *inFile;
-	long viableCount;
-	int clusterWidth, clusterHeight, x1, x2, y1, y2, size, used, avail;
+	bool *isOpen;
+	int hole, goal, moves;
 		
-	//The usual command line argument check and input file opening
-	if (argc != 2)
+	//The usual command line argument check and input file opening. Adding
+	//"map" to the end of the command line also prints the old hand-solving map.
+	if (argc != 2 && (argc != 3 || strcmp(argv[2], "map") != 0))
 	{
-		fprintf(stderr, "Usage:\n\tDay22 <input filename>\n\n");
+		fprintf(stderr, "Usage:\n\tDay22 <input filename> [map]\n\n");
 		return EXIT_FAILURE;
 	}
 
@@ -55,84 +164,775 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 	
-	//Skip the first two lines of the file
-	while (fgetc(inFile) != '\n') {;}
-	while (fgetc(inFile) != '\n') {;}
+	//Read the cluster, and close the file as soon as we're done with it
+	cluster = Read_Cluster(inFile);
+	fclose(inFile);
+
+	if (argc == 3)
+		Print_Map(cluster);
 	
-	//The last line of the input file contains information for the largest
-	//cluster. We can use fscanf() to read the file directly until we run out
-	//of lines.
-	while (fscanf(inFile,
-	                 "/dev/grid/node-x%d-y%d     %*dT   %*dT    %*dT   %*d%%\n",
-					 &clusterWidth, &clusterHeight) == 2) {;}
+	//The goal data starts in the top right corner. If the cluster looks like
+	//the puzzle we expect, with one empty node and some walls, we can solve it
+	//quickly. Otherwise, we fall back to the slow but thorough search.
+	goal = cluster->width - 1;
+	isOpen = Safe_Malloc(cluster->width * cluster->height * sizeof(bool));
+	if (Is_Sliding_Puzzle(cluster, isOpen, &hole))
+		moves = Solve_Sliding_Puzzle(isOpen, cluster->width, cluster->height,
+		                                                          hole, goal);
+	else
+		moves = Solve_General_Puzzle(cluster, goal);
 	
-	//The width and height are one more than the max indices
-	clusterWidth++;
-	clusterHeight++;
+	if (moves == UNREACHABLE)
+		printf("The goal data can't be moved to (0,0)\n");
+	else
+		printf("Fewest number of moves: %d\n", moves);
 	
-	//Allocate memory for the array. First we need an array of pointers (one per
-	//X value)...
-	cluster = malloc(clusterWidth * sizeof(sNode *));
-	if (cluster == NULL)
+	free(isOpen);
+	Delete_Cluster(cluster);
+	
+	return EXIT_SUCCESS;
+}
+
+
+//Print a map of the cluster, the way I originally solved this by hand. X marks
+//the node we can access, G is the goal data, O is the empty node, and # is a
+//node too full to move.
+void Print_Map(const sCluster *cluster)
+{
+	int x, y, n;
+	
+	for (y = 0; y < cluster->height; y++)
 	{
-		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
-		return EXIT_FAILURE;
+		for (x = 0; x < cluster->width; x++)
+		{
+			n = y * cluster->width + x;
+			if (x == 0 && y == 0)
+				printf("X ");
+			else if (y == 0 && x == cluster->width - 1)
+				printf("G ");
+			else if (cluster->used[n] == 0)
+				printf("O ");
+			else if (cluster->used[n] > 100)
+				printf("# ");
+			else
+				printf(". ");
+		}
+		printf("\n");
+	}
+}
+
+
+//Check whether the cluster is the sliding puzzle we expect. Part A showed us
+//that the only viable pairs at the start involve the empty node, but we need
+//that to stay true no matter how the data gets moved around. So we check that:
+//
+//1. There's exactly one empty node (the hole).
+//2. The data on each node either fits on every open node, so it can follow the
+//   hole anywhere, or it doesn't fit on any of them (a wall).
+//3. No node ever has room for a second piece of data, so data never gets
+//   merged. Open nodes can end up holding any of the movable data, so they
+//   can't have room for two of the smallest pieces. That goes for the hole
+//   too -- a big enough hole could take two pieces, one after the other.
+//
+//If all of that holds, we mark which nodes are open and return the position of
+//the hole.
+bool Is_Sliding_Puzzle(const sCluster *cluster, bool *isOpen, int *hole)
+{
+	const uint16_t *size = cluster->size, *used = cluster->used;
+	int n, numNodes, numEmpty, minOpenSize, maxOpenSize, maxOpenUsed, minUsed;
+	int minWall;
+	
+	numNodes = cluster->width * cluster->height;
+	numEmpty = 0;
+	for (n = 0; n < numNodes; n++)
+	{
+		if (used[n] == 0)
+		{
+			numEmpty++;
+			*hole = n;
+		}
 	}
+	if (numEmpty != 1)
+		return false;
 	
-	//...then an array of nodes for each Y value.
-	for (x1 = 0; x1 < clusterWidth; x1++)
+	//A node is open if its data fits in the hole
+	minOpenSize = minUsed = minWall = INT_MAX;
+	maxOpenSize = maxOpenUsed = 0;
+	for (n = 0; n < numNodes; n++)
 	{
-		cluster[x1] = malloc(clusterHeight * sizeof(sNode));
-		if (cluster[x1] == NULL)
+		isOpen[n] = (used[n] <= size[*hole]);
+		if (isOpen[n])
 		{
-			fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
-			return EXIT_FAILURE;
+			if (size[n] < minOpenSize)
+				minOpenSize = size[n];
+			if (size[n] > maxOpenSize)
+				maxOpenSize = size[n];
+			if (used[n] > maxOpenUsed)
+				maxOpenUsed = used[n];
+		} else if (used[n] < minWall)
+		{
+			minWall = used[n];
 		}
+		
+		if (used[n] > 0 && used[n] < minUsed)
+			minUsed = used[n];
 	}
+	
+	//Rule 2
+	if (maxOpenUsed > minOpenSize || minWall <= maxOpenSize)
+		return false;
+	
+	//Rule 3. Walls never change, so they just can't have room for anything.
+	for (n = 0; n < numNodes; n++)
+	{
+		if (isOpen[n] && size[n] - minUsed >= minUsed)
+			return false;
+		if (!isOpen[n] && size[n] - used[n] >= minUsed)
+			return false;
+	}
+	
+	return true;
+}
+
+
+//A plain breadth-first search through the open nodes, giving the number of
+//steps from the start to every node. Unreachable nodes get -1.
+void Find_Distances(const bool *isOpen, int width, int height, int start,
+                    int *distance)
+{
+	int *queue;
+	int head, tail, n, x, y, d, next;
+	static const int dx[4] = {1, -1, 0, 0};
+	static const int dy[4] = {0, 0, 1, -1};
+	
+	for (n = 0; n < width * height; n++)
+	{
+		distance[n] = -1;
+	}
+	if (!isOpen[start])
+		return;
+	
+	queue = Safe_Malloc(width * height * sizeof(int));
+	head = tail = 0;
+	queue[tail++] = start;
+	distance[start] = 0;
+	while (head < tail)
+	{
+		n = queue[head++];
+		x = n % width;
+		y = n / width;
+		for (d = 0; d < 4; d++)
+		{
+			if (x + dx[d] < 0 || x + dx[d] >= width ||
+			                              y + dy[d] < 0 || y + dy[d] >= height)
+				continue;
 			
-	//Now we can read the file again, this time to initialize the nodes. We have
-	//to skip the first two lines again.
-	rewind(inFile);
-	while (fgetc(inFile) != '\n') {;}
-	while (fgetc(inFile) != '\n') {;}
-	while (fscanf(inFile,
-	                    "/dev/grid/node-x%d-y%d     %dT   %dT    %dT   %*d%%\n",
-	                    &x1, &y1, &size, &used, &avail) == 5)
+			next = n + dy[d] * width + dx[d];
+			if (isOpen[next] && distance[next] < 0)
+			{
+				distance[next] = distance[n] + 1;
+				queue[tail++] = next;
+			}
+		}
+	}
+	
+	free(queue);
+}
+
+
+//Estimate how many moves are left, without ever guessing too high (which is
+//what makes A* give the right answer). The hole has to get next to the goal
+//data and swap with it, which takes at least as many moves as the hole's
+//distance to the goal data. After that, every time the goal data moves, the
+//hole ends up behind it, and has to get around to the front again before the
+//next move. That takes at least two moves (for a turn) plus the swap itself, so
+//every step after the first costs at least three.
+//
+//The distance from the hole to the goal data is the same as the distance from
+//the goal data to the hole, so one search from the goal position gives the
+//distance for every hole position. Keeping that for every goal position would
+//take the number of nodes squared, so there's only room for so many at once.
+//When we need one that isn't there, it replaces the oldest one.
+static int Sliding_Estimate(sSlidingPuzzle *puzzle, int hole, int goal)
+{
+	uint16_t *distance;
+	int row, n;
+	
+	if (goal == 0)
+		return 0;
+	if (puzzle->goalDistance[goal] < 0)
+		return UNREACHABLE;
+	
+	row = puzzle->cacheRow[goal];
+	if (row < 0)
 	{
-		cluster[x1][y1].size = size;
-		cluster[x1][y1].used = used;
-		cluster[x1][y1].avail = avail;
+		row = puzzle->nextCacheRow;
+		puzzle->nextCacheRow = (row + 1) % puzzle->numCacheRows;
+		if (puzzle->cacheGoal[row] >= 0)
+			puzzle->cacheRow[puzzle->cacheGoal[row]] = -1;
+		
+		Find_Distances(puzzle->isOpen, puzzle->width, puzzle->height, goal,
+		                                                      puzzle->scratch);
+		distance = &puzzle->holeDistance[(size_t)row * puzzle->numNodes];
+		for (n = 0; n < puzzle->numNodes; n++)
+		{
+			distance[n] = (puzzle->scratch[n] < 0) ? UINT16_MAX :
+			                                              puzzle->scratch[n];
+		}
+		puzzle->cacheGoal[row] = goal;
+		puzzle->cacheRow[goal] = row;
 	}
+	distance = &puzzle->holeDistance[(size_t)row * puzzle->numNodes];
+	if (distance[hole] == UINT16_MAX)
+		return UNREACHABLE;
+	
+	return distance[hole] + 3 * (puzzle->goalDistance[goal] - 1);
+}
 
-	//Close the file as soon as we're done with it
-	fclose(inFile);
 
-	//Print a schematic of the maze for manual calculation. :-(
-	for (y1 = 0; y1 < clusterHeight; y1++)
+//Find a state's slot in the cost table, adding it with a cost of INT_MAX if
+//it isn't there yet. The table is kept at least half empty, and gets rebuilt
+//at twice the size when it fills up. The hash is the top bits of the state
+//times a large odd constant, which spreads neighboring states out.
+static size_t Sliding_Slot(sSlidingPuzzle *puzzle, uint64_t state)
+{
+	uint64_t *oldKey;
+	int *oldCost;
+	size_t oldSize, slot, i;
+	int shift;
+	
+	if (puzzle->numStates >= puzzle->tableSize / 2)
 	{
-		for (x1 = 0; x1 < clusterWidth; x1++)
+		oldKey = puzzle->stateKey;
+		oldCost = puzzle->stateCost;
+		oldSize = puzzle->tableSize;
+		
+		puzzle->tableSize = (oldSize == 0) ? 1024 : oldSize * 2;
+		puzzle->stateKey = Safe_Malloc(puzzle->tableSize * sizeof(uint64_t));
+		puzzle->stateCost = Safe_Malloc(puzzle->tableSize * sizeof(int));
+		for (i = 0; i < puzzle->tableSize; i++)
 		{
-			if (x1 == 0 && y1 == 0)
-				printf("X ");
-			else if (y1 == 0 && x1 == clusterWidth - 1)
-				printf("G ");
-			else if (cluster[x1][y1].used == 0)
-				printf("O ");
-			else if (cluster[x1][y1].used > 100)
-				printf("# ");
+			puzzle->stateKey[i] = UINT64_MAX;
+		}
+		
+		puzzle->numStates = 0;
+		for (i = 0; i < oldSize; i++)
+		{
+			if (oldKey[i] == UINT64_MAX)
+				continue;
+			slot = Sliding_Slot(puzzle, oldKey[i]);
+			puzzle->stateCost[slot] = oldCost[i];
+		}
+		free(oldKey);
+		free(oldCost);
+	}
+	
+	shift = 64 - __builtin_ctzll(puzzle->tableSize);
+	slot = (state * UINT64_C(0x9e3779b97f4a7c15)) >> shift;
+	while (puzzle->stateKey[slot] != state)
+	{
+		if (puzzle->stateKey[slot] == UINT64_MAX)
+		{
+			puzzle->stateKey[slot] = state;
+			puzzle->stateCost[slot] = INT_MAX;
+			puzzle->numStates++;
+			break;
+		}
+		slot = (slot + 1) & (puzzle->tableSize - 1);
+	}
+	
+	return slot;
+}
+
+
+//Find the fewest moves with an A* search. A* is like Dijkstra's algorithm, but
+//instead of always looking at the state with the fewest moves so far, it looks
+//at the state with the fewest moves so far plus an estimate of how many are
+//left. As long as the estimate is never too high, the first time we pull a
+//finished state out of the priority queue, it's the best one. The better the
+//estimate, the fewer states we have to look at.
+//
+//Before searching, we find the distances the goal data has to travel (from
+//every node to node 0). The hole's distances get filled in as the search goes.
+//These only depend on the walls, so we can use them for every estimate. Our
+//estimate isn't perfect, so we might find a cheaper way to a state we've
+//already looked at. If so, we just look at it again.
+int Solve_Sliding_Puzzle(const bool *isOpen, int width, int height, int hole,
+                         int goal)
+{
+	sSlidingPuzzle puzzle;
+	sHeapItem item;
+	int numNodes, n, x, y, d, next, estimate, moves, cost;
+	uint64_t state, nextState;
+	size_t slot;
+	static const int dx[4] = {1, -1, 0, 0};
+	static const int dy[4] = {0, 0, 1, -1};
+	
+	numNodes = width * height;
+	puzzle.width = width;
+	puzzle.height = height;
+	puzzle.numNodes = numNodes;
+	puzzle.isOpen = isOpen;
+	
+	//Find the goal data's distances to node 0. None of the hole's distances
+	//have been found yet.
+	puzzle.goalDistance = Safe_Malloc(numNodes * sizeof(int));
+	Find_Distances(isOpen, width, height, 0, puzzle.goalDistance);
+	
+	puzzle.numCacheRows = HOLE_CACHE_SIZE / numNodes;
+	if (puzzle.numCacheRows > numNodes)
+		puzzle.numCacheRows = numNodes;
+	if (puzzle.numCacheRows < 1)
+		puzzle.numCacheRows = 1;
+	puzzle.nextCacheRow = 0;
+	puzzle.holeDistance = Safe_Malloc((size_t)puzzle.numCacheRows * numNodes *
+	                                                        sizeof(uint16_t));
+	puzzle.scratch = Safe_Malloc(numNodes * sizeof(int));
+	puzzle.cacheGoal = Safe_Malloc(puzzle.numCacheRows * sizeof(int));
+	puzzle.cacheRow = Safe_Malloc(numNodes * sizeof(int));
+	for (n = 0; n < puzzle.numCacheRows; n++)
+	{
+		puzzle.cacheGoal[n] = -1;
+	}
+	for (n = 0; n < numNodes; n++)
+	{
+		puzzle.cacheRow[n] = -1;
+	}
+	
+	//No state has been reached yet
+	puzzle.stateKey = NULL;
+	puzzle.stateCost = NULL;
+	puzzle.tableSize = puzzle.numStates = 0;
+	puzzle.heap = (sHeap){NULL, 0, 0};
+	
+	//Start the search
+	moves = UNREACHABLE;
+	state = (uint64_t)hole * numNodes + goal;
+	estimate = Sliding_Estimate(&puzzle, hole, goal);
+	if (estimate != UNREACHABLE)
+	{
+		slot = Sliding_Slot(&puzzle, state);
+		puzzle.stateCost[slot] = 0;
+		Heap_Push(&puzzle.heap, estimate, state);
+	}
+	
+	while (puzzle.heap.numItems > 0)
+	{
+		item = Heap_Pop(&puzzle.heap);
+		state = item.state;
+		hole = state / numNodes;
+		goal = state % numNodes;
+		slot = Sliding_Slot(&puzzle, state);
+		cost = puzzle.stateCost[slot];
+		
+		if (goal == 0)
+		{
+			moves = cost;
+			break;
+		}
+		
+		//Skip this one if we've since found a cheaper way here
+		if (item.priority > cost + Sliding_Estimate(&puzzle, hole, goal))
+			continue;
+		
+		//Slide the hole in each direction. If it slides into the goal data, the
+		//goal data ends up where the hole was.
+		x = hole % width;
+		y = hole / width;
+		for (d = 0; d < 4; d++)
+		{
+			if (x + dx[d] < 0 || x + dx[d] >= width ||
+			                              y + dy[d] < 0 || y + dy[d] >= height)
+				continue;
+			
+			next = hole + dy[d] * width + dx[d];
+			if (!isOpen[next])
+				continue;
+			
+			if (next == goal)
+				nextState = (uint64_t)next * numNodes + hole;
 			else
-				printf(". ");
+				nextState = (uint64_t)next * numNodes + goal;
+			
+			estimate = Sliding_Estimate(&puzzle, nextState / numNodes,
+			                                         nextState % numNodes);
+			if (estimate == UNREACHABLE)
+				continue;
+			
+			//Adding a state can rebuild the table, so a slot is only good
+			//until the next call to Sliding_Slot()
+			slot = Sliding_Slot(&puzzle, nextState);
+			if (cost + 1 >= puzzle.stateCost[slot])
+				continue;
+			
+			puzzle.stateCost[slot] = cost + 1;
+			Heap_Push(&puzzle.heap, cost + 1 + estimate, nextState);
 		}
-		printf("\n");
 	}
-	return EXIT_SUCCESS;
+	
+	free(puzzle.goalDistance);
+	free(puzzle.holeDistance);
+	free(puzzle.scratch);
+	free(puzzle.cacheGoal);
+	free(puzzle.cacheRow);
+	free(puzzle.stateKey);
+	free(puzzle.stateCost);
+	free(puzzle.heap.items);
+	
+	return moves;
+}
+
+
+//Look up a state in the general search's hash table. The hash is FNV-1a, which
+//mixes in one value at a time. We return the state's number, or -1 if it isn't
+//there, along with the slot where it is (or would go).
+static int Find_State(const sGeneralPuzzle *puzzle, const uint16_t *used,
+                      int goal, size_t *slot)
+{
+	uint64_t hash;
+	int n, state;
+	
+	hash = UINT64_C(14695981039346656037);
+	for (n = 0; n < puzzle->numNodes; n++)
+	{
+		hash = (hash ^ used[n]) * UINT64_C(1099511628211);
+	}
+	hash = (hash ^ (uint32_t)goal) * UINT64_C(1099511628211);
+	
+	//The table size is a power of two, so we can wrap around with a mask. If
+	//the slot is taken by a different state, try the next one.
+	*slot = hash & (puzzle->tableSize - 1);
+	while ((state = puzzle->table[*slot]) >= 0)
+	{
+		if (puzzle->goal[state] == goal &&
+		    memcmp(&puzzle->used[(size_t)state * puzzle->numNodes], used,
+		                       puzzle->numNodes * sizeof(uint16_t)) == 0)
+			return state;
+		*slot = (*slot + 1) & (puzzle->tableSize - 1);
+	}
+	
+	return -1;
+}
+
+
+//Add a new state to the general search, making more room if we need it. The
+//hash table is kept at least half empty so lookups stay quick.
+static int Add_State(sGeneralPuzzle *puzzle, const uint16_t *used, int goal,
+                     int cost)
+{
+	size_t slot, capacity, n;
+	int state;
+	
+	capacity = puzzle->tableSize / 2;
+	if ((size_t)puzzle->numStates == capacity)
+	{
+		if (capacity >= MAX_GENERAL_STATES)
+		{
+			fprintf(stderr, "Error: Too many states (max %d)!\n",
+			                                               MAX_GENERAL_STATES);
+			exit(EXIT_FAILURE);
+		}
+		
+		//Double the storage. realloc() keeps the old contents for us.
+		capacity *= 2;
+		puzzle->used = realloc(puzzle->used,
+		                    capacity * puzzle->numNodes * sizeof(uint16_t));
+		puzzle->goal = realloc(puzzle->goal, capacity * sizeof(int));
+		puzzle->cost = realloc(puzzle->cost, capacity * sizeof(int));
+		if (puzzle->used == NULL || puzzle->goal == NULL ||
+		                                                  puzzle->cost == NULL)
+		{
+			fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		
+		//The hash table has to be rebuilt from scratch, since the slots depend
+		//on its size
+		free(puzzle->table);
+		puzzle->tableSize = capacity * 2;
+		puzzle->table = Safe_Malloc(puzzle->tableSize * sizeof(int));
+		for (n = 0; n < puzzle->tableSize; n++)
+		{
+			puzzle->table[n] = -1;
+		}
+		for (state = 0; state < puzzle->numStates; state++)
+		{
+			Find_State(puzzle, &puzzle->used[(size_t)state * puzzle->numNodes],
+			                                       puzzle->goal[state], &slot);
+			puzzle->table[slot] = state;
+		}
+	}
+	
+	state = puzzle->numStates++;
+	memcpy(&puzzle->used[(size_t)state * puzzle->numNodes], used,
+	                                puzzle->numNodes * sizeof(uint16_t));
+	puzzle->goal[state] = goal;
+	puzzle->cost[state] = cost;
+	Find_State(puzzle, used, goal, &slot);
+	puzzle->table[slot] = state;
+	
+	return state;
+}
+
+
+//Find the fewest moves without any shortcuts. Each state is the used space on
+//every node plus the position of the goal data, and each move sends all of one
+//node's data to a neighbor with enough room. This works for any cluster (more
+//than one empty node, data that gets merged, and so on), but the number of
+//states explodes quickly, so it's only good for small ones. It's an A* search
+//like the sliding one, but with a simpler estimate: the goal data has to move
+//at least its X plus Y distance from node 0.
+int Solve_General_Puzzle(const sCluster *cluster, int goal)
+{
+	sGeneralPuzzle puzzle;
+	sHeapItem item;
+	const uint16_t *size = cluster->size;
+	uint16_t *nextUsed;
+	int width, height, numNodes, state, nextState, nextGoal, a, b, d, x, y;
+	int cost, moves;
+	size_t slot;
+	static const int dx[4] = {1, -1, 0, 0};
+	static const int dy[4] = {0, 0, 1, -1};
+	
+	width = cluster->width;
+	height = cluster->height;
+	numNodes = width * height;
+	puzzle.width = width;
+	puzzle.height = height;
+	puzzle.numNodes = numNodes;
+	puzzle.size = size;
+	puzzle.numStates = 0;
+	puzzle.tableSize = 2048;
+	puzzle.used = Safe_Malloc(puzzle.tableSize / 2 * numNodes *
+	                                                       sizeof(uint16_t));
+	puzzle.goal = Safe_Malloc(puzzle.tableSize / 2 * sizeof(int));
+	puzzle.cost = Safe_Malloc(puzzle.tableSize / 2 * sizeof(int));
+	puzzle.table = Safe_Malloc(puzzle.tableSize * sizeof(int));
+	for (slot = 0; slot < puzzle.tableSize; slot++)
+	{
+		puzzle.table[slot] = -1;
+	}
+	puzzle.heap = (sHeap){NULL, 0, 0};
+	nextUsed = Safe_Malloc(numNodes * sizeof(uint16_t));
+	
+	state = Add_State(&puzzle, cluster->used, goal, 0);
+	Heap_Push(&puzzle.heap, goal % width + goal / width, state);
+	
+	moves = UNREACHABLE;
+	while (puzzle.heap.numItems > 0)
+	{
+		item = Heap_Pop(&puzzle.heap);
+		state = item.state;
+		goal = puzzle.goal[state];
+		cost = puzzle.cost[state];
+		if (goal == 0)
+		{
+			moves = cost;
+			break;
+		}
+		if (item.priority > cost + goal % width + goal / width)
+			continue;
+		
+		//Try moving the data on every node to each of its neighbors
+		for (a = 0; a < numNodes; a++)
+		{
+			if (puzzle.used[(size_t)state * numNodes + a] == 0)
+				continue;
+			
+			x = a % width;
+			y = a / width;
+			for (d = 0; d < 4; d++)
+			{
+				if (x + dx[d] < 0 || x + dx[d] >= width ||
+				                          y + dy[d] < 0 || y + dy[d] >= height)
+					continue;
+				
+				b = a + dy[d] * width + dx[d];
+				memcpy(nextUsed, &puzzle.used[(size_t)state * numNodes],
+				                                   numNodes * sizeof(uint16_t));
+				if (nextUsed[a] > size[b] - nextUsed[b])
+					continue;
+				
+				nextUsed[b] += nextUsed[a];
+				nextUsed[a] = 0;
+				nextGoal = (a == goal) ? b : goal;
+				
+				nextState = Find_State(&puzzle, nextUsed, nextGoal, &slot);
+				if (nextState < 0)
+					nextState = Add_State(&puzzle, nextUsed, nextGoal,
+					                                              cost + 1);
+				else if (cost + 1 < puzzle.cost[nextState])
+					puzzle.cost[nextState] = cost + 1;
+				else
+					continue;
+				
+				Heap_Push(&puzzle.heap, cost + 1 + nextGoal % width +
+				                                   nextGoal / width, nextState);
+			}
+		}
+	}
+	
+	free(nextUsed);
+	free(puzzle.used);
+	free(puzzle.goal);
+	free(puzzle.cost);
+	free(puzzle.table);
+	free(puzzle.heap.items);
+	
+	return moves;
+}
+
+
+//Add an item to the heap. The heap is stored in an array where the children of
+//item i are items 2i+1 and 2i+2. A new item goes at the end, then swaps places
+//with its parent until the parent has a lower priority.
+void Heap_Push(sHeap *heap, int priority, uint64_t state)
+{
+	size_t i;
+	
+	if (heap->numItems == heap->capacity)
+	{
+		heap->capacity = (heap->capacity == 0) ? 1024 : heap->capacity * 2;
+		heap->items = realloc(heap->items, heap->capacity * sizeof(sHeapItem));
+		if (heap->items == NULL)
+		{
+			fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+	}
+	
+	i = heap->numItems++;
+	while (i > 0 && heap->items[(i - 1) / 2].priority > priority)
+	{
+		heap->items[i] = heap->items[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	heap->items[i] = (sHeapItem){priority, state};
+}
+
+
+//Remove the item with the lowest priority from the top of the heap. The last
+//item takes its place, then swaps places with its lower-priority child until
+//both children have higher priorities.
+sHeapItem Heap_Pop(sHeap *heap)
+{
+	sHeapItem top, last;
+	size_t i, child;
+	
+	top = heap->items[0];
+	last = heap->items[--heap->numItems];
+	i = 0;
+	while ((child = 2 * i + 1) < heap->numItems)
+	{
+		if (child + 1 < heap->numItems &&
+		        heap->items[child + 1].priority < heap->items[child].priority)
+			child++;
+		if (heap->items[child].priority >= last.priority)
+			break;
+		heap->items[i] = heap->items[child];
+		i = child;
+	}
+	heap->items[i] = last;
+	
+	return top;
+}
+
 
-	//Free the cluster
-	for (x1 = 0; x1 < clusterWidth; x1++)
+//Read the cluster from the input file in a single pass (same as part A)
+sCluster *Read_Cluster(FILE *inFile)
+{
+	sCluster *cluster;
+	sNode *nodes, node;
+	size_t numNodes, capacity, i, n;
+	
+	//Skip the first two lines of the file
+	while (fgetc(inFile) != '\n') {;}
+	while (fgetc(inFile) != '\n') {;}
+	
+	cluster = Safe_Malloc(sizeof(sCluster));
+	cluster->width = cluster->height = 0;
+	numNodes = 0;
+	capacity = 1024;
+	nodes = Safe_Malloc(capacity * sizeof(sNode));
+	while (fscanf(inFile,
+	                    "/dev/grid/node-x%d-y%d     %dT   %dT    %dT   %*d%%\n",
+	                    &node.x, &node.y, &node.size, &node.used,
+	                    &node.avail) == 5)
+	{
+		if (node.x < 0 || node.y < 0 || node.size < 0 || node.used < 0 ||
+		    node.avail < 0 || node.size > UINT16_MAX ||
+		    node.used > UINT16_MAX || node.avail > UINT16_MAX)
+		{
+			fprintf(stderr, "Error: Node at (%d,%d) is out of range!\n",
+			                                                   node.x, node.y);
+			exit(EXIT_FAILURE);
+		}
+		
+		//realloc() makes the list bigger, keeping what's already in it
+		if (numNodes == capacity)
+		{
+			capacity *= 2;
+			nodes = realloc(nodes, capacity * sizeof(sNode));
+			if (nodes == NULL)
+			{
+				fprintf(stderr, "Error allocating memory: %s\n",
+				                                               strerror(errno));
+				exit(EXIT_FAILURE);
+			}
+		}
+		nodes[numNodes++] = node;
+		
+		//The width and height are one more than the max indices
+		if (node.x >= cluster->width)
+			cluster->width = node.x + 1;
+		if (node.y >= cluster->height)
+			cluster->height = node.y + 1;
+	}
+	
+	//Allocate the planes. Any node missing from the input is left empty,
+	//with no space at all.
+	n = (size_t)cluster->width * cluster->height;
+	cluster->size = Safe_Malloc(n * sizeof(uint16_t));
+	cluster->used = Safe_Malloc(n * sizeof(uint16_t));
+	cluster->avail = Safe_Malloc(n * sizeof(uint16_t));
+	memset(cluster->size, 0, n * sizeof(uint16_t));
+	memset(cluster->used, 0, n * sizeof(uint16_t));
+	memset(cluster->avail, 0, n * sizeof(uint16_t));
+	
+	for (i = 0; i < numNodes; i++)
 	{
-		free(cluster[x1]);
+		n = (size_t)nodes[i].y * cluster->width + nodes[i].x;
+		cluster->size[n] = nodes[i].size;
+		cluster->used[n] = nodes[i].used;
+		cluster->avail[n] = nodes[i].avail;
 	}
+	free(nodes);
+	
+	return cluster;
+}
+
+
+//No change
+void Delete_Cluster(sCluster *cluster)
+{
+	free(cluster->size);
+	free(cluster->used);
+	free(cluster->avail);
 	free(cluster);
+}
+
+
+//Helper function for error-checking malloc()
+void *Safe_Malloc(size_t size)
+{
+	void *retVal;
 	
-	return EXIT_SUCCESS;
+	retVal = malloc(size);
+	if (retVal == NULL)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	
+	return retVal;
 }
@@ -27,6 +27,9 @@
 #include <stdbool.h>
 #include <limits.h>
 #include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
 
 
 //We could define a new queue structure and new functions every time we want a
@@ -35,32 +38,53 @@
 //to make a truly generic container in C. The key is to use pointer typecasting
 //and dynamic memory allocation to copy data without knowing its type. The
 //downside of this is that we can't pass or return objects by value, which makes
-//the user code more complicated. Note that if performance is a concern, you
-//could also do something like this with an array instead of a linked list.
-typedef struct sQueueNode
+//the user code more complicated.
+//
+//Allocating a linked list node for every element means a malloc() and a free()
+//for every room the search visits, which ends up being most of the run time.
+//Instead, the queue is built from chunks, each of which is an array big enough
+//for several hundred elements. Elements are added at the tail of the last chunk
+//and removed from the head of the first chunk. When the first chunk is used up,
+//it goes onto a list of spare chunks instead of being freed, and the next time
+//we need a new chunk we take one from the spare list. Once the queue has grown
+//to its largest size, it never needs to allocate memory again.
+#define QUEUE_CHUNK_BYTES  4096
+
+typedef struct sQueueChunk
 {
-	struct sQueueNode *next;
+	struct sQueueChunk *next;
 	
 	//This is a C99 construct called a flexible array member. Effectively, this
 	//gives us a pointer to the memory location right after the structure. It's
 	//useful for things like variable-length network data packets, or really
 	//anything where you have a fixed-size header and variable-size data.
-	char nodeData[];
-} sQueueNode;
+	char chunkData[];
+} sQueueChunk;
 	
+//The head is the index of the next element to remove from the first chunk, and
+//the tail is the index of the next free slot in the last chunk.
 typedef struct
 {
-	size_t numElements, elementSize;
-	sQueueNode *first, *last;
+	size_t numElements, elementSize, chunkElements;
+	size_t head, tail;
+	sQueueChunk *first, *last, *spare;
 } sQueue;
 
 //As on Day 13, we need to keep track of several variables for each location
 //("room") in the maze: whether the room is an open space or a wall, whether
 //it's been visited already, how far it is from the starting location, and
 //whether it's a numbered target location.
+//
+//Instead of a visited flag, each room gets a generation stamp. Every search
+//gets a new generation number, and a room counts as visited if its stamp
+//matches the current generation. That way, starting a new search just means
+//incrementing the generation number -- we don't have to sweep the whole maze to
+//clear the flags, so a search only costs as much as the rooms it visits. The
+//distance is only meaningful for rooms that have been visited.
 typedef struct
 {
-	bool isOpen, visited;
+	bool isOpen;
+	uint32_t visitStamp;
 	int distance;
 } sRoom;
 
@@ -74,25 +98,76 @@ typedef struct
 //Full information for the maze. This consists of the 2D room array, the size of
 //the maze, a list of target coordinates, and the number of target locations.
 //The main reason for storing all this in a structure is to make it easier to
-//break out the searching and processing code into separate functions.
+//break out the searching and processing code into separate functions. The
+//search queue lives here too, so that its chunks get reused from one search to
+//the next.
 typedef struct
 {
 	sRoom **rooms;
 	int xSize, ySize;
 	sCoord *targets;
 	int numTargets;
+	uint32_t generation;
+	sQueue searchQueue;
 } sMaze;
 
+//One entry in the priority queue used by Dijkstra's algorithm: a node in the
+//contracted graph and its distance from the starting node
+typedef struct
+{
+	uint32_t key;
+	int node;
+} sHeapItem;
+
+//A radix heap has one bucket for each possible bit position in the key, plus
+//one for keys equal to the last key removed. See Init_Radix_Heap() for details.
+#define RADIX_BUCKETS  33
+
+typedef struct
+{
+	sHeapItem *items[RADIX_BUCKETS];
+	int count[RADIX_BUCKETS], capacity[RADIX_BUCKETS];
+	uint32_t last;
+	int size;
+} sRadixHeap;
+
+//The maze contracted into a weighted graph. See Contract_Maze() for details.
+//The distance array and heap are working storage for the searches, so they're
+//allocated once and reused for every starting target.
+typedef struct
+{
+	int numNodes, numEdges, numTargets;
+	int *firstEdge, *edgeTo;
+	uint32_t *edgeLength;
+	uint32_t *distance;
+	sRadixHeap heap;
+} sGraph;
+
 
 sMaze *Create_Maze(FILE *inFile);
 void Reset_Maze(sMaze *maze);
 void Delete_Maze(sMaze *maze);
 void Find_Distances(sMaze *maze, sCoord start, int *distances);
-int Find_Shortest_Route(int **distances, int startNode, uint16_t unvisitedMask);
+void Find_All_Distances(sMaze *maze, int **distances);
+sGraph *Contract_Maze(sMaze *maze);
+void Delete_Graph(sGraph *graph);
+void Find_Graph_Distances(sGraph *graph, int source, int *distances);
+void Init_Radix_Heap(sRadixHeap *heap);
+void Clear_Radix_Heap(sRadixHeap *heap);
+void Radix_Heap_Push(sRadixHeap *heap, uint32_t key, int node);
+sHeapItem Radix_Heap_Pop(sRadixHeap *heap);
+void Delete_Radix_Heap(sRadixHeap *heap);
+void Find_Shortest_Routes(int **distances, int numTargets, int *openRoute,
+                          int *closedRoute);
+int Find_Route_Branch_And_Bound(int **distances, int numTargets,
+                                bool returnToStart);
+int Target_Index(int label);
 void *Safe_Malloc(size_t size);
 void Init_Queue(sQueue *queue, size_t elementSize);
 void Enqueue(sQueue *queue, const void *object);
+void Enqueue_Many(sQueue *queue, const void *objects, size_t count);
 void Dequeue(sQueue *queue, void *object);
+size_t Dequeue_Many(sQueue *queue, void *objects, size_t maxCount);
 void Delete_Queue(sQueue *queue);
 
 
@@ -103,17 +178,32 @@ void Delete_Queue(sQueue *queue);
 //    Reset_Maze()      Prepare for a new breadth-first search
 //    Find_Distances()  Find the shortest paths to all of the targets from
 //                      the given starting coordinates
+//    Find_All_Distances()  Find the shortest paths between every pair of
+//                          targets at once
+//    Find_Shortest_Routes()  Find the shortest routes through all the targets
 int main(int argc, char **argv)
 {
 	FILE *inFile;
 	sMaze *maze;
 	int **distances;
+	sGraph *graph;
+	const char *method;
 	int t, shortestRoute;
 	
-	//The usual command line argument check and input file opening
-	if (argc != 2)
+	//The usual command line argument check and input file opening. There's
+	//also an optional argument to pick how the target distances are found (see
+	//below), which is handy for checking the methods against each other.
+	if (argc != 2 && argc != 3)
+	{
+		fprintf(stderr, "Usage:\n\tDay24 <input filename> "
+		                                           "[bfs|wave|graph]\n\n");
+		return EXIT_FAILURE;
+	}
+	method = (argc == 3) ? argv[2] : "wave";
+	if (strcmp(method, "bfs") != 0 && strcmp(method, "wave") != 0 &&
+	                                             strcmp(method, "graph") != 0)
 	{
-		fprintf(stderr, "Usage:\n\tDay24 <input filename>\n\n");
+		fprintf(stderr, "Unknown search method: %s\n", method);
 		return EXIT_FAILURE;
 	}
 
@@ -143,25 +233,41 @@ int main(int argc, char **argv)
 		distances[t] = Safe_Malloc(maze->numTargets * sizeof(int));
 	}
 	
-	//Now we can run the searches, starting at each target location
-	for (t = 0; t < maze->numTargets; t++)
+	//Now we can run the searches. The straightforward way is to start a search
+	//at each target location in turn. Find_All_Distances() runs all of those
+	//searches at the same time, which is much faster when there are lots of
+	//targets. Alternatively, we can shrink the maze down to a graph of its
+	//junctions and targets and run the searches on that instead.
+	if (strcmp(method, "bfs") == 0)
+	{
+		for (t = 0; t < maze->numTargets; t++)
+		{
+			Reset_Maze(maze);
+			Find_Distances(maze, maze->targets[t], distances[t]);
+		}
+	} else if (strcmp(method, "graph") == 0)
 	{
-		Reset_Maze(maze);
-		Find_Distances(maze, maze->targets[t], distances[t]);
+		graph = Contract_Maze(maze);
+		for (t = 0; t < maze->numTargets; t++)
+		{
+			Find_Graph_Distances(graph, t, distances[t]);
+		}
+		Delete_Graph(graph);
+	} else
+	{
+		Find_All_Distances(maze, distances);
 	}
 	
 	//Now that the searches are done, we have a weighted graph of the target
 	//locations and the distances between them. We need to find the shortest
 	//route that visits every target once. This is a version of the traveling
 	//salesman problem. There's a lot of research on approximate solutions, but
-	//we need an exact solution, so we'll have to go with a brute-force check of
-	//every possible route. This runs in factorial time (O(n!)), so even a dozen
-	//nodes would take a long time to process. Fortunately, we only have seven
-	//(plus a fixed starting point), so only a few hundred tests are required.
-	//Since the number of targets is variable, it's easier to do this with
-	//recursion than loops.
-	shortestRoute = Find_Shortest_Route(distances, 0,
-	                                               (1 << maze->numTargets) - 1);
+	//we need an exact solution. Our first attempt was a brute-force check of
+	//every possible route, which runs in factorial time (O(n!)). That's fine
+	//for seven targets, but even a dozen would take a long time to process. See
+	//Find_Shortest_Routes() for a much faster approach. It can find the answers
+	//to both parts at once, but we only ask for part A's.
+	Find_Shortest_Routes(distances, maze->numTargets, &shortestRoute, NULL);
 	
 	//Free the maze's memory as soon as we're done with it
 	Delete_Maze(maze);
@@ -173,35 +279,847 @@ int main(int argc, char **argv)
 }
 
 
-//Find the shortest route that passes through all of the targets by minimizing
-//the sum of the distances. This is done by trying each node distance
-int Find_Shortest_Route(int **distances, int startNode, uint16_t unvisitedMask)
+//Find the shortest route that passes through all of the targets, both with and
+//without a final return to target 0. The brute-force recursion we started with
+//tries every ordering of the targets, which takes factorial time. Instead,
+//we'll use the Held-Karp dynamic programming algorithm. The key observation is
+//that the best way to finish a route only depends on which targets we've
+//already visited and where we are now -- not on the order we visited them in.
+//So for every subset of targets and every possible last target, we record the
+//length of the shortest route from target 0 that visits exactly that subset and
+//ends on that target:
+//
+//    cost[S][j] = min over k in S-{j} of (cost[S-{j}][k] + distance[k][j])
+//
+//Target 0 is always the start, so the subsets only cover targets 1 to n-1, and
+//bit b of the mask represents target b+1. The table is one flat array indexed
+//by mask * (n-1) + last, which takes O(2^n * n) memory and O(2^n * n^2) time.
+//That's a lot better than O(n!) -- twenty targets take about a billion steps
+//instead of 10^17 -- but the table still grows quickly. With more than
+//HELD_KARP_MAX_TARGETS targets, we switch to Find_Route_Branch_And_Bound().
+//
+//Every subset with p targets only depends on subsets with p-1 targets, so we
+//can process the subsets in layers sorted by population count, and split each
+//layer between several threads. The threads wait for each other at a barrier
+//before moving on to the next layer. A layer with p of the n-1 targets has
+//C(n-1, p) masks, and we number them in increasing order so that each thread
+//can take an equal share of the numbers. A thread works out its first mask
+//directly from its number, then steps through the rest in order with Gosper's
+//hack, so nobody ever looks at a mask from the wrong layer.
+//
+//Once the table is full, the open route (part A) is the smallest entry for the
+//full set, and the closed route (part B) is the smallest entry plus the
+//distance from its last target back to target 0. Unreachable targets have a
+//negative distance; if a route is impossible, we return INT_MAX. Either route
+//pointer can be NULL if that answer isn't needed.
+#define HELD_KARP_MAX_TARGETS  21
+#define NO_ROUTE               UINT32_MAX
+
+//Don't bother with threads unless the table is reasonably large
+#define MIN_THREADED_TARGETS   14
+
+//Information shared by the route-finding threads
+typedef struct
+{
+	int **distances;
+	uint32_t *cost;
+	int numNodes, numThreads;
+	pthread_barrier_t barrier;
+	
+	//Binomial coefficients, for counting and numbering the masks in a layer
+	uint32_t choose[HELD_KARP_MAX_TARGETS][HELD_KARP_MAX_TARGETS];
+} sRouteTable;
+
+//Arguments for one route-finding thread
+typedef struct
+{
+	sRouteTable *table;
+	int thread;
+} sRouteWorker;
+
+
+//Fill in one entry of the Held-Karp table
+static void Route_Cost(sRouteTable *table, uint32_t mask, int last)
+{
+	uint32_t *cost, prevMask, best, prevCost;
+	int **distances;
+	int numNodes, k, step;
+	
+	cost = table->cost;
+	distances = table->distances;
+	numNodes = table->numNodes;
+	
+	//Start with the route that ends by stepping from k to last
+	prevMask = mask & ~(UINT32_C(1) << last);
+	best = NO_ROUTE;
+	for (k = 0; k < numNodes; k++)
+	{
+		if (!(prevMask & (UINT32_C(1) << k)))
+			continue;
+		
+		prevCost = cost[(size_t)prevMask * numNodes + k];
+		step = distances[k + 1][last + 1];
+		if (prevCost == NO_ROUTE || step < 0)
+			continue;
+		if (prevCost + step < best)
+			best = prevCost + step;
+	}
+	cost[(size_t)mask * numNodes + last] = best;
+}
+
+
+//Find the mask with the given number among the masks with count bits set,
+//numbered in increasing order. The number of masks whose highest bit is below
+//bit b is C(b, count), so we look for the highest bit first, then repeat for
+//the bits below it.
+static uint32_t Nth_Mask(const sRouteTable *table, int count, uint32_t index)
+{
+	uint32_t mask;
+	int bit;
+	
+	mask = 0;
+	for (bit = table->numNodes - 1; count > 0; bit--)
+	{
+		if (table->choose[bit][count] <= index)
+		{
+			index -= table->choose[bit][count];
+			mask |= UINT32_C(1) << bit;
+			count--;
+		}
+	}
+	
+	return mask;
+}
+
+
+//Thread function for filling in the table. Each layer of masks is divided into
+//equal shares, one per thread.
+static void *Route_Worker(void *arg)
+{
+	sRouteWorker *worker = arg;
+	sRouteTable *table = worker->table;
+	uint32_t mask, low, high, index, first, end, numMasks;
+	int layer, last;
+	
+	//The single-target layer was filled in before the threads started
+	for (layer = 2; layer <= table->numNodes; layer++)
+	{
+		numMasks = table->choose[table->numNodes][layer];
+		first = (uint64_t)numMasks * worker->thread / table->numThreads;
+		end = (uint64_t)numMasks * (worker->thread + 1) / table->numThreads;
+		
+		mask = Nth_Mask(table, layer, first);
+		for (index = first; index < end; index++)
+		{
+			for (last = 0; last < table->numNodes; last++)
+			{
+				if (mask & (UINT32_C(1) << last))
+					Route_Cost(table, mask, last);
+			}
+			
+			//Gosper's hack: move the lowest block of set bits up to the
+			//next mask with the same number of bits
+			low = mask & -mask;
+			high = mask + low;
+			mask = (((high ^ mask) >> 2) / low) | high;
+		}
+		
+		//Wait for everyone to finish this layer
+		pthread_barrier_wait(&table->barrier);
+	}
+	
+	return NULL;
+}
+
+
+void Find_Shortest_Routes(int **distances, int numTargets, int *openRoute,
+                          int *closedRoute)
+{
+	sRouteTable table;
+	sRouteWorker *workers;
+	pthread_t *threads;
+	uint32_t fullMask, cost;
+	int last, t, i, step, unusedOpen, unusedClosed;
+	bool wantOpen, wantClosed;
+	
+	//Either answer can be left out by passing NULL. The table gives us both
+	//for free, so an unwanted answer just goes into a local variable.
+	wantOpen = (openRoute != NULL);
+	wantClosed = (closedRoute != NULL);
+	if (!wantOpen)
+		openRoute = &unusedOpen;
+	if (!wantClosed)
+		closedRoute = &unusedClosed;
+	
+	//With only target 0, there's nowhere to go
+	*openRoute = 0;
+	*closedRoute = 0;
+	if (numTargets <= 1)
+		return;
+	
+	//The table would be too big, so solve each part separately instead. Each
+	//search is slow, so we only do the ones that were asked for.
+	if (numTargets > HELD_KARP_MAX_TARGETS)
+	{
+		if (wantOpen)
+			*openRoute = Find_Route_Branch_And_Bound(distances, numTargets,
+			                                                           false);
+		if (wantClosed)
+			*closedRoute = Find_Route_Branch_And_Bound(distances, numTargets,
+			                                                            true);
+		return;
+	}
+	
+	//Allocate the table. Entries for a last target that isn't in the mask are
+	//never used, so we don't need to initialize them.
+	table.distances = distances;
+	table.numNodes = numTargets - 1;
+	fullMask = (UINT32_C(1) << table.numNodes) - 1;
+	table.cost = Safe_Malloc(((size_t)fullMask + 1) * table.numNodes *
+	                                                         sizeof(uint32_t));
+	
+	//The first layer is just the distance from target 0 to each target
+	for (last = 0; last < table.numNodes; last++)
+	{
+		step = distances[0][last + 1];
+		table.cost[((size_t)1 << last) * table.numNodes + last] =
+		                                 (step < 0) ? NO_ROUTE : (uint32_t)step;
+	}
+	
+	//Fill in Pascal's triangle for numbering the masks
+	for (t = 0; t <= table.numNodes; t++)
+	{
+		for (i = 0; i <= table.numNodes; i++)
+		{
+			if (i == 0)
+				table.choose[t][i] = 1;
+			else if (t == 0)
+				table.choose[t][i] = 0;
+			else
+				table.choose[t][i] = table.choose[t-1][i-1] +
+				                                       table.choose[t-1][i];
+		}
+	}
+	
+	//Fill in the rest of the table, using threads if it's worth it
+	table.numThreads = 1;
+	if (table.numNodes >= MIN_THREADED_TARGETS)
+		table.numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (table.numThreads < 1)
+		table.numThreads = 1;
+	
+	pthread_barrier_init(&table.barrier, NULL, table.numThreads);
+	workers = Safe_Malloc(table.numThreads * sizeof(sRouteWorker));
+	threads = Safe_Malloc(table.numThreads * sizeof(pthread_t));
+	for (t = 0; t < table.numThreads; t++)
+	{
+		workers[t] = (sRouteWorker){&table, t};
+		
+		//Thread 0 is the current thread
+		if (t > 0 && pthread_create(&threads[t], NULL, Route_Worker,
+		                                                      &workers[t]) != 0)
+		{
+			fprintf(stderr, "Error creating thread\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	Route_Worker(&workers[0]);
+	for (t = 1; t < table.numThreads; t++)
+	{
+		pthread_join(threads[t], NULL);
+	}
+	pthread_barrier_destroy(&table.barrier);
+	free(threads);
+	free(workers);
+	
+	//Now we can read off both answers from the full set of targets
+	*openRoute = INT_MAX;
+	*closedRoute = INT_MAX;
+	for (last = 0; last < table.numNodes; last++)
+	{
+		cost = table.cost[(size_t)fullMask * table.numNodes + last];
+		if (cost == NO_ROUTE)
+			continue;
+		if ((int)cost < *openRoute)
+			*openRoute = cost;
+		
+		step = distances[last + 1][0];
+		if (step >= 0 && (int)cost + step < *closedRoute)
+			*closedRoute = cost + step;
+	}
+	
+	free(table.cost);
+}
+
+
+//Find the shortest route through all of the targets with a branch-and-bound
+//search. The Held-Karp table doubles in size with every target, so past a
+//couple dozen targets it won't fit in memory. Branch and bound goes back to the
+//idea of our original recursion -- try every ordering of the targets -- but
+//skips any partial route that can't possibly beat the best complete route
+//we've found so far. Whether this is fast depends entirely on how good the
+//estimates are, so there are several parts to it:
+//
+//1. A good starting route. We build one greedily by always going to the
+//   nearest unvisited target, then improve it with 2-opt: reversing any section
+//   of the route that makes it shorter, until no reversal helps.
+//
+//2. A lower bound on the cost of finishing a partial route. The rest of the
+//   route passes through every unvisited target, so it includes a tree that
+//   connects them all. That means it can't be shorter than the minimum spanning
+//   tree (MST) of the unvisited targets, plus the shortest step from the
+//   current target onto that tree. If we have to return to target 0, we also
+//   add the shortest step from the tree back to 0. (At the very start, when the
+//   current target is 0, this becomes the classic "1-tree" bound: the MST plus
+//   the two shortest edges at target 0.)
+//
+//3. Better trees. A route enters and leaves every target exactly once, but a
+//   spanning tree can have busy targets with lots of branches and quiet ones
+//   with only one, which makes the bound too low. So we give each target a
+//   penalty that gets added to every edge touching it. A route pays each
+//   target's penalty exactly twice no matter which way it goes, so we can
+//   subtract that back out and still have a valid bound. Raising the penalty on
+//   busy targets and lowering it on quiet ones pushes the tree toward looking
+//   like a route, which raises the bound. We pick the penalties once, before
+//   the search, by repeatedly nudging them based on each target's number of
+//   branches. (This is called Lagrangian relaxation, or the Held-Karp bound --
+//   the same Held and Karp as the table above.)
+//
+//4. A good search order. We try the nearest targets first, since they tend to
+//   lead to short routes, which in turn lets us skip more of the search.
+//
+//5. A memory of where we've been. Different orderings of the same targets often
+//   end up at the same place, and only the cheapest one is worth finishing. We
+//   keep a hash table of (unvisited set, current target) states along with the
+//   lowest cost we've reached them at, and skip a state if we've already been
+//   there for less. The table has a fixed size, and a new state simply
+//   replaces whatever was in its slot, so it's a cache rather than a complete
+//   record. That costs us some extra searching, but never a wrong answer.
+//
+//The result is still exact. The visited sets are 64-bit masks, so we can have
+//up to 64 targets. Unreachable pairs of targets are treated as infinitely far
+//apart; if no route exists, we return INT_MAX. In a maze the distances go both
+//ways, so a route exists exactly when every target can be reached from 0, and
+//we check that before searching at all.
+#define MAX_BRANCH_TARGETS  64
+#define FAR_AWAY            (INT_MAX / 4)
+#define SEEN_TABLE_BITS     20
+#define PENALTY_ROUNDS      200
+
+typedef struct
+{
+	uint64_t unvisited;
+	int current, cost;
+} sSeenState;
+
+typedef struct
+{
+	int numTargets;
+	int *distance;
+	bool returnToStart;
+	int bestCost;
+	
+	//The order to try targets in from each target, nearest first
+	int *nearest;
+	
+	//The penalty for each target
+	double *penalty;
+	
+	//States we've already reached. A current target of -1 means the slot is
+	//empty.
+	sSeenState *seen;
+} sBranchSearch;
+
+
+//Lower bound on the cost of visiting every target in unvisited, starting from
+//the current target (and returning to 0 if required). If branches isn't NULL,
+//it gets the number of tree edges touching each target, which is what we need
+//to adjust the penalties.
+static int Route_Lower_Bound(const sBranchSearch *search, int current,
+                             uint64_t unvisited, int *branches)
+{
+	const int *dist = search->distance;
+	const double *penalty = search->penalty;
+	double closest[MAX_BRANCH_TARGETS], bound, d, toTree, secondToTree;
+	double fromTree, penaltySum, minPenalty;
+	int members[MAX_BRANCH_TARGETS], parent[MAX_BRANCH_TARGETS];
+	bool inTree[MAX_BRANCH_TARGETS];
+	int numTargets, numMembers, i, n, best, to, secondTo, from;
+	
+	numTargets = search->numTargets;
+	if (unvisited == 0)
+		return search->returnToStart ? dist[current * numTargets] : 0;
+	
+	//List the unvisited targets and add up their penalties
+	numMembers = 0;
+	penaltySum = 0;
+	minPenalty = 0;
+	for (n = 0; n < numTargets; n++)
+	{
+		if (!(unvisited & (UINT64_C(1) << n)))
+			continue;
+		if (numMembers == 0 || penalty[n] < minPenalty)
+			minPenalty = penalty[n];
+		members[numMembers++] = n;
+		penaltySum += penalty[n];
+	}
+	if (branches != NULL)
+	{
+		for (n = 0; n < numTargets; n++)
+		{
+			branches[n] = 0;
+		}
+	}
+	
+	//Build the minimum spanning tree of the unvisited targets with Prim's
+	//algorithm. We grow the tree one target at a time, always adding the
+	//target that's closest to the tree so far. closest[i] is the distance from
+	//member i to the tree, and parent[i] is the tree member it's closest to.
+	//Every edge includes the penalties of the targets at both ends.
+	for (i = 0; i < numMembers; i++)
+	{
+		inTree[i] = false;
+		closest[i] = dist[members[0] * numTargets + members[i]] +
+		                            penalty[members[0]] + penalty[members[i]];
+		parent[i] = 0;
+	}
+	inTree[0] = true;
+	bound = 0;
+	for (n = 1; n < numMembers; n++)
+	{
+		best = -1;
+		for (i = 0; i < numMembers; i++)
+		{
+			if (!inTree[i] && (best < 0 || closest[i] < closest[best]))
+				best = i;
+		}
+		bound += closest[best];
+		inTree[best] = true;
+		if (branches != NULL)
+		{
+			branches[members[best]]++;
+			branches[members[parent[best]]]++;
+		}
+		
+		for (i = 0; i < numMembers; i++)
+		{
+			d = dist[members[best] * numTargets + members[i]] +
+			                     penalty[members[best]] + penalty[members[i]];
+			if (!inTree[i] && d < closest[i])
+			{
+				closest[i] = d;
+				parent[i] = best;
+			}
+		}
+	}
+	
+	//Find the shortest (and second shortest) step from the current target to
+	//the tree, and the shortest step from the tree back to 0
+	toTree = secondToTree = fromTree = FAR_AWAY;
+	to = secondTo = from = current;
+	for (i = 0; i < numMembers; i++)
+	{
+		n = members[i];
+		d = dist[current * numTargets + n] + penalty[current] + penalty[n];
+		if (d < toTree)
+		{
+			secondToTree = toTree;
+			secondTo = to;
+			toTree = d;
+			to = n;
+		} else if (d < secondToTree)
+		{
+			secondToTree = d;
+			secondTo = n;
+		}
+		
+		d = dist[n * numTargets] + penalty[n] + penalty[0];
+		if (d < fromTree)
+		{
+			fromTree = d;
+			from = n;
+		}
+	}
+	
+	bound += toTree;
+	if (branches != NULL)
+	{
+		branches[current]++;
+		branches[to]++;
+	}
+	
+	//Now take the penalties back out. The rest of the route enters and leaves
+	//each unvisited target, and leaves the current one. If we return to 0, we
+	//enter 0 one more time. Otherwise the route ends at an unvisited target,
+	//which we only enter, but we don't know which one, so we assume it's the
+	//one with the smallest penalty.
+	if (search->returnToStart)
+	{
+		//Starting from 0 with more than one target left, the route leaves 0
+		//and comes back along two different edges
+		if (current == 0 && numMembers > 1)
+		{
+			bound += secondToTree;
+			if (branches != NULL)
+			{
+				branches[0]++;
+				branches[secondTo]++;
+			}
+		} else
+		{
+			bound += fromTree;
+			if (branches != NULL)
+			{
+				branches[from]++;
+				branches[0]++;
+			}
+		}
+		bound -= penalty[current] + penalty[0] + 2 * penaltySum;
+	} else
+	{
+		bound -= penalty[current] + 2 * penaltySum - minPenalty;
+	}
+	
+	//The real route length is a whole number, so we can round the bound up. The
+	//small fudge factor covers rounding errors in the penalties.
+	if (bound >= FAR_AWAY / 2)
+		return FAR_AWAY;
+	return (int)ceil(bound - 1e-6);
+}
+
+
+//Pick the penalties for the lower bound. We start with no penalties, then on
+//each round, we build the tree for the whole problem and look at how many
+//branches each target has. A target on a route has two (or one, if it's at the
+//end of an open route), so we raise the penalty on targets with more than that
+//and lower it on targets with fewer. The size of the nudge shrinks as we go,
+//and we keep whichever penalties gave the best bound. If the bound ever
+//reaches the best route we've found, that route must be the shortest, and we
+//can stop.
+static void Choose_Penalties(sBranchSearch *search, uint64_t unvisited)
 {
-	int n, minDist, nextDist;
+	double best[MAX_BRANCH_TARGETS], scale, step;
+	int branches[MAX_BRANCH_TARGETS], wanted[MAX_BRANCH_TARGETS];
+	int numTargets, round, n, bound, bestBound, sumSquares;
 	
-	//Mark the current node as visited by clearing its bit in the mask
-	unvisitedMask &= ~(1 << startNode);
+	numTargets = search->numTargets;
+	for (n = 0; n < numTargets; n++)
+	{
+		search->penalty[n] = 0;
+		best[n] = 0;
+		wanted[n] = 2;
+	}
+	if (!search->returnToStart)
+		wanted[0] = 1;
 	
-	//If there are no nodes left, the remaining distance is zero
-	if (unvisitedMask == 0x0000)
+	bestBound = 0;
+	scale = 2.0;
+	for (round = 0; round < PENALTY_ROUNDS; round++)
+	{
+		bound = Route_Lower_Bound(search, 0, unvisited, branches);
+		if (bound >= FAR_AWAY || bound >= search->bestCost)
+		{
+			bestBound = bound;
+			memcpy(best, search->penalty, numTargets * sizeof(double));
+			break;
+		}
+		if (bound > bestBound)
+		{
+			bestBound = bound;
+			memcpy(best, search->penalty, numTargets * sizeof(double));
+		}
+		
+		sumSquares = 0;
+		for (n = 0; n < numTargets; n++)
+		{
+			sumSquares += (branches[n] - wanted[n]) * (branches[n] - wanted[n]);
+		}
+		if (sumSquares == 0)
+			break;
+		
+		step = scale * (search->bestCost - bound) / sumSquares;
+		for (n = 0; n < numTargets; n++)
+		{
+			search->penalty[n] += step * (branches[n] - wanted[n]);
+		}
+		scale *= 0.97;
+	}
+	
+	memcpy(search->penalty, best, numTargets * sizeof(double));
+}
+
+
+//Add a step to a route cost. An unreachable step costs FAR_AWAY, and a few of
+//those would overflow an int, so the total stops at FAR_AWAY.
+static int Add_Step(int cost, int step)
+{
+	if (step >= FAR_AWAY || cost >= FAR_AWAY - step)
+		return FAR_AWAY;
+	return cost + step;
+}
+
+
+//Total cost of a route that starts at 0 and visits the targets in order
+static int Route_Length(const sBranchSearch *search, const int *route)
+{
+	const int *dist = search->distance;
+	int numTargets, i, cost;
+	
+	numTargets = search->numTargets;
+	cost = 0;
+	for (i = 1; i < numTargets; i++)
+	{
+		cost = Add_Step(cost, dist[route[i-1] * numTargets + route[i]]);
+	}
+	if (search->returnToStart)
+		cost = Add_Step(cost, dist[route[numTargets - 1] * numTargets]);
+	
+	return cost;
+}
+
+
+//Build a starting route by always going to the nearest unvisited target, then
+//apply 2-opt moves until none of them help. A 2-opt move reverses the section
+//of the route between positions i and j, which replaces the edges going into i
+//and out of j with edges going into j and out of i. Target 0 always stays at
+//the start. For an open route there's no edge out of the last target, so
+//reversing the tail of the route only changes one edge.
+static void Starting_Route(const sBranchSearch *search, int *route)
+{
+	const int *dist = search->distance;
+	uint64_t visited;
+	int numTargets, i, j, k, n, temp, before, after, next;
+	bool improved;
+	
+	numTargets = search->numTargets;
+	route[0] = 0;
+	visited = 1;
+	for (i = 1; i < numTargets; i++)
+	{
+		for (k = 0; k < numTargets; k++)
+		{
+			n = search->nearest[route[i-1] * numTargets + k];
+			if (!(visited & (UINT64_C(1) << n)))
+				break;
+		}
+		route[i] = n;
+		visited |= UINT64_C(1) << n;
+	}
+	
+	do
+	{
+		improved = false;
+		for (i = 1; i < numTargets - 1; i++)
+		{
+			for (j = i + 1; j < numTargets; j++)
+			{
+				//Work out what follows j, if anything
+				if (j + 1 < numTargets)
+					next = route[j+1];
+				else if (search->returnToStart)
+					next = 0;
+				else
+					next = -1;
+				
+				before = dist[route[i-1] * numTargets + route[i]];
+				after = dist[route[i-1] * numTargets + route[j]];
+				if (next >= 0)
+				{
+					before = Add_Step(before,
+					                  dist[route[j] * numTargets + next]);
+					after = Add_Step(after, dist[route[i] * numTargets + next]);
+				}
+				if (after >= before)
+					continue;
+				
+				for (k = i, n = j; k < n; k++, n--)
+				{
+					temp = route[k];
+					route[k] = route[n];
+					route[n] = temp;
+				}
+				improved = true;
+			}
+		}
+	} while (improved);
+}
+
+
+//Check whether we've already reached this state for the same cost or less. If
+//not, record the new cost. The hash is a multiplicative one: multiplying by a
+//large odd constant mixes the bits of the key, and the top bits of the result
+//pick the slot.
+static bool Already_Seen(sBranchSearch *search, int current, uint64_t unvisited,
+                         int cost)
+{
+	sSeenState *slot;
+	uint64_t hash;
+	
+	hash = (unvisited * 64 + current) * UINT64_C(0x9E3779B97F4A7C15);
+	slot = &search->seen[hash >> (64 - SEEN_TABLE_BITS)];
+	if (slot->current == current && slot->unvisited == unvisited)
+	{
+		if (slot->cost <= cost)
+			return true;
+		slot->cost = cost;
+		return false;
+	}
+	
+	*slot = (sSeenState){unvisited, current, cost};
+	return false;
+}
+
+
+//The recursive part of the search. We're at the current target having spent
+//cost so far, and still need to visit the targets in unvisited.
+static void Route_Branch(sBranchSearch *search, int current, uint64_t unvisited,
+                         int cost)
+{
+	uint64_t nextUnvisited;
+	int k, n, nextCost;
+	
+	if (unvisited == 0)
+	{
+		if (search->returnToStart)
+			cost = Add_Step(cost, search->distance[current *
+			                                           search->numTargets]);
+		if (cost < search->bestCost)
+			search->bestCost = cost;
+		return;
+	}
+	
+	//Try the unvisited targets nearest first, skipping any that can't lead
+	//to a better route than the best one so far
+	for (k = 0; k < search->numTargets; k++)
+	{
+		n = search->nearest[current * search->numTargets + k];
+		if (!(unvisited & (UINT64_C(1) << n)))
+			continue;
+		
+		nextUnvisited = unvisited & ~(UINT64_C(1) << n);
+		nextCost = Add_Step(cost, search->distance[current *
+		                                               search->numTargets + n]);
+		if (nextCost >= search->bestCost)
+			continue;
+		if (Already_Seen(search, n, nextUnvisited, nextCost))
+			continue;
+		if (Add_Step(nextCost, Route_Lower_Bound(search, n, nextUnvisited,
+		                                             NULL)) >= search->bestCost)
+			continue;
+		
+		Route_Branch(search, n, nextUnvisited, nextCost);
+	}
+}
+
+
+int Find_Route_Branch_And_Bound(int **distances, int numTargets,
+                                bool returnToStart)
+{
+	sBranchSearch search;
+	int *route, *row;
+	int i, j, k, temp;
+	uint64_t unvisited;
+	
+	if (numTargets <= 1)
 		return 0;
+	if (numTargets > MAX_BRANCH_TARGETS)
+	{
+		fprintf(stderr, "Error: Too many targets (%d, max %d)!\n", numTargets,
+		                                                   MAX_BRANCH_TARGETS);
+		exit(EXIT_FAILURE);
+	}
 	
-	//Start new routes recursively with the current node removed from the list.
-	//The shortest total distance will be returned.
-	minDist = INT_MAX;
-	for (n = 0; n < 16; n++)
+	//Copy the distances into a flat array, replacing unreachable pairs with a
+	//large number so they never look like a shortcut
+	search.numTargets = numTargets;
+	search.returnToStart = returnToStart;
+	search.distance = Safe_Malloc(numTargets * numTargets * sizeof(int));
+	search.nearest = Safe_Malloc(numTargets * numTargets * sizeof(int));
+	search.penalty = Safe_Malloc(numTargets * sizeof(double));
+	for (i = 0; i < numTargets; i++)
 	{
-		if (unvisitedMask & (1 << n))
+		for (j = 0; j < numTargets; j++)
 		{
-			nextDist = distances[startNode][n] +
-			                   Find_Shortest_Route(distances, n, unvisitedMask);
-							   
-			if (nextDist < minDist)
-				minDist = nextDist;
+			search.distance[i * numTargets + j] = (distances[i][j] < 0) ?
+			                                         FAR_AWAY : distances[i][j];
 		}
 	}
 	
-	return minDist;
+	//If any target can't be reached from 0, no route can visit them all
+	for (j = 1; j < numTargets; j++)
+	{
+		if (search.distance[j] >= FAR_AWAY)
+		{
+			free(search.distance);
+			free(search.nearest);
+			free(search.penalty);
+			return INT_MAX;
+		}
+	}
+	
+	//Sort each target's neighbors by distance. The lists are short, so an
+	//insertion sort is fine.
+	for (i = 0; i < numTargets; i++)
+	{
+		row = &search.nearest[i * numTargets];
+		for (j = 0; j < numTargets; j++)
+		{
+			temp = j;
+			for (k = j; k > 0; k--)
+			{
+				if (search.distance[i * numTargets + row[k-1]] <=
+				                       search.distance[i * numTargets + temp])
+					break;
+				row[k] = row[k-1];
+			}
+			row[k] = temp;
+		}
+	}
+	
+	//Empty the table of states we've seen
+	search.seen = Safe_Malloc(((size_t)1 << SEEN_TABLE_BITS) *
+	                                                       sizeof(sSeenState));
+	for (i = 0; i < (1 << SEEN_TABLE_BITS); i++)
+	{
+		search.seen[i].current = -1;
+	}
+	
+	//Get the starting route and use it as the best so far
+	route = Safe_Malloc(numTargets * sizeof(int));
+	Starting_Route(&search, route);
+	search.bestCost = Route_Length(&search, route);
+	free(route);
+	
+	//Now search for something better. The unvisited mask leaves out target 0.
+	unvisited = (numTargets == 64) ? ~UINT64_C(0) :
+	                                         (UINT64_C(1) << numTargets) - 1;
+	unvisited &= ~UINT64_C(1);
+	Choose_Penalties(&search, unvisited);
+	if (Route_Lower_Bound(&search, 0, unvisited, NULL) < search.bestCost)
+		Route_Branch(&search, 0, unvisited, 0);
+	
+	free(search.distance);
+	free(search.nearest);
+	free(search.penalty);
+	free(search.seen);
+	
+	return (search.bestCost < FAR_AWAY) ? search.bestCost : INT_MAX;
+}
+
+
+//Convert a target label to a target number. Labels '0' through '9' are the
+//usual targets. Our generated mazes need more than ten, so we continue with
+//'A' through 'Z' for 10-35 and 'a' through 'z' for 36-61. Returns -1 if the
+//character isn't a target label.
+int Target_Index(int label)
+{
+	if (label >= '0' && label <= '9')
+		return label - '0';
+	if (label >= 'A' && label <= 'Z')
+		return label - 'A' + 10;
+	if (label >= 'a' && label <= 'z')
+		return label - 'a' + 36;
+	return -1;
 }
 
 
@@ -240,9 +1158,9 @@ sMaze *Create_Maze(FILE *inFile)
 		if (nextChar == '\n')
 		{
 			maze->ySize++;
-		} else if (nextChar >= '0' && nextChar <= '9')
+		} else if (Target_Index(nextChar) >= 0)
 		{
-			target = nextChar - '0';
+			target = Target_Index(nextChar);
 			if (target + 1 > maze->numTargets)
 				maze->numTargets = target + 1;
 		}
@@ -258,15 +1176,19 @@ sMaze *Create_Maze(FILE *inFile)
 		maze->rooms[x] = Safe_Malloc(maze->ySize * sizeof(sRoom));
 	}
 	maze->targets = Safe_Malloc(maze->numTargets * sizeof(sCoord));
+	Init_Queue(&maze->searchQueue, sizeof(sCoord));
 	
 	//Read the input file into the maze array. We'll be doing some of the
 	//initialization in the search loop, so we don't need to do it all here.
+	//The stamps start at zero, and the first search will use generation 1.
+	maze->generation = 0;
 	rewind(inFile);
 	for (y = 0; y < maze->ySize; y++)
 	{
 		for (x = 0; x < maze->xSize; x++)
 		{
 			nextChar = fgetc(inFile);
+			maze->rooms[x][y].visitStamp = 0;
 			if (nextChar == '#')
 			{
 				//It's a wall
@@ -276,9 +1198,9 @@ sMaze *Create_Maze(FILE *inFile)
 				//It's an open space. If it's a numbered target, save the
 				//coordinates.
 				maze->rooms[x][y].isOpen = true;
-				if (nextChar >= '0' && nextChar <= '9')
+				target = Target_Index(nextChar);
+				if (target >= 0)
 				{
-					target = nextChar - '0';
 					
 					//This is another nifty C99 feature -- a compound literal.
 					//Instead of just initializing structures with braced lists
@@ -307,19 +1229,25 @@ sMaze *Create_Maze(FILE *inFile)
 }
 
 
-//Helper function for resetting the room distances and visited flags before
-//running a search.
+//Helper function for resetting the visited flags before running a search. All
+//we have to do is start a new generation. The only time we need to touch the
+//rooms is when the generation counter wraps around to zero, which would make
+//rooms stamped four billion searches ago look visited.
 void Reset_Maze(sMaze *maze)
 {
 	int x, y;
 	
-	for (x = 0; x < maze->xSize; x++)
+	maze->generation++;
+	if (maze->generation == 0)
 	{
-		for (y = 0; y < maze->ySize; y++)
+		for (x = 0; x < maze->xSize; x++)
 		{
-			maze->rooms[x][y].visited = false;
-			maze->rooms[x][y].distance = UINT_MAX;
+			for (y = 0; y < maze->ySize; y++)
+			{
+				maze->rooms[x][y].visitStamp = 0;
+			}
 		}
+		maze->generation = 1;
 	}
 }
 
@@ -335,6 +1263,7 @@ void Delete_Maze(sMaze *maze)
 	}
 	free(maze->rooms);
 	free(maze->targets);
+	Delete_Queue(&maze->searchQueue);
 	free(maze);
 }
 
@@ -342,91 +1271,590 @@ void Delete_Maze(sMaze *maze)
 //Do a breadth-first search on the maze, starting at the given coordinates. Once
 //done, record the distance to each of the target locations in the distances
 //array.
+#define SEARCH_BATCH  64
+
 void Find_Distances(sMaze *maze, sCoord start, int *distances)
 {
 	//We can always access structure members directly, but sometimes copying
 	//them into local variables makes the code easier to read.
-	sQueue queue;
-	sCoord tempCoord;
+	sQueue *queue;
+	sCoord batch[SEARCH_BATCH], found[4];
 	sRoom **rooms;
-	int x, y, target;
+	uint32_t generation;
+	size_t numBatch, b;
+	int x, y, target, numFound;
 	
 	rooms = maze->rooms;
+	generation = maze->generation;
 	
-	//Create a queue for coordinates. The queue will be empty at the end of the
-	//function, so there's no need to delete it later.
-	Init_Queue(&queue, sizeof(sCoord));
+	//Use the maze's queue for coordinates. The queue will be empty at the end
+	//of the function, but it keeps its chunks for the next search, so after
+	//the first search we never have to allocate memory.
+	queue = &maze->searchQueue;
 	
 	//Initialize the starting location and add its coordinates to the queue.
 	//We're using a generic queue today, so everything has to be passed and
 	//returned by reference.
 	maze->rooms[start.x][start.y].distance = 0;
-	maze->rooms[start.x][start.y].visited = true;
-	Enqueue(&queue, &start);
+	maze->rooms[start.x][start.y].visitStamp = generation;
+	Enqueue(queue, &start);
 	
 	//Search until the maze is fully explored. This is not the most efficient
 	//approach in general, but our particular maze has numbers close to each of
 	//the corners, so it's probably not worth the extra comparisons to do an
-	//early termination.
-	while (queue.numElements > 0)
+	//early termination. Rather than taking one room at a time out of the queue,
+	//we take out a whole batch at once. Rooms still come out in the same order,
+	//so this is still a breadth-first search.
+	while ((numBatch = Dequeue_Many(queue, batch, SEARCH_BATCH)) > 0)
+	{
+		for (b = 0; b < numBatch; b++)
+		{
+			//Get the next room
+			x = batch[b].x;
+			y = batch[b].y;
+			numFound = 0;
+			
+			//Discover adjacent nodes, update their distance, and add them to
+			//the queue. Note that since this maze is bounded by walls, we
+			//don't have to worry about walking off the edge of the array. See
+			//the code from Day 13 if you're confused about what's going on
+			//here.
+			if (rooms[x-1][y].isOpen && rooms[x-1][y].visitStamp != generation)
+			{
+				rooms[x-1][y].distance = rooms[x][y].distance + 1;
+				rooms[x-1][y].visitStamp = generation;
+				found[numFound++] = (sCoord){x-1, y};
+			}
+			if (rooms[x+1][y].isOpen && rooms[x+1][y].visitStamp != generation)
+			{
+				rooms[x+1][y].distance = rooms[x][y].distance + 1;
+				rooms[x+1][y].visitStamp = generation;
+				found[numFound++] = (sCoord){x+1, y};
+			}
+			if (rooms[x][y-1].isOpen && rooms[x][y-1].visitStamp != generation)
+			{
+				rooms[x][y-1].distance = rooms[x][y].distance + 1;
+				rooms[x][y-1].visitStamp = generation;
+				found[numFound++] = (sCoord){x, y-1};
+			}
+			if (rooms[x][y+1].isOpen && rooms[x][y+1].visitStamp != generation)
+			{
+				rooms[x][y+1].distance = rooms[x][y].distance + 1;
+				rooms[x][y+1].visitStamp = generation;
+				found[numFound++] = (sCoord){x, y+1};
+			}
+			
+			//Add all of the new rooms to the queue at once
+			Enqueue_Many(queue, found, numFound);
+		}
+	}
+	
+	//Now that the search is complete, we can get the shortest path distance to
+	//each target by going through the target coordinate list. Targets that
+	//weren't visited in this generation are unreachable.
+	for (target = 0; target < maze->numTargets; target++)
+	{
+		x = maze->targets[target].x;
+		y = maze->targets[target].y;
+		if (rooms[x][y].visitStamp == generation)
+			distances[target] = rooms[x][y].distance;
+		else
+			distances[target] = -1;
+	}
+}
+
+
+//Find the distances between every pair of targets with a single search. Running
+//one breadth-first search per target explores the whole maze numTargets times,
+//which adds up when there are dozens of targets. Instead, we can run all of the
+//searches at once. Every room gets a 64-bit mask, where bit k means "the search
+//from target k has reached this room". All of the targets start out in the
+//first wave. On each wave, every room that gained some bits on the previous
+//wave passes those bits along to its open neighbors. A neighbor only keeps the
+//bits it hasn't seen before, and if it gained any, it goes into the next wave.
+//The first time bit k shows up in target j's room, the wave number is the
+//distance from k to j.
+//
+//This works because all of the searches advance in lockstep -- wave d contains
+//exactly the rooms that are d steps from some target, and one OR operation
+//handles up to 64 searches. The room array is awkward for this, so we use a
+//flat array of cells indexed by x * ySize + y. The maze is bounded by walls, so
+//we never need to check whether a neighbor is off the edge. Unreachable pairs
+//get a distance of -1.
+#define MAX_WAVE_TARGETS  64
+
+void Find_All_Distances(sMaze *maze, int **distances)
+{
+	uint64_t *reached, *delta, *nextDelta, *tempMask, bits, newBits;
+	int *frontier, *nextFrontier, *tempList, *targetAt;
+	bool *isOpen;
+	int numCells, numFrontier, numNext, pairsLeft;
+	int x, y, t, k, i, n, cell, neighbor, wave;
+	int offsets[4];
+	
+	if (maze->numTargets > MAX_WAVE_TARGETS)
+	{
+		fprintf(stderr, "Error: Too many targets (%d, max %d)!\n",
+		                                 maze->numTargets, MAX_WAVE_TARGETS);
+		exit(EXIT_FAILURE);
+	}
+	
+	//Allocate the per-cell arrays. Each cell is added to a frontier list at
+	//most once per wave, so the lists never need more than numCells entries.
+	numCells = maze->xSize * maze->ySize;
+	reached = Safe_Malloc(numCells * sizeof(uint64_t));
+	delta = Safe_Malloc(numCells * sizeof(uint64_t));
+	nextDelta = Safe_Malloc(numCells * sizeof(uint64_t));
+	frontier = Safe_Malloc(numCells * sizeof(int));
+	nextFrontier = Safe_Malloc(numCells * sizeof(int));
+	targetAt = Safe_Malloc(numCells * sizeof(int));
+	isOpen = Safe_Malloc(numCells * sizeof(bool));
+	
+	for (x = 0; x < maze->xSize; x++)
+	{
+		for (y = 0; y < maze->ySize; y++)
+		{
+			cell = x * maze->ySize + y;
+			isOpen[cell] = maze->rooms[x][y].isOpen;
+			reached[cell] = 0;
+			delta[cell] = 0;
+			nextDelta[cell] = 0;
+			targetAt[cell] = -1;
+		}
+	}
+	offsets[0] = -maze->ySize;
+	offsets[1] = maze->ySize;
+	offsets[2] = -1;
+	offsets[3] = 1;
+	
+	//Every target starts out reached by its own search at distance 0
+	for (t = 0; t < maze->numTargets; t++)
+	{
+		for (k = 0; k < maze->numTargets; k++)
+		{
+			distances[t][k] = -1;
+		}
+		distances[t][t] = 0;
+	}
+	numFrontier = 0;
+	for (t = 0; t < maze->numTargets; t++)
+	{
+		cell = maze->targets[t].x * maze->ySize + maze->targets[t].y;
+		targetAt[cell] = t;
+		reached[cell] = UINT64_C(1) << t;
+		delta[cell] = UINT64_C(1) << t;
+		frontier[numFrontier++] = cell;
+	}
+	pairsLeft = maze->numTargets * (maze->numTargets - 1);
+	
+	//Run the waves until nothing changes or we've found every pair
+	wave = 0;
+	while (numFrontier > 0 && pairsLeft > 0)
+	{
+		wave++;
+		numNext = 0;
+		
+		//Pass the new bits from each frontier cell to its neighbors. Marking
+		//them as reached right away keeps the same bits from being added twice
+		//in one wave.
+		for (i = 0; i < numFrontier; i++)
+		{
+			cell = frontier[i];
+			bits = delta[cell];
+			delta[cell] = 0;
+			for (n = 0; n < 4; n++)
+			{
+				neighbor = cell + offsets[n];
+				if (!isOpen[neighbor])
+					continue;
+				
+				newBits = bits & ~reached[neighbor];
+				if (newBits == 0)
+					continue;
+				if (nextDelta[neighbor] == 0)
+					nextFrontier[numNext++] = neighbor;
+				nextDelta[neighbor] |= newBits;
+				reached[neighbor] |= newBits;
+			}
+		}
+		
+		//Record the distances for any targets we just reached. The bits are
+		//extracted one at a time by finding the lowest set bit.
+		for (i = 0; i < numNext; i++)
+		{
+			t = targetAt[nextFrontier[i]];
+			if (t < 0)
+				continue;
+			
+			bits = nextDelta[nextFrontier[i]];
+			while (bits != 0)
+			{
+				k = __builtin_ctzll(bits);
+				distances[k][t] = wave;
+				pairsLeft--;
+				bits &= bits - 1;
+			}
+		}
+		
+		//The next wave becomes the current one. Every cell in the old frontier
+		//had its delta cleared, so the old delta array is all zeroes and can be
+		//reused for the wave after that.
+		tempMask = delta;
+		delta = nextDelta;
+		nextDelta = tempMask;
+		tempList = frontier;
+		frontier = nextFrontier;
+		nextFrontier = tempList;
+		numFrontier = numNext;
+	}
+	
+	free(reached);
+	free(delta);
+	free(nextDelta);
+	free(frontier);
+	free(nextFrontier);
+	free(targetAt);
+	free(isOpen);
+}
+
+
+//Contract the maze into a weighted graph. Most of the open rooms in the ducts
+//are corridors -- rooms with exactly two open neighbors. A search can't do
+//anything interesting in a corridor except keep walking, so we can replace each
+//corridor with a single weighted edge between the rooms at either end. The
+//rooms we keep as graph nodes are junctions (three or four open neighbors),
+//dead ends (zero or one), and the targets, no matter how many neighbors they
+//have. To find the edges, we start at each node and walk down each of its
+//corridors until we reach another node, counting the steps as we go.
+//
+//Each node's edges are stored together in one big array (a format called
+//compressed sparse row), with firstEdge[n] giving the index of node n's first
+//edge. Every corridor gets walked from both ends, so each edge shows up once in
+//each direction. The graph doesn't depend on which target we start from, so we
+//only have to build it once.
+sGraph *Contract_Maze(sMaze *maze)
+{
+	sGraph *graph;
+	bool *isOpen;
+	int *nodeOf, *degree;
+	int numCells, x, y, t, n, d, cell, prev, cur, next, length, edge;
+	int offsets[4];
+	
+	graph = Safe_Malloc(sizeof(sGraph));
+	
+	//Make a flat copy of the open flags, indexed the same way as in
+	//Find_All_Distances(), so we can step between rooms with simple offsets
+	numCells = maze->xSize * maze->ySize;
+	isOpen = Safe_Malloc(numCells * sizeof(bool));
+	nodeOf = Safe_Malloc(numCells * sizeof(int));
+	degree = Safe_Malloc(numCells * sizeof(int));
+	for (x = 0; x < maze->xSize; x++)
+	{
+		for (y = 0; y < maze->ySize; y++)
+		{
+			isOpen[x * maze->ySize + y] = maze->rooms[x][y].isOpen;
+		}
+	}
+	offsets[0] = -maze->ySize;
+	offsets[1] = maze->ySize;
+	offsets[2] = -1;
+	offsets[3] = 1;
+	
+	//Count the open neighbors of each room. The outer edge of the maze is all
+	//walls, so we can skip it.
+	for (cell = 0; cell < numCells; cell++)
+	{
+		degree[cell] = 0;
+		nodeOf[cell] = -1;
+	}
+	for (x = 1; x < maze->xSize - 1; x++)
+	{
+		for (y = 1; y < maze->ySize - 1; y++)
+		{
+			cell = x * maze->ySize + y;
+			if (!isOpen[cell])
+				continue;
+			for (d = 0; d < 4; d++)
+			{
+				if (isOpen[cell + offsets[d]])
+					degree[cell]++;
+			}
+		}
+	}
+	
+	//Pick out the nodes. The targets go first so that target t is node t.
+	graph->numTargets = maze->numTargets;
+	graph->numNodes = 0;
+	for (t = 0; t < maze->numTargets; t++)
+	{
+		cell = maze->targets[t].x * maze->ySize + maze->targets[t].y;
+		nodeOf[cell] = graph->numNodes++;
+	}
+	for (cell = 0; cell < numCells; cell++)
+	{
+		if (isOpen[cell] && degree[cell] != 2 && nodeOf[cell] < 0)
+			nodeOf[cell] = graph->numNodes++;
+	}
+	
+	//Each node has one edge per open neighbor, so we can lay out the edge
+	//array before walking any corridors
+	graph->firstEdge = Safe_Malloc((graph->numNodes + 1) * sizeof(int));
+	graph->firstEdge[0] = 0;
+	for (cell = 0; cell < numCells; cell++)
+	{
+		if (nodeOf[cell] >= 0)
+			graph->firstEdge[nodeOf[cell] + 1] = degree[cell];
+	}
+	for (n = 0; n < graph->numNodes; n++)
 	{
-		//Get the next room
-		Dequeue(&queue, &tempCoord);
-		x = tempCoord.x;
-		y = tempCoord.y;
+		graph->firstEdge[n + 1] += graph->firstEdge[n];
+	}
+	graph->numEdges = graph->firstEdge[graph->numNodes];
+	graph->edgeTo = Safe_Malloc(graph->numEdges * sizeof(int));
+	graph->edgeLength = Safe_Malloc(graph->numEdges * sizeof(uint32_t));
+	
+	//Walk the corridors. Every room we pass through has exactly two open
+	//neighbors, so the next room is whichever one we didn't just come from.
+	for (cell = 0; cell < numCells; cell++)
+	{
+		if (nodeOf[cell] < 0)
+			continue;
 		
-		//Discover adjacent nodes, update their distance, and add them to the
-		//queue. Note that since this maze is bounded by walls, we don't have to
-		//worry about walking off the edge of the array. See the code from Day
-		//13 if you're confused about what's going on here.
-		if (rooms[x-1][y].isOpen && !rooms[x-1][y].visited)
-		{
-			rooms[x-1][y].distance = rooms[x][y].distance + 1;
-			rooms[x-1][y].visited = true;
+		edge = graph->firstEdge[nodeOf[cell]];
+		for (d = 0; d < 4; d++)
+		{
+			if (!isOpen[cell + offsets[d]])
+				continue;
+			
+			prev = cell;
+			cur = cell + offsets[d];
+			length = 1;
+			while (nodeOf[cur] < 0)
+			{
+				for (n = 0; n < 4; n++)
+				{
+					next = cur + offsets[n];
+					if (isOpen[next] && next != prev)
+						break;
+				}
+				prev = cur;
+				cur = next;
+				length++;
+			}
 			
-			//Note that we could just enqueue the nameless struct created by the
-			//compound literal, but nameless variables make me nervous. As an
-			//embedded programmer, I'm already nervous about consuming stack
-			//space through syntax rather than declarations. Yes, I know I'm
-			//fretting about eight bytes of stack space while stuffing dozens of
-			//nodes in the queue. :-)
-			tempCoord = (sCoord){x-1, y};
-			Enqueue(&queue, &tempCoord);
+			graph->edgeTo[edge] = nodeOf[cur];
+			graph->edgeLength[edge] = length;
+			edge++;
 		}
-		if (rooms[x+1][y].isOpen && !rooms[x+1][y].visited)
+	}
+	
+	//Allocate the working storage for the searches
+	graph->distance = Safe_Malloc(graph->numNodes * sizeof(uint32_t));
+	Init_Radix_Heap(&graph->heap);
+	
+	free(isOpen);
+	free(nodeOf);
+	free(degree);
+	
+	return graph;
+}
+
+
+//Free the memory used by a graph
+void Delete_Graph(sGraph *graph)
+{
+	free(graph->firstEdge);
+	free(graph->edgeTo);
+	free(graph->edgeLength);
+	free(graph->distance);
+	Delete_Radix_Heap(&graph->heap);
+	free(graph);
+}
+
+
+//Find the distances from one target to all of the others using Dijkstra's
+//algorithm. Now that the edges have different lengths, a plain queue isn't
+//good enough -- we need to always expand the closest unfinished node next,
+//which means we need a priority queue. Rather than leaving stale entries in the
+//heap when we find a shorter path to a node, we just add the node again and
+//skip the old entry when it comes out. As with Find_All_Distances(),
+//unreachable targets get a distance of -1.
+void Find_Graph_Distances(sGraph *graph, int source, int *distances)
+{
+	sHeapItem item;
+	uint32_t newDistance;
+	int n, e, targetsLeft;
+	
+	for (n = 0; n < graph->numNodes; n++)
+	{
+		graph->distance[n] = UINT32_MAX;
+	}
+	graph->distance[source] = 0;
+	Clear_Radix_Heap(&graph->heap);
+	Radix_Heap_Push(&graph->heap, 0, source);
+	
+	//Nodes come out of the heap in order of distance, so we can stop once
+	//we've finished every target
+	targetsLeft = graph->numTargets;
+	while (graph->heap.size > 0 && targetsLeft > 0)
+	{
+		item = Radix_Heap_Pop(&graph->heap);
+		if (item.key != graph->distance[item.node])
+			continue;
+		if (item.node < graph->numTargets)
+			targetsLeft--;
+		
+		for (e = graph->firstEdge[item.node];
+		                               e < graph->firstEdge[item.node + 1]; e++)
 		{
-			rooms[x+1][y].distance = rooms[x][y].distance + 1;
-			rooms[x+1][y].visited = true;
-			tempCoord = (sCoord){x+1, y};
-			Enqueue(&queue, &tempCoord);
+			n = graph->edgeTo[e];
+			newDistance = item.key + graph->edgeLength[e];
+			if (newDistance < graph->distance[n])
+			{
+				graph->distance[n] = newDistance;
+				Radix_Heap_Push(&graph->heap, newDistance, n);
+			}
 		}
-		if (rooms[x][y-1].isOpen && !rooms[x][y-1].visited)
+	}
+	
+	//The targets are the first nodes in the graph
+	for (n = 0; n < graph->numTargets; n++)
+	{
+		if (graph->distance[n] == UINT32_MAX)
+			distances[n] = -1;
+		else
+			distances[n] = graph->distance[n];
+	}
+}
+
+
+//A radix heap is a priority queue that takes advantage of the fact that
+//Dijkstra's algorithm never adds a key smaller than the last one it removed.
+//Items are sorted into buckets based on the highest bit where their key differs
+//from the last key removed: bucket 0 holds keys equal to it, and bucket b holds
+//keys that first differ at bit b-1. When bucket 0 runs out, we find the first
+//non-empty bucket, make its smallest key the new "last" key, and spread its
+//items out into the lower buckets. Each item can only move down a bucket at a
+//time, so the total work is small, and there are no comparisons between items
+//like there are in a binary heap. The bucket arrays are kept between searches,
+//so once they've grown to a comfortable size we stop allocating memory.
+void Init_Radix_Heap(sRadixHeap *heap)
+{
+	int b;
+	
+	for (b = 0; b < RADIX_BUCKETS; b++)
+	{
+		heap->items[b] = NULL;
+		heap->count[b] = 0;
+		heap->capacity[b] = 0;
+	}
+	heap->last = 0;
+	heap->size = 0;
+}
+
+//Empty the heap without freeing its memory
+void Clear_Radix_Heap(sRadixHeap *heap)
+{
+	int b;
+	
+	for (b = 0; b < RADIX_BUCKETS; b++)
+	{
+		heap->count[b] = 0;
+	}
+	heap->last = 0;
+	heap->size = 0;
+}
+
+//Pick the bucket for a key based on its highest bit that differs from the last
+//key removed
+static int Radix_Bucket(const sRadixHeap *heap, uint32_t key)
+{
+	if (key == heap->last)
+		return 0;
+	return 32 - __builtin_clz(key ^ heap->last);
+}
+
+//Add an item to one bucket, growing the bucket if necessary
+static void Radix_Bucket_Add(sRadixHeap *heap, int b, sHeapItem item)
+{
+	if (heap->count[b] == heap->capacity[b])
+	{
+		heap->capacity[b] = (heap->capacity[b] == 0) ? 64 :
+		                                                 2 * heap->capacity[b];
+		heap->items[b] = realloc(heap->items[b],
+		                              heap->capacity[b] * sizeof(sHeapItem));
+		if (heap->items[b] == NULL)
 		{
-			rooms[x][y-1].distance = rooms[x][y].distance + 1;
-			rooms[x][y-1].visited = true;
-			tempCoord = (sCoord){x, y-1};
-			Enqueue(&queue, &tempCoord);
+			fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+			exit(EXIT_FAILURE);
 		}
-		if (rooms[x][y+1].isOpen && !rooms[x][y+1].visited)
+	}
+	heap->items[b][heap->count[b]++] = item;
+}
+
+//Add a key to the heap. The key can't be smaller than the last one removed.
+void Radix_Heap_Push(sRadixHeap *heap, uint32_t key, int node)
+{
+	Radix_Bucket_Add(heap, Radix_Bucket(heap, key), (sHeapItem){key, node});
+	heap->size++;
+}
+
+//Remove and return the item with the smallest key
+sHeapItem Radix_Heap_Pop(sRadixHeap *heap)
+{
+	sHeapItem *items;
+	int b, i, count;
+	uint32_t minKey;
+	
+	if (heap->size == 0)
+	{
+		fprintf(stderr, "Error: Heap underrun!\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	//If there's nothing with the last key, redistribute the first non-empty
+	//bucket. Every item in it ends up in a lower bucket, and at least one ends
+	//up in bucket 0.
+	if (heap->count[0] == 0)
+	{
+		for (b = 1; heap->count[b] == 0; b++)
+			;
+		
+		items = heap->items[b];
+		count = heap->count[b];
+		minKey = items[0].key;
+		for (i = 1; i < count; i++)
+		{
+			if (items[i].key < minKey)
+				minKey = items[i].key;
+		}
+		
+		heap->last = minKey;
+		heap->count[b] = 0;
+		for (i = 0; i < count; i++)
 		{
-			rooms[x][y+1].distance = rooms[x][y].distance + 1;
-			rooms[x][y+1].visited = true;
-			tempCoord = (sCoord){x, y+1};
-			Enqueue(&queue, &tempCoord);
+			Radix_Bucket_Add(heap, Radix_Bucket(heap, items[i].key), items[i]);
 		}
 	}
 	
-	//Now that the search is complete, we can get the shortest path distance to
-	//each target by going through the target coordinate list.
-	for (target = 0; target < maze->numTargets; target++)
+	heap->size--;
+	return heap->items[0][--heap->count[0]];
+}
+
+//Free the memory used by the heap
+void Delete_Radix_Heap(sRadixHeap *heap)
+{
+	int b;
+	
+	for (b = 0; b < RADIX_BUCKETS; b++)
 	{
-		x = maze->targets[target].x;
-		y = maze->targets[target].y;
-		distances[target] = rooms[x][y].distance;
+		free(heap->items[b]);
 	}
+	Init_Radix_Heap(heap);
 }
 
 
+
 //Helper function for error-checking malloc()
 void *Safe_Malloc(size_t size)
 {
@@ -446,50 +1874,100 @@ void *Safe_Malloc(size_t size)
 //Initialize the queue. We'll specify the size of the stored objects here for
 //simplicity. We could theoretically put the element size in the enqueue
 //function, which would let us mix object types in the queue, but that would be
-//weird and not very useful.
+//weird and not very useful. No memory is allocated until the first element is
+//added.
 void Init_Queue(sQueue *queue, size_t elementSize)
 {
 	queue->numElements = 0;
 	queue->elementSize = elementSize;
+	queue->chunkElements = QUEUE_CHUNK_BYTES / elementSize;
+	if (queue->chunkElements == 0)
+		queue->chunkElements = 1;
+	queue->head = 0;
+	queue->tail = 0;
 	queue->first = NULL;
 	queue->last = NULL;
+	queue->spare = NULL;
 }
 
-//Add an object to the queue. Because we don't know the data type, the object
-//must be passed by reference as a void pointer.
-void Enqueue(sQueue *queue, const void *object)
+//Add a new chunk to the tail of the queue, recycling a spare one if we can
+static void Add_Queue_Chunk(sQueue *queue)
 {
-	sQueueNode *new;
+	sQueueChunk *new;
 	
-	//Allocate memory for a new node with enough storage for the object
-	new = malloc(sizeof(sQueueNode) + queue->elementSize);
-	if (new == NULL)
+	if (queue->spare != NULL)
 	{
-		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
-		exit(EXIT_FAILURE);
+		new = queue->spare;
+		queue->spare = new->next;
+	} else
+	{
+		new = malloc(sizeof(sQueueChunk) +
+		                             queue->chunkElements * queue->elementSize);
+		if (new == NULL)
+		{
+			fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+			exit(EXIT_FAILURE);
+		}
 	}
 	
-	//Initialize the list pointer and copy the data into the new node. memcpy()
-	//copies one byte at a time, so we don't have to worry about unaligned data.
 	new->next = NULL;
-	memcpy(new->nodeData, object, queue->elementSize);
-
-	//Add the node to the tail of the list. If the list is empty, we need to
-	//update the queue pointers to cover the new list.
-	if (queue->numElements > 0)
+	if (queue->last != NULL)
 		queue->last->next = new;
 	else
 		queue->first = new;
 	queue->last = new;
-	queue->numElements++;
+	queue->tail = 0;
+}
+
+//Move the used-up first chunk to the spare list
+static void Recycle_Queue_Chunk(sQueue *queue)
+{
+	sQueueChunk *oldest;
+	
+	oldest = queue->first;
+	queue->first = oldest->next;
+	if (queue->first == NULL)
+		queue->last = NULL;
+	oldest->next = queue->spare;
+	queue->spare = oldest;
+	queue->head = 0;
 }
 
-//Remove and return the next node from the queue. Again, not knowing the data
+//Add an object to the queue. Because we don't know the data type, the object
+//must be passed by reference as a void pointer.
+void Enqueue(sQueue *queue, const void *object)
+{
+	Enqueue_Many(queue, object, 1);
+}
+
+//Add several objects to the queue at once. The objects are stored one after
+//another in an array, just like they are in the chunks, so we can copy as many
+//of them as will fit in the last chunk with a single memcpy().
+void Enqueue_Many(sQueue *queue, const void *objects, size_t count)
+{
+	const char *source = objects;
+	size_t space, n;
+	
+	while (count > 0)
+	{
+		if (queue->last == NULL || queue->tail == queue->chunkElements)
+			Add_Queue_Chunk(queue);
+		
+		space = queue->chunkElements - queue->tail;
+		n = (count < space) ? count : space;
+		memcpy(queue->last->chunkData + queue->tail * queue->elementSize,
+		                                     source, n * queue->elementSize);
+		queue->tail += n;
+		queue->numElements += n;
+		source += n * queue->elementSize;
+		count -= n;
+	}
+}
+
+//Remove and return the next object from the queue. Again, not knowing the data
 //type means we have to return the data via a pointer.
 void Dequeue(sQueue *queue, void *object)
 {
-	sQueueNode *oldest;
-	
 	//We can't return anything to indicate an empty queue without knowing the
 	//data type, so instead we'll have to crash the program. If we really
 	//needed to recover gracefully from an underrun, we could set errno to an
@@ -500,28 +1978,71 @@ void Dequeue(sQueue *queue, void *object)
 		exit(EXIT_FAILURE);
 	}
 	
-	//Copy the oldest node's data using the provided pointer
-	oldest = queue->first;
-	memcpy(object, oldest->nodeData, queue->elementSize);
+	Dequeue_Many(queue, object, 1);
+}
+
+//Remove up to maxCount objects from the queue and copy them into an array.
+//Returns the number of objects removed, which is zero if the queue is empty.
+size_t Dequeue_Many(sQueue *queue, void *objects, size_t maxCount)
+{
+	char *dest = objects;
+	size_t available, n, total;
 	
-	//Delete the oldest node from the linked list. We can only update the queue
-	//pointers if there are still other nodes left in the list.
-	if (queue->numElements > 1)
-		queue->first = oldest->next;
-	free(oldest);
-	queue->numElements--;
+	total = 0;
+	while (total < maxCount && queue->numElements > 0)
+	{
+		//The first chunk holds everything from the head up to either the end
+		//of the chunk or the tail, if it's also the last chunk
+		if (queue->first == queue->last)
+			available = queue->tail - queue->head;
+		else
+			available = queue->chunkElements - queue->head;
+		n = maxCount - total;
+		if (n > available)
+			n = available;
+		
+		memcpy(dest, queue->first->chunkData + queue->head * queue->elementSize,
+		                                             n * queue->elementSize);
+		queue->head += n;
+		queue->numElements -= n;
+		dest += n * queue->elementSize;
+		total += n;
+		
+		//If the queue is now empty, we can start over at the beginning of the
+		//same chunk. Otherwise, once we've used up the first chunk, it goes on
+		//the spare list.
+		if (queue->numElements == 0)
+		{
+			queue->head = 0;
+			queue->tail = 0;
+		} else if (queue->head == queue->chunkElements)
+		{
+			Recycle_Queue_Chunk(queue);
+		}
+	}
+	
+	return total;
 }
 
-//Free all the memory used by the queue. Does nothing if the queue is empty.
+//Free all the memory used by the queue, including the spare chunks
 void Delete_Queue(sQueue *queue)
 {
-	sQueueNode *next;
+	sQueueChunk *next;
 	
-	while (queue->numElements > 0)
+	while (queue->first != NULL)
 	{
 		next = queue->first->next;
 		free(queue->first);
 		queue->first = next;
-		queue->numElements--;
 	}
+	while (queue->spare != NULL)
+	{
+		next = queue->spare->next;
+		free(queue->spare);
+		queue->spare = next;
+	}
+	queue->last = NULL;
+	queue->numElements = 0;
+	queue->head = 0;
+	queue->tail = 0;
 }
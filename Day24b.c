@@ -4,8 +4,8 @@
 //needed to visit every non-zero number on the map at least once, and then
 //return to location 0?
 //
-//This is now a true traveling salesman problem. Fortunately, only a small
-//modification is needed to our recursive algorithm.
+//This is now a true traveling salesman problem. Fortunately, the route table
+//from part A already has everything we need.
 
 
 #include <stdio.h>
@@ -15,25 +15,32 @@
 #include <stdbool.h>
 #include <limits.h>
 #include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
 
 
-//None of the structures change
-typedef struct sQueueNode
+//None of the structures change from part A
+#define QUEUE_CHUNK_BYTES  4096
+
+typedef struct sQueueChunk
 {
-	struct sQueueNode *next;
+	struct sQueueChunk *next;
 	
-	char nodeData[];
-} sQueueNode;
+	char chunkData[];
+} sQueueChunk;
 	
 typedef struct
 {
-	size_t numElements, elementSize;
-	sQueueNode *first, *last;
+	size_t numElements, elementSize, chunkElements;
+	size_t head, tail;
+	sQueueChunk *first, *last, *spare;
 } sQueue;
 
 typedef struct
 {
-	bool isOpen, visited;
+	bool isOpen;
+	uint32_t visitStamp;
 	int distance;
 } sRoom;
 
@@ -48,33 +55,86 @@ typedef struct
 	int xSize, ySize;
 	sCoord *targets;
 	int numTargets;
+	uint32_t generation;
+	sQueue searchQueue;
 } sMaze;
 
+typedef struct
+{
+	uint32_t key;
+	int node;
+} sHeapItem;
+
+#define RADIX_BUCKETS  33
+
+typedef struct
+{
+	sHeapItem *items[RADIX_BUCKETS];
+	int count[RADIX_BUCKETS], capacity[RADIX_BUCKETS];
+	uint32_t last;
+	int size;
+} sRadixHeap;
+
+typedef struct
+{
+	int numNodes, numEdges, numTargets;
+	int *firstEdge, *edgeTo;
+	uint32_t *edgeLength;
+	uint32_t *distance;
+	sRadixHeap heap;
+} sGraph;
+
 
 sMaze *Create_Maze(FILE *inFile);
 void Reset_Maze(sMaze *maze);
 void Delete_Maze(sMaze *maze);
 void Find_Distances(sMaze *maze, sCoord start, int *distances);
-int Find_Shortest_Route(int **distances, int startNode, uint16_t unvisitedMask);
+void Find_All_Distances(sMaze *maze, int **distances);
+sGraph *Contract_Maze(sMaze *maze);
+void Delete_Graph(sGraph *graph);
+void Find_Graph_Distances(sGraph *graph, int source, int *distances);
+void Init_Radix_Heap(sRadixHeap *heap);
+void Clear_Radix_Heap(sRadixHeap *heap);
+void Radix_Heap_Push(sRadixHeap *heap, uint32_t key, int node);
+sHeapItem Radix_Heap_Pop(sRadixHeap *heap);
+void Delete_Radix_Heap(sRadixHeap *heap);
+void Find_Shortest_Routes(int **distances, int numTargets, int *openRoute,
+                          int *closedRoute);
+int Find_Route_Branch_And_Bound(int **distances, int numTargets,
+                                bool returnToStart);
+int Target_Index(int label);
 void *Safe_Malloc(size_t size);
 void Init_Queue(sQueue *queue, size_t elementSize);
 void Enqueue(sQueue *queue, const void *object);
+void Enqueue_Many(sQueue *queue, const void *objects, size_t count);
 void Dequeue(sQueue *queue, void *object);
+size_t Dequeue_Many(sQueue *queue, void *objects, size_t maxCount);
 void Delete_Queue(sQueue *queue);
 
 
-//No change to the main function
+//The main function only changes which answer we print
 int main(int argc, char **argv)
 {
 	FILE *inFile;
 	sMaze *maze;
 	int **distances;
+	sGraph *graph;
+	const char *method;
 	int t, shortestRoute;
 	
-	//The usual command line argument check and input file opening
-	if (argc != 2)
+	//The usual command line argument check and input file opening, plus the
+	//optional search method from part A
+	if (argc != 2 && argc != 3)
 	{
-		fprintf(stderr, "Usage:\n\tDay24 <input filename>\n\n");
+		fprintf(stderr, "Usage:\n\tDay24 <input filename> "
+		                                           "[bfs|wave|graph]\n\n");
+		return EXIT_FAILURE;
+	}
+	method = (argc == 3) ? argv[2] : "wave";
+	if (strcmp(method, "bfs") != 0 && strcmp(method, "wave") != 0 &&
+	                                             strcmp(method, "graph") != 0)
+	{
+		fprintf(stderr, "Unknown search method: %s\n", method);
 		return EXIT_FAILURE;
 	}
 
@@ -98,16 +158,30 @@ int main(int argc, char **argv)
 		distances[t] = Safe_Malloc(maze->numTargets * sizeof(int));
 	}
 	
-	//Now we can run the searches, starting at each target location
-	for (t = 0; t < maze->numTargets; t++)
+	//Run the searches the same way as part A
+	if (strcmp(method, "bfs") == 0)
 	{
-		Reset_Maze(maze);
-		Find_Distances(maze, maze->targets[t], distances[t]);
+		for (t = 0; t < maze->numTargets; t++)
+		{
+			Reset_Maze(maze);
+			Find_Distances(maze, maze->targets[t], distances[t]);
+		}
+	} else if (strcmp(method, "graph") == 0)
+	{
+		graph = Contract_Maze(maze);
+		for (t = 0; t < maze->numTargets; t++)
+		{
+			Find_Graph_Distances(graph, t, distances[t]);
+		}
+		Delete_Graph(graph);
+	} else
+	{
+		Find_All_Distances(maze, distances);
 	}
 	
-	//Find the shortest route using our modified function
-	shortestRoute = Find_Shortest_Route(distances, 0,
-	                                               (1 << maze->numTargets) - 1);
+	//Find the shortest route. The route table from part A gives us the
+	//return-to-0 answer too, so all we change is which answer we ask for.
+	Find_Shortest_Routes(distances, maze->numTargets, NULL, &shortestRoute);
 	
 	//Free the maze's memory as soon as we're done with it
 	Delete_Maze(maze);
@@ -119,41 +193,757 @@ int main(int argc, char **argv)
 }
 
 
-//The only change is in this function
-int Find_Shortest_Route(int **distances, int startNode, uint16_t unvisitedMask)
+//The route table is the same as in part A. The return-to-0 answer is read off
+//the full set of targets at the end.
+#define HELD_KARP_MAX_TARGETS  21
+#define NO_ROUTE               UINT32_MAX
+
+#define MIN_THREADED_TARGETS   14
+
+typedef struct
+{
+	int **distances;
+	uint32_t *cost;
+	int numNodes, numThreads;
+	pthread_barrier_t barrier;
+	
+	uint32_t choose[HELD_KARP_MAX_TARGETS][HELD_KARP_MAX_TARGETS];
+} sRouteTable;
+
+typedef struct
+{
+	sRouteTable *table;
+	int thread;
+} sRouteWorker;
+
+
+static void Route_Cost(sRouteTable *table, uint32_t mask, int last)
+{
+	uint32_t *cost, prevMask, best, prevCost;
+	int **distances;
+	int numNodes, k, step;
+	
+	cost = table->cost;
+	distances = table->distances;
+	numNodes = table->numNodes;
+	
+	//Start with the route that ends by stepping from k to last
+	prevMask = mask & ~(UINT32_C(1) << last);
+	best = NO_ROUTE;
+	for (k = 0; k < numNodes; k++)
+	{
+		if (!(prevMask & (UINT32_C(1) << k)))
+			continue;
+		
+		prevCost = cost[(size_t)prevMask * numNodes + k];
+		step = distances[k + 1][last + 1];
+		if (prevCost == NO_ROUTE || step < 0)
+			continue;
+		if (prevCost + step < best)
+			best = prevCost + step;
+	}
+	cost[(size_t)mask * numNodes + last] = best;
+}
+
+
+static uint32_t Nth_Mask(const sRouteTable *table, int count, uint32_t index)
+{
+	uint32_t mask;
+	int bit;
+	
+	mask = 0;
+	for (bit = table->numNodes - 1; count > 0; bit--)
+	{
+		if (table->choose[bit][count] <= index)
+		{
+			index -= table->choose[bit][count];
+			mask |= UINT32_C(1) << bit;
+			count--;
+		}
+	}
+	
+	return mask;
+}
+
+
+static void *Route_Worker(void *arg)
+{
+	sRouteWorker *worker = arg;
+	sRouteTable *table = worker->table;
+	uint32_t mask, low, high, index, first, end, numMasks;
+	int layer, last;
+	
+	//The single-target layer was filled in before the threads started
+	for (layer = 2; layer <= table->numNodes; layer++)
+	{
+		numMasks = table->choose[table->numNodes][layer];
+		first = (uint64_t)numMasks * worker->thread / table->numThreads;
+		end = (uint64_t)numMasks * (worker->thread + 1) / table->numThreads;
+		
+		mask = Nth_Mask(table, layer, first);
+		for (index = first; index < end; index++)
+		{
+			for (last = 0; last < table->numNodes; last++)
+			{
+				if (mask & (UINT32_C(1) << last))
+					Route_Cost(table, mask, last);
+			}
+			
+			//Gosper's hack, as in part A
+			low = mask & -mask;
+			high = mask + low;
+			mask = (((high ^ mask) >> 2) / low) | high;
+		}
+		
+		//Wait for everyone to finish this layer
+		pthread_barrier_wait(&table->barrier);
+	}
+	
+	return NULL;
+}
+
+
+void Find_Shortest_Routes(int **distances, int numTargets, int *openRoute,
+                          int *closedRoute)
+{
+	sRouteTable table;
+	sRouteWorker *workers;
+	pthread_t *threads;
+	uint32_t fullMask, cost;
+	int last, t, i, step, unusedOpen, unusedClosed;
+	bool wantOpen, wantClosed;
+	
+	//Either answer can be left out by passing NULL. The table gives us both
+	//for free, so an unwanted answer just goes into a local variable.
+	wantOpen = (openRoute != NULL);
+	wantClosed = (closedRoute != NULL);
+	if (!wantOpen)
+		openRoute = &unusedOpen;
+	if (!wantClosed)
+		closedRoute = &unusedClosed;
+	
+	//With only target 0, there's nowhere to go
+	*openRoute = 0;
+	*closedRoute = 0;
+	if (numTargets <= 1)
+		return;
+	
+	//The table would be too big, so solve each part separately instead. Each
+	//search is slow, so we only do the ones that were asked for.
+	if (numTargets > HELD_KARP_MAX_TARGETS)
+	{
+		if (wantOpen)
+			*openRoute = Find_Route_Branch_And_Bound(distances, numTargets,
+			                                                           false);
+		if (wantClosed)
+			*closedRoute = Find_Route_Branch_And_Bound(distances, numTargets,
+			                                                            true);
+		return;
+	}
+	
+	//Allocate the table. Entries for a last target that isn't in the mask are
+	//never used, so we don't need to initialize them.
+	table.distances = distances;
+	table.numNodes = numTargets - 1;
+	fullMask = (UINT32_C(1) << table.numNodes) - 1;
+	table.cost = Safe_Malloc(((size_t)fullMask + 1) * table.numNodes *
+	                                                         sizeof(uint32_t));
+	
+	//The first layer is just the distance from target 0 to each target
+	for (last = 0; last < table.numNodes; last++)
+	{
+		step = distances[0][last + 1];
+		table.cost[((size_t)1 << last) * table.numNodes + last] =
+		                                 (step < 0) ? NO_ROUTE : (uint32_t)step;
+	}
+	
+	for (t = 0; t <= table.numNodes; t++)
+	{
+		for (i = 0; i <= table.numNodes; i++)
+		{
+			if (i == 0)
+				table.choose[t][i] = 1;
+			else if (t == 0)
+				table.choose[t][i] = 0;
+			else
+				table.choose[t][i] = table.choose[t-1][i-1] +
+				                                       table.choose[t-1][i];
+		}
+	}
+	
+	//Fill in the rest of the table, using threads if it's worth it
+	table.numThreads = 1;
+	if (table.numNodes >= MIN_THREADED_TARGETS)
+		table.numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (table.numThreads < 1)
+		table.numThreads = 1;
+	
+	pthread_barrier_init(&table.barrier, NULL, table.numThreads);
+	workers = Safe_Malloc(table.numThreads * sizeof(sRouteWorker));
+	threads = Safe_Malloc(table.numThreads * sizeof(pthread_t));
+	for (t = 0; t < table.numThreads; t++)
+	{
+		workers[t] = (sRouteWorker){&table, t};
+		
+		//Thread 0 is the current thread
+		if (t > 0 && pthread_create(&threads[t], NULL, Route_Worker,
+		                                                      &workers[t]) != 0)
+		{
+			fprintf(stderr, "Error creating thread\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	Route_Worker(&workers[0]);
+	for (t = 1; t < table.numThreads; t++)
+	{
+		pthread_join(threads[t], NULL);
+	}
+	pthread_barrier_destroy(&table.barrier);
+	free(threads);
+	free(workers);
+	
+	//Now we can read off both answers from the full set of targets
+	*openRoute = INT_MAX;
+	*closedRoute = INT_MAX;
+	for (last = 0; last < table.numNodes; last++)
+	{
+		cost = table.cost[(size_t)fullMask * table.numNodes + last];
+		if (cost == NO_ROUTE)
+			continue;
+		if ((int)cost < *openRoute)
+			*openRoute = cost;
+		
+		step = distances[last + 1][0];
+		if (step >= 0 && (int)cost + step < *closedRoute)
+			*closedRoute = cost + step;
+	}
+	
+	free(table.cost);
+}
+
+
+//The branch-and-bound search is the same as in part A, including the
+//penalties on each target. It handles both kinds of route.
+#define MAX_BRANCH_TARGETS  64
+#define FAR_AWAY            (INT_MAX / 4)
+#define SEEN_TABLE_BITS     20
+#define PENALTY_ROUNDS      200
+
+typedef struct
+{
+	uint64_t unvisited;
+	int current, cost;
+} sSeenState;
+
+typedef struct
+{
+	int numTargets;
+	int *distance;
+	bool returnToStart;
+	int bestCost;
+	
+	//The order to try targets in from each target, nearest first
+	int *nearest;
+	
+	//The penalty for each target
+	double *penalty;
+	
+	//States we've already reached. A current target of -1 means the slot is
+	//empty.
+	sSeenState *seen;
+} sBranchSearch;
+
+
+//Lower bound on the cost of visiting every target in unvisited, starting from
+//the current target (and returning to 0 if required). If branches isn't NULL,
+//it gets the number of tree edges touching each target, which is what we need
+//to adjust the penalties.
+static int Route_Lower_Bound(const sBranchSearch *search, int current,
+                             uint64_t unvisited, int *branches)
+{
+	const int *dist = search->distance;
+	const double *penalty = search->penalty;
+	double closest[MAX_BRANCH_TARGETS], bound, d, toTree, secondToTree;
+	double fromTree, penaltySum, minPenalty;
+	int members[MAX_BRANCH_TARGETS], parent[MAX_BRANCH_TARGETS];
+	bool inTree[MAX_BRANCH_TARGETS];
+	int numTargets, numMembers, i, n, best, to, secondTo, from;
+	
+	numTargets = search->numTargets;
+	if (unvisited == 0)
+		return search->returnToStart ? dist[current * numTargets] : 0;
+	
+	//List the unvisited targets and add up their penalties
+	numMembers = 0;
+	penaltySum = 0;
+	minPenalty = 0;
+	for (n = 0; n < numTargets; n++)
+	{
+		if (!(unvisited & (UINT64_C(1) << n)))
+			continue;
+		if (numMembers == 0 || penalty[n] < minPenalty)
+			minPenalty = penalty[n];
+		members[numMembers++] = n;
+		penaltySum += penalty[n];
+	}
+	if (branches != NULL)
+	{
+		for (n = 0; n < numTargets; n++)
+		{
+			branches[n] = 0;
+		}
+	}
+	
+	//Build the minimum spanning tree of the unvisited targets with Prim's
+	//algorithm. We grow the tree one target at a time, always adding the
+	//target that's closest to the tree so far. closest[i] is the distance from
+	//member i to the tree, and parent[i] is the tree member it's closest to.
+	//Every edge includes the penalties of the targets at both ends.
+	for (i = 0; i < numMembers; i++)
+	{
+		inTree[i] = false;
+		closest[i] = dist[members[0] * numTargets + members[i]] +
+		                            penalty[members[0]] + penalty[members[i]];
+		parent[i] = 0;
+	}
+	inTree[0] = true;
+	bound = 0;
+	for (n = 1; n < numMembers; n++)
+	{
+		best = -1;
+		for (i = 0; i < numMembers; i++)
+		{
+			if (!inTree[i] && (best < 0 || closest[i] < closest[best]))
+				best = i;
+		}
+		bound += closest[best];
+		inTree[best] = true;
+		if (branches != NULL)
+		{
+			branches[members[best]]++;
+			branches[members[parent[best]]]++;
+		}
+		
+		for (i = 0; i < numMembers; i++)
+		{
+			d = dist[members[best] * numTargets + members[i]] +
+			                     penalty[members[best]] + penalty[members[i]];
+			if (!inTree[i] && d < closest[i])
+			{
+				closest[i] = d;
+				parent[i] = best;
+			}
+		}
+	}
+	
+	//Find the shortest (and second shortest) step from the current target to
+	//the tree, and the shortest step from the tree back to 0
+	toTree = secondToTree = fromTree = FAR_AWAY;
+	to = secondTo = from = current;
+	for (i = 0; i < numMembers; i++)
+	{
+		n = members[i];
+		d = dist[current * numTargets + n] + penalty[current] + penalty[n];
+		if (d < toTree)
+		{
+			secondToTree = toTree;
+			secondTo = to;
+			toTree = d;
+			to = n;
+		} else if (d < secondToTree)
+		{
+			secondToTree = d;
+			secondTo = n;
+		}
+		
+		d = dist[n * numTargets] + penalty[n] + penalty[0];
+		if (d < fromTree)
+		{
+			fromTree = d;
+			from = n;
+		}
+	}
+	
+	bound += toTree;
+	if (branches != NULL)
+	{
+		branches[current]++;
+		branches[to]++;
+	}
+	
+	//Now take the penalties back out. The rest of the route enters and leaves
+	//each unvisited target, and leaves the current one. If we return to 0, we
+	//enter 0 one more time. Otherwise the route ends at an unvisited target,
+	//which we only enter, but we don't know which one, so we assume it's the
+	//one with the smallest penalty.
+	if (search->returnToStart)
+	{
+		//Starting from 0 with more than one target left, the route leaves 0
+		//and comes back along two different edges
+		if (current == 0 && numMembers > 1)
+		{
+			bound += secondToTree;
+			if (branches != NULL)
+			{
+				branches[0]++;
+				branches[secondTo]++;
+			}
+		} else
+		{
+			bound += fromTree;
+			if (branches != NULL)
+			{
+				branches[from]++;
+				branches[0]++;
+			}
+		}
+		bound -= penalty[current] + penalty[0] + 2 * penaltySum;
+	} else
+	{
+		bound -= penalty[current] + 2 * penaltySum - minPenalty;
+	}
+	
+	//The real route length is a whole number, so we can round the bound up. The
+	//small fudge factor covers rounding errors in the penalties.
+	if (bound >= FAR_AWAY / 2)
+		return FAR_AWAY;
+	return (int)ceil(bound - 1e-6);
+}
+
+
+//Pick the penalties for the lower bound. We start with no penalties, then on
+//each round, we build the tree for the whole problem and look at how many
+//branches each target has. A target on a route has two (or one, if it's at the
+//end of an open route), so we raise the penalty on targets with more than that
+//and lower it on targets with fewer. The size of the nudge shrinks as we go,
+//and we keep whichever penalties gave the best bound. If the bound ever
+//reaches the best route we've found, that route must be the shortest, and we
+//can stop.
+static void Choose_Penalties(sBranchSearch *search, uint64_t unvisited)
+{
+	double best[MAX_BRANCH_TARGETS], scale, step;
+	int branches[MAX_BRANCH_TARGETS], wanted[MAX_BRANCH_TARGETS];
+	int numTargets, round, n, bound, bestBound, sumSquares;
+	
+	numTargets = search->numTargets;
+	for (n = 0; n < numTargets; n++)
+	{
+		search->penalty[n] = 0;
+		best[n] = 0;
+		wanted[n] = 2;
+	}
+	if (!search->returnToStart)
+		wanted[0] = 1;
+	
+	bestBound = 0;
+	scale = 2.0;
+	for (round = 0; round < PENALTY_ROUNDS; round++)
+	{
+		bound = Route_Lower_Bound(search, 0, unvisited, branches);
+		if (bound >= FAR_AWAY || bound >= search->bestCost)
+		{
+			bestBound = bound;
+			memcpy(best, search->penalty, numTargets * sizeof(double));
+			break;
+		}
+		if (bound > bestBound)
+		{
+			bestBound = bound;
+			memcpy(best, search->penalty, numTargets * sizeof(double));
+		}
+		
+		sumSquares = 0;
+		for (n = 0; n < numTargets; n++)
+		{
+			sumSquares += (branches[n] - wanted[n]) * (branches[n] - wanted[n]);
+		}
+		if (sumSquares == 0)
+			break;
+		
+		step = scale * (search->bestCost - bound) / sumSquares;
+		for (n = 0; n < numTargets; n++)
+		{
+			search->penalty[n] += step * (branches[n] - wanted[n]);
+		}
+		scale *= 0.97;
+	}
+	
+	memcpy(search->penalty, best, numTargets * sizeof(double));
+}
+
+
+static int Add_Step(int cost, int step)
+{
+	if (step >= FAR_AWAY || cost >= FAR_AWAY - step)
+		return FAR_AWAY;
+	return cost + step;
+}
+
+
+//Total cost of a route that starts at 0 and visits the targets in order
+static int Route_Length(const sBranchSearch *search, const int *route)
 {
-	int n, minDist, nextDist;
+	const int *dist = search->distance;
+	int numTargets, i, cost;
 	
-	//Mark the current node as visited by clearing its bit in the mask
-	unvisitedMask &= ~(1 << startNode);
+	numTargets = search->numTargets;
+	cost = 0;
+	for (i = 1; i < numTargets; i++)
+	{
+		cost = Add_Step(cost, dist[route[i-1] * numTargets + route[i]]);
+	}
+	if (search->returnToStart)
+		cost = Add_Step(cost, dist[route[numTargets - 1] * numTargets]);
 	
-	//This is the only change. If there are no nodes left, we still have to move
-	//one more time back to location 0.
-	if (unvisitedMask == 0x0000)
-		return distances[startNode][0];
+	return cost;
+}
+
+
+//Build a starting route by always going to the nearest unvisited target, then
+//apply 2-opt moves until none of them help. A 2-opt move reverses the section
+//of the route between positions i and j, which replaces the edges going into i
+//and out of j with edges going into j and out of i. Target 0 always stays at
+//the start. For an open route there's no edge out of the last target, so
+//reversing the tail of the route only changes one edge.
+static void Starting_Route(const sBranchSearch *search, int *route)
+{
+	const int *dist = search->distance;
+	uint64_t visited;
+	int numTargets, i, j, k, n, temp, before, after, next;
+	bool improved;
+	
+	numTargets = search->numTargets;
+	route[0] = 0;
+	visited = 1;
+	for (i = 1; i < numTargets; i++)
+	{
+		for (k = 0; k < numTargets; k++)
+		{
+			n = search->nearest[route[i-1] * numTargets + k];
+			if (!(visited & (UINT64_C(1) << n)))
+				break;
+		}
+		route[i] = n;
+		visited |= UINT64_C(1) << n;
+	}
 	
-	//Start new routes recursively with the current node removed from the list.
-	//The shortest total distance will be returned.
-	minDist = INT_MAX;
-	for (n = 0; n < 16; n++)
+	do
 	{
-		if (unvisitedMask & (1 << n))
+		improved = false;
+		for (i = 1; i < numTargets - 1; i++)
 		{
-			nextDist = distances[startNode][n] +
-			                   Find_Shortest_Route(distances, n, unvisitedMask);
-							   
-			if (nextDist < minDist)
-				minDist = nextDist;
+			for (j = i + 1; j < numTargets; j++)
+			{
+				//Work out what follows j, if anything
+				if (j + 1 < numTargets)
+					next = route[j+1];
+				else if (search->returnToStart)
+					next = 0;
+				else
+					next = -1;
+				
+				before = dist[route[i-1] * numTargets + route[i]];
+				after = dist[route[i-1] * numTargets + route[j]];
+				if (next >= 0)
+				{
+					before = Add_Step(before,
+					                  dist[route[j] * numTargets + next]);
+					after = Add_Step(after, dist[route[i] * numTargets + next]);
+				}
+				if (after >= before)
+					continue;
+				
+				for (k = i, n = j; k < n; k++, n--)
+				{
+					temp = route[k];
+					route[k] = route[n];
+					route[n] = temp;
+				}
+				improved = true;
+			}
 		}
+	} while (improved);
+}
+
+
+//No change
+static bool Already_Seen(sBranchSearch *search, int current, uint64_t unvisited,
+                         int cost)
+{
+	sSeenState *slot;
+	uint64_t hash;
+	
+	hash = (unvisited * 64 + current) * UINT64_C(0x9E3779B97F4A7C15);
+	slot = &search->seen[hash >> (64 - SEEN_TABLE_BITS)];
+	if (slot->current == current && slot->unvisited == unvisited)
+	{
+		if (slot->cost <= cost)
+			return true;
+		slot->cost = cost;
+		return false;
+	}
+	
+	*slot = (sSeenState){unvisited, current, cost};
+	return false;
+}
+
+
+//The recursive part of the search. We're at the current target having spent
+//cost so far, and still need to visit the targets in unvisited.
+static void Route_Branch(sBranchSearch *search, int current, uint64_t unvisited,
+                         int cost)
+{
+	uint64_t nextUnvisited;
+	int k, n, nextCost;
+	
+	if (unvisited == 0)
+	{
+		if (search->returnToStart)
+			cost = Add_Step(cost, search->distance[current *
+			                                           search->numTargets]);
+		if (cost < search->bestCost)
+			search->bestCost = cost;
+		return;
 	}
 	
-	return minDist;
+	//Try the unvisited targets nearest first, skipping any that can't lead
+	//to a better route than the best one so far
+	for (k = 0; k < search->numTargets; k++)
+	{
+		n = search->nearest[current * search->numTargets + k];
+		if (!(unvisited & (UINT64_C(1) << n)))
+			continue;
+		
+		nextUnvisited = unvisited & ~(UINT64_C(1) << n);
+		nextCost = Add_Step(cost, search->distance[current *
+		                                               search->numTargets + n]);
+		if (nextCost >= search->bestCost)
+			continue;
+		if (Already_Seen(search, n, nextUnvisited, nextCost))
+			continue;
+		if (Add_Step(nextCost, Route_Lower_Bound(search, n, nextUnvisited,
+		                                             NULL)) >= search->bestCost)
+			continue;
+		
+		Route_Branch(search, n, nextUnvisited, nextCost);
+	}
+}
+
+
+int Find_Route_Branch_And_Bound(int **distances, int numTargets,
+                                bool returnToStart)
+{
+	sBranchSearch search;
+	int *route, *row;
+	int i, j, k, temp;
+	uint64_t unvisited;
+	
+	if (numTargets <= 1)
+		return 0;
+	if (numTargets > MAX_BRANCH_TARGETS)
+	{
+		fprintf(stderr, "Error: Too many targets (%d, max %d)!\n", numTargets,
+		                                                   MAX_BRANCH_TARGETS);
+		exit(EXIT_FAILURE);
+	}
+	
+	//Copy the distances into a flat array, replacing unreachable pairs with a
+	//large number so they never look like a shortcut
+	search.numTargets = numTargets;
+	search.returnToStart = returnToStart;
+	search.distance = Safe_Malloc(numTargets * numTargets * sizeof(int));
+	search.nearest = Safe_Malloc(numTargets * numTargets * sizeof(int));
+	search.penalty = Safe_Malloc(numTargets * sizeof(double));
+	for (i = 0; i < numTargets; i++)
+	{
+		for (j = 0; j < numTargets; j++)
+		{
+			search.distance[i * numTargets + j] = (distances[i][j] < 0) ?
+			                                         FAR_AWAY : distances[i][j];
+		}
+	}
+	
+	//No route if any target is cut off from 0
+	for (j = 1; j < numTargets; j++)
+	{
+		if (search.distance[j] >= FAR_AWAY)
+		{
+			free(search.distance);
+			free(search.nearest);
+			free(search.penalty);
+			return INT_MAX;
+		}
+	}
+	
+	//Sort each target's neighbors by distance. The lists are short, so an
+	//insertion sort is fine.
+	for (i = 0; i < numTargets; i++)
+	{
+		row = &search.nearest[i * numTargets];
+		for (j = 0; j < numTargets; j++)
+		{
+			temp = j;
+			for (k = j; k > 0; k--)
+			{
+				if (search.distance[i * numTargets + row[k-1]] <=
+				                       search.distance[i * numTargets + temp])
+					break;
+				row[k] = row[k-1];
+			}
+			row[k] = temp;
+		}
+	}
+	
+	//Empty the table of states we've seen
+	search.seen = Safe_Malloc(((size_t)1 << SEEN_TABLE_BITS) *
+	                                                       sizeof(sSeenState));
+	for (i = 0; i < (1 << SEEN_TABLE_BITS); i++)
+	{
+		search.seen[i].current = -1;
+	}
+	
+	//Get the starting route and use it as the best so far
+	route = Safe_Malloc(numTargets * sizeof(int));
+	Starting_Route(&search, route);
+	search.bestCost = Route_Length(&search, route);
+	free(route);
+	
+	//Now search for something better. The unvisited mask leaves out target 0.
+	unvisited = (numTargets == 64) ? ~UINT64_C(0) :
+	                                         (UINT64_C(1) << numTargets) - 1;
+	unvisited &= ~UINT64_C(1);
+	Choose_Penalties(&search, unvisited);
+	if (Route_Lower_Bound(&search, 0, unvisited, NULL) < search.bestCost)
+		Route_Branch(&search, 0, unvisited, 0);
+	
+	free(search.distance);
+	free(search.nearest);
+	free(search.penalty);
+	free(search.seen);
+	
+	return (search.bestCost < FAR_AWAY) ? search.bestCost : INT_MAX;
 }
 
 
 //Everything below here is the same as part A
 
 
+//Convert a target label to a target number. Labels '0' through '9' are the
+//usual targets. Our generated mazes need more than ten, so we continue with
+//'A' through 'Z' for 10-35 and 'a' through 'z' for 36-61. Returns -1 if the
+//character isn't a target label.
+int Target_Index(int label)
+{
+	if (label >= '0' && label <= '9')
+		return label - '0';
+	if (label >= 'A' && label <= 'Z')
+		return label - 'A' + 10;
+	if (label >= 'a' && label <= 'z')
+		return label - 'a' + 36;
+	return -1;
+}
+
+
 //Helper function for parsing the input data, allocating memory, and setting up
 //the maze structure. For extra fun (and to make life easier for the calling
 //function), let's dynamically allocate the maze structure itself.
@@ -189,9 +979,9 @@ sMaze *Create_Maze(FILE *inFile)
 		if (nextChar == '\n')
 		{
 			maze->ySize++;
-		} else if (nextChar >= '0' && nextChar <= '9')
+		} else if (Target_Index(nextChar) >= 0)
 		{
-			target = nextChar - '0';
+			target = Target_Index(nextChar);
 			if (target + 1 > maze->numTargets)
 				maze->numTargets = target + 1;
 		}
@@ -207,15 +997,19 @@ sMaze *Create_Maze(FILE *inFile)
 		maze->rooms[x] = Safe_Malloc(maze->ySize * sizeof(sRoom));
 	}
 	maze->targets = Safe_Malloc(maze->numTargets * sizeof(sCoord));
+	Init_Queue(&maze->searchQueue, sizeof(sCoord));
 	
 	//Read the input file into the maze array. We'll be doing some of the
 	//initialization in the search loop, so we don't need to do it all here.
+	//The stamps start at zero, and the first search will use generation 1.
+	maze->generation = 0;
 	rewind(inFile);
 	for (y = 0; y < maze->ySize; y++)
 	{
 		for (x = 0; x < maze->xSize; x++)
 		{
 			nextChar = fgetc(inFile);
+			maze->rooms[x][y].visitStamp = 0;
 			if (nextChar == '#')
 			{
 				//It's a wall
@@ -225,9 +1019,9 @@ sMaze *Create_Maze(FILE *inFile)
 				//It's an open space. If it's a numbered target, save the
 				//coordinates.
 				maze->rooms[x][y].isOpen = true;
-				if (nextChar >= '0' && nextChar <= '9')
+				target = Target_Index(nextChar);
+				if (target >= 0)
 				{
-					target = nextChar - '0';
 					
 					//This is another nifty C99 feature -- a compound literal.
 					//Instead of just initializing structures with braced lists
@@ -256,19 +1050,25 @@ sMaze *Create_Maze(FILE *inFile)
 }
 
 
-//Helper function for resetting the room distances and visited flags before
-//running a search.
+//Helper function for resetting the visited flags before running a search. All
+//we have to do is start a new generation. The only time we need to touch the
+//rooms is when the generation counter wraps around to zero, which would make
+//rooms stamped four billion searches ago look visited.
 void Reset_Maze(sMaze *maze)
 {
 	int x, y;
 	
-	for (x = 0; x < maze->xSize; x++)
+	maze->generation++;
+	if (maze->generation == 0)
 	{
-		for (y = 0; y < maze->ySize; y++)
+		for (x = 0; x < maze->xSize; x++)
 		{
-			maze->rooms[x][y].visited = false;
-			maze->rooms[x][y].distance = UINT_MAX;
+			for (y = 0; y < maze->ySize; y++)
+			{
+				maze->rooms[x][y].visitStamp = 0;
+			}
 		}
+		maze->generation = 1;
 	}
 }
 
@@ -284,6 +1084,7 @@ void Delete_Maze(sMaze *maze)
 	}
 	free(maze->rooms);
 	free(maze->targets);
+	Delete_Queue(&maze->searchQueue);
 	free(maze);
 }
 
@@ -291,90 +1092,589 @@ void Delete_Maze(sMaze *maze)
 //Do a breadth-first search on the maze, starting at the given coordinates. Once
 //done, record the distance to each of the target locations in the distances
 //array.
+#define SEARCH_BATCH  64
+
 void Find_Distances(sMaze *maze, sCoord start, int *distances)
 {
 	//We can always access structure members directly, but sometimes copying
 	//them into local variables makes the code easier to read.
-	sQueue queue;
-	sCoord tempCoord;
+	sQueue *queue;
+	sCoord batch[SEARCH_BATCH], found[4];
 	sRoom **rooms;
-	int x, y, target;
+	uint32_t generation;
+	size_t numBatch, b;
+	int x, y, target, numFound;
 	
 	rooms = maze->rooms;
+	generation = maze->generation;
 	
-	//Create a queue for coordinates. The queue will be empty at the end of the
-	//function, so there's no need to delete it later.
-	Init_Queue(&queue, sizeof(sCoord));
+	//Use the maze's queue for coordinates. The queue will be empty at the end
+	//of the function, but it keeps its chunks for the next search, so after
+	//the first search we never have to allocate memory.
+	queue = &maze->searchQueue;
 	
 	//Initialize the starting location and add its coordinates to the queue.
 	//We're using a generic queue today, so everything has to be passed and
 	//returned by reference.
 	maze->rooms[start.x][start.y].distance = 0;
-	maze->rooms[start.x][start.y].visited = true;
-	Enqueue(&queue, &start);
+	maze->rooms[start.x][start.y].visitStamp = generation;
+	Enqueue(queue, &start);
 	
 	//Search until the maze is fully explored. This is not the most efficient
 	//approach in general, but our particular maze has numbers close to each of
 	//the corners, so it's probably not worth the extra comparisons to do an
-	//early termination.
-	while (queue.numElements > 0)
+	//early termination. Rather than taking one room at a time out of the queue,
+	//we take out a whole batch at once. Rooms still come out in the same order,
+	//so this is still a breadth-first search.
+	while ((numBatch = Dequeue_Many(queue, batch, SEARCH_BATCH)) > 0)
+	{
+		for (b = 0; b < numBatch; b++)
+		{
+			//Get the next room
+			x = batch[b].x;
+			y = batch[b].y;
+			numFound = 0;
+			
+			//Discover adjacent nodes, update their distance, and add them to
+			//the queue. Note that since this maze is bounded by walls, we
+			//don't have to worry about walking off the edge of the array. See
+			//the code from Day 13 if you're confused about what's going on
+			//here.
+			if (rooms[x-1][y].isOpen && rooms[x-1][y].visitStamp != generation)
+			{
+				rooms[x-1][y].distance = rooms[x][y].distance + 1;
+				rooms[x-1][y].visitStamp = generation;
+				found[numFound++] = (sCoord){x-1, y};
+			}
+			if (rooms[x+1][y].isOpen && rooms[x+1][y].visitStamp != generation)
+			{
+				rooms[x+1][y].distance = rooms[x][y].distance + 1;
+				rooms[x+1][y].visitStamp = generation;
+				found[numFound++] = (sCoord){x+1, y};
+			}
+			if (rooms[x][y-1].isOpen && rooms[x][y-1].visitStamp != generation)
+			{
+				rooms[x][y-1].distance = rooms[x][y].distance + 1;
+				rooms[x][y-1].visitStamp = generation;
+				found[numFound++] = (sCoord){x, y-1};
+			}
+			if (rooms[x][y+1].isOpen && rooms[x][y+1].visitStamp != generation)
+			{
+				rooms[x][y+1].distance = rooms[x][y].distance + 1;
+				rooms[x][y+1].visitStamp = generation;
+				found[numFound++] = (sCoord){x, y+1};
+			}
+			
+			//Add all of the new rooms to the queue at once
+			Enqueue_Many(queue, found, numFound);
+		}
+	}
+	
+	//Now that the search is complete, we can get the shortest path distance to
+	//each target by going through the target coordinate list. Targets that
+	//weren't visited in this generation are unreachable.
+	for (target = 0; target < maze->numTargets; target++)
+	{
+		x = maze->targets[target].x;
+		y = maze->targets[target].y;
+		if (rooms[x][y].visitStamp == generation)
+			distances[target] = rooms[x][y].distance;
+		else
+			distances[target] = -1;
+	}
+}
+
+
+//Find the distances between every pair of targets with a single search. Running
+//one breadth-first search per target explores the whole maze numTargets times,
+//which adds up when there are dozens of targets. Instead, we can run all of the
+//searches at once. Every room gets a 64-bit mask, where bit k means "the search
+//from target k has reached this room". All of the targets start out in the
+//first wave. On each wave, every room that gained some bits on the previous
+//wave passes those bits along to its open neighbors. A neighbor only keeps the
+//bits it hasn't seen before, and if it gained any, it goes into the next wave.
+//The first time bit k shows up in target j's room, the wave number is the
+//distance from k to j.
+//
+//This works because all of the searches advance in lockstep -- wave d contains
+//exactly the rooms that are d steps from some target, and one OR operation
+//handles up to 64 searches. The room array is awkward for this, so we use a
+//flat array of cells indexed by x * ySize + y. The maze is bounded by walls, so
+//we never need to check whether a neighbor is off the edge. Unreachable pairs
+//get a distance of -1.
+#define MAX_WAVE_TARGETS  64
+
+void Find_All_Distances(sMaze *maze, int **distances)
+{
+	uint64_t *reached, *delta, *nextDelta, *tempMask, bits, newBits;
+	int *frontier, *nextFrontier, *tempList, *targetAt;
+	bool *isOpen;
+	int numCells, numFrontier, numNext, pairsLeft;
+	int x, y, t, k, i, n, cell, neighbor, wave;
+	int offsets[4];
+	
+	if (maze->numTargets > MAX_WAVE_TARGETS)
+	{
+		fprintf(stderr, "Error: Too many targets (%d, max %d)!\n",
+		                                 maze->numTargets, MAX_WAVE_TARGETS);
+		exit(EXIT_FAILURE);
+	}
+	
+	//Allocate the per-cell arrays. Each cell is added to a frontier list at
+	//most once per wave, so the lists never need more than numCells entries.
+	numCells = maze->xSize * maze->ySize;
+	reached = Safe_Malloc(numCells * sizeof(uint64_t));
+	delta = Safe_Malloc(numCells * sizeof(uint64_t));
+	nextDelta = Safe_Malloc(numCells * sizeof(uint64_t));
+	frontier = Safe_Malloc(numCells * sizeof(int));
+	nextFrontier = Safe_Malloc(numCells * sizeof(int));
+	targetAt = Safe_Malloc(numCells * sizeof(int));
+	isOpen = Safe_Malloc(numCells * sizeof(bool));
+	
+	for (x = 0; x < maze->xSize; x++)
+	{
+		for (y = 0; y < maze->ySize; y++)
+		{
+			cell = x * maze->ySize + y;
+			isOpen[cell] = maze->rooms[x][y].isOpen;
+			reached[cell] = 0;
+			delta[cell] = 0;
+			nextDelta[cell] = 0;
+			targetAt[cell] = -1;
+		}
+	}
+	offsets[0] = -maze->ySize;
+	offsets[1] = maze->ySize;
+	offsets[2] = -1;
+	offsets[3] = 1;
+	
+	//Every target starts out reached by its own search at distance 0
+	for (t = 0; t < maze->numTargets; t++)
+	{
+		for (k = 0; k < maze->numTargets; k++)
+		{
+			distances[t][k] = -1;
+		}
+		distances[t][t] = 0;
+	}
+	numFrontier = 0;
+	for (t = 0; t < maze->numTargets; t++)
 	{
-		//Get the next room
-		Dequeue(&queue, &tempCoord);
-		x = tempCoord.x;
-		y = tempCoord.y;
+		cell = maze->targets[t].x * maze->ySize + maze->targets[t].y;
+		targetAt[cell] = t;
+		reached[cell] = UINT64_C(1) << t;
+		delta[cell] = UINT64_C(1) << t;
+		frontier[numFrontier++] = cell;
+	}
+	pairsLeft = maze->numTargets * (maze->numTargets - 1);
+	
+	//Run the waves until nothing changes or we've found every pair
+	wave = 0;
+	while (numFrontier > 0 && pairsLeft > 0)
+	{
+		wave++;
+		numNext = 0;
+		
+		//Pass the new bits from each frontier cell to its neighbors. Marking
+		//them as reached right away keeps the same bits from being added twice
+		//in one wave.
+		for (i = 0; i < numFrontier; i++)
+		{
+			cell = frontier[i];
+			bits = delta[cell];
+			delta[cell] = 0;
+			for (n = 0; n < 4; n++)
+			{
+				neighbor = cell + offsets[n];
+				if (!isOpen[neighbor])
+					continue;
+				
+				newBits = bits & ~reached[neighbor];
+				if (newBits == 0)
+					continue;
+				if (nextDelta[neighbor] == 0)
+					nextFrontier[numNext++] = neighbor;
+				nextDelta[neighbor] |= newBits;
+				reached[neighbor] |= newBits;
+			}
+		}
 		
-		//Discover adjacent nodes, update their distance, and add them to the
-		//queue. Note that since this maze is bounded by walls, we don't have to
-		//worry about walking off the edge of the array. See the code from Day
-		//13 if you're confused about what's going on here.
-		if (rooms[x-1][y].isOpen && !rooms[x-1][y].visited)
-		{
-			rooms[x-1][y].distance = rooms[x][y].distance + 1;
-			rooms[x-1][y].visited = true;
+		//Record the distances for any targets we just reached. The bits are
+		//extracted one at a time by finding the lowest set bit.
+		for (i = 0; i < numNext; i++)
+		{
+			t = targetAt[nextFrontier[i]];
+			if (t < 0)
+				continue;
 			
-			//Note that we could just enqueue the nameless struct created by the
-			//compound literal, but nameless variables make me nervous. As an
-			//embedded programmer, I'm already nervous about consuming stack
-			//space through syntax rather than declarations. Yes, I know I'm
-			//fretting about eight bytes of stack space while stuffing dozens of
-			//nodes in the queue. :-)
-			tempCoord = (sCoord){x-1, y};
-			Enqueue(&queue, &tempCoord);
+			bits = nextDelta[nextFrontier[i]];
+			while (bits != 0)
+			{
+				k = __builtin_ctzll(bits);
+				distances[k][t] = wave;
+				pairsLeft--;
+				bits &= bits - 1;
+			}
 		}
-		if (rooms[x+1][y].isOpen && !rooms[x+1][y].visited)
+		
+		//The next wave becomes the current one. Every cell in the old frontier
+		//had its delta cleared, so the old delta array is all zeroes and can be
+		//reused for the wave after that.
+		tempMask = delta;
+		delta = nextDelta;
+		nextDelta = tempMask;
+		tempList = frontier;
+		frontier = nextFrontier;
+		nextFrontier = tempList;
+		numFrontier = numNext;
+	}
+	
+	free(reached);
+	free(delta);
+	free(nextDelta);
+	free(frontier);
+	free(nextFrontier);
+	free(targetAt);
+	free(isOpen);
+}
+
+
+//Contract the maze into a weighted graph. Most of the open rooms in the ducts
+//are corridors -- rooms with exactly two open neighbors. A search can't do
+//anything interesting in a corridor except keep walking, so we can replace each
+//corridor with a single weighted edge between the rooms at either end. The
+//rooms we keep as graph nodes are junctions (three or four open neighbors),
+//dead ends (zero or one), and the targets, no matter how many neighbors they
+//have. To find the edges, we start at each node and walk down each of its
+//corridors until we reach another node, counting the steps as we go.
+//
+//Each node's edges are stored together in one big array (a format called
+//compressed sparse row), with firstEdge[n] giving the index of node n's first
+//edge. Every corridor gets walked from both ends, so each edge shows up once in
+//each direction. The graph doesn't depend on which target we start from, so we
+//only have to build it once.
+sGraph *Contract_Maze(sMaze *maze)
+{
+	sGraph *graph;
+	bool *isOpen;
+	int *nodeOf, *degree;
+	int numCells, x, y, t, n, d, cell, prev, cur, next, length, edge;
+	int offsets[4];
+	
+	graph = Safe_Malloc(sizeof(sGraph));
+	
+	//Make a flat copy of the open flags, indexed the same way as in
+	//Find_All_Distances(), so we can step between rooms with simple offsets
+	numCells = maze->xSize * maze->ySize;
+	isOpen = Safe_Malloc(numCells * sizeof(bool));
+	nodeOf = Safe_Malloc(numCells * sizeof(int));
+	degree = Safe_Malloc(numCells * sizeof(int));
+	for (x = 0; x < maze->xSize; x++)
+	{
+		for (y = 0; y < maze->ySize; y++)
 		{
-			rooms[x+1][y].distance = rooms[x][y].distance + 1;
-			rooms[x+1][y].visited = true;
-			tempCoord = (sCoord){x+1, y};
-			Enqueue(&queue, &tempCoord);
+			isOpen[x * maze->ySize + y] = maze->rooms[x][y].isOpen;
 		}
-		if (rooms[x][y-1].isOpen && !rooms[x][y-1].visited)
+	}
+	offsets[0] = -maze->ySize;
+	offsets[1] = maze->ySize;
+	offsets[2] = -1;
+	offsets[3] = 1;
+	
+	//Count the open neighbors of each room. The outer edge of the maze is all
+	//walls, so we can skip it.
+	for (cell = 0; cell < numCells; cell++)
+	{
+		degree[cell] = 0;
+		nodeOf[cell] = -1;
+	}
+	for (x = 1; x < maze->xSize - 1; x++)
+	{
+		for (y = 1; y < maze->ySize - 1; y++)
 		{
-			rooms[x][y-1].distance = rooms[x][y].distance + 1;
-			rooms[x][y-1].visited = true;
-			tempCoord = (sCoord){x, y-1};
-			Enqueue(&queue, &tempCoord);
+			cell = x * maze->ySize + y;
+			if (!isOpen[cell])
+				continue;
+			for (d = 0; d < 4; d++)
+			{
+				if (isOpen[cell + offsets[d]])
+					degree[cell]++;
+			}
 		}
-		if (rooms[x][y+1].isOpen && !rooms[x][y+1].visited)
+	}
+	
+	//Pick out the nodes. The targets go first so that target t is node t.
+	graph->numTargets = maze->numTargets;
+	graph->numNodes = 0;
+	for (t = 0; t < maze->numTargets; t++)
+	{
+		cell = maze->targets[t].x * maze->ySize + maze->targets[t].y;
+		nodeOf[cell] = graph->numNodes++;
+	}
+	for (cell = 0; cell < numCells; cell++)
+	{
+		if (isOpen[cell] && degree[cell] != 2 && nodeOf[cell] < 0)
+			nodeOf[cell] = graph->numNodes++;
+	}
+	
+	//Each node has one edge per open neighbor, so we can lay out the edge
+	//array before walking any corridors
+	graph->firstEdge = Safe_Malloc((graph->numNodes + 1) * sizeof(int));
+	graph->firstEdge[0] = 0;
+	for (cell = 0; cell < numCells; cell++)
+	{
+		if (nodeOf[cell] >= 0)
+			graph->firstEdge[nodeOf[cell] + 1] = degree[cell];
+	}
+	for (n = 0; n < graph->numNodes; n++)
+	{
+		graph->firstEdge[n + 1] += graph->firstEdge[n];
+	}
+	graph->numEdges = graph->firstEdge[graph->numNodes];
+	graph->edgeTo = Safe_Malloc(graph->numEdges * sizeof(int));
+	graph->edgeLength = Safe_Malloc(graph->numEdges * sizeof(uint32_t));
+	
+	//Walk the corridors. Every room we pass through has exactly two open
+	//neighbors, so the next room is whichever one we didn't just come from.
+	for (cell = 0; cell < numCells; cell++)
+	{
+		if (nodeOf[cell] < 0)
+			continue;
+		
+		edge = graph->firstEdge[nodeOf[cell]];
+		for (d = 0; d < 4; d++)
 		{
-			rooms[x][y+1].distance = rooms[x][y].distance + 1;
-			rooms[x][y+1].visited = true;
-			tempCoord = (sCoord){x, y+1};
-			Enqueue(&queue, &tempCoord);
+			if (!isOpen[cell + offsets[d]])
+				continue;
+			
+			prev = cell;
+			cur = cell + offsets[d];
+			length = 1;
+			while (nodeOf[cur] < 0)
+			{
+				for (n = 0; n < 4; n++)
+				{
+					next = cur + offsets[n];
+					if (isOpen[next] && next != prev)
+						break;
+				}
+				prev = cur;
+				cur = next;
+				length++;
+			}
+			
+			graph->edgeTo[edge] = nodeOf[cur];
+			graph->edgeLength[edge] = length;
+			edge++;
 		}
 	}
 	
-	//Now that the search is complete, we can get the shortest path distance to
-	//each target by going through the target coordinate list.
-	for (target = 0; target < maze->numTargets; target++)
+	//Allocate the working storage for the searches
+	graph->distance = Safe_Malloc(graph->numNodes * sizeof(uint32_t));
+	Init_Radix_Heap(&graph->heap);
+	
+	free(isOpen);
+	free(nodeOf);
+	free(degree);
+	
+	return graph;
+}
+
+
+//Free the memory used by a graph
+void Delete_Graph(sGraph *graph)
+{
+	free(graph->firstEdge);
+	free(graph->edgeTo);
+	free(graph->edgeLength);
+	free(graph->distance);
+	Delete_Radix_Heap(&graph->heap);
+	free(graph);
+}
+
+
+//Find the distances from one target to all of the others using Dijkstra's
+//algorithm. Now that the edges have different lengths, a plain queue isn't
+//good enough -- we need to always expand the closest unfinished node next,
+//which means we need a priority queue. Rather than leaving stale entries in the
+//heap when we find a shorter path to a node, we just add the node again and
+//skip the old entry when it comes out. As with Find_All_Distances(),
+//unreachable targets get a distance of -1.
+void Find_Graph_Distances(sGraph *graph, int source, int *distances)
+{
+	sHeapItem item;
+	uint32_t newDistance;
+	int n, e, targetsLeft;
+	
+	for (n = 0; n < graph->numNodes; n++)
 	{
-		x = maze->targets[target].x;
-		y = maze->targets[target].y;
-		distances[target] = rooms[x][y].distance;
+		graph->distance[n] = UINT32_MAX;
+	}
+	graph->distance[source] = 0;
+	Clear_Radix_Heap(&graph->heap);
+	Radix_Heap_Push(&graph->heap, 0, source);
+	
+	//Nodes come out of the heap in order of distance, so we can stop once
+	//we've finished every target
+	targetsLeft = graph->numTargets;
+	while (graph->heap.size > 0 && targetsLeft > 0)
+	{
+		item = Radix_Heap_Pop(&graph->heap);
+		if (item.key != graph->distance[item.node])
+			continue;
+		if (item.node < graph->numTargets)
+			targetsLeft--;
+		
+		for (e = graph->firstEdge[item.node];
+		                               e < graph->firstEdge[item.node + 1]; e++)
+		{
+			n = graph->edgeTo[e];
+			newDistance = item.key + graph->edgeLength[e];
+			if (newDistance < graph->distance[n])
+			{
+				graph->distance[n] = newDistance;
+				Radix_Heap_Push(&graph->heap, newDistance, n);
+			}
+		}
+	}
+	
+	//The targets are the first nodes in the graph
+	for (n = 0; n < graph->numTargets; n++)
+	{
+		if (graph->distance[n] == UINT32_MAX)
+			distances[n] = -1;
+		else
+			distances[n] = graph->distance[n];
+	}
+}
+
+
+//A radix heap is a priority queue that takes advantage of the fact that
+//Dijkstra's algorithm never adds a key smaller than the last one it removed.
+//Items are sorted into buckets based on the highest bit where their key differs
+//from the last key removed: bucket 0 holds keys equal to it, and bucket b holds
+//keys that first differ at bit b-1. When bucket 0 runs out, we find the first
+//non-empty bucket, make its smallest key the new "last" key, and spread its
+//items out into the lower buckets. Each item can only move down a bucket at a
+//time, so the total work is small, and there are no comparisons between items
+//like there are in a binary heap. The bucket arrays are kept between searches,
+//so once they've grown to a comfortable size we stop allocating memory.
+void Init_Radix_Heap(sRadixHeap *heap)
+{
+	int b;
+	
+	for (b = 0; b < RADIX_BUCKETS; b++)
+	{
+		heap->items[b] = NULL;
+		heap->count[b] = 0;
+		heap->capacity[b] = 0;
+	}
+	heap->last = 0;
+	heap->size = 0;
+}
+
+//Empty the heap without freeing its memory
+void Clear_Radix_Heap(sRadixHeap *heap)
+{
+	int b;
+	
+	for (b = 0; b < RADIX_BUCKETS; b++)
+	{
+		heap->count[b] = 0;
+	}
+	heap->last = 0;
+	heap->size = 0;
+}
+
+//Pick the bucket for a key based on its highest bit that differs from the last
+//key removed
+static int Radix_Bucket(const sRadixHeap *heap, uint32_t key)
+{
+	if (key == heap->last)
+		return 0;
+	return 32 - __builtin_clz(key ^ heap->last);
+}
+
+//Add an item to one bucket, growing the bucket if necessary
+static void Radix_Bucket_Add(sRadixHeap *heap, int b, sHeapItem item)
+{
+	if (heap->count[b] == heap->capacity[b])
+	{
+		heap->capacity[b] = (heap->capacity[b] == 0) ? 64 :
+		                                                 2 * heap->capacity[b];
+		heap->items[b] = realloc(heap->items[b],
+		                              heap->capacity[b] * sizeof(sHeapItem));
+		if (heap->items[b] == NULL)
+		{
+			fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+			exit(EXIT_FAILURE);
+		}
 	}
+	heap->items[b][heap->count[b]++] = item;
 }
 
+//Add a key to the heap. The key can't be smaller than the last one removed.
+void Radix_Heap_Push(sRadixHeap *heap, uint32_t key, int node)
+{
+	Radix_Bucket_Add(heap, Radix_Bucket(heap, key), (sHeapItem){key, node});
+	heap->size++;
+}
+
+//Remove and return the item with the smallest key
+sHeapItem Radix_Heap_Pop(sRadixHeap *heap)
+{
+	sHeapItem *items;
+	int b, i, count;
+	uint32_t minKey;
+	
+	if (heap->size == 0)
+	{
+		fprintf(stderr, "Error: Heap underrun!\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	//If there's nothing with the last key, redistribute the first non-empty
+	//bucket. Every item in it ends up in a lower bucket, and at least one ends
+	//up in bucket 0.
+	if (heap->count[0] == 0)
+	{
+		for (b = 1; heap->count[b] == 0; b++)
+			;
+		
+		items = heap->items[b];
+		count = heap->count[b];
+		minKey = items[0].key;
+		for (i = 1; i < count; i++)
+		{
+			if (items[i].key < minKey)
+				minKey = items[i].key;
+		}
+		
+		heap->last = minKey;
+		heap->count[b] = 0;
+		for (i = 0; i < count; i++)
+		{
+			Radix_Bucket_Add(heap, Radix_Bucket(heap, items[i].key), items[i]);
+		}
+	}
+	
+	heap->size--;
+	return heap->items[0][--heap->count[0]];
+}
+
+//Free the memory used by the heap
+void Delete_Radix_Heap(sRadixHeap *heap)
+{
+	int b;
+	
+	for (b = 0; b < RADIX_BUCKETS; b++)
+	{
+		free(heap->items[b]);
+	}
+	Init_Radix_Heap(heap);
+}
+
+
 
 //Helper function for error-checking malloc()
 void *Safe_Malloc(size_t size)
@@ -395,50 +1695,100 @@ void *Safe_Malloc(size_t size)
 //Initialize the queue. We'll specify the size of the stored objects here for
 //simplicity. We could theoretically put the element size in the enqueue
 //function, which would let us mix object types in the queue, but that would be
-//weird and not very useful.
+//weird and not very useful. No memory is allocated until the first element is
+//added.
 void Init_Queue(sQueue *queue, size_t elementSize)
 {
 	queue->numElements = 0;
 	queue->elementSize = elementSize;
+	queue->chunkElements = QUEUE_CHUNK_BYTES / elementSize;
+	if (queue->chunkElements == 0)
+		queue->chunkElements = 1;
+	queue->head = 0;
+	queue->tail = 0;
 	queue->first = NULL;
 	queue->last = NULL;
+	queue->spare = NULL;
 }
 
-//Add an object to the queue. Because we don't know the data type, the object
-//must be passed by reference as a void pointer.
-void Enqueue(sQueue *queue, const void *object)
+//Add a new chunk to the tail of the queue, recycling a spare one if we can
+static void Add_Queue_Chunk(sQueue *queue)
 {
-	sQueueNode *new;
+	sQueueChunk *new;
 	
-	//Allocate memory for a new node with enough storage for the object
-	new = malloc(sizeof(sQueueNode) + queue->elementSize);
-	if (new == NULL)
+	if (queue->spare != NULL)
 	{
-		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
-		exit(EXIT_FAILURE);
+		new = queue->spare;
+		queue->spare = new->next;
+	} else
+	{
+		new = malloc(sizeof(sQueueChunk) +
+		                             queue->chunkElements * queue->elementSize);
+		if (new == NULL)
+		{
+			fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+			exit(EXIT_FAILURE);
+		}
 	}
 	
-	//Initialize the list pointer and copy the data into the new node. memcpy()
-	//copies one byte at a time, so we don't have to worry about unaligned data.
 	new->next = NULL;
-	memcpy(new->nodeData, object, queue->elementSize);
-
-	//Add the node to the tail of the list. If the list is empty, we need to
-	//update the queue pointers to cover the new list.
-	if (queue->numElements > 0)
+	if (queue->last != NULL)
 		queue->last->next = new;
 	else
 		queue->first = new;
 	queue->last = new;
-	queue->numElements++;
+	queue->tail = 0;
 }
 
-//Remove and return the next node from the queue. Again, not knowing the data
+//Move the used-up first chunk to the spare list
+static void Recycle_Queue_Chunk(sQueue *queue)
+{
+	sQueueChunk *oldest;
+	
+	oldest = queue->first;
+	queue->first = oldest->next;
+	if (queue->first == NULL)
+		queue->last = NULL;
+	oldest->next = queue->spare;
+	queue->spare = oldest;
+	queue->head = 0;
+}
+
+//Add an object to the queue. Because we don't know the data type, the object
+//must be passed by reference as a void pointer.
+void Enqueue(sQueue *queue, const void *object)
+{
+	Enqueue_Many(queue, object, 1);
+}
+
+//Add several objects to the queue at once. The objects are stored one after
+//another in an array, just like they are in the chunks, so we can copy as many
+//of them as will fit in the last chunk with a single memcpy().
+void Enqueue_Many(sQueue *queue, const void *objects, size_t count)
+{
+	const char *source = objects;
+	size_t space, n;
+	
+	while (count > 0)
+	{
+		if (queue->last == NULL || queue->tail == queue->chunkElements)
+			Add_Queue_Chunk(queue);
+		
+		space = queue->chunkElements - queue->tail;
+		n = (count < space) ? count : space;
+		memcpy(queue->last->chunkData + queue->tail * queue->elementSize,
+		                                     source, n * queue->elementSize);
+		queue->tail += n;
+		queue->numElements += n;
+		source += n * queue->elementSize;
+		count -= n;
+	}
+}
+
+//Remove and return the next object from the queue. Again, not knowing the data
 //type means we have to return the data via a pointer.
 void Dequeue(sQueue *queue, void *object)
 {
-	sQueueNode *oldest;
-	
 	//We can't return anything to indicate an empty queue without knowing the
 	//data type, so instead we'll have to crash the program. If we really
 	//needed to recover gracefully from an underrun, we could set errno to an
@@ -449,28 +1799,71 @@ void Dequeue(sQueue *queue, void *object)
 		exit(EXIT_FAILURE);
 	}
 	
-	//Copy the oldest node's data using the provided pointer
-	oldest = queue->first;
-	memcpy(object, oldest->nodeData, queue->elementSize);
+	Dequeue_Many(queue, object, 1);
+}
+
+//Remove up to maxCount objects from the queue and copy them into an array.
+//Returns the number of objects removed, which is zero if the queue is empty.
+size_t Dequeue_Many(sQueue *queue, void *objects, size_t maxCount)
+{
+	char *dest = objects;
+	size_t available, n, total;
+	
+	total = 0;
+	while (total < maxCount && queue->numElements > 0)
+	{
+		//The first chunk holds everything from the head up to either the end
+		//of the chunk or the tail, if it's also the last chunk
+		if (queue->first == queue->last)
+			available = queue->tail - queue->head;
+		else
+			available = queue->chunkElements - queue->head;
+		n = maxCount - total;
+		if (n > available)
+			n = available;
+		
+		memcpy(dest, queue->first->chunkData + queue->head * queue->elementSize,
+		                                             n * queue->elementSize);
+		queue->head += n;
+		queue->numElements -= n;
+		dest += n * queue->elementSize;
+		total += n;
+		
+		//If the queue is now empty, we can start over at the beginning of the
+		//same chunk. Otherwise, once we've used up the first chunk, it goes on
+		//the spare list.
+		if (queue->numElements == 0)
+		{
+			queue->head = 0;
+			queue->tail = 0;
+		} else if (queue->head == queue->chunkElements)
+		{
+			Recycle_Queue_Chunk(queue);
+		}
+	}
 	
-	//Delete the oldest node from the linked list. We can only update the queue
-	//pointers if there are still other nodes left in the list.
-	if (queue->numElements > 1)
-		queue->first = oldest->next;
-	free(oldest);
-	queue->numElements--;
+	return total;
 }
 
-//Free all the memory used by the queue. Does nothing if the queue is empty.
+//Free all the memory used by the queue, including the spare chunks
 void Delete_Queue(sQueue *queue)
 {
-	sQueueNode *next;
+	sQueueChunk *next;
 	
-	while (queue->numElements > 0)
+	while (queue->first != NULL)
 	{
 		next = queue->first->next;
 		free(queue->first);
 		queue->first = next;
-		queue->numElements--;
 	}
+	while (queue->spare != NULL)
+	{
+		next = queue->spare->next;
+		free(queue->spare);
+		queue->spare = next;
+	}
+	queue->last = NULL;
+	queue->numElements = 0;
+	queue->head = 0;
+	queue->tail = 0;
 }
@@ -27,6 +27,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
 
 //There are many ways we could simulate the keypad. We could use Cartesian
 //coordinates, or (similarly) a 2D array, or even a bunch of switch-case
@@ -88,6 +95,9 @@ typedef struct sButton
 	//keyword and the odd typedef syntax is needed to keep the compiler from
 	//being confused by the presence of "sButton" in the structure definition.
 	struct sButton *up, *down, *left, *right;
+	
+	//Where the button ends up in the compiled table (see below)
+	int state;
 } sButton;
 
 //The puzzle says that we "picture" a nine-button keypad. I have a feeling that
@@ -97,7 +107,77 @@ typedef struct sButton
 #define NUM_ROWS    3
 #define NUM_COLS    3
 
+//Following pointers one character at a time is simple, but it's slow: every
+//step waits for a load whose address depends on the step before it. So once
+//the keypad is built, we "compile" it into a table. Each button gets a state
+//number, and for each move there's a row of the table that says which state
+//every state goes to. The same code works for any keypad shape, because all
+//it sees is the table.
+//
+//Now here's the trick. Instead of following one button through a line, we can
+//follow all of them at once. A line turns into a function from "the button we
+//started on" to "the button we ended on", stored as a list of states. Every
+//move replaces each entry of the list with its table entry. With 16 or fewer
+//buttons, the whole list fits in one 128-bit SSE register, and the SSSE3
+//_mm_shuffle_epi8() instruction (also known as pshufb) does exactly this
+//lookup for all 16 entries in a single instruction. Compilers won't use it
+//unless we ask, so build with -mssse3 (or -march=native) to get it. Otherwise
+//we fall back to a plain loop that does the same thing.
+//
+//Functions can also be stuck together: doing one chunk of a line and then the
+//next is the same lookup, applied to the two functions. That means we can cut
+//a very long line into chunks, work out each chunk's function on a different
+//thread, and then join the results in order. The answer comes out the same no
+//matter how the line was split.
+#define MAX_BUTTONS        16
+#define MIN_THREADED_LINE  (1 << 20)
+
+//The moves are numbered from one so that zero can mean "not a move"
+enum {NO_MOVE, MOVE_UP, MOVE_DOWN, MOVE_LEFT, MOVE_RIGHT, NUM_MOVES};
+
+typedef struct
+{
+	int numButtons;
+	int number[MAX_BUTTONS];
+	
+	//next[move][state] is the state we're in after making the move from
+	//state. The unused states (and the NO_MOVE row) just go to themselves.
+	uint8_t next[NUM_MOVES][MAX_BUTTONS];
+} sKeypad;
+
+//Each thread works out the function for its own chunk of the line
+typedef struct
+{
+	const sKeypad *keypad;
+	const char *line;
+	size_t length;
+	int numThreads, thread;
+	uint8_t function[MAX_BUTTONS];
+	bool ok;
+	char badChar;
+} sLineWorker;
+
+
+bool Compile_Keypad(sButton **list, int numButtons, sKeypad *keypad);
+void Identity_Function(uint8_t function[MAX_BUTTONS]);
+void Compose_Functions(const uint8_t first[MAX_BUTTONS],
+                       const uint8_t second[MAX_BUTTONS],
+                       uint8_t result[MAX_BUTTONS]);
+bool Line_Function(const sKeypad *keypad, const char *line, size_t length,
+                   uint8_t function[MAX_BUTTONS], char *badChar);
+bool Line_Function_Threaded(const sKeypad *keypad, const char *line,
+                            size_t length, uint8_t function[MAX_BUTTONS],
+                            char *badChar);
+void *Safe_Malloc(size_t size);
 
+
+//The helper functions are:
+//
+//    Compile_Keypad()     Turn the linked list into a transition table
+//    Identity_Function()  The function for an empty line
+//    Compose_Functions()  Do one function, then another
+//    Line_Function()      Work out the function for a line (or part of one)
+//    Line_Function_Threaded()  The same, with a long line split between threads
 int main(int argc, char **argv)
 {
 	//Note that using typedefs to name structure types is somewhat
@@ -105,10 +185,16 @@ int main(int argc, char **argv)
 	//http://stackoverflow.com/questions/252780/why-should-we-typedef-a-struct-so-often-in-c
 	//https://www.kernel.org/doc/Documentation/CodingStyle
 	sButton buttons[NUM_ROWS][NUM_COLS];
-	sButton *b = &buttons[1][1];
+	sButton *list[NUM_ROWS*NUM_COLS];
+	sKeypad keypad;
+	uint8_t function[MAX_BUTTONS];
 	FILE *inFile;
-	int r, c, next;
+	char *line = NULL;
+	size_t capacity = 0;
+	ssize_t length;
+	int r, c, state;
 	int code = 0;
+	char badChar;
 	
 	//Generate the list of buttons. C makes multidimensional arrays (mostly)
 	//easy to construct and work with. Strangely, some higher-level languages
@@ -146,8 +232,15 @@ int main(int argc, char **argv)
 				buttons[r][c].right = &buttons[r][c];
 			else
 				buttons[r][c].right = &buttons[r][c+1];
+			
+			list[r*NUM_COLS + c] = &buttons[r][c];
 		}
 	}
+	
+	//Compile the keypad into a table. We start on 5, in the middle.
+	if (!Compile_Keypad(list, NUM_ROWS*NUM_COLS, &keypad))
+		return EXIT_FAILURE;
+	state = buttons[1][1].state;
 			
 	//The usual command line argument check and input file opening
 	if (argc != 2)
@@ -163,41 +256,269 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
-	//Read the file one character at a time, processing as we go. A newline
-	//means that we've reached the next code digit.
-	next = fgetc(inFile);
-	while (next != EOF)
+	//Read the file one line at a time. The POSIX getline() function grows the
+	//buffer as needed, so there's no limit on line length.
+	while ((length = getline(&line, &capacity, inFile)) > 0)
 	{
-		if ((char)next == '\n')
+		//A newline means that we've reached the next code digit, but it isn't
+		//a move, so we leave it out of the function
+		if (line[length - 1] == '\n')
+			length--;
+		
+		if (!Line_Function_Threaded(&keypad, line, length, function, &badChar))
 		{
-			//We have the next digit! Shift the code left one place and add it.
-			code = 10*code + b->number;
-		} else
-		{	
-			//Move to the next button. Setting up the data structre in advance
-			//means the core program logic is simple!
-			switch ((char)next)
-			{
-				case 'U': b = b->up;    break;
-				case 'D': b = b->down;  break;
-				case 'L': b = b->left;  break;
-				case 'R': b = b->right; break;
-				default:
-					fprintf(stderr, "Error: Unexpected character %c\n\n", next);
-					fclose(inFile);
-					return EXIT_FAILURE;
-			}
-		}		
-	
-		//Read the next character
-		next = fgetc(inFile);
+			fprintf(stderr, "Error: Unexpected character %c\n\n", badChar);
+			free(line);
+			fclose(inFile);
+			return EXIT_FAILURE;
+		}
+		state = function[state];
+		
+		//We have the next digit! Shift the code left one place and add it.
+		if (line[length] == '\n')
+			code = 10*code + keypad.number[state];
 	}
 	
 	//Close the file as soon as we're done with it
+	free(line);
 	fclose(inFile);
 	
 	//Print the code
 	printf("Door code: %d\n", code);
-	
+
 	return EXIT_SUCCESS;
 }
+
+
+//Give every button a state number, then fill out the table by following each
+//button's pointers. After this, we don't need the linked list anymore.
+bool Compile_Keypad(sButton **list, int numButtons, sKeypad *keypad)
+{
+	int i, s;
+	
+	if (numButtons > MAX_BUTTONS)
+	{
+		fprintf(stderr, "Error: Too many buttons (%d, max %d)\n\n",
+		                                             numButtons, MAX_BUTTONS);
+		return false;
+	}
+	
+	keypad->numButtons = numButtons;
+	for (i = 0; i < numButtons; i++)
+	{
+		list[i]->state = i;
+		keypad->number[i] = list[i]->number;
+	}
+	
+	for (s = 0; s < MAX_BUTTONS; s++)
+	{
+		for (i = 0; i < NUM_MOVES; i++)
+		{
+			keypad->next[i][s] = s;
+		}
+	}
+	for (i = 0; i < numButtons; i++)
+	{
+		keypad->next[MOVE_UP][i]    = list[i]->up->state;
+		keypad->next[MOVE_DOWN][i]  = list[i]->down->state;
+		keypad->next[MOVE_LEFT][i]  = list[i]->left->state;
+		keypad->next[MOVE_RIGHT][i] = list[i]->right->state;
+	}
+	
+	return true;
+}
+
+
+//An empty line leaves every button where it is
+void Identity_Function(uint8_t function[MAX_BUTTONS])
+{
+	int s;
+	
+	for (s = 0; s < MAX_BUTTONS; s++)
+	{
+		function[s] = s;
+	}
+}
+
+
+//Doing first and then second. This is the same lookup as a single move, with
+//second standing in for the table row.
+void Compose_Functions(const uint8_t first[MAX_BUTTONS],
+                       const uint8_t second[MAX_BUTTONS],
+                       uint8_t result[MAX_BUTTONS])
+{
+#ifdef __SSSE3__
+	__m128i table = _mm_loadu_si128((const __m128i *)second);
+	__m128i index = _mm_loadu_si128((const __m128i *)first);
+	
+	_mm_storeu_si128((__m128i *)result, _mm_shuffle_epi8(table, index));
+#else
+	uint8_t temp[MAX_BUTTONS];
+	int s;
+	
+	//Use a temporary in case result is the same array as first or second
+	for (s = 0; s < MAX_BUTTONS; s++)
+	{
+		temp[s] = second[first[s]];
+	}
+	memcpy(result, temp, MAX_BUTTONS);
+#endif
+}
+
+
+//Work out which state each state ends up in after following the moves. If
+//there's a character that isn't a move, we stop and report it.
+bool Line_Function(const sKeypad *keypad, const char *line, size_t length,
+                   uint8_t function[MAX_BUTTONS], char *badChar)
+{
+	//A quick way to turn a character into a move. Every other character maps
+	//to zero, which is NO_MOVE.
+	static const uint8_t moveOf[256] =
+		{['U'] = MOVE_UP, ['D'] = MOVE_DOWN, ['L'] = MOVE_LEFT,
+		 ['R'] = MOVE_RIGHT};
+	size_t i;
+	int move;
+#ifdef __SSSE3__
+	__m128i table[NUM_MOVES], current;
+	
+	//Keep the table and the function in registers for the whole loop
+	for (move = 0; move < NUM_MOVES; move++)
+	{
+		table[move] = _mm_loadu_si128((const __m128i *)keypad->next[move]);
+	}
+	current = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+	                        8, 9, 10, 11, 12, 13, 14, 15);
+	for (i = 0; i < length; i++)
+	{
+		move = moveOf[(unsigned char)line[i]];
+		if (move == NO_MOVE)
+		{
+			*badChar = line[i];
+			return false;
+		}
+		current = _mm_shuffle_epi8(table[move], current);
+	}
+	_mm_storeu_si128((__m128i *)function, current);
+#else
+	uint8_t current[MAX_BUTTONS];
+	const uint8_t *row;
+	int s;
+	
+	Identity_Function(current);
+	for (i = 0; i < length; i++)
+	{
+		move = moveOf[(unsigned char)line[i]];
+		if (move == NO_MOVE)
+		{
+			*badChar = line[i];
+			return false;
+		}
+		row = keypad->next[move];
+		for (s = 0; s < keypad->numButtons; s++)
+		{
+			current[s] = row[current[s]];
+		}
+	}
+	memcpy(function, current, MAX_BUTTONS);
+#endif
+	
+	return true;
+}
+
+
+//Each thread takes an equal block of the line
+static void *Line_Worker(void *arg)
+{
+	sLineWorker *worker = arg;
+	size_t first, end, blockSize;
+	
+	blockSize = (worker->length + worker->numThreads - 1) / worker->numThreads;
+	first = blockSize * worker->thread;
+	end = first + blockSize;
+	if (first > worker->length)
+		first = worker->length;
+	if (end > worker->length)
+		end = worker->length;
+	
+	worker->ok = Line_Function(worker->keypad, &worker->line[first],
+	                           end - first, worker->function, &worker->badChar);
+	
+	return NULL;
+}
+
+
+//Split a long line between threads. Each thread works out the function for its
+//block, and then we compose the functions in order. A short line isn't worth
+//the cost of starting threads, so it gets done directly.
+bool Line_Function_Threaded(const sKeypad *keypad, const char *line,
+                            size_t length, uint8_t function[MAX_BUTTONS],
+                            char *badChar)
+{
+	sLineWorker *workers;
+	pthread_t *threads;
+	int numThreads, t;
+	bool ok;
+	
+	numThreads = 1;
+	if (length >= MIN_THREADED_LINE)
+		numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (numThreads <= 1)
+		return Line_Function(keypad, line, length, function, badChar);
+	
+	workers = Safe_Malloc(numThreads * sizeof(sLineWorker));
+	threads = Safe_Malloc(numThreads * sizeof(pthread_t));
+	for (t = 0; t < numThreads; t++)
+	{
+		workers[t] = (sLineWorker){keypad, line, length, numThreads, t,
+		                                                     {0}, false, 0};
+		
+		//Thread 0 is the current thread
+		if (t > 0 && pthread_create(&threads[t], NULL, Line_Worker,
+		                                                      &workers[t]) != 0)
+		{
+			fprintf(stderr, "Error creating thread\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	Line_Worker(&workers[0]);
+	for (t = 1; t < numThreads; t++)
+	{
+		pthread_join(threads[t], NULL);
+	}
+	
+	//Join the blocks in order. The first bad character (if any) is the one
+	//we report, just like the single-threaded version.
+	ok = true;
+	Identity_Function(function);
+	for (t = 0; t < numThreads; t++)
+	{
+		if (!workers[t].ok)
+		{
+			*badChar = workers[t].badChar;
+			ok = false;
+			break;
+		}
+		Compose_Functions(function, workers[t].function, function);
+	}
+	
+	free(threads);
+	free(workers);
+	
+	return ok;
+}
+
+
+//Helper function for error-checking malloc()
+void *Safe_Malloc(size_t size)
+{
+	void *retVal;
+	
+	retVal = malloc(size);
+	if (retVal == NULL)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	
+	return retVal;
+}
@@ -29,6 +29,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
 
 
 //The structure is the same as last time
@@ -37,14 +44,52 @@ typedef struct sButton
 	int number;
 	
 	struct sButton *up, *down, *left, *right;
+	int state;
 } sButton;
 
 //Sure enough, these had to change. We'll need extra logic too.
 #define NUM_ROWS    5
 #define NUM_COLS    5
 
+//The compiled keypad works just like part A. The diamond has 13 buttons, so
+//it still fits in one SSE register.
+#define MAX_BUTTONS        16
+#define MIN_THREADED_LINE  (1 << 20)
+
+enum {NO_MOVE, MOVE_UP, MOVE_DOWN, MOVE_LEFT, MOVE_RIGHT, NUM_MOVES};
+
+typedef struct
+{
+	int numButtons;
+	int number[MAX_BUTTONS];
+	
+	uint8_t next[NUM_MOVES][MAX_BUTTONS];
+} sKeypad;
+
+typedef struct
+{
+	const sKeypad *keypad;
+	const char *line;
+	size_t length;
+	int numThreads, thread;
+	uint8_t function[MAX_BUTTONS];
+	bool ok;
+	char badChar;
+} sLineWorker;
+
 
 void Free_Buttons(sButton *buttons[NUM_ROWS][NUM_COLS]);
+bool Compile_Keypad(sButton **list, int numButtons, sKeypad *keypad);
+void Identity_Function(uint8_t function[MAX_BUTTONS]);
+void Compose_Functions(const uint8_t first[MAX_BUTTONS],
+                       const uint8_t second[MAX_BUTTONS],
+                       uint8_t result[MAX_BUTTONS]);
+bool Line_Function(const sKeypad *keypad, const char *line, size_t length,
+                   uint8_t function[MAX_BUTTONS], char *badChar);
+bool Line_Function_Threaded(const sKeypad *keypad, const char *line,
+                            size_t length, uint8_t function[MAX_BUTTONS],
+                            char *badChar);
+void *Safe_Malloc(size_t size);
 
 	
 int main(int argc, char **argv)
@@ -52,11 +97,18 @@ int main(int argc, char **argv)
 	//Instead of an array of structs, we have an array of pointers to structs.
 	//Pointer syntax can be confusing, so sometimes it helps to parenthesize.
 	sButton *buttons[NUM_ROWS][NUM_COLS];
-	sButton *b;
+	sButton *list[NUM_ROWS*NUM_COLS];
+	sKeypad keypad;
+	uint8_t function[MAX_BUTTONS];
 	FILE *inFile;
-	int r, c, next;
+	char *line = NULL;
+	size_t capacity = 0;
+	ssize_t length;
+	int r, c, state;
 	int code = 0;
 	int nextNumber = 1;
+	int numButtons = 0;
+	char badChar;
 	
 	//Initialize the pointer array, allocating memory for the real buttons.
 	//Doing this in a separate loop simplifies later code.
@@ -130,11 +182,20 @@ int main(int argc, char **argv)
 				buttons[r][c]->right = buttons[r][c];
 			else
 				buttons[r][c]->right = buttons[r][c+1];
+			
+			list[numButtons++] = buttons[r][c];
 		}
 	}
 	
-	//We can initialize b once all the pointer values are fixed
-	b = buttons[2][0];
+	//Compile the keypad, starting on 5. Once that's done, we're finished with
+	//the linked list, so we can free it right away.
+	if (!Compile_Keypad(list, numButtons, &keypad))
+	{
+		Free_Buttons(buttons);
+		return EXIT_FAILURE;
+	}
+	state = buttons[2][0]->state;
+	Free_Buttons(buttons);
 	
 	//The rest is almost identical except for the final output. First, we check
 	//the command line arguments and open the file...
@@ -151,37 +212,31 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
-	//...then we read the file one character at a time...
-	next = fgetc(inFile);
-	while (next != EOF)
+	//...then we read the file one line at a time...
+	while ((length = getline(&line, &capacity, inFile)) > 0)
 	{
-		if ((char)next == '\n')
-		{
-			//Here's the change. Because we're working with hexadecimal digits,
-			//we need to shift left one hex place instead of one decimal place.
-			//Instead of multiplying by 10, we multiply by 16.
-			code = 16*code + b->number;
-		} else
+		if (line[length - 1] == '\n')
+			length--;
+		
+		if (!Line_Function_Threaded(&keypad, line, length, function, &badChar))
 		{
-			switch ((char)next)
-			{
-				case 'U': b = b->up;    break;
-				case 'D': b = b->down;  break;
-				case 'L': b = b->left;  break;
-				case 'R': b = b->right; break;
-				default:
-					fprintf(stderr, "Error: Unexpected character %c\n\n", next);
-					fclose(inFile);
-					return EXIT_FAILURE;
-			}
-		}		
-
-		next = fgetc(inFile);
+			fprintf(stderr, "Error: Unexpected character %c\n\n", badChar);
+			free(line);
+			fclose(inFile);
+			return EXIT_FAILURE;
+		}
+		state = function[state];
+		
+		//Here's the change. Because we're working with hexadecimal digits,
+		//we need to shift left one hex place instead of one decimal place.
+		//Instead of multiplying by 10, we multiply by 16.
+		if (line[length] == '\n')
+			code = 16*code + keypad.number[state];
 	}
 	
-	//...finally, we close the file, free the memory, and print the code.
+	//...finally, we close the file and print the code.
+	free(line);
 	fclose(inFile);
-	Free_Buttons(buttons);
 	
 	//Note that the code is printed as hex instead of decimal (%x instead of %d)
 	printf("Door code: %x\n", code);
@@ -204,3 +259,232 @@ void Free_Buttons(sButton *buttons[NUM_ROWS][NUM_COLS])
 		}
 	}
 }
+
+
+//No change
+bool Compile_Keypad(sButton **list, int numButtons, sKeypad *keypad)
+{
+	int i, s;
+	
+	if (numButtons > MAX_BUTTONS)
+	{
+		fprintf(stderr, "Error: Too many buttons (%d, max %d)\n\n",
+		                                             numButtons, MAX_BUTTONS);
+		return false;
+	}
+	
+	keypad->numButtons = numButtons;
+	for (i = 0; i < numButtons; i++)
+	{
+		list[i]->state = i;
+		keypad->number[i] = list[i]->number;
+	}
+	
+	for (s = 0; s < MAX_BUTTONS; s++)
+	{
+		for (i = 0; i < NUM_MOVES; i++)
+		{
+			keypad->next[i][s] = s;
+		}
+	}
+	for (i = 0; i < numButtons; i++)
+	{
+		keypad->next[MOVE_UP][i]    = list[i]->up->state;
+		keypad->next[MOVE_DOWN][i]  = list[i]->down->state;
+		keypad->next[MOVE_LEFT][i]  = list[i]->left->state;
+		keypad->next[MOVE_RIGHT][i] = list[i]->right->state;
+	}
+	
+	return true;
+}
+
+
+//No change
+void Identity_Function(uint8_t function[MAX_BUTTONS])
+{
+	int s;
+	
+	for (s = 0; s < MAX_BUTTONS; s++)
+	{
+		function[s] = s;
+	}
+}
+
+
+//No change
+void Compose_Functions(const uint8_t first[MAX_BUTTONS],
+                       const uint8_t second[MAX_BUTTONS],
+                       uint8_t result[MAX_BUTTONS])
+{
+#ifdef __SSSE3__
+	__m128i table = _mm_loadu_si128((const __m128i *)second);
+	__m128i index = _mm_loadu_si128((const __m128i *)first);
+	
+	_mm_storeu_si128((__m128i *)result, _mm_shuffle_epi8(table, index));
+#else
+	uint8_t temp[MAX_BUTTONS];
+	int s;
+	
+	//Use a temporary in case result is the same array as first or second
+	for (s = 0; s < MAX_BUTTONS; s++)
+	{
+		temp[s] = second[first[s]];
+	}
+	memcpy(result, temp, MAX_BUTTONS);
+#endif
+}
+
+
+//No change
+bool Line_Function(const sKeypad *keypad, const char *line, size_t length,
+                   uint8_t function[MAX_BUTTONS], char *badChar)
+{
+	//A quick way to turn a character into a move. Every other character maps
+	//to zero, which is NO_MOVE.
+	static const uint8_t moveOf[256] =
+		{['U'] = MOVE_UP, ['D'] = MOVE_DOWN, ['L'] = MOVE_LEFT,
+		 ['R'] = MOVE_RIGHT};
+	size_t i;
+	int move;
+#ifdef __SSSE3__
+	__m128i table[NUM_MOVES], current;
+	
+	//Keep the table and the function in registers for the whole loop
+	for (move = 0; move < NUM_MOVES; move++)
+	{
+		table[move] = _mm_loadu_si128((const __m128i *)keypad->next[move]);
+	}
+	current = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+	                        8, 9, 10, 11, 12, 13, 14, 15);
+	for (i = 0; i < length; i++)
+	{
+		move = moveOf[(unsigned char)line[i]];
+		if (move == NO_MOVE)
+		{
+			*badChar = line[i];
+			return false;
+		}
+		current = _mm_shuffle_epi8(table[move], current);
+	}
+	_mm_storeu_si128((__m128i *)function, current);
+#else
+	uint8_t current[MAX_BUTTONS];
+	const uint8_t *row;
+	int s;
+	
+	Identity_Function(current);
+	for (i = 0; i < length; i++)
+	{
+		move = moveOf[(unsigned char)line[i]];
+		if (move == NO_MOVE)
+		{
+			*badChar = line[i];
+			return false;
+		}
+		row = keypad->next[move];
+		for (s = 0; s < keypad->numButtons; s++)
+		{
+			current[s] = row[current[s]];
+		}
+	}
+	memcpy(function, current, MAX_BUTTONS);
+#endif
+	
+	return true;
+}
+
+
+//No change
+static void *Line_Worker(void *arg)
+{
+	sLineWorker *worker = arg;
+	size_t first, end, blockSize;
+	
+	blockSize = (worker->length + worker->numThreads - 1) / worker->numThreads;
+	first = blockSize * worker->thread;
+	end = first + blockSize;
+	if (first > worker->length)
+		first = worker->length;
+	if (end > worker->length)
+		end = worker->length;
+	
+	worker->ok = Line_Function(worker->keypad, &worker->line[first],
+	                           end - first, worker->function, &worker->badChar);
+	
+	return NULL;
+}
+
+
+//No change
+bool Line_Function_Threaded(const sKeypad *keypad, const char *line,
+                            size_t length, uint8_t function[MAX_BUTTONS],
+                            char *badChar)
+{
+	sLineWorker *workers;
+	pthread_t *threads;
+	int numThreads, t;
+	bool ok;
+	
+	numThreads = 1;
+	if (length >= MIN_THREADED_LINE)
+		numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (numThreads <= 1)
+		return Line_Function(keypad, line, length, function, badChar);
+	
+	workers = Safe_Malloc(numThreads * sizeof(sLineWorker));
+	threads = Safe_Malloc(numThreads * sizeof(pthread_t));
+	for (t = 0; t < numThreads; t++)
+	{
+		workers[t] = (sLineWorker){keypad, line, length, numThreads, t,
+		                                                     {0}, false, 0};
+		
+		//Thread 0 is the current thread
+		if (t > 0 && pthread_create(&threads[t], NULL, Line_Worker,
+		                                                      &workers[t]) != 0)
+		{
+			fprintf(stderr, "Error creating thread\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	Line_Worker(&workers[0]);
+	for (t = 1; t < numThreads; t++)
+	{
+		pthread_join(threads[t], NULL);
+	}
+	
+	//Join the blocks in order. The first bad character (if any) is the one
+	//we report, just like the single-threaded version.
+	ok = true;
+	Identity_Function(function);
+	for (t = 0; t < numThreads; t++)
+	{
+		if (!workers[t].ok)
+		{
+			*badChar = workers[t].badChar;
+			ok = false;
+			break;
+		}
+		Compose_Functions(function, workers[t].function, function);
+	}
+	
+	free(threads);
+	free(workers);
+	
+	return ok;
+}
+
+
+//Helper function for error-checking malloc()
+void *Safe_Malloc(size_t size)
+{
+	void *retVal;
+	
+	retVal = malloc(size);
+	if (retVal == NULL)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	
+	return retVal;
+}
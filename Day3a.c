@@ -16,25 +16,69 @@
 //this puzzle is "Squares With Three Sides", so question 2 will almost certainly
 //reveal that we're dealing with a different shape. But this problem is simple
 //enough that there's not much point in trying to plan ahead.
+//
+//The input is only a couple thousand lines, but let's pretend someone hands us
+//a few gigabytes of triangles. Calling strtol() three times per line and
+//checking one triangle at a time would leave the CPU doing far more work than
+//the disk. Instead, we'll read the file in big blocks, turn each block into
+//three arrays of side lengths, and then check eight triangles at once.
 
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #define LINE_LENGTH 16
+#define NUM_SIDES   3
+
+//Every line is the same length, so a block of lines is just a block of bytes.
+//4096 lines is 64 kB of text, which is plenty to keep fread() efficient while
+//staying small enough that the side arrays stay in the cache.
+#define BLOCK_LINES 4096
+
+//Each number is right-aligned in a five-character column, like this:
+//
+//    "  775  785  361\n"
+//     |    |    |    |
+//     0    5    10   15
+//
+//The first character of each column has to be a space (otherwise we couldn't
+//tell where one number ends and the next begins), so a number can have at most
+//four digits.
+#define FIELD_WIDTH   5
+#define MAX_DIGITS    4
 
 
+bool Parse_Lines(const char *text, size_t numLines,
+                 uint32_t sides[NUM_SIDES][BLOCK_LINES], size_t *badLine);
+bool Parse_Line(const char *line, uint32_t sides[NUM_SIDES][BLOCK_LINES],
+                size_t index);
+size_t Count_Triangles(uint32_t sides[NUM_SIDES][BLOCK_LINES],
+                       size_t numTriangles);
+
+
+//The helper functions are:
+//
+//    Parse_Lines()      Turn a block of text into arrays of side lengths
+//    Parse_Line()       The same thing for one line, without any tricks
+//    Count_Triangles()  Check the triangle inequality on the arrays
 int main(int argc, char **argv)
 {
-	//When allocating space for strings, always leave room for the terminating
-	//null character!
-	char line[LINE_LENGTH+1];
-	char *next;
+	//These are static because they're a bit big for the stack. Note that the
+	//text buffer doesn't need room for a null character -- we never treat it
+	//as a string.
+	static char text[BLOCK_LINES*LINE_LENGTH];
+	static uint32_t sides[NUM_SIDES][BLOCK_LINES];
 	FILE *inFile;
-	long s1, s2, s3;
-	int numTriangles = 0;
+	size_t bytes, numLines, badLine;
+	size_t lineNumber = 0;
+	size_t numTriangles = 0;
 	
 	//The usual command line argument check and input file opening
 	if (argc != 2)
@@ -42,50 +86,246 @@ int main(int argc, char **argv)
 		fprintf(stderr, "Usage:\n\tDay3 <input filename>\n\n");
 		return EXIT_FAILURE;
 	}
-
+	
 	inFile = fopen(argv[1], "r");
 	if (inFile == NULL)
 	{
 		fprintf(stderr, "Error opening file: %s\n\n", strerror(errno));
 		return EXIT_FAILURE;
 	}
-
-	//Read the file one line at a time. fgets() automatically stops after a
-	//newline, but we won't rely on that behavior here. Note that the length
-	//passed to fgets() includes the terminating null character.
-	while (fgets(line, LINE_LENGTH+1, inFile) != NULL)
+	
+	//Read the file one block at a time. fread() only comes up short at the end
+	//of the file, so every block except the last is exactly BLOCK_LINES lines.
+	while ((bytes = fread(text, 1, sizeof(text), inFile)) > 0)
 	{
-		//We could use strtok() and atoi() like on Day 1, but since we're only
-		//dealing with numbers we can use strtol() instead. strtol() takes in a
-		//pointer to a string, a reference to a pointer, and a number base.
-		//Unlike in C++, there's no special syntax for refernces -- we just
-		//pass in a pointer to a variable. In this case, that's a pointer to
-		//a pointer. strtol() returns the converted number and modifies the
-		//referenced pointer to point to the remaining part of the string. The
-		//string is not modified. To get the next number, we pass in the
-		//modified pointer. strtol() returns 0 on failure. If 0 were a valid
-		//value, we could check errno instead.
-		s1 = strtol(line, &next, 10);
-		s2 = strtol(next, &next, 10);
-		s3 = strtol(next, &next, 10);
-		if (s1 == 0 || s2 == 0 || s3 == 0)
+		//If the last line is missing its newline, put one back. There's always
+		//room, since a full block is a whole number of lines.
+		if (bytes % LINE_LENGTH == LINE_LENGTH - 1)
+			text[bytes++] = '\n';
+		
+		if (bytes % LINE_LENGTH != 0)
+		{
+			fprintf(stderr, "Error: Line %zu is the wrong length\n\n",
+			                                lineNumber + bytes/LINE_LENGTH + 1);
+			fclose(inFile);
+			return EXIT_FAILURE;
+		}
+		numLines = bytes / LINE_LENGTH;
+		
+		if (!Parse_Lines(text, numLines, sides, &badLine))
 		{
-			fprintf(stderr, "Error parsing numbers: %s\n\n", strerror(errno));
-			fprintf(stderr, "Line: %s\n", line);
+			fprintf(stderr, "Error parsing numbers on line %zu\n\n",
+			                                         lineNumber + badLine + 1);
+			fprintf(stderr, "Line: %.*s\n", LINE_LENGTH,
+			                                     &text[badLine*LINE_LENGTH]);
 			fclose(inFile);
 			return EXIT_FAILURE;
 		}
 		
-		//Check for a possible triangle and increment the count if necessary
-		if (s1 + s2 > s3 && s2 + s3 > s1 && s3 + s1 > s2)
-			numTriangles++;
+		//Check the triangles and add them to the count
+		numTriangles += Count_Triangles(sides, numLines);
+		lineNumber += numLines;
 	}
 	
 	//Close the file as soon as we're done with it
 	fclose(inFile);
 	
 	//Print the number of triangles
-	printf("Number of possible triangles: %d\n", numTriangles);
+	printf("Number of possible triangles: %zu\n", numTriangles);
 	
 	return EXIT_SUCCESS;
 }
+
+
+//Since every line has the same layout, we can parse two lines at a time with
+//AVX2. A 256-bit register holds exactly 32 characters, which is two lines. The
+//steps are:
+//
+//  1. Subtract '0' from every character. Digits become 0-9, and anything else
+//     becomes something bigger (subtraction wraps around for unsigned bytes).
+//  2. Make bitmasks of which characters are digits, spaces, and newlines, and
+//     check that the layout is right using ordinary integer math.
+//  3. Zero out the spaces, and shuffle each number's four possible digits into
+//     four bytes in a row.
+//  4. Multiply-add pairs of bytes by 10 and 1 to get two-digit numbers, then
+//     pairs of those by 100 and 1 to get the whole number.
+//
+//The values land in 32-bit slots that we copy into the side arrays. (Storing
+//the sides as a "structure of arrays" is what makes Count_Triangles() easy.)
+//If we don't have AVX2, or there's an odd line left over, we use Parse_Line().
+//Returns false and sets badLine if there's a line we can't understand.
+bool Parse_Lines(const char *text, size_t numLines,
+                 uint32_t sides[NUM_SIDES][BLOCK_LINES], size_t *badLine)
+{
+	size_t i = 0;
+#ifdef __AVX2__
+	//For each line: the digit positions of the three numbers. -1 puts a zero
+	//in the output byte. The shuffle works on each 128-bit half separately, so
+	//the pattern is the same for both lines.
+	const __m256i gather = _mm256_setr_epi8(
+	                1, 2, 3, 4, 6, 7, 8, 9, 11, 12, 13, 14, -1, -1, -1, -1,
+	                1, 2, 3, 4, 6, 7, 8, 9, 11, 12, 13, 14, -1, -1, -1, -1);
+	const __m256i zeroChar = _mm256_set1_epi8('0');
+	const __m256i nine = _mm256_set1_epi8(9);
+	const __m256i space = _mm256_set1_epi8(' ');
+	const __m256i newline = _mm256_set1_epi8('\n');
+	const __m256i tens = _mm256_set1_epi16(0x010a);
+	const __m256i hundreds = _mm256_set1_epi32(0x00010064);
+	
+	//Bit masks for the two lines. Bits 0, 5, and 10 are the separators, bits
+	//4, 9, and 14 are the last digits, and bit 15 is the newline. The second
+	//line is the same, 16 bits higher.
+	const uint32_t separators = 0x04210421;
+	const uint32_t lastDigits = 0x42104210;
+	const uint32_t newlines   = 0x80008000;
+	__m256i chars, digits, isDigit, values;
+	uint32_t digitMask, spaceMask, newlineMask;
+	uint32_t temp[8];
+	
+	for (; i + 2 <= numLines; i += 2)
+	{
+		chars = _mm256_loadu_si256((const __m256i *)&text[i*LINE_LENGTH]);
+		
+		//Step 1 and 2. A byte is a digit if it's still the same after taking
+		//the minimum with 9.
+		digits = _mm256_sub_epi8(chars, zeroChar);
+		isDigit = _mm256_cmpeq_epi8(_mm256_min_epu8(digits, nine), digits);
+		digitMask = _mm256_movemask_epi8(isDigit);
+		spaceMask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, space));
+		newlineMask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, newline));
+		
+		//The layout is right if every character is a digit, a space, or a
+		//newline in the right place, every column starts with a space and ends
+		//with a digit, and no space comes right after a digit (the numbers are
+		//right-aligned). The separators are the only exception to the last
+		//rule, since they come right after the previous number.
+		if ((digitMask | spaceMask | newlineMask) != 0xffffffff ||
+		    newlineMask != newlines ||
+		    (spaceMask & separators) != separators ||
+		    (digitMask & lastDigits) != lastDigits ||
+		    (spaceMask & (digitMask << 1) & ~separators) != 0)
+		{
+			//Let the simple version figure out which line it was
+			break;
+		}
+		
+		//Steps 3 and 4
+		digits = _mm256_and_si256(digits, isDigit);
+		digits = _mm256_shuffle_epi8(digits, gather);
+		values = _mm256_madd_epi16(_mm256_maddubs_epi16(digits, tens),
+		                                                             hundreds);
+		
+		_mm256_storeu_si256((__m256i *)temp, values);
+		sides[0][i]   = temp[0];
+		sides[1][i]   = temp[1];
+		sides[2][i]   = temp[2];
+		sides[0][i+1] = temp[4];
+		sides[1][i+1] = temp[5];
+		sides[2][i+1] = temp[6];
+	}
+#endif
+	
+	for (; i < numLines; i++)
+	{
+		if (!Parse_Line(&text[i*LINE_LENGTH], sides, i))
+		{
+			*badLine = i;
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+
+//Parse a single line one character at a time. This checks the same layout as
+//the AVX2 version, so the two always agree on which lines are okay. Unlike
+//with strtol(), a zero can't be confused with an error, so a side of zero is
+//allowed. It just can't be part of a triangle.
+bool Parse_Line(const char *line, uint32_t sides[NUM_SIDES][BLOCK_LINES],
+                size_t index)
+{
+	const char *field;
+	uint32_t value;
+	int s, d;
+	
+	if (line[LINE_LENGTH-1] != '\n')
+		return false;
+	
+	for (s = 0; s < NUM_SIDES; s++)
+	{
+		field = &line[s*FIELD_WIDTH];
+		if (field[0] != ' ')
+			return false;
+		
+		//Skip the leading spaces, then read the digits
+		for (d = 1; d <= MAX_DIGITS && field[d] == ' '; d++)
+			;
+		if (d > MAX_DIGITS)
+			return false;
+		
+		value = 0;
+		for (; d <= MAX_DIGITS; d++)
+		{
+			if (field[d] < '0' || field[d] > '9')
+				return false;
+			value = 10*value + (field[d] - '0');
+		}
+		sides[s][index] = value;
+	}
+	
+	return true;
+}
+
+
+//Check the triangle inequality for every set of sides. With AVX2, each 256-bit
+//register holds eight 32-bit side lengths, so we can check eight triangles with
+//a handful of instructions. A comparison gives us -1 (all bits set) for true
+//and 0 for false, so subtracting the result adds one for each good triangle.
+//The sides are at most four digits, so none of the sums can overflow.
+size_t Count_Triangles(uint32_t sides[NUM_SIDES][BLOCK_LINES],
+                       size_t numTriangles)
+{
+	size_t count = 0;
+	size_t i = 0;
+#ifdef __AVX2__
+	__m256i a, b, c, good;
+	__m256i total = _mm256_setzero_si256();
+	uint32_t temp[8];
+	int t;
+	
+	for (; i + 8 <= numTriangles; i += 8)
+	{
+		a = _mm256_loadu_si256((const __m256i *)&sides[0][i]);
+		b = _mm256_loadu_si256((const __m256i *)&sides[1][i]);
+		c = _mm256_loadu_si256((const __m256i *)&sides[2][i]);
+		
+		good = _mm256_and_si256(
+		               _mm256_cmpgt_epi32(_mm256_add_epi32(a, b), c),
+		               _mm256_and_si256(
+		                   _mm256_cmpgt_epi32(_mm256_add_epi32(b, c), a),
+		                   _mm256_cmpgt_epi32(_mm256_add_epi32(c, a), b)));
+		total = _mm256_sub_epi32(total, good);
+	}
+	
+	//Add up the eight running counts
+	_mm256_storeu_si256((__m256i *)temp, total);
+	for (t = 0; t < 8; t++)
+	{
+		count += temp[t];
+	}
+#endif
+	
+	//The leftovers (or everything, without AVX2)
+	for (; i < numTriangles; i++)
+	{
+		if (sides[0][i] + sides[1][i] > sides[2][i] &&
+		    sides[1][i] + sides[2][i] > sides[0][i] &&
+		    sides[2][i] + sides[0][i] > sides[1][i])
+		{
+			count++;
+		}
+	}
+	
+	return count;
+}
@@ -4,29 +4,54 @@
 //rows. How many possible triangles are there?
 //
 //This doesn't change much. Instead of processing one line at a time, we'll need
-//to process three.
+//to process three. We still parse the lines like part A, but the numbers on
+//each line get sent to the side arrays in a different order. Once they're
+//there, counting the triangles is no different.
 
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #define LINE_LENGTH 16
 #define NUM_SIDES   3
 #define NUM_COLS    3
 
+//The block size has to be a multiple of six lines now (see Parse_Groups())
+#define BLOCK_LINES (6*1024)
 
+//Same as part A
+#define FIELD_WIDTH   5
+#define MAX_DIGITS    4
+
+
+bool Parse_Groups(const char *text, size_t numLines,
+                  uint32_t sides[NUM_SIDES][BLOCK_LINES+2], size_t *badLine);
+bool Parse_Line(const char *line, uint32_t values[NUM_COLS]);
+size_t Count_Triangles(uint32_t sides[NUM_SIDES][BLOCK_LINES+2],
+                       size_t numTriangles);
+
+
+//The helper functions are:
+//
+//    Parse_Groups()     Turn a block of text into arrays of side lengths
+//    Parse_Line()       Parse one line, without any tricks
+//    Count_Triangles()  Check the triangle inequality on the arrays
 int main(int argc, char **argv)
 {
-	char line[LINE_LENGTH+1];
-	char *next;
+	//These are static because they're a bit big for the stack
+	static char text[BLOCK_LINES*LINE_LENGTH];
+	static uint32_t sides[NUM_SIDES][BLOCK_LINES+2];
 	FILE *inFile;
-	//Using a 2D array and nested loops will save us from having to write a ton
-	//of comparisons later.
-	long sides[NUM_COLS][NUM_SIDES];
-	int s, t;
-	int numTriangles = 0;
+	size_t bytes, numLines, badLine;
+	size_t lineNumber = 0;
+	size_t numTriangles = 0;
 	
 	//The usual command line argument check and input file opening
 	if (argc != 2)
@@ -34,67 +59,270 @@ int main(int argc, char **argv)
 		fprintf(stderr, "Usage:\n\tDay3 <input filename>\n\n");
 		return EXIT_FAILURE;
 	}
-
+	
 	inFile = fopen(argv[1], "r");
 	if (inFile == NULL)
 	{
 		fprintf(stderr, "Error opening file: %s\n\n", strerror(errno));
 		return EXIT_FAILURE;
 	}
-
-	//Since we're working on three lines at once, we need to change the loop.
-	//Instead of doing a single null check after each line, we'll check for the
-	//end of file after each group of three lines.
-	while (!feof(inFile))
+	
+	//Read the file one block at a time, same as part A
+	while ((bytes = fread(text, 1, sizeof(text), inFile)) > 0)
 	{
-		//We still have to read and parse one line at a time, unless we want to
-		//do some funky seeking within the file.
-		for (s = 0; s < NUM_SIDES; s++)
+		if (bytes % LINE_LENGTH == LINE_LENGTH - 1)
+			text[bytes++] = '\n';
+		
+		if (bytes % LINE_LENGTH != 0)
 		{
-			fgets(line, LINE_LENGTH+1, inFile);
-			next = line;
-			
-			//We could have unrolled this loop instead. There would be a small
-			//performance improvement and a small code size penalty. Doesn't
-			//sound like a big deal until you have to write a program that fits
-			//into 16kB of RAM. :-)
-			for (t = 0; t < NUM_COLS; t++)
-			{
-				sides[t][s] = strtol(next, &next, 10);
-				
-				if (sides[t][s] == 0)
-				{
-					fprintf(stderr, "Error parsing numbers: %s\n\n",
-					                                           strerror(errno));
-					fprintf(stderr, "Line: %s\n", line);
-					fclose(inFile);
-					return EXIT_FAILURE;
-				}
-			}
+			fprintf(stderr, "Error: Line %zu is the wrong length\n\n",
+			                                lineNumber + bytes/LINE_LENGTH + 1);
+			fclose(inFile);
+			return EXIT_FAILURE;
 		}
+		numLines = bytes / LINE_LENGTH;
 		
-		//Now we can check all three triangles
-		for (t = 0; t < NUM_COLS; t++)
+		//Every block but the last is a whole number of groups, so this can
+		//only happen at the end of the file
+		if (numLines % NUM_SIDES != 0)
 		{
-			if (sides[t][0] + sides[t][1] > sides[t][2] &&
-			    sides[t][1] + sides[t][2] > sides[t][0] &&
-				sides[t][2] + sides[t][0] > sides[t][1])
-			{
-				numTriangles++;
-			}
+			fprintf(stderr, "Error: The number of lines isn't a multiple of "
+			                                                      "three\n\n");
+			fclose(inFile);
+			return EXIT_FAILURE;
 		}
 		
-		//Unfortunately, the EOF indicator doesn't get set until we try to read
-		//past the end of the file. Using fgetc() and ungetc() lets us do that
-		//without losing any data.
-		ungetc(fgetc(inFile), inFile);
+		if (!Parse_Groups(text, numLines, sides, &badLine))
+		{
+			fprintf(stderr, "Error parsing numbers on line %zu\n\n",
+			                                         lineNumber + badLine + 1);
+			fprintf(stderr, "Line: %.*s\n", LINE_LENGTH,
+			                                     &text[badLine*LINE_LENGTH]);
+			fclose(inFile);
+			return EXIT_FAILURE;
+		}
+		
+		//Check the triangles and add them to the count. There's one triangle
+		//per line, just like before.
+		numTriangles += Count_Triangles(sides, numLines);
+		lineNumber += numLines;
 	}
 	
 	//Close the file as soon as we're done with it
 	fclose(inFile);
 	
 	//Print the number of triangles
-	printf("Number of possible triangles: %d\n", numTriangles);
+	printf("Number of possible triangles: %zu\n", numTriangles);
 	
 	return EXIT_SUCCESS;
 }
+
+
+#ifdef __AVX2__
+//Parse two lines with AVX2, exactly like Parse_Lines() in part A. The numbers
+//come out as (a, b, c, 0) in each 128-bit half of values. Returns false if
+//either line doesn't look right.
+static inline bool Parse_Pair(const char *text, __m256i *values)
+{
+	const __m256i gather = _mm256_setr_epi8(
+	                1, 2, 3, 4, 6, 7, 8, 9, 11, 12, 13, 14, -1, -1, -1, -1,
+	                1, 2, 3, 4, 6, 7, 8, 9, 11, 12, 13, 14, -1, -1, -1, -1);
+	const __m256i zeroChar = _mm256_set1_epi8('0');
+	const __m256i nine = _mm256_set1_epi8(9);
+	const __m256i space = _mm256_set1_epi8(' ');
+	const __m256i newline = _mm256_set1_epi8('\n');
+	const __m256i tens = _mm256_set1_epi16(0x010a);
+	const __m256i hundreds = _mm256_set1_epi32(0x00010064);
+	const uint32_t separators = 0x04210421;
+	const uint32_t lastDigits = 0x42104210;
+	const uint32_t newlines   = 0x80008000;
+	__m256i chars, digits, isDigit;
+	uint32_t digitMask, spaceMask, newlineMask;
+	
+	chars = _mm256_loadu_si256((const __m256i *)text);
+	digits = _mm256_sub_epi8(chars, zeroChar);
+	isDigit = _mm256_cmpeq_epi8(_mm256_min_epu8(digits, nine), digits);
+	digitMask = _mm256_movemask_epi8(isDigit);
+	spaceMask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, space));
+	newlineMask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, newline));
+	
+	if ((digitMask | spaceMask | newlineMask) != 0xffffffff ||
+	    newlineMask != newlines ||
+	    (spaceMask & separators) != separators ||
+	    (digitMask & lastDigits) != lastDigits ||
+	    (spaceMask & (digitMask << 1) & ~separators) != 0)
+	{
+		return false;
+	}
+	
+	digits = _mm256_and_si256(digits, isDigit);
+	digits = _mm256_shuffle_epi8(digits, gather);
+	*values = _mm256_madd_epi16(_mm256_maddubs_epi16(digits, tens), hundreds);
+	
+	return true;
+}
+#endif
+
+
+//In part A, line i's numbers went to slot i of the three side arrays. Now each
+//group of three lines holds three triangles, one in each column, and triangle
+//t of a group gets its sides from column t of the three lines. If we put
+//triangle t of the group starting at line g in slot g + t, then:
+//
+//    sides[s][g + t] = (number t on line g + s)
+//
+//In other words, the three numbers on line g + s go straight into slots g to
+//g + 2 of side array s! So the "transpose" is really a matter of sending each
+//line to the right array.
+//
+//With AVX2, we parse six lines (two groups) into three registers, each holding
+//two lines. The lines we want for side array s are line s and line s + 3, and
+//they're always in different registers. _mm256_permute2x128_si256() picks the
+//two 128-bit halves we want, and _mm256_permutevar8x32_epi32() squeezes out
+//the unused fourth number of each line. That leaves six sides in a row, which
+//we store all at once. The store writes two extra numbers past the end, but
+//the next six lines overwrite them, and the side arrays have a little extra
+//room for the last ones.
+//
+//The block size is a multiple of six lines, so a group never gets split
+//between blocks, and neither does a pair of lines. (fread() keeps reading until
+//the block is full, even from a pipe.) If we don't have AVX2, or there's a
+//group left over, we do it one line at a time with Parse_Line().
+bool Parse_Groups(const char *text, size_t numLines,
+                  uint32_t sides[NUM_SIDES][BLOCK_LINES+2], size_t *badLine)
+{
+	uint32_t values[NUM_COLS];
+	size_t i = 0;
+	int t;
+#ifdef __AVX2__
+	const __m256i squeeze = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+	__m256i lines01, lines23, lines45;
+	
+	for (; i + 2*NUM_SIDES <= numLines; i += 2*NUM_SIDES)
+	{
+		//If anything is wrong, let the simple version figure out which line
+		if (!Parse_Pair(&text[i*LINE_LENGTH], &lines01) ||
+		    !Parse_Pair(&text[(i+2)*LINE_LENGTH], &lines23) ||
+		    !Parse_Pair(&text[(i+4)*LINE_LENGTH], &lines45))
+		{
+			break;
+		}
+		
+		//Side 0 is lines 0 and 3, side 1 is lines 1 and 4, and side 2 is
+		//lines 2 and 5
+		_mm256_storeu_si256((__m256i *)&sides[0][i],
+		            _mm256_permutevar8x32_epi32(
+		                _mm256_permute2x128_si256(lines01, lines23, 0x30),
+		                squeeze));
+		_mm256_storeu_si256((__m256i *)&sides[1][i],
+		            _mm256_permutevar8x32_epi32(
+		                _mm256_permute2x128_si256(lines01, lines45, 0x21),
+		                squeeze));
+		_mm256_storeu_si256((__m256i *)&sides[2][i],
+		            _mm256_permutevar8x32_epi32(
+		                _mm256_permute2x128_si256(lines23, lines45, 0x30),
+		                squeeze));
+	}
+#endif
+	
+	for (; i < numLines; i++)
+	{
+		if (!Parse_Line(&text[i*LINE_LENGTH], values))
+		{
+			*badLine = i;
+			return false;
+		}
+		
+		//Line i is side i % 3 of the group that starts at i - i % 3
+		for (t = 0; t < NUM_COLS; t++)
+		{
+			sides[i % NUM_SIDES][i - i % NUM_SIDES + t] = values[t];
+		}
+	}
+	
+	return true;
+}
+
+
+//Same as part A, but the numbers go into a plain array
+bool Parse_Line(const char *line, uint32_t values[NUM_COLS])
+{
+	const char *field;
+	uint32_t value;
+	int s, d;
+	
+	if (line[LINE_LENGTH-1] != '\n')
+		return false;
+	
+	for (s = 0; s < NUM_COLS; s++)
+	{
+		field = &line[s*FIELD_WIDTH];
+		if (field[0] != ' ')
+			return false;
+		
+		for (d = 1; d <= MAX_DIGITS && field[d] == ' '; d++)
+			;
+		if (d > MAX_DIGITS)
+			return false;
+		
+		value = 0;
+		for (; d <= MAX_DIGITS; d++)
+		{
+			if (field[d] < '0' || field[d] > '9')
+				return false;
+			value = 10*value + (field[d] - '0');
+		}
+		values[s] = value;
+	}
+	
+	return true;
+}
+
+
+//No change
+size_t Count_Triangles(uint32_t sides[NUM_SIDES][BLOCK_LINES+2],
+                       size_t numTriangles)
+{
+	size_t count = 0;
+	size_t i = 0;
+#ifdef __AVX2__
+	__m256i a, b, c, good;
+	__m256i total = _mm256_setzero_si256();
+	uint32_t temp[8];
+	int t;
+	
+	for (; i + 8 <= numTriangles; i += 8)
+	{
+		a = _mm256_loadu_si256((const __m256i *)&sides[0][i]);
+		b = _mm256_loadu_si256((const __m256i *)&sides[1][i]);
+		c = _mm256_loadu_si256((const __m256i *)&sides[2][i]);
+		
+		good = _mm256_and_si256(
+		               _mm256_cmpgt_epi32(_mm256_add_epi32(a, b), c),
+		               _mm256_and_si256(
+		                   _mm256_cmpgt_epi32(_mm256_add_epi32(b, c), a),
+		                   _mm256_cmpgt_epi32(_mm256_add_epi32(c, a), b)));
+		total = _mm256_sub_epi32(total, good);
+	}
+	
+	//Add up the eight running counts
+	_mm256_storeu_si256((__m256i *)temp, total);
+	for (t = 0; t < 8; t++)
+	{
+		count += temp[t];
+	}
+#endif
+	
+	//The leftovers (or everything, without AVX2)
+	for (; i < numTriangles; i++)
+	{
+		if (sides[0][i] + sides[1][i] > sides[2][i] &&
+		    sides[1][i] + sides[2][i] > sides[0][i] &&
+		    sides[2][i] + sides[0][i] > sides[1][i])
+		{
+			count++;
+		}
+	}
+	
+	return count;
+}
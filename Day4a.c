@@ -27,6 +27,13 @@
 //don't have a fixed length, let's process them one character at a time. This
 //lets us handle arbitrarily long lines. They're all less than 80 characters in
 //the actual input, but it's good practice.
+//
+//Reading one character at a time with fgetc() is easy, but it's slow if we
+//have tens of millions of rooms to check. So instead, we read the file in big
+//blocks and work through the lines in memory. A line that runs off the end of
+//a block gets moved to the front of the buffer so the next read can finish
+//it, and if a line won't fit in the buffer at all, we make the buffer bigger.
+//That way we can still handle arbitrarily long lines.
 
 
 #include <stdio.h>
@@ -34,27 +41,53 @@
 #include <string.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 //We all know there are 26 letters, but it's still bad practice to put random
 //constants in your code.
 #define NUM_LETTERS  26
 #define CHKSUM_LEN   5
 
+//The starting size of the read buffer. It only grows if a single line is
+//longer than this.
+#define BLOCK_SIZE   65536
+
+//The pieces of one line. The name and checksum point into the read buffer.
+typedef struct
+{
+	const char *name;
+	size_t nameLength;
+	long id;
+	const char *chksum;
+} sRoom;
+
+
+bool Check_Rooms(const char *text, size_t length, size_t *lineNumber,
+                 long *idSum);
+bool Parse_Room(const char *line, size_t length, sRoom *room);
+void Count_Letters(const char *name, size_t length, int *counts);
+void Calc_Chksum(const int *counts, char *chksum);
+void *Safe_Malloc(size_t size);
 
-void Calc_Chksum(int *counts, char *chksum, int numCounts, int chksumSize);
 
+//The helper functions are:
+//
+//    Check_Rooms()    Go through a buffer full of lines
+//    Parse_Room()     Split a line into its name, ID, and checksum
+//    Count_Letters()  Count how many times each letter appears
+//    Calc_Chksum()    Pick the five most common letters
 int main(int argc, char **argv)
 {
 	FILE *inFile;
-	int counts[NUM_LETTERS];
-	char calcChksum[CHKSUM_LEN];
-	char readChksum[CHKSUM_LEN];
-	//We could use a pointer or an integer to keep track of how many checksum
-	//characters we've read. Let's use a pointer to illustrate some common
-	//pointer syntax.
-	char *chksumChar;
-	bool inChksum;
-	int nextChar;
+	char *buffer;
+	size_t bufSize = BLOCK_SIZE;
+	size_t used = 0;
+	size_t bytes, end;
+	size_t lineNumber = 0;
+	bool atEnd;
 	//Why use a long here instead of an int? Int is only guaranteed to be at
 	//least 16 bits. There are almost a thousand lines of input and the sector
 	//IDs are three-digit numbers, so it would be quite possible to get a sum
@@ -64,84 +97,69 @@ int main(int argc, char **argv)
 	//types like uint32_t. Likewise, almost everyone assumes a char is 8 bits,
 	//but on old mainframes or new DSPs that's not necessarily true...
 	long idSum = 0;
-	long id;
-
+	
 	//The usual command line argument check and input file opening
 	if (argc != 2)
 	{
 		fprintf(stderr, "Usage:\n\tDay4 <input filename>\n\n");
 		return EXIT_FAILURE;
 	}
-
+	
 	inFile = fopen(argv[1], "r");
 	if (inFile == NULL)
 	{
 		fprintf(stderr, "Error opening file: %s\n\n", strerror(errno));
 		return EXIT_FAILURE;
 	}
-
-	//We need to do four tasks for each line:
-	//
-	//1. Count up the letters
-	//2. Extract the sector ID
-	//3. Read the provided checksum
-	//4. Compute the actual checksum
-	//5. Compare the two checksums
-	//
-	//We'll pretend there's an initial newline character. This forces the loop
-	//to initialize the variables first.
-	nextChar = '\n';
+	
+	buffer = Safe_Malloc(bufSize);
 	do
 	{
-		if (nextChar == '\n')
-		{
-			//If the character is a newline, we're (obviously) about to start a
-			//new line. Clear the counts and (for easier debugging) reset the
-			//checksum and sector ID.
-			memset(counts, 0, NUM_LETTERS * sizeof(int));
-			memset(calcChksum, '\0', CHKSUM_LEN * sizeof(char));
-			memset(readChksum, '\0', CHKSUM_LEN * sizeof(char));
-			chksumChar = readChksum;
-			inChksum = false;
-			id = 0;
-		} else if (nextChar >= 'a' && nextChar <= 'z')
+		//Fill up the rest of the buffer. fread() only comes up short at the
+		//end of the file.
+		bytes = fread(&buffer[used], 1, bufSize - used, inFile);
+		used += bytes;
+		atEnd = (used < bufSize);
+		
+		//Find the end of the last complete line. At the end of the file, the
+		//last line counts as complete even without a newline.
+		end = used;
+		if (!atEnd)
 		{
-			if (inChksum)
-			{
-				//If the letter is part of the checksum, save it. This syntax
-				//is very common for iterating over an array. *pointer++ means
-				//to access whatever the pointer points to now, then increment
-				//the pointer so it points to the next element in the array.
-				*chksumChar++ = (char)nextChar;
-			} else
+			while (end > 0 && buffer[end - 1] != '\n')
+				end--;
+			
+			//If there isn't a single newline, the line is too long for the
+			//buffer. Double the buffer size and try again.
+			if (end == 0)
 			{
-				//If the next character is a letter in the string, add it to the
-				//counts. This code breaks if the character set is EBCDIC. :-(
-				counts[nextChar - 'a']++;
+				bufSize *= 2;
+				buffer = realloc(buffer, bufSize);
+				if (buffer == NULL)
+				{
+					fprintf(stderr, "Error reallocating: %s\n\n",
+					                                           strerror(errno));
+					fclose(inFile);
+					return EXIT_FAILURE;
+				}
+				continue;
 			}
-		} else if (nextChar >= '0' && nextChar <= '9')
-		{
-			//If the next character is a number, add it to the sector ID
-			id = 10*id + (nextChar - '0');
-		} else if (nextChar == '[')
-		{
-			//If the character is an open square bracket, we're entering the
-			//provided checksum and must handle letters differently.
-			inChksum = true;
-		} else if (nextChar == ']')
+		}
+		
+		if (!Check_Rooms(buffer, end, &lineNumber, &idSum))
 		{
-			//We'll use the close bracket as a trigger to do the calculations
-			Calc_Chksum(counts, calcChksum, NUM_LETTERS, CHKSUM_LEN);
-			
-			//Compare the checksums and add the ID to the total if they match.
-			//We have to use strncmp() instead of strcmp() because we don't have
-			//a terminating null character on the checksums. (Also, it's safer.)
-			if (strncmp(calcChksum, readChksum, CHKSUM_LEN) == 0)
-				idSum += id;
+			free(buffer);
+			fclose(inFile);
+			return EXIT_FAILURE;
 		}
-	} while ((nextChar = fgetc(inFile)) != EOF);	
+		
+		//Move the leftover part of a line to the front of the buffer
+		memmove(buffer, &buffer[end], used - end);
+		used -= end;
+	} while (!atEnd);
 	
-	//Close the file as soon as we're done with it
+	//Close the file and free the memory as soon as we're done with it
+	free(buffer);
 	fclose(inFile);
 	
 	//Print the sum of the sector IDs
@@ -150,39 +168,210 @@ int main(int argc, char **argv)
 	return EXIT_SUCCESS;
 }
 
-//Calculate the checksum based on the letter counts
-void Calc_Chksum(int *counts, char *chksum, int numCounts, int chksumSize)
+
+//Go through the lines in the buffer and add up the IDs of the real rooms. We
+//keep track of the line number for error messages. memchr() is usually a lot
+//faster than checking one character at a time, since the C library can use
+//SIMD instructions for it.
+bool Check_Rooms(const char *text, size_t length, size_t *lineNumber,
+                 long *idSum)
 {
-	int max = 0, s = 0;
-	int c;
+	const char *line = text;
+	const char *textEnd = text + length;
+	const char *newline;
+	size_t lineLength;
+	int counts[NUM_LETTERS];
+	char calcChksum[CHKSUM_LEN];
+	sRoom room;
 	
-	//Get the maximum count
-	for (c = 0; c < numCounts; c++)
+	while (line < textEnd)
 	{
-		if (counts[c] > max)
-			max = counts[c];
+		newline = memchr(line, '\n', textEnd - line);
+		if (newline == NULL)
+			newline = textEnd;
+		lineLength = newline - line;
+		(*lineNumber)++;
+		
+		//Skip blank lines
+		if (lineLength > 0 && !(lineLength == 1 && line[0] == '\r'))
+		{
+			if (!Parse_Room(line, lineLength, &room))
+			{
+				fprintf(stderr, "Error: Can't understand line %zu: %.*s\n\n",
+				                           *lineNumber, (int)lineLength, line);
+				return false;
+			}
+			
+			//Compute the checksum and add the ID to the total if it matches.
+			//We have to use strncmp() instead of strcmp() because we don't
+			//have a terminating null character on the checksums. (Also, it's
+			//safer.)
+			Count_Letters(room.name, room.nameLength, counts);
+			Calc_Chksum(counts, calcChksum);
+			if (strncmp(calcChksum, room.chksum, CHKSUM_LEN) == 0)
+				*idSum += room.id;
+		}
+		
+		line = newline + 1;
 	}
 	
-	//Search for letters counts equal to the max in alphabetical order. Once all
-	//the counts have been checked, decrement the max and try again. When all of
-	//the checksum characters have been computed, stop.
-	while (s < chksumSize)
+	return true;
+}
+
+
+//Split a line into its parts. The name is everything before the hyphen in
+//front of the sector ID. Returns false if the line doesn't look right.
+bool Parse_Room(const char *line, size_t length, sRoom *room)
+{
+	size_t i, c;
+	
+	//Windows line endings are okay
+	if (length > 0 && line[length - 1] == '\r')
+		length--;
+	
+	//The name is made of letters and hyphens
+	for (i = 0; i < length && (line[i] < '0' || line[i] > '9'); i++)
 	{
-		//Breaking out of nested loops is always a little awkward. In this case,
-		//it was easiest to check s in both the while loop and the for loop.
-		for (c = 0; c < numCounts && s < chksumSize; c++)
+		if ((line[i] < 'a' || line[i] > 'z') && line[i] != '-')
+			return false;
+	}
+	if (i == 0 || line[i - 1] != '-')
+		return false;
+	room->name = line;
+	room->nameLength = i - 1;
+	
+	//The sector ID. Keeping it under a billion means it can't overflow a long.
+	room->id = 0;
+	for (; i < length && line[i] >= '0' && line[i] <= '9'; i++)
+	{
+		room->id = 10*room->id + (line[i] - '0');
+		if (room->id >= 1000000000)
+			return false;
+	}
+	
+	//The checksum, in brackets
+	if (length - i != CHKSUM_LEN + 2 || line[i] != '[' ||
+	                                           line[length - 1] != ']')
+	{
+		return false;
+	}
+	room->chksum = &line[i + 1];
+	for (c = 0; c < CHKSUM_LEN; c++)
+	{
+		if (room->chksum[c] < 'a' || room->chksum[c] > 'z')
+			return false;
+	}
+	
+	return true;
+}
+
+
+//Count the letters in the name, ignoring the hyphens. This code breaks if the
+//character set is EBCDIC. :-(
+//
+//With AVX2, we keep all 26 counts in one 256-bit register, one byte per letter.
+//For each character of the name, we fill a register with copies of it and
+//compare that to a register holding the alphabet. The letter's byte comes out
+//as -1 (all bits set) and the rest come out as 0, so subtracting the result
+//adds one to the right count. There's no array indexing at all, so there's no
+//waiting on a load that depends on the character, and the counts never leave
+//the register until the end. A byte can only count to 255, so every 255
+//characters we add the bytes to the real counts and start over.
+void Count_Letters(const char *name, size_t length, int *counts)
+{
+	size_t i;
+#ifdef __AVX2__
+	const __m256i alphabet = _mm256_setr_epi8('a', 'b', 'c', 'd', 'e', 'f',
+	                          'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p',
+	                          'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z',
+	                          0, 0, 0, 0, 0, 0);
+	__m256i total = _mm256_setzero_si256();
+	uint8_t bytes[32];
+	int c, run = 0;
+	
+	memset(counts, 0, NUM_LETTERS * sizeof(int));
+	for (i = 0; i < length; i++)
+	{
+		total = _mm256_sub_epi8(total,
+		               _mm256_cmpeq_epi8(alphabet, _mm256_set1_epi8(name[i])));
+		
+		if (++run == 255 || i == length - 1)
 		{
-			//We never need to go back to the beginning of the checksum, so it's
-			//okay to modify our only pointer.
-			if (counts[c] == max)
+			_mm256_storeu_si256((__m256i *)bytes, total);
+			for (c = 0; c < NUM_LETTERS; c++)
 			{
-				*chksum++ = 'a' + c;
-				s++;
+				counts[c] += bytes[c];
 			}
+			total = _mm256_setzero_si256();
+			run = 0;
 		}
+	}
+#else
+	memset(counts, 0, NUM_LETTERS * sizeof(int));
+	for (i = 0; i < length; i++)
+	{
+		if (name[i] != '-')
+			counts[name[i] - 'a']++;
+	}
+#endif
+}
+
+
+//Calculate the checksum based on the letter counts. We want the letters sorted
+//by count (biggest first), and then alphabetically. If we pack each letter
+//into a single number like this:
+//
+//    key = (count << 5) | (25 - letter)
+//
+//then sorting the keys from biggest to smallest does both at once. The count
+//is in the high bits, so it matters most. When two counts are the same, the
+//low five bits decide, and since we flipped the letter around, 'a' (25) beats
+//'b' (24). Every key is different, so there's never a tie to worry about.
+//
+//We only need the top five, so we go through the keys once and keep a short
+//sorted list. Each new key slides in where it belongs and pushes the smallest
+//one off the end.
+void Calc_Chksum(const int *counts, char *chksum)
+{
+	uint32_t best[CHKSUM_LEN];
+	uint32_t key;
+	int numBest = 0;
+	int c, s;
+	
+	for (c = 0; c < NUM_LETTERS; c++)
+	{
+		key = ((uint32_t)counts[c] << 5) | (NUM_LETTERS - 1 - c);
+		if (numBest == CHKSUM_LEN && key <= best[CHKSUM_LEN - 1])
+			continue;
 		
-		max--;
+		if (numBest < CHKSUM_LEN)
+			numBest++;
+		for (s = numBest - 1; s > 0 && best[s - 1] < key; s--)
+		{
+			best[s] = best[s - 1];
+		}
+		best[s] = key;
+	}
+	
+	//Unpack the letters
+	for (s = 0; s < CHKSUM_LEN; s++)
+	{
+		chksum[s] = 'a' + (NUM_LETTERS - 1 - (best[s] & 0x1f));
 	}
 }
 
 
+//Helper function for error-checking malloc()
+void *Safe_Malloc(size_t size)
+{
+	void *retVal;
+	
+	retVal = malloc(size);
+	if (retVal == NULL)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	
+	return retVal;
+}
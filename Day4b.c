@@ -8,15 +8,9 @@
 //stored?
 //
 //To solve this puzzle, we have to decrypt the names of the valid rooms. This
-//means we now have to save the line of text. If we keep our assumption that a
-//line could be arbitrarily long, we have to read through each line to figure
-//out its length, then rewind to the start of the line, allocate memory for a
-//buffer, and then re-read the line into the buffer. Alternately, we could
-//allocate memory for the entire file at once. We already did that one Day 1,
-//so let's use the latter method to get some practice with memory management.
-//This will also give you an idea of how much work high-level languages can
-//do behind the scenes, whether you want them to or not! See, for instance:
-//http://stupidpythonideas.blogspot.com/2013/06/readlines-considered-silly.html
+//means we now have to save the line of text. Luckily, part A already reads the
+//file in blocks, so every line is sitting in the buffer when we check it. We
+//can decode the room names right there in the buffer.
 
 
 #include <stdio.h>
@@ -24,32 +18,65 @@
 #include <string.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #define NUM_LETTERS  26
 #define CHKSUM_LEN   5
 
+#define BLOCK_SIZE   65536
 
-void Decode_Room_Name(char *name, int id);
-void Calc_Chksum(int *counts, char *chksum, int numCounts, int chksumSize);
+//Decode_Room_Name() reads a little past the end of the name, so we leave this
+//much extra room at the end of the read buffer. It also limits how long the
+//word we're looking for can be.
+#define PADDING          64
+#define MAX_WORD_LENGTH  (PADDING - 32)
 
+//The name isn't const anymore, since we decode it in place
+typedef struct
+{
+	char *name;
+	size_t nameLength;
+	long id;
+	const char *chksum;
+} sRoom;
+
+
+bool Check_Rooms(char *text, size_t length, size_t *lineNumber, long *idSum);
+bool Parse_Room(char *line, size_t length, sRoom *room);
+void Count_Letters(const char *name, size_t length, int *counts);
+void Calc_Chksum(const int *counts, char *chksum);
+bool Decode_Room_Name(char *name, size_t length, long id, const char *word);
+void *Safe_Malloc(size_t size);
+
+
+//The helper functions are:
+//
+//    Check_Rooms()    Go through a buffer full of lines
+//    Parse_Room()     Split a line into its name, ID, and checksum
+//    Count_Letters()  Count how many times each letter appears
+//    Calc_Chksum()    Pick the five most common letters
+//    Decode_Room_Name()  Undo the shift cipher and look for a word
 int main(int argc, char **argv)
 {
 	FILE *inFile;
-	int counts[NUM_LETTERS];
-	char calcChksum[CHKSUM_LEN];
-	char *readChksum;
-	char *roomName;
-	int nextChar, lineLength, bufSize;
+	char *buffer;
+	size_t bufSize = BLOCK_SIZE;
+	size_t used = 0;
+	size_t bytes, end;
+	size_t lineNumber = 0;
+	bool atEnd;
 	long idSum = 0;
-	long id;
-
+	
 	//The usual command line argument check and input file opening
 	if (argc != 2)
 	{
 		fprintf(stderr, "Usage:\n\tDay4 <input filename>\n\n");
 		return EXIT_FAILURE;
 	}
-
+	
 	inFile = fopen(argv[1], "r");
 	if (inFile == NULL)
 	{
@@ -57,107 +84,48 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 	
-	//We still have to do the same tasks as before, but now we need to store
-	//the line text along the way. To do this, we're going to keep track of
-	//the current line's length and how much memory we've allocated. Whenever
-	//we run out of memory, we'll call realloc() to get more. The usual
-	//recommendation for realloc() is to round up to the next power of two when
-	//you need more memory, so let's do that. To show how it works, we'll start
-	//out with 2 bytes and print a message to stderr whenever we need more.
-	bufSize = 2;
-	roomName = malloc(bufSize * sizeof(char));
-	if (roomName == NULL)
-	{
-		fprintf(stderr, "Error allocating memory: %s\n\n", strerror(errno));
-		fclose(inFile);
-		return EXIT_FAILURE;
-	}
-	
-	//Now we can start the actual loop
-	nextChar = '\n';
+	buffer = Safe_Malloc(bufSize + PADDING);
 	do
 	{
-		if (nextChar == '\n')
-		{
-			//Reset everything on a new line. This time we also clear out our
-			//buffer and reset the line length.
-			memset(counts, 0, NUM_LETTERS * sizeof(int));
-			memset(calcChksum, '\0', CHKSUM_LEN * sizeof(char));
-			memset(roomName, '\0', bufSize * sizeof(char));
-			id = 0;
-			lineLength = 0;
-		} else if (nextChar >= 'a' && nextChar <= 'z')
-		{
-			//We don't need to save the checksum separately anymore
-			counts[nextChar - 'a']++;
-			
-			//Save the letters here. We'll handle the hyphens next.
-			roomName[lineLength-1] = (char)nextChar;
-		} else if (nextChar == '-')
-		{
-			roomName[lineLength-1] = ' ';
-		} else if (nextChar >= '0' && nextChar <= '9')
-		{
-			//There's no need to change the ID handling. Using strtol() would
-			//only complicate things.
-			id = 10*id + (nextChar - '0');
-		} else if (nextChar == '[')
-		{
-			//We're going to store the provided checksum in the same buffer as
-			//the room name. We'll split the buffer by writing a null character
-			//in place of a '['. We still need a separate pointer to pass to
-			//Calc_Chksum(). The buffer index will be the character after this
-			//one.
-			//
-			//Adding an index value to an array pointer produces a pointer to
-			//that array index. I've been using lineLength-1 for the current
-			//character, so I add one to that. Even though the -1 and the +1
-			//cancel out, I still like to write them out to be more clear about
-			//what I'm doing. The compiler optimizes it out for us.
-			readChksum = roomName + (lineLength-1) + 1;
-			roomName[lineLength - 1] = '\0';
-		} else if (nextChar == ']')
+		//Same as part A
+		bytes = fread(&buffer[used], 1, bufSize - used, inFile);
+		used += bytes;
+		atEnd = (used < bufSize);
+		
+		end = used;
+		if (!atEnd)
 		{
-			//No change to our checksum handling...
-			Calc_Chksum(counts, calcChksum, NUM_LETTERS, CHKSUM_LEN);
+			while (end > 0 && buffer[end - 1] != '\n')
+				end--;
 			
-			//...or the comparison.
-			if (strncmp(calcChksum, readChksum, CHKSUM_LEN) == 0)
+			if (end == 0)
 			{
-				idSum += id;
-
-				//We only want to decode and print valid room names that contain
-				//the word "north". To check for "north", we can use the
-				//hilariously-named strstr(). strstr() returns a pointer to the
-				//substring if it finds it or a null pointer if not.
-				Decode_Room_Name(roomName, id);
-				if (strstr(roomName, "north") != NULL)
-					printf("%s ID:%ld\n", roomName, id);
+				bufSize *= 2;
+				buffer = realloc(buffer, bufSize + PADDING);
+				if (buffer == NULL)
+				{
+					fprintf(stderr, "Error reallocating: %s\n\n",
+					                                           strerror(errno));
+					fclose(inFile);
+					return EXIT_FAILURE;
+				}
+				continue;
 			}
 		}
 		
-		//Here's where we handle the memory management. Before we read a new
-		//character, we increment the line length and check whether we need more
-		//buffer space. If we do, we call realloc() with the rounded up buffer
-		//size. There's no change to the existing data in the buffer.
-		lineLength++;
-		if (lineLength > bufSize)
+		if (!Check_Rooms(buffer, end, &lineNumber, &idSum))
 		{
-			bufSize *= 2;
-			if (realloc(roomName, bufSize * sizeof(char)) == NULL)
-			{
-				fprintf(stderr, "Error reallocating: %s\n\n", strerror(errno));
-				fclose(inFile);
-				free(roomName);
-				return EXIT_FAILURE;
-			}
-			
-			fprintf(stderr, "New buffer size: %d\n", bufSize);
+			free(buffer);
+			fclose(inFile);
+			return EXIT_FAILURE;
 		}
-	} while ((nextChar = fgetc(inFile)) != EOF);	
+		
+		memmove(buffer, &buffer[end], used - end);
+		used -= end;
+	} while (!atEnd);
 	
 	//Close the file and free the memory as soon as we're done with it
-	free(roomName);
+	free(buffer);
 	fclose(inFile);
 	
 	//Print the sum of the sector IDs
@@ -167,12 +135,271 @@ int main(int argc, char **argv)
 }
 
 
-//Decode the room name using the sector ID as the shift
-void Decode_Room_Name(char *name, int id)
+//Same as part A, but now we also decode the valid rooms
+bool Check_Rooms(char *text, size_t length, size_t *lineNumber, long *idSum)
 {
-	do
+	char *line = text;
+	char *textEnd = text + length;
+	char *newline;
+	size_t lineLength;
+	int counts[NUM_LETTERS];
+	char calcChksum[CHKSUM_LEN];
+	sRoom room;
+	
+	while (line < textEnd)
+	{
+		newline = memchr(line, '\n', textEnd - line);
+		if (newline == NULL)
+			newline = textEnd;
+		lineLength = newline - line;
+		(*lineNumber)++;
+		
+		if (lineLength > 0 && !(lineLength == 1 && line[0] == '\r'))
+		{
+			if (!Parse_Room(line, lineLength, &room))
+			{
+				fprintf(stderr, "Error: Can't understand line %zu: %.*s\n\n",
+				                           *lineNumber, (int)lineLength, line);
+				return false;
+			}
+			
+			Count_Letters(room.name, room.nameLength, counts);
+			Calc_Chksum(counts, calcChksum);
+			if (strncmp(calcChksum, room.chksum, CHKSUM_LEN) == 0)
+			{
+				*idSum += room.id;
+				
+				//We only want to print valid room names that contain the word
+				//"north". We used to decode the name and then search it with
+				//the hilariously-named strstr(), but Decode_Room_Name() can do
+				//both at once. To print the name, we write a null over the
+				//hyphen after the name. We've already read the ID, so we don't
+				//need the hyphen anymore.
+				if (Decode_Room_Name(room.name, room.nameLength, room.id,
+				                                                      "north"))
+				{
+					room.name[room.nameLength] = '\0';
+					printf("%s ID:%ld\n", room.name, room.id);
+				}
+			}
+		}
+		
+		line = newline + 1;
+	}
+	
+	return true;
+}
+
+
+//No change
+bool Parse_Room(char *line, size_t length, sRoom *room)
+{
+	size_t i, c;
+	
+	if (length > 0 && line[length - 1] == '\r')
+		length--;
+	
+	for (i = 0; i < length && (line[i] < '0' || line[i] > '9'); i++)
+	{
+		if ((line[i] < 'a' || line[i] > 'z') && line[i] != '-')
+			return false;
+	}
+	if (i == 0 || line[i - 1] != '-')
+		return false;
+	room->name = line;
+	room->nameLength = i - 1;
+	
+	room->id = 0;
+	for (; i < length && line[i] >= '0' && line[i] <= '9'; i++)
+	{
+		room->id = 10*room->id + (line[i] - '0');
+		if (room->id >= 1000000000)
+			return false;
+	}
+	
+	if (length - i != CHKSUM_LEN + 2 || line[i] != '[' ||
+	                                           line[length - 1] != ']')
+	{
+		return false;
+	}
+	room->chksum = &line[i + 1];
+	for (c = 0; c < CHKSUM_LEN; c++)
+	{
+		if (room->chksum[c] < 'a' || room->chksum[c] > 'z')
+			return false;
+	}
+	
+	return true;
+}
+
+
+//No change
+void Count_Letters(const char *name, size_t length, int *counts)
+{
+	size_t i;
+#ifdef __AVX2__
+	const __m256i alphabet = _mm256_setr_epi8('a', 'b', 'c', 'd', 'e', 'f',
+	                          'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p',
+	                          'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z',
+	                          0, 0, 0, 0, 0, 0);
+	__m256i total = _mm256_setzero_si256();
+	uint8_t bytes[32];
+	int c, run = 0;
+	
+	memset(counts, 0, NUM_LETTERS * sizeof(int));
+	for (i = 0; i < length; i++)
+	{
+		total = _mm256_sub_epi8(total,
+		               _mm256_cmpeq_epi8(alphabet, _mm256_set1_epi8(name[i])));
+		
+		if (++run == 255 || i == length - 1)
+		{
+			_mm256_storeu_si256((__m256i *)bytes, total);
+			for (c = 0; c < NUM_LETTERS; c++)
+			{
+				counts[c] += bytes[c];
+			}
+			total = _mm256_setzero_si256();
+			run = 0;
+		}
+	}
+#else
+	memset(counts, 0, NUM_LETTERS * sizeof(int));
+	for (i = 0; i < length; i++)
+	{
+		if (name[i] != '-')
+			counts[name[i] - 'a']++;
+	}
+#endif
+}
+
+
+//Decode the room name using the sector ID as the shift, and look for word in
+//the decoded name at the same time. Returns true if we find it.
+//
+//With AVX2, we decode 32 characters at a time. For each character, we work
+//out its offset from 'a', add the shift, and subtract 26 from anything that
+//went past 'z'. There's no division at all -- a compare makes a mask of the
+//characters that wrapped, and we subtract 26 only where the mask is set. The
+//hyphens turn into garbage along the way, so we make another mask of those and
+//swap in spaces.
+//
+//For the search, we use a trick from fast substring search code: look for
+//places where both the first and the last character of the word match. We
+//compare 32 positions against the first character, and the 32 positions four
+//characters later against the last character. Only positions where both match
+//are worth a full comparison, and they're rare. Better yet, we don't even need
+//the decoded text. The cipher just shifts letters around, so we can shift the
+//word the other way and look for that in the original text instead. That
+//means we can check each block before we overwrite it with the decoded
+//version, all in one pass.
+//
+//Near the end of the name, a 32-character load reads past it. That's fine
+//since the read buffer has some padding at the end (see main()). We can't
+//store past the end of the name, though, because the rest of the line is
+//there. So we blend the original text back into the part of the block after
+//the end of the name before storing it.
+bool Decode_Room_Name(char *name, size_t length, long id, const char *word)
+{
+	char encoded[MAX_WORD_LENGTH];
+	size_t wordLength = strlen(word);
+	size_t i, j;
+	int shift = id % NUM_LETTERS;
+	bool found = false;
+#ifdef __AVX2__
+	const __m256i lowA = _mm256_set1_epi8('a');
+	const __m256i hyphen = _mm256_set1_epi8('-');
+	const __m256i spaces = _mm256_set1_epi8(' ');
+	const __m256i shifts = _mm256_set1_epi8(shift);
+	const __m256i last = _mm256_set1_epi8(NUM_LETTERS - 1);
+	const __m256i wrap = _mm256_set1_epi8(NUM_LETTERS);
+	const __m256i positions = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9,
+	                           10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21,
+	                           22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+	__m256i firstChar, lastChar, text, ahead, offset, decoded, past;
+	uint32_t candidates;
+	size_t valid;
+	int bit;
+#endif
+	
+	//Encode the word with the opposite shift
+	if (wordLength == 0 || wordLength > MAX_WORD_LENGTH)
+		return false;
+	for (j = 0; j < wordLength; j++)
+	{
+		if (word[j] == ' ')
+			encoded[j] = '-';
+		else
+			encoded[j] = 'a' + (word[j] - 'a' + NUM_LETTERS - shift) %
+			                                                       NUM_LETTERS;
+	}
+	
+	i = 0;
+#ifdef __AVX2__
+	firstChar = _mm256_set1_epi8(encoded[0]);
+	lastChar = _mm256_set1_epi8(encoded[wordLength - 1]);
+	for (; i < length; i += 32)
+	{
+		text = _mm256_loadu_si256((const __m256i *)&name[i]);
+		ahead = _mm256_loadu_si256((const __m256i *)&name[i + wordLength - 1]);
+		
+		//The search. Only positions where the whole word fits in the name
+		//count.
+		if (!found && i + wordLength <= length)
+		{
+			candidates = _mm256_movemask_epi8(_mm256_and_si256(
+			                               _mm256_cmpeq_epi8(text, firstChar),
+			                               _mm256_cmpeq_epi8(ahead, lastChar)));
+			valid = length - wordLength + 1 - i;
+			if (valid < 32)
+				candidates &= (1u << valid) - 1;
+			
+			while (candidates != 0)
+			{
+				bit = __builtin_ctz(candidates);
+				if (memcmp(&name[i + bit], encoded, wordLength) == 0)
+				{
+					found = true;
+					break;
+				}
+				candidates &= candidates - 1;
+			}
+		}
+		
+		//The decoding
+		offset = _mm256_add_epi8(_mm256_sub_epi8(text, lowA), shifts);
+		offset = _mm256_sub_epi8(offset,
+		               _mm256_and_si256(wrap, _mm256_cmpgt_epi8(offset, last)));
+		decoded = _mm256_add_epi8(offset, lowA);
+		decoded = _mm256_blendv_epi8(decoded, spaces,
+		                                       _mm256_cmpeq_epi8(text, hyphen));
+		
+		//Put back anything past the end of the name
+		if (length - i < 32)
+		{
+			past = _mm256_cmpgt_epi8(positions,
+			                         _mm256_set1_epi8((char)(length - i - 1)));
+			decoded = _mm256_blendv_epi8(decoded, text, past);
+		}
+		_mm256_storeu_si256((__m256i *)&name[i], decoded);
+	}
+#else
+	//Without AVX2, do the same thing one character at a time. We still check
+	//each position before it gets decoded.
+	for (; i < length; i++)
 	{
-		if (*name != ' ')
+		if (!found && i + wordLength <= length &&
+		    name[i] == encoded[0] &&
+		    name[i + wordLength - 1] == encoded[wordLength - 1] &&
+		    memcmp(&name[i], encoded, wordLength) == 0)
+		{
+			found = true;
+		}
+		
+		if (name[i] == '-')
+		{
+			name[i] = ' ';
+		} else
 		{
 			//Any time you need to rotate through a list of numbers, you're
 			//going to use modulus division. This is no exception. The tricky
@@ -187,40 +414,56 @@ void Decode_Room_Name(char *name, int id)
 			//    newOffset = (oldOffset + id) % 26
 			//
 			//then add it to 'a' to get a letter.
-			*name = (((*name - 'a') + id) % 26) + 'a';
+			name[i] = (((name[i] - 'a') + shift) % 26) + 'a';
 		}
-		
-		//Move to the next character. Stop when we hit the null termination.
-		name++;
-	} while (*name != '\0');
+	}
+#endif
+	
+	return found;
 }
 
 
 //The checksum function is unchanged
-void Calc_Chksum(int *counts, char *chksum, int numCounts, int chksumSize)
+void Calc_Chksum(const int *counts, char *chksum)
 {
-	int max = 0, s = 0;
-	int c;
+	uint32_t best[CHKSUM_LEN];
+	uint32_t key;
+	int numBest = 0;
+	int c, s;
 	
-	for (c = 0; c < numCounts; c++)
+	for (c = 0; c < NUM_LETTERS; c++)
 	{
-		if (counts[c] > max)
-			max = counts[c];
+		key = ((uint32_t)counts[c] << 5) | (NUM_LETTERS - 1 - c);
+		if (numBest == CHKSUM_LEN && key <= best[CHKSUM_LEN - 1])
+			continue;
+		
+		if (numBest < CHKSUM_LEN)
+			numBest++;
+		for (s = numBest - 1; s > 0 && best[s - 1] < key; s--)
+		{
+			best[s] = best[s - 1];
+		}
+		best[s] = key;
 	}
 	
-	while (s < chksumSize)
+	for (s = 0; s < CHKSUM_LEN; s++)
 	{
-		for (c = 0; c < numCounts && s < chksumSize; c++)
-		{
-			if (counts[c] == max)
-			{
-				*chksum++ = 'a' + c;
-				s++;
-			}
-		}
-		
-		max--;
+		chksum[s] = 'a' + (NUM_LETTERS - 1 - (best[s] & 0x1f));
 	}
 }
 
 
+//Helper function for error-checking malloc()
+void *Safe_Malloc(size_t size)
+{
+	void *retVal;
+	
+	retVal = malloc(size);
+	if (retVal == NULL)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	
+	return retVal;
+}
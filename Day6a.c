@@ -13,82 +13,356 @@
 //
 //To solve this, we need to keep track of character counts, similar to what we
 //did on Day 4. This day is easy!
+//
+//It's so easy that we can afford to make it fast. Instead of assuming the
+//message is 8 letters long, we'll measure the first line and use that. Every
+//line is the same length, so we know exactly where each line starts without
+//reading the ones before it. That means we can hand each thread its own share
+//of the lines, let it count into its own private set of counts, and add them
+//all up at the end. The threads never have to wait for each other.
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 //We all know there are 26 letters, but it's still bad practice to put random
 //constants in your code.
 #define NUM_LETTERS  26
-#define MESSAGE_LEN   8
+
+//The counts have a spot for every possible character, not just the letters.
+//That way the counting loop doesn't need to check anything -- it just counts.
+//We check that everything was a letter afterward, when there are only a few
+//counts to look at instead of the whole file.
+#define NUM_CHARS   256
+
+//Below this many lines, it isn't worth starting threads
+#define MIN_THREADED_LINES  65536
+
+//Each thread counts a block of lines. The counts array has one row of NUM_CHARS
+//counts per column, plus a row for each character of the line ending.
+typedef struct
+{
+	const char *data;
+	size_t numLines;
+	int stride;
+	int numThreads, thread;
+	uint64_t *counts;
+} sCountWorker;
+
+
+bool Map_File(const char *fileName, const char **data, size_t *length);
+uint64_t *Count_Columns(const char *data, size_t length, int *width);
+void Find_Messages(const uint64_t *counts, int width, char *mostCommon,
+                   char *leastCommon);
+void *Safe_Malloc(size_t size);
+void *Safe_Calloc(size_t count, size_t size);
 
 
+//The helper functions are:
+//
+//    Map_File()       Map the input file into memory
+//    Count_Columns()  Count the characters in each column, using threads
+//    Find_Messages()  Pick out the most and least common letters
 int main(int argc, char **argv)
 {
-	//The message length buffer needs to hold both the newline and the null
-	//terminator in addition to the message. If we wanted to, we could 
-	FILE *inFile;
-	int counts[MESSAGE_LEN][NUM_LETTERS];
-	char line[MESSAGE_LEN + 2];
-	char message[MESSAGE_LEN+1];
-	int c, l, maxCount;
-	
-	//Clear all the arrays
-	memset(counts, 0, MESSAGE_LEN * NUM_LETTERS * sizeof(int));
-	memset(line, '\0', MESSAGE_LEN + 2);
-	memset(message, '\0', MESSAGE_LEN + 1);
-
-	//The usual command line argument check and input file opening
+	const char *data;
+	size_t length;
+	uint64_t *counts;
+	char *mostCommon, *leastCommon;
+	int width;
+	
+	//The usual command line argument check
 	if (argc != 2)
 	{
 		fprintf(stderr, "Usage:\n\tDay6 <input filename>\n\n");
 		return EXIT_FAILURE;
 	}
+	
+	//Map the file into memory, like we did on Day 1, and count the letters
+	if (!Map_File(argv[1], &data, &length))
+		return EXIT_FAILURE;
+	counts = Count_Columns(data, length, &width);
+	if (length > 0)
+		munmap((void *)data, length);
+	if (counts == NULL)
+		return EXIT_FAILURE;
+	
+	//Find the message. We get the least common letters for free along the way,
+	//which we don't need yet. The message length buffers need to hold the null
+	//terminator in addition to the message.
+	mostCommon = Safe_Malloc(width + 1);
+	leastCommon = Safe_Malloc(width + 1);
+	Find_Messages(counts, width, mostCommon, leastCommon);
+	
+	//Print the message
+	printf("%s\n", mostCommon);
+	
+	free(counts);
+	free(mostCommon);
+	free(leastCommon);
+	
+	return EXIT_SUCCESS;
+}
 
-	inFile = fopen(argv[1], "r");
-	if (inFile == NULL)
+
+//Map the whole file into memory. An empty file can't be mapped, so we just
+//return a length of zero for it.
+bool Map_File(const char *fileName, const char **data, size_t *length)
+{
+	struct stat fileInfo;
+	int fd;
+	
+	fd = open(fileName, O_RDONLY);
+	if (fd < 0)
 	{
 		fprintf(stderr, "Error opening file: %s\n\n", strerror(errno));
-		return EXIT_FAILURE;
+		return false;
 	}
+	
+	if (fstat(fd, &fileInfo) != 0)
+	{
+		fprintf(stderr, "Error reading file: %s\n\n", strerror(errno));
+		close(fd);
+		return false;
+	}
+	*length = (size_t)fileInfo.st_size;
+	
+	*data = NULL;
+	if (*length > 0)
+	{
+		*data = mmap(NULL, *length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (*data == MAP_FAILED)
+		{
+			fprintf(stderr, "Error mapping file: %s\n\n", strerror(errno));
+			close(fd);
+			return false;
+		}
+		madvise((void *)*data, *length, MADV_SEQUENTIAL);
+	}
+	close(fd);
+	
+	return true;
+}
+
 
-	//Read the lines one at a time and count the letters
-	while (fgets(line, MESSAGE_LEN+1, inFile) != NULL)
+//Count one thread's block of lines. The counts are stored in a 2D array. The
+//first dimension is the position within the line. The second dimension is the
+//character.
+static void *Count_Worker(void *arg)
+{
+	sCountWorker *worker = arg;
+	const char *line;
+	size_t first, end, blockSize, i;
+	int stride = worker->stride;
+	int c;
+	
+	blockSize = (worker->numLines + worker->numThreads - 1) /
+	                                                        worker->numThreads;
+	first = blockSize * worker->thread;
+	end = first + blockSize;
+	if (first > worker->numLines)
+		first = worker->numLines;
+	if (end > worker->numLines)
+		end = worker->numLines;
+	
+	worker->counts = Safe_Calloc(stride * NUM_CHARS, sizeof(uint64_t));
+	for (i = first; i < end; i++)
 	{
-		for (c = 0; c < MESSAGE_LEN; c++)
+		line = &worker->data[i * stride];
+		for (c = 0; c < stride; c++)
 		{
-			//The counts are stored in a 2D array. The first dimension is the
-			//position within the message. The second dimension is the letter.
-			//To get the letter offset, we can subtract the ASCII value of 'a'
-			//from the line character.
-			counts[c][line[c] - 'a']++;
+			worker->counts[c*NUM_CHARS + (unsigned char)line[c]]++;
 		}
 	}
 	
-	//Close the file as soon as we're done with it
-	fclose(inFile);
+	return NULL;
+}
+
+
+//Count the characters in each column of the file. The width of the message is
+//the length of the first line. Returns the counts (which the caller has to
+//free), or NULL if the lines aren't all the same length or there's something
+//besides lowercase letters in them.
+uint64_t *Count_Columns(const char *data, size_t length, int *width)
+{
+	sCountWorker *workers;
+	pthread_t *threads;
+	uint64_t *counts;
+	const char *newline, *ending;
+	size_t numLines, leftover, i;
+	int numThreads, stride, t, c, ch;
+	
+	//Measure the first line. If there's no newline at all, the whole file is
+	//one line. Lines can end in "\r\n" instead of just '\n', and then the
+	//'\r' isn't part of the message either.
+	newline = (length > 0) ? memchr(data, '\n', length) : NULL;
+	*width = (newline == NULL) ? (int)length : (int)(newline - data);
+	ending = "\n";
+	if (*width > 0 && data[*width - 1] == '\r')
+	{
+		ending = "\r\n";
+		(*width)--;
+	}
+	stride = *width + strlen(ending);
+	numLines = length / stride;
+	
+	//The last line is allowed to be missing its line ending, or just the '\n'
+	//of a "\r\n". Either way, we count it as if the whole ending were there.
+	//Anything else left over means the lines aren't all the same length.
+	leftover = length % stride;
+	if (leftover == (size_t)*width + 1 && data[length - 1] == '\r')
+		leftover = *width;
+	if (leftover != 0 && leftover != (size_t)*width)
+	{
+		fprintf(stderr, "Error: Every line should be %d letters long\n\n",
+		                                                               *width);
+		return NULL;
+	}
+	
+	numThreads = 1;
+	if (numLines >= MIN_THREADED_LINES)
+		numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (numThreads < 1)
+		numThreads = 1;
 	
-	//Find the most common letters by iterating over the count array, looking
-	//for the maximum counts.
-	for (c = 0; c < MESSAGE_LEN; c++)
+	workers = Safe_Malloc(numThreads * sizeof(sCountWorker));
+	threads = Safe_Malloc(numThreads * sizeof(pthread_t));
+	for (t = 0; t < numThreads; t++)
 	{
-		maxCount = 0;
-		for (l = 0; l < NUM_LETTERS; l++)
+		workers[t] = (sCountWorker){data, numLines, stride, numThreads, t,
+		                                                                 NULL};
+		
+		//Thread 0 is the current thread
+		if (t > 0 && pthread_create(&threads[t], NULL, Count_Worker,
+		                                                      &workers[t]) != 0)
 		{
-			if (counts[c][l] > maxCount)
+			fprintf(stderr, "Error creating thread\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	Count_Worker(&workers[0]);
+	for (t = 1; t < numThreads; t++)
+	{
+		pthread_join(threads[t], NULL);
+	}
+	
+	//Add everything up in the first thread's counts
+	counts = workers[0].counts;
+	for (t = 1; t < numThreads; t++)
+	{
+		for (i = 0; i < (size_t)stride * NUM_CHARS; i++)
+		{
+			counts[i] += workers[t].counts[i];
+		}
+		free(workers[t].counts);
+	}
+	free(threads);
+	free(workers);
+	
+	//Count the last line if it didn't have a line ending
+	if (leftover != 0)
+	{
+		for (c = 0; c < *width; c++)
+		{
+			counts[c*NUM_CHARS + (unsigned char)data[numLines*stride + c]]++;
+		}
+		for (c = *width; c < stride; c++)
+		{
+			counts[c*NUM_CHARS + (unsigned char)ending[c - *width]]++;
+		}
+	}
+	
+	//Now make sure the letter columns only have letters and the last columns
+	//only have the line ending
+	for (c = 0; c < stride; c++)
+	{
+		for (ch = 0; ch < NUM_CHARS; ch++)
+		{
+			if (counts[c*NUM_CHARS + ch] == 0)
+				continue;
+			if ((c < *width && (ch < 'a' || ch > 'z')) ||
+			    (c >= *width && ch != ending[c - *width]))
 			{
-				maxCount = counts[c][l];
-				
-				//The last character we write will be the correct one
-				message[c] = 'a' + l;
+				fprintf(stderr, "Error: Unexpected character 0x%02x in "
+				                                  "column %d\n\n", ch, c + 1);
+				free(counts);
+				return NULL;
 			}
 		}
 	}
 	
-	//Print the message
-	printf("%s\n", message);
+	return counts;
+}
+
+
+//Find the most and least common letters in each column by iterating over the
+//count array, looking for the maximum and minimum counts. Both come from the
+//same pass. Ties go to the letter that comes first in the alphabet.
+void Find_Messages(const uint64_t *counts, int width, char *mostCommon,
+                   char *leastCommon)
+{
+	const uint64_t *column;
+	uint64_t maxCount, minCount;
+	int c, l;
 	
-	return EXIT_SUCCESS;
+	for (c = 0; c < width; c++)
+	{
+		column = &counts[c*NUM_CHARS + 'a'];
+		mostCommon[c] = leastCommon[c] = 'a';
+		maxCount = minCount = column[0];
+		for (l = 1; l < NUM_LETTERS; l++)
+		{
+			if (column[l] > maxCount)
+			{
+				maxCount = column[l];
+				mostCommon[c] = 'a' + l;
+			}
+			if (column[l] < minCount)
+			{
+				minCount = column[l];
+				leastCommon[c] = 'a' + l;
+			}
+		}
+	}
+	mostCommon[width] = leastCommon[width] = '\0';
+}
+
+
+//Helper function for error-checking malloc()
+void *Safe_Malloc(size_t size)
+{
+	void *retVal;
+	
+	retVal = malloc(size);
+	if (retVal == NULL)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	
+	return retVal;
+}
+
+
+//The same thing for calloc(), which also clears the memory
+void *Safe_Calloc(size_t count, size_t size)
+{
+	void *retVal;
+	
+	retVal = calloc(count, size);
+	if (retVal == NULL)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	
+	return retVal;
 }
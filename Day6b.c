@@ -4,74 +4,318 @@
 //the most common, what is the message?
 //
 //To solve this, we simply look for the minimum counts instead of the maximum.
+//Part A already finds both, so all we have to change is which one we print.
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
-#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-//We all know there are 26 letters, but it's still bad practice to put random
-//constants in your code.
 #define NUM_LETTERS  26
-#define MESSAGE_LEN   8
+#define NUM_CHARS   256
+#define MIN_THREADED_LINES  65536
 
+//No change
+typedef struct
+{
+	const char *data;
+	size_t numLines;
+	int stride;
+	int numThreads, thread;
+	uint64_t *counts;
+} sCountWorker;
+
+
+bool Map_File(const char *fileName, const char **data, size_t *length);
+uint64_t *Count_Columns(const char *data, size_t length, int *width);
+void Find_Messages(const uint64_t *counts, int width, char *mostCommon,
+                   char *leastCommon);
+void *Safe_Malloc(size_t size);
+void *Safe_Calloc(size_t count, size_t size);
 
+
+//The helper functions are:
+//
+//    Map_File()       Map the input file into memory
+//    Count_Columns()  Count the characters in each column, using threads
+//    Find_Messages()  Pick out the most and least common letters
 int main(int argc, char **argv)
 {
-	//Just a variable name change
-	FILE *inFile;
-	int counts[MESSAGE_LEN][NUM_LETTERS];
-	char line[MESSAGE_LEN + 2];
-	char message[MESSAGE_LEN+1];
-	int c, l, minCount;
+	const char *data;
+	size_t length;
+	uint64_t *counts;
+	char *mostCommon, *leastCommon;
+	int width;
 	
-	memset(counts, 0, MESSAGE_LEN * NUM_LETTERS * sizeof(int));
-	memset(line, '\0', MESSAGE_LEN + 2);
-	memset(message, '\0', MESSAGE_LEN + 1);
-
+	//The usual command line argument check
 	if (argc != 2)
 	{
 		fprintf(stderr, "Usage:\n\tDay6 <input filename>\n\n");
 		return EXIT_FAILURE;
 	}
+	
+	//The counts work the same way
+	if (!Map_File(argv[1], &data, &length))
+		return EXIT_FAILURE;
+	counts = Count_Columns(data, length, &width);
+	if (length > 0)
+		munmap((void *)data, length);
+	if (counts == NULL)
+		return EXIT_FAILURE;
+	
+	//This time we want the least common letters
+	mostCommon = Safe_Malloc(width + 1);
+	leastCommon = Safe_Malloc(width + 1);
+	Find_Messages(counts, width, mostCommon, leastCommon);
+	
+	printf("%s\n", leastCommon);
+	
+	free(counts);
+	free(mostCommon);
+	free(leastCommon);
+	
+	return EXIT_SUCCESS;
+}
+
 
-	inFile = fopen(argv[1], "r");
-	if (inFile == NULL)
+//No change
+bool Map_File(const char *fileName, const char **data, size_t *length)
+{
+	struct stat fileInfo;
+	int fd;
+	
+	fd = open(fileName, O_RDONLY);
+	if (fd < 0)
 	{
 		fprintf(stderr, "Error opening file: %s\n\n", strerror(errno));
-		return EXIT_FAILURE;
+		return false;
+	}
+	
+	if (fstat(fd, &fileInfo) != 0)
+	{
+		fprintf(stderr, "Error reading file: %s\n\n", strerror(errno));
+		close(fd);
+		return false;
 	}
+	*length = (size_t)fileInfo.st_size;
+	
+	*data = NULL;
+	if (*length > 0)
+	{
+		*data = mmap(NULL, *length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (*data == MAP_FAILED)
+		{
+			fprintf(stderr, "Error mapping file: %s\n\n", strerror(errno));
+			close(fd);
+			return false;
+		}
+		madvise((void *)*data, *length, MADV_SEQUENTIAL);
+	}
+	close(fd);
+	
+	return true;
+}
 
-	//The counts work the same way
-	while (fgets(line, MESSAGE_LEN+1, inFile) != NULL)
+
+//No change
+static void *Count_Worker(void *arg)
+{
+	sCountWorker *worker = arg;
+	const char *line;
+	size_t first, end, blockSize, i;
+	int stride = worker->stride;
+	int c;
+	
+	blockSize = (worker->numLines + worker->numThreads - 1) /
+	                                                        worker->numThreads;
+	first = blockSize * worker->thread;
+	end = first + blockSize;
+	if (first > worker->numLines)
+		first = worker->numLines;
+	if (end > worker->numLines)
+		end = worker->numLines;
+	
+	worker->counts = Safe_Calloc(stride * NUM_CHARS, sizeof(uint64_t));
+	for (i = first; i < end; i++)
+	{
+		line = &worker->data[i * stride];
+		for (c = 0; c < stride; c++)
+		{
+			worker->counts[c*NUM_CHARS + (unsigned char)line[c]]++;
+		}
+	}
+	
+	return NULL;
+}
+
+
+//No change
+uint64_t *Count_Columns(const char *data, size_t length, int *width)
+{
+	sCountWorker *workers;
+	pthread_t *threads;
+	uint64_t *counts;
+	const char *newline, *ending;
+	size_t numLines, leftover, i;
+	int numThreads, stride, t, c, ch;
+	
+	newline = (length > 0) ? memchr(data, '\n', length) : NULL;
+	*width = (newline == NULL) ? (int)length : (int)(newline - data);
+	ending = "\n";
+	if (*width > 0 && data[*width - 1] == '\r')
+	{
+		ending = "\r\n";
+		(*width)--;
+	}
+	stride = *width + strlen(ending);
+	numLines = length / stride;
+	
+	leftover = length % stride;
+	if (leftover == (size_t)*width + 1 && data[length - 1] == '\r')
+		leftover = *width;
+	if (leftover != 0 && leftover != (size_t)*width)
+	{
+		fprintf(stderr, "Error: Every line should be %d letters long\n\n",
+		                                                               *width);
+		return NULL;
+	}
+	
+	numThreads = 1;
+	if (numLines >= MIN_THREADED_LINES)
+		numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (numThreads < 1)
+		numThreads = 1;
+	
+	workers = Safe_Malloc(numThreads * sizeof(sCountWorker));
+	threads = Safe_Malloc(numThreads * sizeof(pthread_t));
+	for (t = 0; t < numThreads; t++)
+	{
+		workers[t] = (sCountWorker){data, numLines, stride, numThreads, t,
+		                                                                 NULL};
+		
+		if (t > 0 && pthread_create(&threads[t], NULL, Count_Worker,
+		                                                      &workers[t]) != 0)
+		{
+			fprintf(stderr, "Error creating thread\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	Count_Worker(&workers[0]);
+	for (t = 1; t < numThreads; t++)
+	{
+		pthread_join(threads[t], NULL);
+	}
+	
+	counts = workers[0].counts;
+	for (t = 1; t < numThreads; t++)
 	{
-		for (c = 0; c < MESSAGE_LEN; c++)
+		for (i = 0; i < (size_t)stride * NUM_CHARS; i++)
 		{
-			counts[c][line[c] - 'a']++;
+			counts[i] += workers[t].counts[i];
 		}
+		free(workers[t].counts);
 	}
+	free(threads);
+	free(workers);
 	
-	fclose(inFile);
+	if (leftover != 0)
+	{
+		for (c = 0; c < *width; c++)
+		{
+			counts[c*NUM_CHARS + (unsigned char)data[numLines*stride + c]]++;
+		}
+		for (c = *width; c < stride; c++)
+		{
+			counts[c*NUM_CHARS + (unsigned char)ending[c - *width]]++;
+		}
+	}
 	
-	//Instead of looking for the maximum counts, we look for the minimum counts.
-	for (c = 0; c < MESSAGE_LEN; c++)
+	for (c = 0; c < stride; c++)
 	{
-		minCount = INT_MAX;
-		for (l = 0; l < NUM_LETTERS; l++)
+		for (ch = 0; ch < NUM_CHARS; ch++)
 		{
-			if (counts[c][l] < minCount)
+			if (counts[c*NUM_CHARS + ch] == 0)
+				continue;
+			if ((c < *width && (ch < 'a' || ch > 'z')) ||
+			    (c >= *width && ch != ending[c - *width]))
 			{
-				minCount = counts[c][l];
-				
-				//The last character we write will be the correct one
-				message[c] = 'a' + l;
+				fprintf(stderr, "Error: Unexpected character 0x%02x in "
+				                                  "column %d\n\n", ch, c + 1);
+				free(counts);
+				return NULL;
 			}
 		}
 	}
 	
-	//Print the message
-	printf("%s\n", message);
+	return counts;
+}
+
+
+//No change
+void Find_Messages(const uint64_t *counts, int width, char *mostCommon,
+                   char *leastCommon)
+{
+	const uint64_t *column;
+	uint64_t maxCount, minCount;
+	int c, l;
 	
-	return EXIT_SUCCESS;
+	for (c = 0; c < width; c++)
+	{
+		column = &counts[c*NUM_CHARS + 'a'];
+		mostCommon[c] = leastCommon[c] = 'a';
+		maxCount = minCount = column[0];
+		for (l = 1; l < NUM_LETTERS; l++)
+		{
+			if (column[l] > maxCount)
+			{
+				maxCount = column[l];
+				mostCommon[c] = 'a' + l;
+			}
+			if (column[l] < minCount)
+			{
+				minCount = column[l];
+				leastCommon[c] = 'a' + l;
+			}
+		}
+	}
+	mostCommon[width] = leastCommon[width] = '\0';
+}
+
+
+//Helper function for error-checking malloc()
+void *Safe_Malloc(size_t size)
+{
+	void *retVal;
+	
+	retVal = malloc(size);
+	if (retVal == NULL)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	
+	return retVal;
+}
+
+
+//The same thing for calloc(), which also clears the memory
+void *Safe_Calloc(size_t count, size_t size)
+{
+	void *retVal;
+	
+	retVal = calloc(count, size);
+	if (retVal == NULL)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	
+	return retVal;
 }
@@ -36,6 +36,19 @@
 //
 //Just for fun, let's use some simple object-oriented techniques to make
 //something more reusable.
+//
+//The shift register is nice and simple, but going one character at a time
+//doesn't make the most of a modern CPU. So most of the work is now done by
+//reading in each line and checking 32 positions at a time with AVX2. The shift
+//register still handles the last few characters of each line (and everything,
+//if we don't have AVX2).
+//
+//Even that is one thread reading one line at a time, and some address lists
+//are a lot longer than our input. The addresses don't depend on each other, so
+//the file gets mapped into memory and cut into one shard per thread. Each
+//thread counts the matching addresses in its own shard, and we add up the
+//counts at the end. The cuts are moved forward to the next newline, so no
+//address gets split between two threads.
 
 
 #include <stdio.h>
@@ -43,13 +56,33 @@
 #include <string.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 //Internal structure. User code will only interact with this through functions
 //and an opaque pointer type.
+//
+//The first version moved every character forward on each shift, which takes
+//longer the bigger the register is. Instead, we can leave the characters where
+//they are and move the start of the register. The data array is a circular
+//buffer: element 0 is at index start, element 1 is at start + 1, and so on,
+//wrapping around at the end. If the array size is a power of two, wrapping
+//around is just a bitwise AND with size - 1, which is much cheaper than a
+//modulus. So a shift or a read takes the same (short) time no matter how big
+//the register is.
 struct sShiftRegister
 {
 	char *data;
 	size_t size;
+	size_t mask;
+	size_t start;
 };
 
 //Opaque type that gets passed to the functions. This sort of thing is sometimes
@@ -57,14 +90,20 @@ struct sShiftRegister
 typedef struct sShiftRegister *SR_Handle;
 
 //"Constructor". Allocates memory for an sShiftRegister structure along with the
-//actual data. The register data is initialized to all zeros.
+//actual data. The register data is initialized to all zeros. The data array is
+//rounded up to a power of two.
 SR_Handle SR_Construct(size_t numElements)
 {
 	SR_Handle newSR;
-
+	size_t capacity;
+	
 	if (numElements == 0)
 		return NULL;
-
+	
+	capacity = 1;
+	while (capacity < numElements)
+		capacity <<= 1;
+	
 	newSR = malloc(sizeof(struct sShiftRegister));
 	if (newSR == NULL)
 	{
@@ -72,25 +111,27 @@ SR_Handle SR_Construct(size_t numElements)
 	} else
 	{
 		newSR->size = numElements;
-		newSR->data = malloc(numElements);
+		newSR->mask = capacity - 1;
+		newSR->start = 0;
+		newSR->data = malloc(capacity);
 		if (newSR->data == NULL)
 		{
 			free(newSR);
 			return NULL;
 		} else
 		{
-			memset(newSR->data, 0, numElements);
+			memset(newSR->data, 0, capacity);
 			return newSR;
 		}
 	}
 }
 
-//Perform a shift operation. This returns a character from the start of the data
-//array, shifts the other characters to make room at the end, then writes the
-//new character to the end.
+//Perform a shift operation. This returns the character at the start of the
+//register, then writes the new character just past the end and moves the start
+//forward one space. If the array is exactly the size of the register, the new
+//character lands right where the old one was.
 char SR_Shift(SR_Handle sr, char in)
 {
-	size_t c;
 	char out;
 	
 	//We're not being very defensive in these exercises, so this seems like a
@@ -99,17 +140,12 @@ char SR_Shift(SR_Handle sr, char in)
 		return '\0';
 	
 	//Save the output character
-	out = sr->data[0];
+	out = sr->data[sr->start];
 	
-	//Shift all the other characters forward one space
-	for (c = 0; c < sr->size - 1; c++)
-	{
-		sr->data[c] = sr->data[c+1];
-	}
-
-	//Write the new character to the end of the data array and return the
-	//output character.
-	sr->data[sr->size - 1] = in;
+	//Write the new character to the end of the register and return the output
+	//character
+	sr->data[(sr->start + sr->size) & sr->mask] = in;
+	sr->start = (sr->start + 1) & sr->mask;
 	return out;
 }
 
@@ -119,7 +155,7 @@ char SR_Read(SR_Handle sr, size_t element)
 	//Basic error handling. Theoretically we could combine the null check and
 	//the size check into a single if statement:
 	//
-	//if (sr == NULL || element > sr->size)
+	//if (sr == NULL || element >= sr->size)
 	//
 	//C's short-circuiting behavior should guarantee that sr is never
 	//dereferenced if it's null. But getting sloppy about null pointer
@@ -128,11 +164,21 @@ char SR_Read(SR_Handle sr, size_t element)
 	if (sr == NULL)
 		return '\0';
 		
-	if (element > sr->size)
+	if (element >= sr->size)
 		return '\0';
 		
 	//Read and return the data element
-	return sr->data[element];
+	return sr->data[(sr->start + element) & sr->mask];
+}
+
+//Set every element back to zero
+void SR_Clear(SR_Handle sr)
+{
+	if (sr == NULL)
+		return;
+	
+	memset(sr->data, 0, sr->mask + 1);
+	sr->start = 0;
 }
 
 //"Destructor". Frees allocated memory for both the data and the structure.
@@ -145,89 +191,335 @@ void SR_Destruct(SR_Handle sr)
 }
 
 
-//With our new shift register type defined, we can move on to main()
+//Below this much input, it isn't worth starting threads
+#define MIN_THREADED_LENGTH  (1 << 20)
+
+//Each thread counts the matching addresses between start and end. Those are
+//always the start of a line (or the end of the file).
+typedef struct
+{
+	const char *data;
+	size_t start, end;
+	size_t count;
+} sCountWorker;
+
+
+bool Supports_TLS(SR_Handle sr, const char *line, size_t length);
+bool Map_File(const char *fileName, const char **data, size_t *length);
+size_t Count_Addresses(const char *data, size_t length, int numThreads);
+void *Safe_Malloc(size_t size);
+
+
+//With our new shift register type defined, we can move on to main(). The helper
+//functions are:
+//
+//    Map_File()         Map the input file into memory
+//    Count_Addresses()  Count the addresses that support TLS, using threads
+//    Supports_TLS()     Check a single address
 int main(int argc, char **argv)
 {
-	//For lack of better terms, I'll call an ABBA sequence outside of square
-	//brackets a "match" and an ABBA sequence inside square brackets a "fail".
-	FILE *inFile;
+	const char *data;
+	size_t length, addrCount;
+	int numThreads;
+	
+	//The usual command line argument check. There's also an optional argument
+	//to run everything on one thread, which is handy for checking the threaded
+	//version against.
+	if (argc != 2 && (argc != 3 || strcmp(argv[2], "serial") != 0))
+	{
+		fprintf(stderr, "Usage:\n\tDay7 <input filename> [serial]\n\n");
+		return EXIT_FAILURE;
+	}
+	
+	//Small files don't get threads, even when they're allowed
+	numThreads = 1;
+	if (argc == 2)
+		numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (numThreads < 1)
+		numThreads = 1;
+	
+	//Map the file into memory, like we did on Day 6, and count the addresses
+	if (!Map_File(argv[1], &data, &length))
+		return EXIT_FAILURE;
+	addrCount = Count_Addresses(data, length, numThreads);
+	if (length > 0)
+		munmap((void *)data, length);
+	
+	//Print the number of matches
+	printf("Matching addresses: %zu\n", addrCount);
+	
+	return EXIT_SUCCESS;
+}
+
+
+//Map the whole file into memory. An empty file can't be mapped, so we just
+//return a length of zero for it.
+bool Map_File(const char *fileName, const char **data, size_t *length)
+{
+	struct stat fileInfo;
+	int fd;
+	
+	fd = open(fileName, O_RDONLY);
+	if (fd < 0)
+	{
+		fprintf(stderr, "Error opening file: %s\n\n", strerror(errno));
+		return false;
+	}
+	
+	if (fstat(fd, &fileInfo) != 0)
+	{
+		fprintf(stderr, "Error reading file: %s\n\n", strerror(errno));
+		close(fd);
+		return false;
+	}
+	*length = (size_t)fileInfo.st_size;
+	
+	*data = NULL;
+	if (*length > 0)
+	{
+		*data = mmap(NULL, *length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (*data == MAP_FAILED)
+		{
+			fprintf(stderr, "Error mapping file: %s\n\n", strerror(errno));
+			close(fd);
+			return false;
+		}
+		madvise((void *)*data, *length, MADV_SEQUENTIAL);
+	}
+	close(fd);
+	
+	return true;
+}
+
+
+//Count the matching addresses in one thread's shard. Every thread needs its
+//own shift register, since the register holds the state of the current line.
+static void *Count_Worker(void *arg)
+{
+	sCountWorker *worker = arg;
 	SR_Handle sr;
-	int next, addrCount;
-	bool match, fail, inBrackets;
+	const char *line, *newline;
+	size_t pos, length;
 	
-	//Create a shift register with four elements
 	sr = SR_Construct(4);
 	if (sr == NULL)
 	{
 		fprintf(stderr, "Error creating shift register\n\n");
-		return EXIT_FAILURE;
+		exit(EXIT_FAILURE);
 	}
 	
-	//The usual command line argument check and input file opening
-	if (argc != 2)
+	//The newline isn't part of the address. The last line of the file might
+	//not have one.
+	worker->count = 0;
+	for (pos = worker->start; pos < worker->end; pos += length + 1)
 	{
-		fprintf(stderr, "Usage:\n\tDay7 <input filename>\n\n");
-		return EXIT_FAILURE;
+		line = &worker->data[pos];
+		newline = memchr(line, '\n', worker->end - pos);
+		if (newline == NULL)
+			length = worker->end - pos;
+		else
+			length = newline - line;
+		
+		if (Supports_TLS(sr, line, length))
+			worker->count++;
 	}
+	
+	SR_Destruct(sr);
+	return NULL;
+}
 
-	inFile = fopen(argv[1], "r");
-	if (inFile == NULL)
-	{
-		fprintf(stderr, "Error opening file: %s\n\n", strerror(errno));
-		return EXIT_FAILURE;
-	}
 
-	//Set up for the main loop
-	addrCount = 0;
-	match = false;
-	fail = false;
-	inBrackets = false;
+//Split the file into shards and count the matching addresses in each one. Each
+//shard starts out as an even share of the file, then the boundary moves forward
+//to just past the next newline. If a line is longer than a whole shard, some
+//shards end up empty, which is fine.
+size_t Count_Addresses(const char *data, size_t length, int numThreads)
+{
+	sCountWorker *workers;
+	pthread_t *threads;
+	const char *newline;
+	size_t boundary, total;
+	int t;
 	
-	//Read characters one at a time
-	while ((next = fgetc(inFile)) != EOF)
+	if (length < MIN_THREADED_LENGTH)
+		numThreads = 1;
+	
+	workers = Safe_Malloc(numThreads * sizeof(sCountWorker));
+	threads = Safe_Malloc(numThreads * sizeof(pthread_t));
+	boundary = 0;
+	for (t = 0; t < numThreads; t++)
 	{
-		//Shift the new character into the register
-		SR_Shift(sr, next);
+		workers[t].data = data;
+		workers[t].start = boundary;
+		
+		if (t == numThreads - 1)
+		{
+			boundary = length;
+		} else if (length / numThreads * (t + 1) > boundary)
+		{
+			boundary = length / numThreads * (t + 1);
+			newline = memchr(&data[boundary], '\n', length - boundary);
+			if (newline == NULL)
+				boundary = length;
+			else
+				boundary = newline - data + 1;
+		}
+		workers[t].end = boundary;
+	}
 	
-		//Determine the final status of the address and reset the booleans on a
-		//newline.
-		if (next == '\n')
+	//Thread 0 is the current thread
+	for (t = 1; t < numThreads; t++)
+	{
+		if (pthread_create(&threads[t], NULL, Count_Worker, &workers[t]) != 0)
 		{
-			if (match && !fail)
-				addrCount++;
-			
-			match = false;
-			fail = false;
+			fprintf(stderr, "Error creating thread\n");
+			exit(EXIT_FAILURE);
 		}
+	}
+	Count_Worker(&workers[0]);
+	total = workers[0].count;
+	for (t = 1; t < numThreads; t++)
+	{
+		pthread_join(threads[t], NULL);
+		total += workers[t].count;
+	}
+	
+	free(threads);
+	free(workers);
+	return total;
+}
+
+
+#ifdef __AVX2__
+//Turn a mask of bracket positions into a mask of positions inside brackets.
+//Each bit of the result is the XOR of that bit and all the bits below it, so it
+//flips on at every '[' and back off at every ']'. Shifting and XORing in steps
+//of 1, 2, 4, 8, and 16 bits adds up all 32 positions in five steps.
+static inline uint32_t Prefix_XOR(uint32_t x)
+{
+	x ^= x << 1;
+	x ^= x << 2;
+	x ^= x << 4;
+	x ^= x << 8;
+	x ^= x << 16;
+	
+	return x;
+}
+#endif
+
+
+//Check whether an address has an ABBA sequence outside of brackets and none
+//inside. For lack of better terms, I'll call an ABBA sequence outside of square
+//brackets a "match" and an ABBA sequence inside square brackets a "fail".
+//
+//With AVX2, we load the 32 characters starting at i, and the 32 characters
+//starting at i + 1, i + 2, and i + 3. Lined up like that, byte k of each load
+//is one character of the sequence starting at i + k, so three compares check
+//all 32 sequences at once:
+//
+//    s0 == s3  &&  s1 == s2  &&  s0 != s1
+//
+//Sequences with a bracket in them don't count. A bracket can only be the
+//first or second letter (the other two are copies of those), so we throw out
+//any position where either s0 or s1 is a bracket.
+//
+//To tell which sequences are inside brackets, we make a bitmask of the bracket
+//positions and run it through Prefix_XOR(). Since the sequences we keep don't
+//have a bracket in them, the bit at their first letter says whether the whole
+//thing is inside. If the block ends inside brackets, the next block starts that
+//way too, so we carry that over by flipping the next block's mask.
+//
+//Brackets aren't nested, and every address starts outside of them.
+bool Supports_TLS(SR_Handle sr, const char *line, size_t length)
+{
+	bool match = false;
+	bool inBrackets = false;
+	size_t i = 0;
+	char next;
+#ifdef __AVX2__
+	const __m256i open = _mm256_set1_epi8('[');
+	const __m256i close = _mm256_set1_epi8(']');
+	__m256i s0, s1, s2, s3;
+	uint32_t abba, brackets, inside;
+	uint32_t carry = 0;
+	
+	//Each block looks three characters past its end
+	for (; i + 32 + 3 <= length; i += 32)
+	{
+		s0 = _mm256_loadu_si256((const __m256i *)&line[i]);
+		s1 = _mm256_loadu_si256((const __m256i *)&line[i + 1]);
+		s2 = _mm256_loadu_si256((const __m256i *)&line[i + 2]);
+		s3 = _mm256_loadu_si256((const __m256i *)&line[i + 3]);
+		
+		abba = _mm256_movemask_epi8(_mm256_andnot_si256(
+		                    _mm256_cmpeq_epi8(s0, s1),
+		                    _mm256_and_si256(_mm256_cmpeq_epi8(s0, s3),
+		                                     _mm256_cmpeq_epi8(s1, s2))));
+		brackets = _mm256_movemask_epi8(_mm256_or_si256(
+		                    _mm256_cmpeq_epi8(s0, open),
+		                    _mm256_cmpeq_epi8(s0, close)));
+		abba &= ~brackets & ~(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+		                    _mm256_cmpeq_epi8(s1, open),
+		                    _mm256_cmpeq_epi8(s1, close)));
+		
+		inside = Prefix_XOR(brackets) ^ carry;
+		
+		//A single fail rules out the whole address, so we can stop early
+		if ((abba & inside) != 0)
+			return false;
+		if ((abba & ~inside) != 0)
+			match = true;
+		
+		carry = (inside & 0x80000000) ? 0xffffffff : 0;
+	}
+	inBrackets = (carry != 0);
+#endif
+	
+	//The shift register handles whatever's left, one character at a time. It
+	//starts out as all zeros, which can't match anything, so the first three
+	//characters won't give us a false match.
+	SR_Clear(sr);
+	for (; i < length; i++)
+	{
+		next = line[i];
+		SR_Shift(sr, next);
 		
 		//A square bracket changes whether we're inside brackets
 		if (next == '[')
 			inBrackets = true;
 		if (next == ']')
 			inBrackets = false;
-			
-		//Check for an ABBA pattern in the shift register. We could skip this
-		//when we see a special character, but they can't form ABBA patterns, so
-		//it's not worth the trouble.
+		
+		//Check for an ABBA pattern in the shift register
 		if (SR_Read(sr, 0) != SR_Read(sr, 1) &&    //Letters aren't the same
 		    SR_Read(sr, 0) == SR_Read(sr, 3) &&    //Outer letters match
-		    SR_Read(sr, 1) == SR_Read(sr, 2))      //Inner letters match
+		    SR_Read(sr, 1) == SR_Read(sr, 2) &&    //Inner letters match
+		    SR_Read(sr, 0) != '[' && SR_Read(sr, 0) != ']' &&
+		    SR_Read(sr, 1) != '[' && SR_Read(sr, 1) != ']')
 		{
 			//This could be a match or a fail depending on whether we're
 			//currently in square brackets.
 			if (inBrackets)
-				fail = true;
-			else
-				match = true;
+				return false;
+			match = true;
 		}
 	}
 	
-	//Close the file and destroy the shift register
-	fclose(inFile);
-	SR_Destruct(sr);
-		
-	//Print the number of matches
-	printf("Matching addresses: %d\n", addrCount);	
+	return match;
+}
+
+
+//Helper function for error-checking malloc()
+void *Safe_Malloc(size_t size)
+{
+	void *retVal;
 	
-	return EXIT_SUCCESS;
+	retVal = malloc(size);
+	if (retVal == NULL)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	
+	return retVal;
 }
@@ -10,7 +10,8 @@
 //This just got nasty. Instead of just looking at the current four characters,
 //now we have to save all of the ABA and BAB sequences we find for later
 //comparison. So much for a simple exercise! On the bright side, the
-//slightly-generic shift register is still useful.
+//slightly-generic shift register is still useful, and so are part A's AVX2
+//trick for finding the sequences and its threads.
 
 
 #include <stdio.h>
@@ -18,12 +19,23 @@
 #include <string.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 //The shift register doesn't change
 struct sShiftRegister
 {
 	char *data;
 	size_t size;
+	size_t mask;
+	size_t start;
 };
 
 typedef struct sShiftRegister *SR_Handle;
@@ -31,10 +43,15 @@ typedef struct sShiftRegister *SR_Handle;
 SR_Handle SR_Construct(size_t numElements)
 {
 	SR_Handle newSR;
-
+	size_t capacity;
+	
 	if (numElements == 0)
 		return NULL;
-
+	
+	capacity = 1;
+	while (capacity < numElements)
+		capacity <<= 1;
+	
 	newSR = malloc(sizeof(struct sShiftRegister));
 	if (newSR == NULL)
 	{
@@ -42,14 +59,16 @@ SR_Handle SR_Construct(size_t numElements)
 	} else
 	{
 		newSR->size = numElements;
-		newSR->data = malloc(numElements);
+		newSR->mask = capacity - 1;
+		newSR->start = 0;
+		newSR->data = malloc(capacity);
 		if (newSR->data == NULL)
 		{
 			free(newSR);
 			return NULL;
 		} else
 		{
-			memset(newSR->data, 0, numElements);
+			memset(newSR->data, 0, capacity);
 			return newSR;
 		}
 	}
@@ -57,20 +76,15 @@ SR_Handle SR_Construct(size_t numElements)
 
 char SR_Shift(SR_Handle sr, char in)
 {
-	size_t c;
 	char out;
 	
 	if (sr == NULL)
 		return '\0';
 	
-	out = sr->data[0];
+	out = sr->data[sr->start];
 	
-	for (c = 0; c < sr->size - 1; c++)
-	{
-		sr->data[c] = sr->data[c+1];
-	}
-
-	sr->data[sr->size - 1] = in;
+	sr->data[(sr->start + sr->size) & sr->mask] = in;
+	sr->start = (sr->start + 1) & sr->mask;
 	return out;
 }
 
@@ -79,10 +93,19 @@ char SR_Read(SR_Handle sr, size_t element)
 	if (sr == NULL)
 		return '\0';
 		
-	if (element > sr->size)
+	if (element >= sr->size)
 		return '\0';
 		
-	return sr->data[element];
+	return sr->data[(sr->start + element) & sr->mask];
+}
+
+void SR_Clear(SR_Handle sr)
+{
+	if (sr == NULL)
+		return;
+	
+	memset(sr->data, 0, sr->mask + 1);
+	sr->start = 0;
 }
 
 void SR_Destruct(SR_Handle sr)
@@ -95,147 +118,402 @@ void SR_Destruct(SR_Handle sr)
 
 
 //We won't know which sequences match until the line is over, so we have to save
-//them all. We'll implement this as a structure with a two-character array and a
-//boolean tag that indicates whether the sequence is ABA (outside brackets) or
-//BAB (inside brackets). We only need two characters because the sequence is
-//symmetrical. We'll create an array of these structures and grow it dynamically
-//like we did on Day 4.
+//them all. There are only 26 * 26 possible ABA sequences, though, so instead of
+//a list we can use a table with one bit for each. The ABA sequences go in one
+//table and the BAB sequences in another. The trick is that a BAB is stored
+//transposed: "yxy" sets the same bit as "xyx" would. That way an address
+//supports SSL if any bit is set in both tables, which is just an AND over the
+//85 bytes (rounded up to eleven 64-bit words) each table takes.
+//
+//Clearing both tables for every line would be cheap enough, but there's an
+//even cheaper way. Each word gets a generation number, and we bump the current
+//generation at the start of every line. A word whose generation is out of date
+//is treated as zero, and gets cleared the first time it's written.
+#define NUM_LETTERS		26
+#define TABLE_WORDS		((NUM_LETTERS * NUM_LETTERS + 63) / 64)
+
+enum {ABA_TABLE, BAB_TABLE, NUM_TABLES};
+
 typedef struct
 {
-	char letters[2];
-	bool isBAB;
-} sABA;
+	uint64_t bits[NUM_TABLES][TABLE_WORDS];
+	uint32_t generation[NUM_TABLES][TABLE_WORDS];
+	uint32_t current;
+} sABATable;
 
 
+//Below this much input, it isn't worth starting threads
+#define MIN_THREADED_LENGTH  (1 << 20)
+
+//Each thread counts the matching addresses between start and end. Those are
+//always the start of a line (or the end of the file).
+typedef struct
+{
+	const char *data;
+	size_t start, end;
+	size_t count;
+} sCountWorker;
+
+
+void Next_Line(sABATable *table);
+void Add_ABA(sABATable *table, const char *letters, bool isBAB);
+bool Tables_Match(const sABATable *table);
+bool Supports_SSL(SR_Handle sr, const char *line, size_t length,
+                  sABATable *table);
+bool Map_File(const char *fileName, const char **data, size_t *length);
+size_t Count_Addresses(const char *data, size_t length, int numThreads);
+void *Safe_Malloc(size_t size);
+
+
+//The helper functions are the same as part A, except Supports_SSL() takes the
+//place of Supports_TLS()
 int main(int argc, char **argv)
 {
-	//We don't need to save match and fail status anymore since we determine
-	//those at the end of the line. We do need a list pointer, though.
-	sABA *aba;
-	FILE *inFile;
-	SR_Handle sr;
-	int next, addrCount, numABA, bufSize, s1, s2;
-	bool inBrackets;
+	const char *data;
+	size_t length, addrCount;
+	int numThreads;
 	
-	//Start the ABA buffer with four sequences available
-	bufSize = 4;
-	aba = malloc(bufSize * sizeof(sABA));
-	memset(aba, 0, bufSize * sizeof(sABA));
+	//Same as part A
+	if (argc != 2 && (argc != 3 || strcmp(argv[2], "serial") != 0))
+	{
+		fprintf(stderr, "Usage:\n\tDay7 <input filename> [serial]\n\n");
+		return EXIT_FAILURE;
+	}
+	
+	numThreads = 1;
+	if (argc == 2)
+		numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (numThreads < 1)
+		numThreads = 1;
+	
+	if (!Map_File(argv[1], &data, &length))
+		return EXIT_FAILURE;
+	addrCount = Count_Addresses(data, length, numThreads);
+	if (length > 0)
+		munmap((void *)data, length);
+	
+	//Print the number of matches
+	printf("Matching addresses: %zu\n", addrCount);
+	
+	return EXIT_SUCCESS;
+}
+
+
+//No change
+bool Map_File(const char *fileName, const char **data, size_t *length)
+{
+	struct stat fileInfo;
+	int fd;
+	
+	fd = open(fileName, O_RDONLY);
+	if (fd < 0)
+	{
+		fprintf(stderr, "Error opening file: %s\n\n", strerror(errno));
+		return false;
+	}
+	
+	if (fstat(fd, &fileInfo) != 0)
+	{
+		fprintf(stderr, "Error reading file: %s\n\n", strerror(errno));
+		close(fd);
+		return false;
+	}
+	*length = (size_t)fileInfo.st_size;
+	
+	*data = NULL;
+	if (*length > 0)
+	{
+		*data = mmap(NULL, *length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (*data == MAP_FAILED)
+		{
+			fprintf(stderr, "Error mapping file: %s\n\n", strerror(errno));
+			close(fd);
+			return false;
+		}
+		madvise((void *)*data, *length, MADV_SEQUENTIAL);
+	}
+	close(fd);
+	
+	return true;
+}
+
+
+//Same as part A, except that the shift register only needs three elements and
+//every thread gets its own pair of tables too. The tables hold the state of the
+//line the thread is working on, so they can't be shared.
+static void *Count_Worker(void *arg)
+{
+	sCountWorker *worker = arg;
+	SR_Handle sr;
+	sABATable *table;
+	const char *line, *newline;
+	size_t pos, length;
 	
-	//The new shift register only needs three elements
 	sr = SR_Construct(3);
 	if (sr == NULL)
 	{
 		fprintf(stderr, "Error creating shift register\n\n");
-		return EXIT_FAILURE;
+		exit(EXIT_FAILURE);
 	}
 	
-	//The usual command line argument check and input file opening
-	if (argc != 2)
+	//Start with every word out of date. Generation zero is never used, so a
+	//zeroed table counts as empty.
+	table = Safe_Malloc(sizeof(sABATable));
+	memset(table, 0, sizeof(sABATable));
+	
+	worker->count = 0;
+	for (pos = worker->start; pos < worker->end; pos += length + 1)
 	{
-		fprintf(stderr, "Usage:\n\tDay7 <input filename>\n\n");
-		return EXIT_FAILURE;
+		line = &worker->data[pos];
+		newline = memchr(line, '\n', worker->end - pos);
+		if (newline == NULL)
+			length = worker->end - pos;
+		else
+			length = newline - line;
+		
+		if (Supports_SSL(sr, line, length, table))
+			worker->count++;
 	}
+	
+	free(table);
+	SR_Destruct(sr);
+	return NULL;
+}
 
-	inFile = fopen(argv[1], "r");
-	if (inFile == NULL)
+
+//No change
+size_t Count_Addresses(const char *data, size_t length, int numThreads)
+{
+	sCountWorker *workers;
+	pthread_t *threads;
+	const char *newline;
+	size_t boundary, total;
+	int t;
+	
+	if (length < MIN_THREADED_LENGTH)
+		numThreads = 1;
+	
+	workers = Safe_Malloc(numThreads * sizeof(sCountWorker));
+	threads = Safe_Malloc(numThreads * sizeof(pthread_t));
+	boundary = 0;
+	for (t = 0; t < numThreads; t++)
 	{
-		fprintf(stderr, "Error opening file: %s\n\n", strerror(errno));
-		return EXIT_FAILURE;
+		workers[t].data = data;
+		workers[t].start = boundary;
+		
+		if (t == numThreads - 1)
+		{
+			boundary = length;
+		} else if (length / numThreads * (t + 1) > boundary)
+		{
+			boundary = length / numThreads * (t + 1);
+			newline = memchr(&data[boundary], '\n', length - boundary);
+			if (newline == NULL)
+				boundary = length;
+			else
+				boundary = newline - data + 1;
+		}
+		workers[t].end = boundary;
+	}
+	
+	for (t = 1; t < numThreads; t++)
+	{
+		if (pthread_create(&threads[t], NULL, Count_Worker, &workers[t]) != 0)
+		{
+			fprintf(stderr, "Error creating thread\n");
+			exit(EXIT_FAILURE);
+		}
 	}
+	Count_Worker(&workers[0]);
+	total = workers[0].count;
+	for (t = 1; t < numThreads; t++)
+	{
+		pthread_join(threads[t], NULL);
+		total += workers[t].count;
+	}
+	
+	free(threads);
+	free(workers);
+	return total;
+}
+
 
-	//Set up for the main loop
-	addrCount = 0;
-	numABA = 0;
-	inBrackets = false;
+//Move on to a new line. When the generation counter wraps around, the old
+//generation numbers could come back to life, so that's the one time we
+//actually clear the tables.
+void Next_Line(sABATable *table)
+{
+	table->current++;
+	if (table->current == 0)
+	{
+		memset(table, 0, sizeof(*table));
+		table->current = 1;
+	}
+}
+
+
+//Set the bit for a sequence. Sequences with anything other than lowercase
+//letters don't count. Remember that a BAB goes in transposed.
+void Add_ABA(sABATable *table, const char *letters, bool isBAB)
+{
+	unsigned int a = (unsigned char)letters[0] - 'a';
+	unsigned int b = (unsigned char)letters[1] - 'a';
+	unsigned int index, word;
+	int t;
 	
-	//Read characters one at a time
-	while ((next = fgetc(inFile)) != EOF)
+	if (a >= NUM_LETTERS || b >= NUM_LETTERS)
+		return;
+	
+	if (isBAB)
 	{
-		//Shift the new character into the register
-		SR_Shift(sr, next);
+		t = BAB_TABLE;
+		index = b * NUM_LETTERS + a;
+	} else
+	{
+		t = ABA_TABLE;
+		index = a * NUM_LETTERS + b;
+	}
 	
-		//A newline is still our trigger to evaluate the address
-		if (next == '\n')
-		{
-			//Instead of checking for matches on the fly, we now do pairwise
-			//comparisons between every stored ABA sequence at the end of the
-			//line.
-			for (s1 = 0; s1 < numABA; s1++)
-			{
-				for (s2 = s1 + 1; s2 < numABA; s2++)
-				{
-					//Don't forget, the letters still have to be in reverse
-					//order even though we have the boolean flag.
-					if (aba[s1].letters[0] == aba[s2].letters[1] &&
-					    aba[s1].letters[1] == aba[s2].letters[0] &&
-						aba[s1].isBAB != aba[s2].isBAB)
-					{
-						addrCount++;
-						
-						//Once the comparison passes, we don't want to increment
-						//the count anymore. We could use a boolean variable
-						//here and increment the counter later, but instead I'm
-						//going to show a valid use of
-						//
-						//    THE DREADED GOTO
-						//
-						//which is breaking out of nested loops. BEHOLD ITS
-						//TERRIBLE SPLENDOR:
-						goto ABA_CHECK_DONE;
-					}
-				}
-			}
-
-			//Here's the goto label. Don't feel bad -- at the assembly level,
-			//it's ALL gotos. ;-)
-			ABA_CHECK_DONE:
+	//Clear the word first if it's left over from an earlier line
+	word = index / 64;
+	if (table->generation[t][word] != table->current)
+	{
+		table->generation[t][word] = table->current;
+		table->bits[t][word] = 0;
+	}
+	
+	table->bits[t][word] |= (uint64_t)1 << (index % 64);
+}
+
+
+//Look for a bit that's set in both tables. Both words have to be from the
+//current line to count.
+bool Tables_Match(const sABATable *table)
+{
+	int w;
+	
+	for (w = 0; w < TABLE_WORDS; w++)
+	{
+		if (table->generation[ABA_TABLE][w] == table->current &&
+		    table->generation[BAB_TABLE][w] == table->current &&
+		    (table->bits[ABA_TABLE][w] & table->bits[BAB_TABLE][w]) != 0)
+			return true;
+	}
+	
+	return false;
+}
+
+
+#ifdef __AVX2__
+//No change
+static inline uint32_t Prefix_XOR(uint32_t x)
+{
+	x ^= x << 1;
+	x ^= x << 2;
+	x ^= x << 4;
+	x ^= x << 8;
+	x ^= x << 16;
+	
+	return x;
+}
+#endif
+
+
+//Collect the ABA and BAB sequences, then look for a matching pair. Finding the
+//sequences works just like part A, except that there are only three letters to
+//compare:
+//
+//    s0 == s2  &&  s0 != s1
+//
+//Every sequence we find goes in the tables, so we go through the bits of the
+//mask one at a time. __builtin_ctz() counts the zeros below the lowest set
+//bit, which is the position of the next sequence, and x & (x - 1) clears that
+//bit.
+bool Supports_SSL(SR_Handle sr, const char *line, size_t length,
+                  sABATable *table)
+{
+	bool inBrackets = false;
+	size_t i = 0;
+	char next;
+#ifdef __AVX2__
+	const __m256i open = _mm256_set1_epi8('[');
+	const __m256i close = _mm256_set1_epi8(']');
+	__m256i s0, s1v, s2v;
+	uint32_t aba, brackets, inside;
+	uint32_t carry = 0;
+	int bit;
+#endif
+	
+	Next_Line(table);
+#ifdef __AVX2__
+	for (; i + 32 + 2 <= length; i += 32)
+	{
+		s0 = _mm256_loadu_si256((const __m256i *)&line[i]);
+		s1v = _mm256_loadu_si256((const __m256i *)&line[i + 1]);
+		s2v = _mm256_loadu_si256((const __m256i *)&line[i + 2]);
+		
+		aba = _mm256_movemask_epi8(_mm256_andnot_si256(
+		                    _mm256_cmpeq_epi8(s0, s1v),
+		                    _mm256_cmpeq_epi8(s0, s2v)));
+		brackets = _mm256_movemask_epi8(_mm256_or_si256(
+		                    _mm256_cmpeq_epi8(s0, open),
+		                    _mm256_cmpeq_epi8(s0, close)));
+		aba &= ~brackets & ~(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+		                    _mm256_cmpeq_epi8(s1v, open),
+		                    _mm256_cmpeq_epi8(s1v, close)));
+		inside = Prefix_XOR(brackets) ^ carry;
 		
-			//Strangely, the variable reset gets simpler
-			numABA = 0;
+		while (aba != 0)
+		{
+			bit = __builtin_ctz(aba);
+			Add_ABA(table, &line[i + bit], (inside >> bit) & 1);
+			aba &= aba - 1;
 		}
 		
-		//Square brackets work the same way
+		carry = (inside & 0x80000000) ? 0xffffffff : 0;
+	}
+	inBrackets = (carry != 0);
+#endif
+	
+	//The shift register handles the rest
+	SR_Clear(sr);
+	for (; i < length; i++)
+	{
+		next = line[i];
+		SR_Shift(sr, next);
+		
 		if (next == '[')
 			inBrackets = true;
 		if (next == ']')
 			inBrackets = false;
 		
-		//Check for an ABA pattern in the shift register. Special characters can
-		//be in the middle of an ABA sequence, so we need to check for that.
 		if (SR_Read(sr, 0) != SR_Read(sr, 1) &&    //Letters aren't all the same
 		    SR_Read(sr, 0) == SR_Read(sr, 2) &&    //Outer letters match
-		    SR_Read(sr, 1) != '[' &&               //No special characters
-			SR_Read(sr, 1) != ']' &&
-			SR_Read(sr, 1) != '\n')
+		    SR_Read(sr, 0) != '[' && SR_Read(sr, 0) != ']' &&
+		    SR_Read(sr, 1) != '[' && SR_Read(sr, 1) != ']')
 		{
-			//First, make sure the buffer is big enough
-			numABA++;
-			if (numABA > bufSize)
-			{
-				bufSize *= 2;
-				aba = realloc(aba, bufSize * sizeof(sABA));
-				if (aba == NULL)
-				{
-					fprintf(stderr, "Error reallocating: %s", strerror(errno));
-				}
-			}
-			
-			//Now we can write the new sequence
-			aba[numABA-1].letters[0] = SR_Read(sr, 0);
-			aba[numABA-1].letters[1] = SR_Read(sr, 1);
-			
-			//ABA vs. BAB is determined by whether we're in brackets
-			aba[numABA-1].isBAB = inBrackets;
+			//The first two elements are the letters we need
+			Add_ABA(table, (char[2]){SR_Read(sr, 0), SR_Read(sr, 1)},
+			                                                      inBrackets);
 		}
 	}
 	
-	//Close the file and destroy the shift register
-	fclose(inFile);
-	SR_Destruct(sr);
-		
-	//Print the number of matches
-	printf("Matching addresses: %d\n", addrCount);	
+	//All that's left is to compare the tables
+	return Tables_Match(table);
+}
+
+
+//Helper function for error-checking malloc()
+void *Safe_Malloc(size_t size)
+{
+	void *retVal;
 	
-	return EXIT_SUCCESS;
+	retVal = malloc(size);
+	if (retVal == NULL)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	
+	return retVal;
 }
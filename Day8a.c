@@ -17,9 +17,21 @@
 //
 //Question 1: After executing all of the commands, how many pixels will be lit?
 //
-//To solve this puzzle, we can use an array of boolean values to represent the
+//To solve this puzzle, we could use an array of boolean values to represent the
 //pixels. The rotate operations are similar to the shift register we made on Day
 //7, but we can't reuse that structure because our model is two-dimensional.
+//
+//That's how this started out, and it works fine for a 50x6 screen. But rotating
+//a pixel at a time gets slow when there are millions of commands and the screen
+//is a lot bigger. So instead, each row is packed into bits, one 64-bit word per
+//64 pixels. A rect command becomes a few ORs, a row rotation becomes a couple
+//of shifts, and counting the lit pixels is a popcount.
+//
+//Columns are the catch, since each pixel in a column is in a different word. So
+//we also keep a transposed copy of the screen, where each column is packed into
+//words instead. Column rotations happen there. The two copies don't have to be
+//kept in sync all the time. We just remember which rows (or columns) have been
+//rotated, and copy them over to the other side when it's needed next.
 
 
 #include <stdio.h>
@@ -27,37 +39,87 @@
 #include <string.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 
 #define NUM_ROWS     6
 #define NUM_COLUMNS  50
-#define LINEBUF_SIZE (24+1)
+#define LINEBUF_SIZE 64
+
+//The screen, packed into bits. The rows are the main copy, and the columns are
+//the transposed shadow. Each list of dirty rows or columns says which ones have
+//changed since they were last copied to the other side. Only one of the lists
+//ever has anything in it.
+typedef struct
+{
+	int numRows, numColumns;
+	int rowWords, columnWords;
+	uint64_t *rows;
+	uint64_t *columns;
+	uint64_t *temp;
+	bool *rowDirty, *columnDirty;
+	int *dirtyRows, *dirtyColumns;
+	int numDirtyRows, numDirtyColumns;
+} sScreen;
 
 
+sScreen *Screen_Construct(int numColumns, int numRows);
+bool Screen_Rect(sScreen *screen, int width, int height);
+bool Screen_Rotate_Row(sScreen *screen, int row, int places);
+bool Screen_Rotate_Column(sScreen *screen, int column, int places);
+long Screen_Count_Lit(sScreen *screen);
+void Screen_Destruct(sScreen *screen);
+
+
+//The helper functions are:
+//
+//    Screen_Construct()      Create a blank screen
+//    Screen_Rect()           Turn on a rectangle at the top left
+//    Screen_Rotate_Row()     Rotate a row to the right
+//    Screen_Rotate_Column()  Rotate a column down
+//    Screen_Count_Lit()      Count the lit pixels
+//    Screen_Destruct()       Free the screen
 int main(int argc, char **argv)
 {
 	//The size of our input lines is well-defined for a change. The longest
-	//possible command is:
+	//possible command for the usual screen is:
 	//
 	//    rotate column y=50 by 6
 	//
-	//which is 24 characters long including the newline. We can make a fixed-
-	//size line buffer as a local variable!
+	//which is 24 characters long including the newline. Bigger screens need
+	//bigger numbers, but even ten-digit numbers fit in 64 characters. We can
+	//make a fixed-size line buffer as a local variable!
 	FILE *inFile;
 	char line[LINEBUF_SIZE];
-	bool pixels[NUM_ROWS][NUM_COLUMNS];
+	sScreen *screen;
 	char *token;
-	int r, c, p, maxR, maxC, places, numLit;
-	bool temp;
+	int r, c, maxR, maxC, places, numColumns, numRows;
+	bool onScreen;
 	
-	//Clear the pixel array (and the line buffer, just to be paranoid).
-	memset(pixels, false, NUM_ROWS * NUM_COLUMNS * sizeof(bool));
+	//Clear the line buffer, just to be paranoid
 	memset(line, '\0', LINEBUF_SIZE);
 
-	//The usual command line argument check and input file opening
-	if (argc != 2)
+	//The usual command line argument check and input file opening. The screen
+	//size can be changed with two more optional arguments.
+	if (argc != 2 && argc != 4)
 	{
-		fprintf(stderr, "Usage:\n\tDay8 <input filename>\n\n");
+		fprintf(stderr, "Usage:\n\tDay8 <input filename> [width height]\n\n");
+		return EXIT_FAILURE;
+	}
+	numColumns = NUM_COLUMNS;
+	numRows = NUM_ROWS;
+	if (argc == 4)
+	{
+		numColumns = (int)strtol(argv[2], NULL, 10);
+		numRows = (int)strtol(argv[3], NULL, 10);
+	}
+	
+	//Create a blank screen
+	screen = Screen_Construct(numColumns, numRows);
+	if (screen == NULL)
+	{
+		fprintf(stderr, "Error creating a %dx%d screen\n\n", numColumns,
+		                                                             numRows);
 		return EXIT_FAILURE;
 	}
 
@@ -88,14 +150,8 @@ int main(int argc, char **argv)
 			maxR = (int)strtol(token, NULL, 10);
 			
 			//Now that we have the size of the rectangle, we just have to turn
-			//on the pixels.
-			for (r = 0; r < maxR; r++)
-			{
-				for (c = 0; c < maxC; c++)
-				{
-					pixels[r][c] = true;
-				}
-			}
+			//on the pixels
+			onScreen = Screen_Rect(screen, maxC, maxR);
 		} else if (strcmp(token, "rotate") == 0)
 		{
 			//Rotate something -- but what? The next token tells us.
@@ -112,19 +168,8 @@ int main(int argc, char **argv)
 				token = strtok(NULL, " by");
 				places = strtol(token, NULL, 10);
 				
-				//Now we do the rotations. The outer loop is completely
-				//independent from the inner loop.
-				for (p = 0; p < places; p++)
-				{
-					//Do a single rotation. Because we're rotating to the right,
-					//we need to start at the last column.
-					temp = pixels[r][NUM_COLUMNS - 1];
-					for (c = NUM_COLUMNS - 1; c > 0; c--)
-					{
-						pixels[r][c] = pixels[r][c-1];
-					}
-					pixels[r][0] = temp;
-				}
+				//Now we do the rotation
+				onScreen = Screen_Rotate_Row(screen, r, places);
 			} else
 			{
 				//Rotate a column. This uses the same format as for rows, so the
@@ -136,26 +181,25 @@ int main(int argc, char **argv)
 				token = strtok(NULL, " by");
 				places = strtol(token, NULL, 10);
 
-				//Now do the rotations. Again, this is almost identical to the
-				//row version. If we wanted to, we could probably merge them
-				//with a few extra if statements. This would reduce code size
-				//and (maybe) improve maintainability with a small cost to
-				//performance.
-				for (p = 0; p < places; p++)
-				{
-					//Do a single rotation
-					temp = pixels[NUM_ROWS - 1][c];
-					for (r = NUM_ROWS - 1; r > 0; r--)
-					{
-						pixels[r][c] = pixels[r-1][c];
-					}
-					pixels[0][c] = temp;
-				}
+				//Now do the rotation. It's the same as the rows, but it
+				//happens on the transposed copy of the screen.
+				onScreen = Screen_Rotate_Column(screen, c, places);
 			}
 		} else
 		{
 			fprintf(stderr, "Error: Unrecognized command %s\n\n", line);
 			fclose(inFile);
+			Screen_Destruct(screen);
+			return EXIT_FAILURE;
+		}
+		
+		//All of the commands fail if they would go off the screen
+		if (!onScreen)
+		{
+			fprintf(stderr, "Error: Command is off the %dx%d screen\n\n",
+			                                               numColumns, numRows);
+			fclose(inFile);
+			Screen_Destruct(screen);
 			return EXIT_FAILURE;
 		}
 	}
@@ -164,16 +208,261 @@ int main(int argc, char **argv)
 	fclose(inFile);
 		
 	//Print the number of lit pixels
-	numLit = 0;
-	for (r = 0; r < NUM_ROWS; r++)
+	printf("Number of lit pixels: %ld\n", Screen_Count_Lit(screen));
+	Screen_Destruct(screen);
+	
+	return EXIT_SUCCESS;
+}
+
+
+//"Constructor". Allocates the screen with every pixel off. Returns NULL if
+//anything goes wrong, just like the shift register on Day 7.
+sScreen *Screen_Construct(int numColumns, int numRows)
+{
+	sScreen *screen;
+	int maxWords;
+	
+	if (numColumns < 1 || numRows < 1)
+		return NULL;
+	
+	screen = malloc(sizeof(sScreen));
+	if (screen == NULL)
+		return NULL;
+	
+	screen->numRows = numRows;
+	screen->numColumns = numColumns;
+	screen->rowWords = (numColumns + 63) / 64;
+	screen->columnWords = (numRows + 63) / 64;
+	maxWords = (screen->rowWords > screen->columnWords) ? screen->rowWords :
+	                                                      screen->columnWords;
+	
+	//calloc() takes care of turning all of the pixels off
+	screen->rows = calloc((size_t)numRows * screen->rowWords,
+	                                                      sizeof(uint64_t));
+	screen->columns = calloc((size_t)numColumns * screen->columnWords,
+	                                                      sizeof(uint64_t));
+	screen->temp = malloc(maxWords * sizeof(uint64_t));
+	screen->rowDirty = calloc(numRows, sizeof(bool));
+	screen->columnDirty = calloc(numColumns, sizeof(bool));
+	screen->dirtyRows = malloc(numRows * sizeof(int));
+	screen->dirtyColumns = malloc(numColumns * sizeof(int));
+	screen->numDirtyRows = screen->numDirtyColumns = 0;
+	if (screen->rows == NULL || screen->columns == NULL ||
+	    screen->temp == NULL || screen->rowDirty == NULL ||
+	    screen->columnDirty == NULL || screen->dirtyRows == NULL ||
+	    screen->dirtyColumns == NULL)
+	{
+		Screen_Destruct(screen);
+		return NULL;
+	}
+	
+	return screen;
+}
+
+
+//Turn on the first count bits of a row or column
+static void Fill_Bits(uint64_t *bits, int count)
+{
+	int w;
+	
+	for (w = 0; w < count / 64; w++)
+	{
+		bits[w] = ~(uint64_t)0;
+	}
+	if (count % 64 != 0)
+		bits[w] |= ((uint64_t)1 << (count % 64)) - 1;
+}
+
+
+//Rotate a row or column toward the higher bits by some number of places. For a
+//screen that fits in one word, this is just the usual rotate:
+//
+//    ((x << places) | (x >> (width - places))) & mask
+//
+//The mask keeps the bits past the edge of the screen at zero. A wider screen
+//does the same two shifts, but each one has to move whole words as well as
+//bits. The result is built in temp and then copied back.
+static void Rotate_Bits(uint64_t *bits, int width, int numWords, int places,
+                        uint64_t *temp)
+{
+	int wordShift, bitShift, w;
+	
+	places %= width;
+	if (places == 0)
+		return;
+	
+	//Shift toward the higher bits by places
+	wordShift = places / 64;
+	bitShift = places % 64;
+	for (w = 0; w < numWords; w++)
+	{
+		temp[w] = 0;
+		if (w >= wordShift)
+			temp[w] |= bits[w - wordShift] << bitShift;
+		if (bitShift != 0 && w >= wordShift + 1)
+			temp[w] |= bits[w - wordShift - 1] >> (64 - bitShift);
+	}
+	
+	//And the bits that wrapped around, shifted the other way by the rest of
+	//the width
+	wordShift = (width - places) / 64;
+	bitShift = (width - places) % 64;
+	for (w = 0; w + wordShift < numWords; w++)
+	{
+		temp[w] |= bits[w + wordShift] >> bitShift;
+		if (bitShift != 0 && w + wordShift + 1 < numWords)
+			temp[w] |= bits[w + wordShift + 1] << (64 - bitShift);
+	}
+	
+	if (width % 64 != 0)
+		temp[numWords - 1] &= ((uint64_t)1 << (width % 64)) - 1;
+	memcpy(bits, temp, numWords * sizeof(uint64_t));
+}
+
+
+//Copy the rows that changed since the last sync into the transposed shadow. We
+//only have to touch one bit in each column per row.
+static void Sync_Columns(sScreen *screen)
+{
+	const uint64_t *row;
+	uint64_t *word, bit;
+	int d, r, c;
+	
+	for (d = 0; d < screen->numDirtyRows; d++)
 	{
-		for (c = 0; c < NUM_COLUMNS; c++)
+		r = screen->dirtyRows[d];
+		row = &screen->rows[r * screen->rowWords];
+		bit = (uint64_t)1 << (r % 64);
+		for (c = 0; c < screen->numColumns; c++)
 		{
-			if (pixels[r][c])
-				numLit++;
+			word = &screen->columns[c * screen->columnWords + r / 64];
+			*word = (*word & ~bit) |
+			        (((row[c / 64] >> (c % 64)) & 1) << (r % 64));
 		}
+		screen->rowDirty[r] = false;
 	}
-	printf("Number of lit pixels: %d\n", numLit);
+	screen->numDirtyRows = 0;
+}
+
+
+//The same thing going the other way
+static void Sync_Rows(sScreen *screen)
+{
+	const uint64_t *column;
+	uint64_t *word, bit;
+	int d, r, c;
 	
-	return EXIT_SUCCESS;
+	for (d = 0; d < screen->numDirtyColumns; d++)
+	{
+		c = screen->dirtyColumns[d];
+		column = &screen->columns[c * screen->columnWords];
+		bit = (uint64_t)1 << (c % 64);
+		for (r = 0; r < screen->numRows; r++)
+		{
+			word = &screen->rows[r * screen->rowWords + c / 64];
+			*word = (*word & ~bit) |
+			        (((column[r / 64] >> (r % 64)) & 1) << (c % 64));
+		}
+		screen->columnDirty[c] = false;
+	}
+	screen->numDirtyColumns = 0;
+}
+
+
+//Turn on a rectangle at the top left. This is cheap in both directions, so we
+//do it to the rows and the columns and they both stay up to date.
+bool Screen_Rect(sScreen *screen, int width, int height)
+{
+	int r, c;
+	
+	if (width < 0 || height < 0 || width > screen->numColumns ||
+	    height > screen->numRows)
+		return false;
+	
+	for (r = 0; r < height; r++)
+	{
+		Fill_Bits(&screen->rows[r * screen->rowWords], width);
+	}
+	for (c = 0; c < width; c++)
+	{
+		Fill_Bits(&screen->columns[c * screen->columnWords], height);
+	}
+	
+	return true;
+}
+
+
+//Rotate a row to the right. Any columns that were rotated since the last sync
+//have to be copied back into the rows first. Afterward, the row is the only
+//copy that's up to date.
+bool Screen_Rotate_Row(sScreen *screen, int row, int places)
+{
+	if (row < 0 || row >= screen->numRows || places < 0)
+		return false;
+	
+	Sync_Rows(screen);
+	Rotate_Bits(&screen->rows[row * screen->rowWords], screen->numColumns,
+	            screen->rowWords, places, screen->temp);
+	
+	if (!screen->rowDirty[row])
+	{
+		screen->rowDirty[row] = true;
+		screen->dirtyRows[screen->numDirtyRows++] = row;
+	}
+	
+	return true;
+}
+
+
+//Rotate a column down. Same as the rows, with everything swapped.
+bool Screen_Rotate_Column(sScreen *screen, int column, int places)
+{
+	if (column < 0 || column >= screen->numColumns || places < 0)
+		return false;
+	
+	Sync_Columns(screen);
+	Rotate_Bits(&screen->columns[column * screen->columnWords],
+	            screen->numRows, screen->columnWords, places, screen->temp);
+	
+	if (!screen->columnDirty[column])
+	{
+		screen->columnDirty[column] = true;
+		screen->dirtyColumns[screen->numDirtyColumns++] = column;
+	}
+	
+	return true;
+}
+
+
+//Count the lit pixels. Once the rows are up to date, that's one popcount per
+//word.
+long Screen_Count_Lit(sScreen *screen)
+{
+	long numLit = 0;
+	int w;
+	
+	Sync_Rows(screen);
+	for (w = 0; w < screen->numRows * screen->rowWords; w++)
+	{
+		numLit += __builtin_popcountll(screen->rows[w]);
+	}
+	
+	return numLit;
+}
+
+
+//"Destructor". Frees everything, including a partly-constructed screen.
+void Screen_Destruct(sScreen *screen)
+{
+	if (screen == NULL)
+		return;
+	
+	free(screen->rows);
+	free(screen->columns);
+	free(screen->temp);
+	free(screen->rowDirty);
+	free(screen->columnDirty);
+	free(screen->dirtyRows);
+	free(screen->dirtyColumns);
+	free(screen);
 }
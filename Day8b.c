@@ -6,6 +6,15 @@
 //To solve this puzzle, all we have to do is print the array using a fixed-
 //width font. The actual modification is only three lines of code near the end,
 //but just for fun I'm going to heavily optimize the command processing.
+//
+//The screen itself is the same packed one as part A, with one more function to
+//read a single pixel for printing.
+//
+//Reading the letters off the screen is easy for a person, but not when there
+//are thousands of screens to check. So the program reads them too. Each letter
+//is 5 pixels wide (counting the blank column after it) and 6 pixels tall, which
+//is 30 pixels. That fits in a 32-bit number, so every letter has its own key.
+//We look the keys up in a small hash table of the letters we know about.
 
 
 #include <stdio.h>
@@ -13,30 +22,141 @@
 #include <string.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 
 #define NUM_ROWS     6
 #define NUM_COLUMNS  50
-#define LINEBUF_SIZE (24+1)
+#define LINEBUF_SIZE 64
+
+//The size of one letter on the screen, including the blank column to its right
+#define GLYPH_WIDTH   5
+#define GLYPH_HEIGHT  6
+
+//The hash table has 2^GLYPH_TABLE_BITS entries. That leaves lots of room for
+//the letters, so it's easy to find a hash where none of them collide.
+#define GLYPH_TABLE_BITS  6
+#define GLYPH_TABLE_SIZE  (1 << GLYPH_TABLE_BITS)
+
+//Same as part A
+typedef struct
+{
+	int numRows, numColumns;
+	int rowWords, columnWords;
+	uint64_t *rows;
+	uint64_t *columns;
+	uint64_t *temp;
+	bool *rowDirty, *columnDirty;
+	int *dirtyRows, *dirtyColumns;
+	int numDirtyRows, numDirtyColumns;
+} sScreen;
+
+//The letters we know how to read, drawn the same way they get printed. Not
+//every letter shows up in these puzzles, so these are the ones that have been
+//seen so far. A blank glyph reads as a space.
+typedef struct
+{
+	char letter;
+	const char *rows[GLYPH_HEIGHT];
+} sGlyph;
+
+const sGlyph font[] =
+{
+	{'A', {" 88  ", "8  8 ", "8  8 ", "8888 ", "8  8 ", "8  8 "}},
+	{'B', {"888  ", "8  8 ", "888  ", "8  8 ", "8  8 ", "888  "}},
+	{'C', {" 88  ", "8  8 ", "8    ", "8    ", "8  8 ", " 88  "}},
+	{'E', {"8888 ", "8    ", "888  ", "8    ", "8    ", "8888 "}},
+	{'F', {"8888 ", "8    ", "888  ", "8    ", "8    ", "8    "}},
+	{'G', {" 88  ", "8  8 ", "8    ", "8 88 ", "8  8 ", " 888 "}},
+	{'H', {"8  8 ", "8  8 ", "8888 ", "8  8 ", "8  8 ", "8  8 "}},
+	{'I', {" 888 ", "  8  ", "  8  ", "  8  ", "  8  ", " 888 "}},
+	{'J', {"  88 ", "   8 ", "   8 ", "   8 ", "8  8 ", " 88  "}},
+	{'K', {"8  8 ", "8 8  ", "88   ", "8 8  ", "8 8  ", "8  8 "}},
+	{'L', {"8    ", "8    ", "8    ", "8    ", "8    ", "8888 "}},
+	{'O', {" 88  ", "8  8 ", "8  8 ", "8  8 ", "8  8 ", " 88  "}},
+	{'P', {"888  ", "8  8 ", "8  8 ", "888  ", "8    ", "8    "}},
+	{'R', {"888  ", "8  8 ", "8  8 ", "888  ", "8 8  ", "8  8 "}},
+	{'S', {" 888 ", "8    ", "8    ", " 88  ", "   8 ", "888  "}},
+	{'U', {"8  8 ", "8  8 ", "8  8 ", "8  8 ", "8  8 ", " 88  "}},
+	{'Y', {"8   8", "8   8", " 8 8 ", "  8  ", "  8  ", "  8  "}},
+	{'Z', {"8888 ", "   8 ", "  8  ", " 8   ", "8    ", "8888 "}},
+	{' ', {"     ", "     ", "     ", "     ", "     ", "     "}}
+};
+#define NUM_GLYPHS  (sizeof(font) / sizeof(font[0]))
+
+//The hash table. The hash of a key is the top bits of the key times the
+//multiplier. Each entry holds the whole key, so a glyph that isn't in the
+//table can't be mistaken for one that is.
+typedef struct
+{
+	uint32_t key;
+	char letter;
+	bool used;
+} sGlyphEntry;
+
+typedef struct
+{
+	uint32_t multiplier;
+	sGlyphEntry entries[GLYPH_TABLE_SIZE];
+} sGlyphTable;
 
 
+int Read_Number(const char *text, const char **end);
+sScreen *Screen_Construct(int numColumns, int numRows);
+bool Screen_Rect(sScreen *screen, int width, int height);
+bool Screen_Rotate_Row(sScreen *screen, int row, int places);
+bool Screen_Rotate_Column(sScreen *screen, int column, int places);
+long Screen_Count_Lit(sScreen *screen);
+bool Screen_Pixel(sScreen *screen, int row, int column);
+uint32_t Screen_Glyph(sScreen *screen, int top, int left);
+void Screen_Destruct(sScreen *screen);
+bool Build_Glyph_Table(sGlyphTable *table);
+int Read_Text(sScreen *screen, const sGlyphTable *table, int top, char *text);
+void Print_Glyph(uint32_t key);
+void *Safe_Malloc(size_t size);
+
+
+//The helper functions are the same as part A, plus:
+//
+//    Read_Number()          Read a number from a known spot in the line
+//    Screen_Pixel()         Read a single pixel
+//    Screen_Glyph()         Read the key for one letter
+//    Build_Glyph_Table()    Put the known letters in a hash table
+//    Read_Text()            Read a line of letters off the screen
 int main(int argc, char **argv)
 {
 	//No major changes here...
 	FILE *inFile;
 	char line[LINEBUF_SIZE];
-	bool pixels[NUM_ROWS][NUM_COLUMNS];
-	int r, c, p, maxR, maxC, places, numLit;
-	bool temp;
+	const char *next;
+	sScreen *screen;
+	sGlyphTable glyphTable;
+	char *text;
+	int r, c, maxR, maxC, places, numColumns, numRows, numUnknown;
+	bool onScreen;
 	
 	//...or here.
-	memset(pixels, false, NUM_ROWS * NUM_COLUMNS * sizeof(bool));
 	memset(line, '\0', LINEBUF_SIZE);
 
-	//The usual command line argument check and input file opening
-	if (argc != 2)
+	//Same as part A
+	if (argc != 2 && argc != 4)
+	{
+		fprintf(stderr, "Usage:\n\tDay8 <input filename> [width height]\n\n");
+		return EXIT_FAILURE;
+	}
+	numColumns = NUM_COLUMNS;
+	numRows = NUM_ROWS;
+	if (argc == 4)
+	{
+		numColumns = (int)strtol(argv[2], NULL, 10);
+		numRows = (int)strtol(argv[3], NULL, 10);
+	}
+	
+	screen = Screen_Construct(numColumns, numRows);
+	if (screen == NULL)
 	{
-		fprintf(stderr, "Usage:\n\tDay8 <input filename>\n\n");
+		fprintf(stderr, "Error creating a %dx%d screen\n\n", numColumns,
+		                                                             numRows);
 		return EXIT_FAILURE;
 	}
 
@@ -64,33 +184,20 @@ int main(int argc, char **argv)
 		if (line[1] == 'e')
 		{
 			//The command was "rect". Next, we can get the first number. It
-			//always starts at column 5 and is either one or two digits. To
-			//determine which, we check the next column for the 'x'. The second
-			//number is guaranteed to be one digit by the size of the screen.
+			//always starts at column 5. It used to be one or two digits, but
+			//a bigger screen can have bigger numbers, so Read_Number() reads
+			//digits until it runs out and tells us where it stopped. That's the
+			//'x', and the second number starts right after it.
 			//
 			//    012345678
 			//    rect CxR
 			//    rect CCxR
-			if (line[6] == 'x')
-			{
-				maxC = line[5] - '0';
-				maxR = line[7] - '0';
-			} else
-			{
-				maxC = 10*(line[5] - '0') + (line[6] - '0');
-				maxR = line[8] - '0';
-			}
+			maxC = Read_Number(&line[5], &next);
+			maxR = Read_Number(next + 1, &next);
 			
-			//That's it. Two comparisons and four or five array accesses. This
-			//is probably at least an order of magnitude faster than before. The
-			//rest of the code is the same.
-			for (r = 0; r < maxR; r++)
-			{
-				for (c = 0; c < maxC; c++)
-				{
-					pixels[r][c] = true;
-				}
-			}
+			//That's it. A comparison and a few array accesses per digit. This
+			//is probably at least an order of magnitude faster than before.
+			onScreen = Screen_Rect(screen, maxC, maxR);
 		} else if (line[1] == 'o')
 		{
 			//The command was "rotate". The next word start in column 7, and the
@@ -102,73 +209,51 @@ int main(int argc, char **argv)
 			//    rotate column
 			if (line[7] == 'r')
 			{
-				//The word was "row". Rows can only be one digit, and we can
-				//find that in column 13. The number of places to rotate starts
-				//in column 18 and can be one or two digits. If it's one digit,
-				//the next character will be a newline.
+				//The word was "row". The row number always starts in column 13.
+				//The number of places to rotate starts four characters after
+				//it ends, past the " by ".
 				//
 				//              1111111111
 				//    01234567890123456789
 				//    rotate row y=R by N
 				//    rotate row y=R by NN
-				r = line[13] - '0';
-				if (line[19] == '\n')
-					places = line[18] - '0';
-				else
-					places = 10*(line[18] - '0') + (line[19] - '0');
+				r = Read_Number(&line[13], &next);
+				places = Read_Number(next + 4, &next);
 				
-				//The rotations are still the same. I've heard that unrolling
-				//loop is more trouble than it's worth on superscalar branch-
-				//predicting CPUs. In most microcontrollers it's probably still
-				//usable, but it works best when you have a fixed loop length,
-				//and that's somewhat uncommon.
-				for (p = 0; p < places; p++)
-				{
-					temp = pixels[r][NUM_COLUMNS - 1];
-					for (c = NUM_COLUMNS - 1; c > 0; c--)
-					{
-						pixels[r][c] = pixels[r][c-1];
-					}
-					pixels[r][0] = temp;
-				}
+				//The rotation itself is a couple of shifts now, so there's
+				//nothing left to unroll
+				onScreen = Screen_Rotate_Row(screen, r, places);
 			} else
 			{
-				//The word was "column". Columns can be one or two digits
-				//followed by a space, which we can find starting in column 17.
-				//The number of places is guaranteed to be one digit because of
-				//the size of the screen, and starts in either column 22 or
-				//column 23.
+				//The word was "column". The column number always starts in
+				//column 16, and the number of places works the same as for
+				//rows.
 				//
 				//              1111111111222
 				//    01234567890123456789012
 				//    rotate column x=C by N
 				//    rotate column x=CC by N
-				if (line[17] == ' ')
-				{
-					c = line[16] - '0';
-					places = line[21] - '0';
-				} else
-				{
-					c = 10*(line[16] - '0') + (line[17] - '0');
-					places = line[22] - '0';
-				}
+				c = Read_Number(&line[16], &next);
+				places = Read_Number(next + 4, &next);
 				
-				//The rotations are still the same
-				for (p = 0; p < places; p++)
-				{
-					//Do a single rotation
-					temp = pixels[NUM_ROWS - 1][c];
-					for (r = NUM_ROWS - 1; r > 0; r--)
-					{
-						pixels[r][c] = pixels[r-1][c];
-					}
-					pixels[0][c] = temp;
-				}
+				//This one happens on the transposed copy
+				onScreen = Screen_Rotate_Column(screen, c, places);
 			}
 		} else
 		{
 			fprintf(stderr, "Error: Unrecognized command %s\n\n", line);
 			fclose(inFile);
+			Screen_Destruct(screen);
+			return EXIT_FAILURE;
+		}
+		
+		//Same as part A
+		if (!onScreen)
+		{
+			fprintf(stderr, "Error: Command is off the %dx%d screen\n\n",
+			                                               numColumns, numRows);
+			fclose(inFile);
+			Screen_Destruct(screen);
 			return EXIT_FAILURE;
 		}
 	}		
@@ -176,27 +261,485 @@ int main(int argc, char **argv)
 	//Close the file as soon as we're done with it
 	fclose(inFile);
 
-	//Count the number of lit pixels and print the "screen" at the same time
-	numLit = 0;
-	for (r = 0; r < NUM_ROWS; r++)
+	//Print the "screen". The lit pixels get counted separately now, since
+	//that's just a popcount.
+	for (r = 0; r < numRows; r++)
 	{
-		for (c = 0; c < NUM_COLUMNS; c++)
+		for (c = 0; c < numColumns; c++)
 		{
-			if (pixels[r][c])
-			{
-				numLit++;
-				
-				//After some experimentation, I found that 8s were easier to
-				//read than Xs or Os.
+			//After some experimentation, I found that 8s were easier to
+			//read than Xs or Os.
+			if (Screen_Pixel(screen, r, c))
 				printf("8");
-			} else
-			{
+			else
 				printf(" ");
-			}
 		}
 		printf("\n");
 	}
-	printf("\nNumber of lit pixels: %d\n", numLit);
+	printf("\nNumber of lit pixels: %ld\n", Screen_Count_Lit(screen));
+	
+	//Now read the code. A bigger screen can have more than one line of text,
+	//and each line gets read separately.
+	if (!Build_Glyph_Table(&glyphTable))
+	{
+		fprintf(stderr, "Error: Couldn't build the glyph table\n\n");
+		Screen_Destruct(screen);
+		return EXIT_FAILURE;
+	}
+	text = Safe_Malloc((numColumns + GLYPH_WIDTH - 1) / GLYPH_WIDTH + 1);
+	numUnknown = 0;
+	for (r = 0; r + GLYPH_HEIGHT <= numRows; r += GLYPH_HEIGHT)
+	{
+		numUnknown += Read_Text(screen, &glyphTable, r, text);
+		printf("Code: %s\n", text);
+	}
+	free(text);
+	Screen_Destruct(screen);
+	
+	//Unknown letters have already been reported, but they should also be
+	//something a script can notice
+	if (numUnknown > 0)
+		return EXIT_FAILURE;
 	
 	return EXIT_SUCCESS;
 }
+
+
+//Read the digits starting at text, and set end to the first character that
+//isn't one. If there aren't any digits, this returns -1, which is off the
+//screen no matter what the command was.
+int Read_Number(const char *text, const char **end)
+{
+	int number;
+	
+	if (*text < '0' || *text > '9')
+	{
+		*end = text;
+		return -1;
+	}
+	
+	number = 0;
+	while (*text >= '0' && *text <= '9')
+	{
+		number = 10*number + (*text - '0');
+		text++;
+	}
+	*end = text;
+	
+	return number;
+}
+
+
+//No change
+sScreen *Screen_Construct(int numColumns, int numRows)
+{
+	sScreen *screen;
+	int maxWords;
+	
+	if (numColumns < 1 || numRows < 1)
+		return NULL;
+	
+	screen = malloc(sizeof(sScreen));
+	if (screen == NULL)
+		return NULL;
+	
+	screen->numRows = numRows;
+	screen->numColumns = numColumns;
+	screen->rowWords = (numColumns + 63) / 64;
+	screen->columnWords = (numRows + 63) / 64;
+	maxWords = (screen->rowWords > screen->columnWords) ? screen->rowWords :
+	                                                      screen->columnWords;
+	
+	screen->rows = calloc((size_t)numRows * screen->rowWords,
+	                                                      sizeof(uint64_t));
+	screen->columns = calloc((size_t)numColumns * screen->columnWords,
+	                                                      sizeof(uint64_t));
+	screen->temp = malloc(maxWords * sizeof(uint64_t));
+	screen->rowDirty = calloc(numRows, sizeof(bool));
+	screen->columnDirty = calloc(numColumns, sizeof(bool));
+	screen->dirtyRows = malloc(numRows * sizeof(int));
+	screen->dirtyColumns = malloc(numColumns * sizeof(int));
+	screen->numDirtyRows = screen->numDirtyColumns = 0;
+	if (screen->rows == NULL || screen->columns == NULL ||
+	    screen->temp == NULL || screen->rowDirty == NULL ||
+	    screen->columnDirty == NULL || screen->dirtyRows == NULL ||
+	    screen->dirtyColumns == NULL)
+	{
+		Screen_Destruct(screen);
+		return NULL;
+	}
+	
+	return screen;
+}
+
+
+//No change
+static void Fill_Bits(uint64_t *bits, int count)
+{
+	int w;
+	
+	for (w = 0; w < count / 64; w++)
+	{
+		bits[w] = ~(uint64_t)0;
+	}
+	if (count % 64 != 0)
+		bits[w] |= ((uint64_t)1 << (count % 64)) - 1;
+}
+
+
+//No change
+static void Rotate_Bits(uint64_t *bits, int width, int numWords, int places,
+                        uint64_t *temp)
+{
+	int wordShift, bitShift, w;
+	
+	places %= width;
+	if (places == 0)
+		return;
+	
+	wordShift = places / 64;
+	bitShift = places % 64;
+	for (w = 0; w < numWords; w++)
+	{
+		temp[w] = 0;
+		if (w >= wordShift)
+			temp[w] |= bits[w - wordShift] << bitShift;
+		if (bitShift != 0 && w >= wordShift + 1)
+			temp[w] |= bits[w - wordShift - 1] >> (64 - bitShift);
+	}
+	
+	wordShift = (width - places) / 64;
+	bitShift = (width - places) % 64;
+	for (w = 0; w + wordShift < numWords; w++)
+	{
+		temp[w] |= bits[w + wordShift] >> bitShift;
+		if (bitShift != 0 && w + wordShift + 1 < numWords)
+			temp[w] |= bits[w + wordShift + 1] << (64 - bitShift);
+	}
+	
+	if (width % 64 != 0)
+		temp[numWords - 1] &= ((uint64_t)1 << (width % 64)) - 1;
+	memcpy(bits, temp, numWords * sizeof(uint64_t));
+}
+
+
+//No change
+static void Sync_Columns(sScreen *screen)
+{
+	const uint64_t *row;
+	uint64_t *word, bit;
+	int d, r, c;
+	
+	for (d = 0; d < screen->numDirtyRows; d++)
+	{
+		r = screen->dirtyRows[d];
+		row = &screen->rows[r * screen->rowWords];
+		bit = (uint64_t)1 << (r % 64);
+		for (c = 0; c < screen->numColumns; c++)
+		{
+			word = &screen->columns[c * screen->columnWords + r / 64];
+			*word = (*word & ~bit) |
+			        (((row[c / 64] >> (c % 64)) & 1) << (r % 64));
+		}
+		screen->rowDirty[r] = false;
+	}
+	screen->numDirtyRows = 0;
+}
+
+
+//No change
+static void Sync_Rows(sScreen *screen)
+{
+	const uint64_t *column;
+	uint64_t *word, bit;
+	int d, r, c;
+	
+	for (d = 0; d < screen->numDirtyColumns; d++)
+	{
+		c = screen->dirtyColumns[d];
+		column = &screen->columns[c * screen->columnWords];
+		bit = (uint64_t)1 << (c % 64);
+		for (r = 0; r < screen->numRows; r++)
+		{
+			word = &screen->rows[r * screen->rowWords + c / 64];
+			*word = (*word & ~bit) |
+			        (((column[r / 64] >> (r % 64)) & 1) << (c % 64));
+		}
+		screen->columnDirty[c] = false;
+	}
+	screen->numDirtyColumns = 0;
+}
+
+
+//No change
+bool Screen_Rect(sScreen *screen, int width, int height)
+{
+	int r, c;
+	
+	if (width < 0 || height < 0 || width > screen->numColumns ||
+	    height > screen->numRows)
+		return false;
+	
+	for (r = 0; r < height; r++)
+	{
+		Fill_Bits(&screen->rows[r * screen->rowWords], width);
+	}
+	for (c = 0; c < width; c++)
+	{
+		Fill_Bits(&screen->columns[c * screen->columnWords], height);
+	}
+	
+	return true;
+}
+
+
+//No change
+bool Screen_Rotate_Row(sScreen *screen, int row, int places)
+{
+	if (row < 0 || row >= screen->numRows || places < 0)
+		return false;
+	
+	Sync_Rows(screen);
+	Rotate_Bits(&screen->rows[row * screen->rowWords], screen->numColumns,
+	            screen->rowWords, places, screen->temp);
+	
+	if (!screen->rowDirty[row])
+	{
+		screen->rowDirty[row] = true;
+		screen->dirtyRows[screen->numDirtyRows++] = row;
+	}
+	
+	return true;
+}
+
+
+//No change
+bool Screen_Rotate_Column(sScreen *screen, int column, int places)
+{
+	if (column < 0 || column >= screen->numColumns || places < 0)
+		return false;
+	
+	Sync_Columns(screen);
+	Rotate_Bits(&screen->columns[column * screen->columnWords],
+	            screen->numRows, screen->columnWords, places, screen->temp);
+	
+	if (!screen->columnDirty[column])
+	{
+		screen->columnDirty[column] = true;
+		screen->dirtyColumns[screen->numDirtyColumns++] = column;
+	}
+	
+	return true;
+}
+
+
+//No change
+long Screen_Count_Lit(sScreen *screen)
+{
+	long numLit = 0;
+	int w;
+	
+	Sync_Rows(screen);
+	for (w = 0; w < screen->numRows * screen->rowWords; w++)
+	{
+		numLit += __builtin_popcountll(screen->rows[w]);
+	}
+	
+	return numLit;
+}
+
+
+
+//Read a single pixel. The rows have to be up to date first, but after the
+//first call there's nothing left to sync.
+bool Screen_Pixel(sScreen *screen, int row, int column)
+{
+	Sync_Rows(screen);
+	return (screen->rows[row * screen->rowWords + column / 64] >>
+	                                                       (column % 64)) & 1;
+}
+
+
+//Read the key for the glyph whose top left corner is at (top, left). Each row
+//of the glyph is five bits out of the packed row, which might straddle two
+//words. Row r of the glyph ends up in bits 5r through 5r+4 of the key, so the
+//key reads the same way as the screen does, left to right and top to bottom.
+uint32_t Screen_Glyph(sScreen *screen, int top, int left)
+{
+	const uint64_t *row;
+	uint64_t bits;
+	uint32_t key = 0;
+	int r, word, shift;
+	
+	Sync_Rows(screen);
+	word = left / 64;
+	shift = left % 64;
+	for (r = 0; r < GLYPH_HEIGHT; r++)
+	{
+		row = &screen->rows[(top + r) * screen->rowWords];
+		bits = row[word] >> shift;
+		if (shift > 64 - GLYPH_WIDTH && word + 1 < screen->rowWords)
+			bits |= row[word + 1] << (64 - shift);
+		key |= (uint32_t)(bits & ((1 << GLYPH_WIDTH) - 1)) << (r * GLYPH_WIDTH);
+	}
+	
+	return key;
+}
+
+
+//No change
+void Screen_Destruct(sScreen *screen)
+{
+	if (screen == NULL)
+		return;
+	
+	free(screen->rows);
+	free(screen->columns);
+	free(screen->temp);
+	free(screen->rowDirty);
+	free(screen->columnDirty);
+	free(screen->dirtyRows);
+	free(screen->dirtyColumns);
+	free(screen);
+}
+
+
+//Turn one of the glyphs in the font into a key, the same way Screen_Glyph()
+//reads them off the screen
+static uint32_t Font_Key(const sGlyph *glyph)
+{
+	uint32_t key = 0;
+	int r, c;
+	
+	for (r = 0; r < GLYPH_HEIGHT; r++)
+	{
+		for (c = 0; c < GLYPH_WIDTH; c++)
+		{
+			if (glyph->rows[r][c] != ' ')
+				key |= (uint32_t)1 << (r * GLYPH_WIDTH + c);
+		}
+	}
+	
+	return key;
+}
+
+
+//The hash function. Multiplying spreads the bits of the key into the top bits
+//of the product, and those are the ones we keep.
+static inline unsigned int Glyph_Hash(uint32_t multiplier, uint32_t key)
+{
+	return (uint32_t)(key * multiplier) >> (32 - GLYPH_TABLE_BITS);
+}
+
+
+//Find a multiplier that puts every letter in its own entry. That makes it a
+//perfect hash, so a lookup is always one entry and one compare. There's no
+//clever math here -- we just try odd multipliers until one works. With this
+//many empty entries, it usually takes a few dozen tries at most.
+bool Build_Glyph_Table(sGlyphTable *table)
+{
+	uint32_t keys[NUM_GLYPHS];
+	unsigned int g, h;
+	int tries;
+	bool collision;
+	
+	for (g = 0; g < NUM_GLYPHS; g++)
+	{
+		keys[g] = Font_Key(&font[g]);
+	}
+	
+	table->multiplier = 0x9e3779b1;
+	for (tries = 0; tries < 100000; tries++)
+	{
+		memset(table->entries, 0, sizeof(table->entries));
+		collision = false;
+		for (g = 0; g < NUM_GLYPHS && !collision; g++)
+		{
+			h = Glyph_Hash(table->multiplier, keys[g]);
+			if (table->entries[h].used)
+			{
+				collision = true;
+			} else
+			{
+				table->entries[h].key = keys[g];
+				table->entries[h].letter = font[g].letter;
+				table->entries[h].used = true;
+			}
+		}
+		if (!collision)
+			return true;
+		
+		table->multiplier += 2;
+	}
+	
+	return false;
+}
+
+
+//Read a line of letters whose top is at row top. Each glyph is looked up in the
+//table. Anything we don't recognize becomes a '?' in the text, and its bitmap
+//gets printed so someone can add it to the font. Returns the number of glyphs
+//we couldn't read.
+int Read_Text(sScreen *screen, const sGlyphTable *table, int top, char *text)
+{
+	const sGlyphEntry *entry;
+	uint32_t key;
+	int left, numUnknown, g;
+	
+	numUnknown = 0;
+	for (left = 0, g = 0; left < screen->numColumns; left += GLYPH_WIDTH, g++)
+	{
+		key = Screen_Glyph(screen, top, left);
+		entry = &table->entries[Glyph_Hash(table->multiplier, key)];
+		if (entry->used && entry->key == key)
+		{
+			text[g] = entry->letter;
+		} else
+		{
+			text[g] = '?';
+			numUnknown++;
+			fprintf(stderr, "Unknown glyph at row %d, column %d "
+			                "(key 0x%08x):\n", top, left, key);
+			Print_Glyph(key);
+		}
+	}
+	text[g] = '\0';
+	
+	return numUnknown;
+}
+
+
+//Print a glyph's bitmap to stderr, the same way the screen gets printed
+void Print_Glyph(uint32_t key)
+{
+	int r, c;
+	
+	for (r = 0; r < GLYPH_HEIGHT; r++)
+	{
+		fprintf(stderr, "    ");
+		for (c = 0; c < GLYPH_WIDTH; c++)
+		{
+			if ((key >> (r * GLYPH_WIDTH + c)) & 1)
+				fprintf(stderr, "8");
+			else
+				fprintf(stderr, " ");
+		}
+		fprintf(stderr, "\n");
+	}
+}
+
+
+//Helper function for error-checking malloc()
+void *Safe_Malloc(size_t size)
+{
+	void *retVal;
+	
+	retVal = malloc(size);
+	if (retVal == NULL)
+	{
+		fprintf(stderr, "Error allocating memory: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	
+	return retVal;
+}